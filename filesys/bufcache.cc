@@ -0,0 +1,462 @@
+// bufcache.cc
+//	Routines to cache disk sectors in memory.
+//
+//	Every file system operation reads the same few sectors over and
+//	over -- the free map, the directory, file headers, the sector a
+//	small write is landing in -- and each SynchDisk request costs a
+//	seek and a rotational delay.  The cache keeps recently used
+//	sectors in memory, and writes modified ones back lazily.
+//
+//	A buffer is "busy" while it is being read or written; anybody who
+//	wants it then waits on "ioDone".  Busy buffers are never chosen
+//	for replacement.
+//
+//	Read-ahead and write-behind requests are only hints: they are
+//	queued for the disk I/O daemon, and dropped if the queue is full.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "bufcache.h"
+#include "synchdisk.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// StartIODaemon
+// 	Dummy function, because C++ can't take a pointer to a member
+//	function, to start up the disk I/O daemon.
+//----------------------------------------------------------------------
+
+static void
+StartIODaemon(_int arg)
+{
+    BufferCache *cache = (BufferCache *)arg;
+
+    cache->IODaemon();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::BufferCache
+// 	Initialize an empty cache.
+//
+//	"diskToCache" -- the disk to cache
+//	"size" -- how many sectors to keep in memory
+//	"how" -- the replacement policy
+//----------------------------------------------------------------------
+
+BufferCache::BufferCache(SynchDisk *diskToCache, int size, CachePolicy how)
+{
+    int i;
+
+    ASSERT(size > 0);
+    disk = diskToCache;
+    policy = how;
+    numBuffers = size;
+    buffers = new CacheBlock[numBuffers];
+    for (i = 0; i < numBuffers; i++) {
+	buffers[i].sector = -1;
+	buffers[i].dirty = FALSE;
+	buffers[i].busy = FALSE;
+	buffers[i].inFifo = FALSE;
+	lru.Append(&buffers[i]);
+    }
+    for (i = 0; i < NumSectors; i++)
+	where[i] = NULL;
+
+    // the sizes the 2Q paper recommends: a quarter of the buffers for
+    // first-time sectors, and remember half as many as we have buffers
+    fifoSize = 0;
+    maxFifo = numBuffers / 4 > 0 ? numBuffers / 4 : 1;
+    maxGhosts = numBuffers / 2 > 0 ? numBuffers / 2 : 1;
+    ghosts = new int[maxGhosts];
+    numGhosts = oldestGhost = 0;
+
+    firstRequest = numRequests = 0;
+
+    lock = new Lock("buffer cache");
+    ioDone = new Condition("buffer cache I/O");
+    ioWanted = new Condition("buffer cache requests");
+    (new Thread("disk I/O daemon"))->Fork(StartIODaemon, (_int) this);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::~BufferCache
+// 	Deallocate the cache.  Anything still dirty is lost.
+//----------------------------------------------------------------------
+
+BufferCache::~BufferCache()
+{
+    delete [] buffers;
+    delete [] ghosts;
+    delete lock;
+    delete ioDone;
+    delete ioWanted;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSector
+// 	Copy a sector into "data", reading it from disk only if it isn't
+//	in the cache.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSector(int sectorNumber, char* data)
+{
+    CacheBlock *block;
+
+    lock->Acquire();
+    block = GetBuffer(sectorNumber, TRUE);
+    bcopy(block->data, data, SectorSize);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSector
+// 	Copy "data" into the cache, to be written to the sector later.
+//	There is no need to read the sector first, since all of it is
+//	being replaced.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteSector(int sectorNumber, char* data)
+{
+    CacheBlock *block;
+
+    lock->Acquire();
+    block = GetBuffer(sectorNumber, FALSE);
+    bcopy(data, block->data, SectorSize);
+    block->dirty = TRUE;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBytes
+// 	Copy "numBytes" bytes into the cached copy of a sector, starting
+//	"offset" bytes into it.  The sector is read in first, unless it
+//	is "fresh" -- just allocated -- in which case the rest of it is
+//	zeroed.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteBytes(int sectorNumber, char* from, int offset, int numBytes,
+			bool fresh)
+{
+    CacheBlock *block;
+
+    lock->Acquire();
+    block = GetBuffer(sectorNumber, !fresh);
+    if (fresh)
+	bzero(block->data, SectorSize);
+    bcopy(from, &block->data[offset], numBytes);
+    block->dirty = TRUE;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flush
+// 	Write every dirty buffer back to disk, including any dirtied while
+//	we are at it.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flush()
+{
+    int i;
+
+    lock->Acquire();
+    for (;;) {
+	Clean();
+	for (i = 0; i < numBuffers; i++)
+	    if (buffers[i].dirty)	// still being written by somebody else
+		break;
+	if (i == numBuffers)
+	    break;
+	ioDone->Wait(lock);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Clean
+// 	Write out the dirty buffers that aren't busy, each time choosing
+//	the one the disk can get to soonest.  A run of consecutive sectors
+//	then goes out in a couple of rotations, rather than one rotation
+//	per sector.  Give up after writing as many as there are buffers,
+//	in case somebody keeps dirtying them.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Clean()
+{
+    CacheBlock *block, *best;
+    int i, latency, bestLatency = 0;
+
+    for (int written = 0; written < numBuffers; written++) {
+	best = NULL;
+	for (i = 0; i < numBuffers; i++) {
+	    block = &buffers[i];
+	    if (!block->dirty || block->busy)
+		continue;
+	    latency = disk->Latency(block->sector, TRUE);
+	    if (best == NULL || latency < bestLatency) {
+		best = block;
+		bestLatency = latency;
+	    }
+	}
+	if (best == NULL)
+	    return;
+	Transfer(best, TRUE);
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Prefetch
+// 	Ask the daemon to read a sector into the cache, because somebody
+//	is likely to want it soon.  Return without waiting.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Prefetch(int sectorNumber)
+{
+    lock->Acquire();
+    if (where[sectorNumber] == NULL)
+	Enqueue(sectorNumber, FALSE);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBehind
+// 	Ask the daemon to write a dirty sector out, because nobody is
+//	likely to change it again soon.  Return without waiting.  The
+//	sector stays in the cache.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteBehind(int sectorNumber)
+{
+    lock->Acquire();
+    if (where[sectorNumber] != NULL && where[sectorNumber]->dirty)
+	Enqueue(sectorNumber, TRUE);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Enqueue
+// 	Queue a request for the daemon, and wake it up.  If the queue is
+//	full, forget about it.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Enqueue(int sectorNumber, bool writing)
+{
+    IORequest *request;
+
+    if (numRequests == MaxIORequests)
+	return;
+    request = &requests[(firstRequest + numRequests++) % MaxIORequests];
+    request->sector = sectorNumber;
+    request->writing = writing;
+    ioWanted->Signal(lock);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::IODaemon
+// 	Serve read-ahead and write-behind requests, one at a time, in the
+//	order they were made -- except that of the writes waiting, the
+//	one the disk can get to soonest goes first.  Never returns.
+//	Requests that no longer make sense (the sector has been read in,
+//	or written out, in the meantime) are skipped, and so are writes
+//	while the disk is busy: they would only get in the way of
+//	requests somebody is waiting for.
+//----------------------------------------------------------------------
+
+void
+BufferCache::IODaemon()
+{
+    IORequest request, other;
+    CacheBlock *block;
+    int i, latency, otherLatency;
+
+    lock->Acquire();
+    for (;;) {
+	while (numRequests == 0)
+	    ioWanted->Wait(lock);
+	request = requests[firstRequest];
+	firstRequest = (firstRequest + 1) % MaxIORequests;
+	numRequests--;
+
+	if (request.writing) {		// swap in the cheapest write
+	    latency = disk->Latency(request.sector, TRUE);
+	    for (i = 0; i < numRequests; i++) {
+		other = requests[(firstRequest + i) % MaxIORequests];
+		if (!other.writing)
+		    continue;
+		otherLatency = disk->Latency(other.sector, TRUE);
+		if (otherLatency < latency) {
+		    requests[(firstRequest + i) % MaxIORequests] = request;
+		    request = other;
+		    latency = otherLatency;
+		}
+	    }
+	}
+
+	block = where[request.sector];
+	if (request.writing) {
+	    if (block != NULL && block->dirty && !block->busy
+						&& !disk->IsBusy()) {
+		stats->numWriteBehinds++;
+		Transfer(block, TRUE);
+	    }
+	} else if (block == NULL) {
+	    stats->numReadAheads++;
+	    GetBuffer(request.sector, TRUE);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::GetBuffer
+// 	Return the buffer holding "sectorNumber", with the cache's lock
+//	held.  If the sector isn't in the cache, reuse a buffer for it,
+//	writing out what was there if that was dirty; if "fill", read the
+//	sector in.
+//
+//	We may have to wait, and then everything may have changed; so
+//	every time we wait, we start over.
+//----------------------------------------------------------------------
+
+CacheBlock *
+BufferCache::GetBuffer(int sectorNumber, bool fill)
+{
+    CacheBlock *block;
+
+    ASSERT(sectorNumber >= 0 && sectorNumber < NumSectors);
+    for (;;) {
+	block = where[sectorNumber];
+	if (block != NULL) {
+	    if (block->busy) {		// somebody else is reading it in
+		ioDone->Wait(lock);
+		continue;
+	    }
+	    stats->numCacheHits++;
+	    if (!block->inFifo) {		// most recently used
+		lru.RemoveItem(block);
+		lru.Append(block);
+	    }
+	    return block;
+	}
+
+	block = FindVictim();
+	if (block == NULL) {		// every buffer is busy
+	    ioDone->Wait(lock);
+	    continue;
+	}
+	if (block->dirty) {		// clean it (and the rest), then
+	    Clean();			// look again
+	    continue;
+	}
+
+	// take it over
+	if (block->sector != -1) {
+	    DEBUG('f', "Cache: replacing sector %d with %d\n",
+		  block->sector, sectorNumber);
+	    stats->numCacheEvictions++;
+	    where[block->sector] = NULL;
+	}
+	if (block->inFifo) {
+	    fifo.RemoveItem(block);
+	    fifoSize--;
+	    if (block->sector != -1)
+		Remember(block->sector);
+	} else
+	    lru.RemoveItem(block);
+	stats->numCacheMisses++;
+	block->sector = sectorNumber;
+	where[sectorNumber] = block;
+	block->inFifo = (policy == Cache2Q && !Recall(sectorNumber));
+	if (block->inFifo) {
+	    fifo.Append(block);
+	    fifoSize++;
+	} else
+	    lru.Append(block);
+	if (fill)
+	    Transfer(block, FALSE);
+	return block;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FindVictim
+// 	Choose a buffer to reuse: the least recently used one, or with
+//	2Q, the oldest first-time sector if there are more of those than
+//	we want.  Skip busy buffers; return NULL if they all are.
+//----------------------------------------------------------------------
+
+CacheBlock *
+BufferCache::FindVictim()
+{
+    CacheBlock *block;
+
+    if (fifoSize > maxFifo || lru.IsEmpty()) {
+	for (block = fifo.Front(NULL); block != NULL; block = block->link.next)
+	    if (!block->busy)
+		return block;
+    }
+    for (block = lru.Front(NULL); block != NULL; block = block->link.next)
+	if (!block->busy)
+	    return block;
+    for (block = fifo.Front(NULL); block != NULL; block = block->link.next)
+	if (!block->busy)
+	    return block;
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Transfer
+// 	Read a buffer's sector in, or write it out, with the buffer busy
+//	and without holding the lock.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Transfer(CacheBlock *block, bool writing)
+{
+    block->busy = TRUE;
+    lock->Release();
+    if (writing)
+	disk->WriteToDisk(block->sector, block->data);
+    else
+	disk->ReadFromDisk(block->sector, block->data);
+    lock->Acquire();
+    block->busy = FALSE;
+    if (writing)
+	block->dirty = FALSE;
+    ioDone->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Remember, BufferCache::Recall
+// 	2Q keeps the numbers (not the contents) of the last few sectors
+//	that were read once and then pushed out.  If one of them is asked
+//	for again, it goes straight onto the LRU queue.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Remember(int sectorNumber)
+{
+    if (numGhosts == maxGhosts) {	// forget the oldest
+	ghosts[oldestGhost] = sectorNumber;
+	oldestGhost = (oldestGhost + 1) % maxGhosts;
+    } else
+	ghosts[(oldestGhost + numGhosts++) % maxGhosts] = sectorNumber;
+}
+
+bool
+BufferCache::Recall(int sectorNumber)
+{
+    for (int i = 0; i < numGhosts; i++)
+	if (ghosts[(oldestGhost + i) % maxGhosts] == sectorNumber)
+	    return TRUE;
+    return FALSE;
+}
@@ -0,0 +1,126 @@
+// bufcache.h
+//	Data structures for a cache of disk sectors, kept in memory in
+//	front of the synchronous disk.
+//
+//	The cache is write-back: a sector written through the cache only
+//	goes to disk when its buffer is reused for another sector, or
+//	when the cache is flushed.  Dirty buffers are then written out
+//	together, in the order the disk can get to them soonest: writing
+//	consecutive sectors one at a time costs a full rotation each.
+//
+//	A kernel thread, the "disk I/O daemon", reads sectors into the
+//	cache ahead of time and writes dirty ones out in the background,
+//	when asked to by the file system (see OpenFile).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef BUFCACHE_H
+#define BUFCACHE_H
+
+#include "disk.h"
+#include "ilist.h"
+#include "synch.h"
+
+class SynchDisk;
+
+// Replacement policies:
+//   CacheLRU -- replace the least recently used buffer
+//   Cache2Q  -- "2Q": a sector read for the first time goes on a short
+//		 FIFO queue, and is only promoted to the LRU queue if it
+//		 is asked for again after it has been replaced (which we
+//		 remember for a while).  A sequential scan then only
+//		 pushes other scan sectors out of the cache, not the
+//		 frequently used ones (the free map, directories, ...).
+enum CachePolicy { CacheLRU, Cache2Q };
+
+#define DefaultCacheSize 32	// buffers, set with -dc (0 turns it off)
+#define MaxIORequests 32	// background requests that can be queued
+
+// The following class defines one buffer of the cache.
+
+class CacheBlock {
+  public:
+    int sector;			// sector held, -1 if none
+    bool dirty;			// modified since it was read or written
+    bool busy;			// being read from or written to disk; its
+				// contents must be left alone until then
+    bool inFifo;		// on the first-time queue (2Q only)
+    char data[SectorSize];	// the contents of the sector
+    ListLink<CacheBlock> link;	// for the replacement queues
+};
+
+// A request for the disk I/O daemon: read "sector" into the cache, or
+// write it out if it is still dirty.
+
+class IORequest {
+  public:
+    int sector;
+    bool writing;
+};
+
+// The following class defines the cache.  Any number of threads may use
+// it at once; disk I/O is done without holding the cache's lock, so that
+// a hit doesn't have to wait for somebody else's miss.
+
+class BufferCache {
+  public:
+    BufferCache(SynchDisk *diskToCache, int size, CachePolicy how);
+					// Initialize an empty cache
+    ~BufferCache();			// Deallocate it (flush it first!)
+
+    void ReadSector(int sectorNumber, char* data);
+    void WriteSector(int sectorNumber, char* data);
+					// Read/write a sector, through the
+					// cache
+    void WriteBytes(int sectorNumber, char* from, int offset, int numBytes,
+		    bool fresh);	// Write part of a sector, in place
+
+    void Flush();			// Write every dirty buffer to disk
+
+    void Prefetch(int sectorNumber);	// Read a sector into the cache in
+					// the background
+    void WriteBehind(int sectorNumber);	// Write a dirty sector to disk in
+					// the background
+    void IODaemon();			// Body of the disk I/O daemon
+
+  private:
+    SynchDisk *disk;			// where the sectors come from
+    CachePolicy policy;
+    int numBuffers;
+    CacheBlock *buffers;
+    CacheBlock *where[NumSectors];	// the buffer holding each sector,
+					// if any
+    IntrusiveList<CacheBlock, &CacheBlock::link> lru;
+					// least recently used first
+    IntrusiveList<CacheBlock, &CacheBlock::link> fifo;
+					// 2Q: read once, oldest first
+    int fifoSize, maxFifo;
+    int *ghosts;			// 2Q: sectors recently pushed out of
+    int numGhosts, maxGhosts;		// "fifo", oldest first (a ring)
+    int oldestGhost;
+
+    IORequest requests[MaxIORequests];	// the daemon's queue (a ring)
+    int firstRequest, numRequests;
+
+    Lock *lock;				// protects all of the above
+    Condition *ioDone;			// signalled when a buffer stops
+					// being busy
+    Condition *ioWanted;		// signalled when a request is queued
+
+    CacheBlock *GetBuffer(int sectorNumber, bool fill);
+					// find or load a sector's buffer
+    CacheBlock *FindVictim();		// choose a buffer to reuse
+    void Transfer(CacheBlock *block, bool writing);
+					// read or write a buffer
+    void Clean();			// write dirty buffers, cheapest first
+    void Remember(int sectorNumber);	// 2Q: note it was pushed out
+    bool Recall(int sectorNumber);	// 2Q: was it, recently?
+    void Enqueue(int sectorNumber, bool writing);
+					// queue a request for the daemon
+};
+
+#endif // BUFCACHE_H
@@ -0,0 +1,30 @@
+#!/bin/sh
+# crashtest.sh
+#	Crash Nachos at random points in the crash test workload, and
+#	check the file system after each crash.  Run from the directory
+#	nachos was built in:  sh crashtest.sh [number of crashes]
+
+runs=${1:-20}
+ticks=`./nachos -f -ct 0 | sed -n 's/.*done after \([0-9]*\) ticks.*/\1/p'`
+if [ -z "$ticks" ]; then
+	echo "crash test workload didn't finish"
+	exit 1
+fi
+
+failures=0
+i=1
+while [ $i -le $runs ]; do
+	tick=`awk -v seed=$i -v max=$ticks 'BEGIN { srand(seed); print 1 + int(rand() * max) }'`
+	./nachos -f -ct $tick > /dev/null
+	if ./nachos -fsck | grep -q "fsck: ok"; then
+		echo "crash at tick $tick: ok"
+	else
+		echo "crash at tick $tick: FILE SYSTEM DAMAGED"
+		./nachos -fsck
+		failures=`expr $failures + 1`
+	fi
+	i=`expr $i + 1`
+done
+
+echo "$failures of $runs crashes damaged the file system"
+[ $failures -eq 0 ]
@@ -1,197 +1,703 @@
-// directory.cc 
+// directory.cc
 //	Routines to manage a directory of file names.
 //
-//	The directory is a table of fixed length entries; each
-//	entry represents a single file, and contains the file name,
-//	and the location of the file header on disk.  The fixed size
-//	of each directory entry means that we have the restriction
-//	of a fixed maximum size for file names.
+//	The directory is a hash table of variable length entries; each
+//	entry represents a single file (or another directory), and
+//	contains the file name, and the location of the file header on
+//	disk.  A name hashes to one of the buckets, and a bucket is a
+//	chain of disk blocks, usually just one.
 //
-//	The constructor initializes an empty directory of a certain size;
-//	we use ReadFrom/WriteBack to fetch the contents of the directory
-//	from disk, and to write back any modifications back to disk.
+//	The constructor takes the open file that holds the directory; we
+//	read and write the blocks of the table in it as we need them,
+//	rather than the whole table at once.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
-//	Fixing this is one of the parts to the assignment.
+//	The name cache, at the end, remembers recent lookups in any
+//	directory.
+//
+//	When there are more than MaxLoad names per bucket on average, the
+//	number of buckets is doubled, and every entry is moved to its new
+//	bucket.  So the chains stay short and looking up a name reads one
+//	or two blocks, however big the directory gets.  The directory file
+//	grows as needed, but never shrinks; blocks that are no longer
+//	needed are kept on a free list.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
-// All rights reserved.  See copyright.h for copyright notice and limitation 
+// All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
 #include "utility.h"
 #include "filehdr.h"
 #include "directory.h"
+#include "system.h"
+
+#define EntriesSize ((int)sizeof(((DirectoryBlock *)0)->entries))
+
+//----------------------------------------------------------------------
+// Hash
+// 	Return the hash of the "length" character name "name" (which need
+//	not be '\0'-terminated).
+//----------------------------------------------------------------------
+
+static unsigned int
+Hash(char *name, int length)
+{
+    unsigned int hash = 5381;
+
+    for (int i = 0; i < length; i++)
+	hash = hash * 33 + (unsigned char)name[i];
+    return hash;
+}
 
 //----------------------------------------------------------------------
 // Directory::Directory
-// 	Initialize a directory; initially, the directory is completely
-//	empty.  If the disk is being formatted, an empty directory
-//	is all we need, but otherwise, we need to call FetchFrom in order
-//	to initialize it from disk.
+// 	Initialize a directory, from the file "file" that holds it.  If
+//	the disk is being formatted, or the directory has just been
+//	created, there is nothing in the file yet, and we need to call
+//	Format.
 //
-//	"size" is the number of entries in the directory
+//	"dirFile" is the open directory file
 //----------------------------------------------------------------------
 
-Directory::Directory(int size)
+Directory::Directory(OpenFile *dirFile)
 {
-    table = new DirectoryEntry[size];
-    tableSize = size;
-    for (int i = 0; i < tableSize; i++)
-	table[i].inUse = FALSE;
+    file = dirFile;
+    (void) file->ReadAt((char *)&header, sizeof(DirectoryHeader), 0);
 }
 
 //----------------------------------------------------------------------
 // Directory::~Directory
-// 	De-allocate directory data structure.
+// 	De-allocate directory data structure.  The file is left open.
 //----------------------------------------------------------------------
 
 Directory::~Directory()
-{ 
-    delete [] table;
-} 
+{
+}
 
 //----------------------------------------------------------------------
-// Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// Directory::Format
+// 	Write out an empty directory, with InitialBuckets buckets.  The
+//	file must already be big enough for them.
 //
-//	"file" -- file containing the directory contents
+//	"parentSector" -- the header of the directory this one is in
 //----------------------------------------------------------------------
 
 void
-Directory::FetchFrom(OpenFile *file)
+Directory::Format(int parentSector)
 {
-    (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    DirectoryBlock empty;
+    bool written;
+
+    ASSERT(file->Length() >= (1 + InitialBuckets) * SectorSize);
+    header.numBuckets = InitialBuckets;
+    header.numEntries = 0;
+    header.numBlocks = 1 + InitialBuckets;
+    header.freeBlock = 0;
+    header.parent = parentSector;
+    WriteHeader();
+
+    bzero((char *)&empty, sizeof(DirectoryBlock));
+    for (int i = 1; i <= InitialBuckets; i++) {
+	written = WriteBlock(i, &empty);
+	ASSERT(written);
+    }
 }
 
 //----------------------------------------------------------------------
-// Directory::WriteBack
-// 	Write any modifications to the directory back to disk
-//
-//	"file" -- file to contain the new directory contents
+// Directory::ReadBlock, Directory::WriteBlock, Directory::WriteHeader
+// 	Read or write one block of the directory file.  If writing makes
+//	the file longer, its file header is written back as well.
+//	WriteBlock returns FALSE if the disk is full.
 //----------------------------------------------------------------------
 
 void
-Directory::WriteBack(OpenFile *file)
+Directory::ReadBlock(int block, DirectoryBlock *buf)
+{
+    int numRead = file->ReadAt((char *)buf, SectorSize, block * SectorSize);
+
+    ASSERT(numRead == SectorSize);
+}
+
+bool
+Directory::WriteBlock(int block, DirectoryBlock *buf)
+{
+    int length = file->Length();
+
+    if (file->WriteAt((char *)buf, SectorSize, block * SectorSize)
+							!= SectorSize)
+	return FALSE;
+    if (file->Length() != length)
+	file->WriteBack();
+    return TRUE;
+}
+
+void
+Directory::WriteHeader()
 {
-    (void) file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    (void) file->WriteAt((char *)&header, sizeof(DirectoryHeader), 0);
 }
 
 //----------------------------------------------------------------------
-// Directory::FindIndex
-// 	Look up file name in directory, and return its location in the table of
-//	directory entries.  Return -1 if the name isn't in the directory.
+// Directory::FindEntry
+// 	Look up file name in directory, and return where its entry is in
+//	the block it is in, with the block read into "buf" and its number
+//	in "*block".  Return -1 if the name isn't in the directory.
 //
 //	"name" -- the file name to look up
 //----------------------------------------------------------------------
 
 int
-Directory::FindIndex(char *name)
+Directory::FindEntry(char *name, int *block, DirectoryBlock *buf)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
-	    return i;
-    return -1;		// name not in directory
+    int length = strlen(name);
+    DirectoryEntry *entry;
+
+    *block = 1 + Hash(name, length) % header.numBuckets;
+    for (;;) {
+	ReadBlock(*block, buf);
+	for (int i = 0; i < buf->used; i += EntrySize(entry->nameLength)) {
+	    entry = (DirectoryEntry *)&buf->entries[i];
+	    if (entry->nameLength == length
+			&& !strncmp(entry->name, name, length))
+		return i;
+	}
+	if (buf->next == 0)
+	    return -1;		// name not in directory
+	*block = buf->next;
+    }
 }
 
 //----------------------------------------------------------------------
 // Directory::Find
 // 	Look up file name in directory, and return the disk sector number
-//	where the file's header is stored. Return -1 if the name isn't 
+//	where the file's header is stored. Return -1 if the name isn't
 //	in the directory.
 //
 //	"name" -- the file name to look up
+//	"isDir" -- if not NULL, set to whether "name" is a directory
 //----------------------------------------------------------------------
 
 int
-Directory::Find(char *name)
+Directory::Find(char *name, bool *isDir)
 {
-    int i = FindIndex(name);
+    DirectoryBlock buf;
+    DirectoryEntry *entry;
+    int block, i = FindEntry(name, &block, &buf);
 
-    if (i != -1)
-	return table[i].sector;
-    return -1;
+    if (i == -1)
+	return -1;
+    entry = (DirectoryEntry *)&buf.entries[i];
+    if (isDir != NULL)
+	*isDir = entry->isDir;
+    return entry->sector;
+}
+
+//----------------------------------------------------------------------
+// Directory::Insert
+// 	Put "size" bytes of directory entry at the end of a bucket.  If
+//	none of its blocks has room, chain on a new one, from the free
+//	list if there are any there.  Return FALSE if the file needs to
+//	grow for that, and the disk is full.
+//
+//	The header is changed, but not written out.
+//----------------------------------------------------------------------
+
+bool
+Directory::Insert(int bucket, char *entry, int size)
+{
+    DirectoryBlock buf, newBuf;
+    int block = 1 + bucket, newBlock;
+    bool written;
+
+    for (ReadBlock(block, &buf); buf.used + size > EntriesSize;
+						ReadBlock(block, &buf)) {
+	if (buf.next == 0) {
+	    if (header.freeBlock != 0) {
+		newBlock = header.freeBlock;
+		ReadBlock(newBlock, &newBuf);
+		header.freeBlock = newBuf.next;
+	    } else
+		newBlock = header.numBlocks++;
+	    newBuf.next = 0;
+	    newBuf.used = size;
+	    bcopy(entry, newBuf.entries, size);
+	    if (!WriteBlock(newBlock, &newBuf)) {
+		header.numBlocks--;	// only a new block can fail
+		return FALSE;
+	    }
+	    buf.next = newBlock;
+	    written = WriteBlock(block, &buf);
+	    ASSERT(written);
+	    return TRUE;
+	}
+	block = buf.next;
+    }
+    bcopy(entry, &buf.entries[buf.used], size);
+    buf.used += size;
+    written = WriteBlock(block, &buf);
+    ASSERT(written);
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
-//	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	return FALSE if the file name is already in the directory, or is
+//	too long, or if the directory needs to grow and the disk is full.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
+//	"isDir" -- is the file a directory?
 //----------------------------------------------------------------------
 
 bool
-Directory::Add(char *name, int newSector)
-{ 
-    if (FindIndex(name) != -1)
+Directory::Add(char *name, int newSector, bool isDir)
+{
+    DirectoryEntry entry;
+    int length = strlen(name);
+
+    if (length == 0 || length > FileNameMaxLen || Find(name) != -1)
 	return FALSE;
 
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse) {
-            table[i].inUse = TRUE;
-            strncpy(table[i].name, name, FileNameMaxLen); 
-            table[i].sector = newSector;
-        return TRUE;
-	}
-    return FALSE;	// no space.  Fix when we have extensible files.
+    entry.sector = newSector;
+    entry.isDir = isDir;
+    entry.nameLength = length;
+    bcopy(name, entry.name, length);
+    if (!Insert(Hash(name, length) % header.numBuckets, (char *)&entry,
+		EntrySize(length)))
+	return FALSE;
+
+    header.numEntries++;
+    if (header.numEntries > header.numBuckets * MaxLoad)
+	Rehash();
+    WriteHeader();
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
 // Directory::Remove
 // 	Remove a file name from the directory.  Return TRUE if successful;
-//	return FALSE if the file isn't in the directory. 
+//	return FALSE if the file isn't in the directory.
+//
+//	If that empties a block chained on to a bucket, it goes on the
+//	free list.
 //
 //	"name" -- the file name to be removed
 //----------------------------------------------------------------------
 
 bool
 Directory::Remove(char *name)
-{ 
-    int i = FindIndex(name);
+{
+    DirectoryBlock buf, prevBuf;
+    int block, prev, size, i = FindEntry(name, &block, &buf);
+    bool written;
 
     if (i == -1)
 	return FALSE; 		// name not in directory
-    table[i].inUse = FALSE;
-    return TRUE;	
+    size = EntrySize(((DirectoryEntry *)&buf.entries[i])->nameLength);
+    bcopy(&buf.entries[i + size], &buf.entries[i], buf.used - i - size);
+    buf.used -= size;
+
+    if (buf.used == 0 && block > header.numBuckets) {
+	prev = 1 + Hash(name, strlen(name)) % header.numBuckets;
+	for (ReadBlock(prev, &prevBuf); prevBuf.next != block;
+						ReadBlock(prev, &prevBuf))
+	    prev = prevBuf.next;
+	prevBuf.next = buf.next;
+	written = WriteBlock(prev, &prevBuf);
+	ASSERT(written);
+	buf.next = header.freeBlock;
+	header.freeBlock = block;
+    }
+    written = WriteBlock(block, &buf);
+    ASSERT(written);
+
+    header.numEntries--;
+    WriteHeader();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// TableSectors
+// 	Return the most sectors that writing "numBlocks" blocks of a
+//	directory can change: the blocks, the header and indirect blocks
+//	of its file (if it grows), and the free map.
+//----------------------------------------------------------------------
+
+static int
+TableSectors(int numBlocks)
+{
+    return numBlocks + HeaderSectors(numBlocks * SectorSize) + 1;
+}
+
+//----------------------------------------------------------------------
+// Directory::Rehash
+// 	Double the number of buckets, and move every entry to the bucket
+//	it now hashes to.  The new table is put together in memory and
+//	written out in one go, over the old one, as part of the operation
+//	adding to the directory.  If the journal's batch hasn't room for
+//	that much more (past a few dozen buckets, it never has), or the
+//	file would need to grow for it and the disk is full, we keep the
+//	old table (its chains will just be longer).
+//
+//	The header is not written out.
+//----------------------------------------------------------------------
+
+void
+Directory::Rehash()
+{
+    int numBuckets = 2 * header.numBuckets;
+    int maxBlocks = 1 + numBuckets + header.numEntries;
+    DirectoryBlock buf, *to, *table;
+    int *last;				// last block of each new bucket
+    DirectoryHeader newHeader = header;
+    DirectoryEntry *entry;
+    int b, i, size, block, bucket, length = file->Length();
+
+    if (!journal->Reserve(TableSectors(1 + numBuckets)))
+	return;
+    table = new DirectoryBlock[maxBlocks];
+    last = new int[numBuckets];
+    bzero((char *)table, maxBlocks * sizeof(DirectoryBlock));
+    newHeader.numBuckets = numBuckets;
+    newHeader.numBlocks = 1 + numBuckets;
+    newHeader.freeBlock = 0;
+    for (b = 0; b < numBuckets; b++)
+	last[b] = 1 + b;
+
+    for (b = 1; b <= header.numBuckets; b++)
+	for (block = b; block != 0; block = buf.next) {
+	    ReadBlock(block, &buf);
+	    for (i = 0; i < buf.used; i += size) {
+		entry = (DirectoryEntry *)&buf.entries[i];
+		size = EntrySize(entry->nameLength);
+		bucket = Hash(entry->name, entry->nameLength) % numBuckets;
+		to = &table[last[bucket]];
+		if (to->used + size > EntriesSize) {
+		    last[bucket] = to->next = newHeader.numBlocks++;
+		    to = &table[last[bucket]];
+		}
+		bcopy((char *)entry, &to->entries[to->used], size);
+		to->used += size;
+	    }
+	}
+
+    bcopy((char *)&newHeader, (char *)&table[0], sizeof(DirectoryHeader));
+    if (journal->Reserve(TableSectors(newHeader.numBlocks)
+			 - TableSectors(1 + numBuckets))
+	    && file->WriteAt((char *)table, newHeader.numBlocks * SectorSize, 0)
+				== newHeader.numBlocks * SectorSize) {
+	DEBUG('f', "Rehashed directory into %d buckets, %d blocks\n",
+	      numBuckets, newHeader.numBlocks);
+	header = newHeader;
+	if (file->Length() != length)
+	    file->WriteBack();
+    }
+    delete [] table;
+    delete [] last;
 }
 
 //----------------------------------------------------------------------
 // Directory::List
-// 	List all the file names in the directory. 
+// 	List all the file names in the directory, with a '/' after the
+//	names of directories.
 //----------------------------------------------------------------------
 
 void
 Directory::List()
 {
-   for (int i = 0; i < tableSize; i++)
-	if (table[i].inUse)
-	    printf("%s\n", table[i].name);
+    DirectoryBlock buf;
+    DirectoryEntry *entry;
+
+    for (int b = 1; b <= header.numBuckets; b++)
+	for (int block = b; block != 0; block = buf.next) {
+	    ReadBlock(block, &buf);
+	    for (int i = 0; i < buf.used; i += EntrySize(entry->nameLength)) {
+		entry = (DirectoryEntry *)&buf.entries[i];
+		printf("%.*s%s\n", entry->nameLength, entry->name,
+		       entry->isDir ? "/" : "");
+	    }
+	}
 }
 
 //----------------------------------------------------------------------
 // Directory::Print
 // 	List all the file names in the directory, their FileHeader locations,
-//	and the contents of each file.  For debugging.
+//	and the contents of each file, and then the same for every
+//	directory in it.  For debugging.
 //----------------------------------------------------------------------
 
 void
 Directory::Print()
-{ 
+{
     FileHeader *hdr = new FileHeader;
+    DirectoryBlock buf;
+    DirectoryEntry *entry;
 
-    printf("Directory contents:\n");
-    for (int i = 0; i < tableSize; i++)
-	if (table[i].inUse) {
-	    printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
-	    hdr->FetchFrom(table[i].sector);
-	    hdr->Print();
+    printf("Directory contents: %d names, %d buckets, %d blocks\n",
+	   header.numEntries, header.numBuckets, header.numBlocks);
+    for (int b = 1; b <= header.numBuckets; b++)
+	for (int block = b; block != 0; block = buf.next) {
+	    ReadBlock(block, &buf);
+	    for (int i = 0; i < buf.used; i += EntrySize(entry->nameLength)) {
+		entry = (DirectoryEntry *)&buf.entries[i];
+		printf("Name: %.*s%s, Sector: %d\n", entry->nameLength,
+		       entry->name, entry->isDir ? "/" : "", entry->sector);
+		hdr->FetchFrom(entry->sector);
+		hdr->Print();
+		if (entry->isDir) {
+		    OpenFile *subFile = new OpenFile(entry->sector, TRUE);
+		    Directory *subDir = new Directory(subFile);
+
+		    subDir->Print();
+		    delete subDir;
+		    delete subFile;
+		}
+	    }
 	}
     printf("\n");
     delete hdr;
 }
+
+//----------------------------------------------------------------------
+// Directory::Check
+// 	Check that the directory makes sense: its header, every bucket's
+//	chain of blocks, and every entry in them; mark the header and the
+//	sectors of every file in it in "inUse", and then check every
+//	directory in it the same way.  Return how many problems were
+//	found.  For checking the file system.
+//
+//	"mySector" -- the header of this directory
+//	"parentSector" -- the header of the directory it is in
+//	"inUse" -- the sectors found to be in use so far
+//----------------------------------------------------------------------
+
+int
+Directory::Check(int mySector, int parentSector, BitMap *inUse)
+{
+    FileHeader *hdr = new FileHeader;
+    DirectoryBlock buf;
+    DirectoryEntry *entry;
+    int numBlocks = header.numBlocks, count = 0, problems = 0;
+    int b, i, n, block, size;
+    bool *seen;
+
+    if (header.parent != parentSector) {
+	printf("fsck: directory %d: parent is %d, not %d\n", mySector,
+	       header.parent, parentSector);
+	problems++;
+    }
+    if (header.numBuckets < 1 || numBlocks < 1 + header.numBuckets
+		|| numBlocks * SectorSize > file->Length()) {
+	printf("fsck: directory %d: bad header\n", mySector);
+	delete hdr;
+	return problems + 1;
+    }
+    seen = new bool[numBlocks];
+    for (block = 0; block < numBlocks; block++)
+	seen[block] = FALSE;
+
+    for (b = 1; b <= header.numBuckets; b++)
+	for (block = b; block != 0; block = buf.next) {
+	    if (block < 1 || block >= numBlocks || seen[block]
+			|| (block != b && block <= header.numBuckets)) {
+		printf("fsck: directory %d: bucket %d: bad chain\n",
+		       mySector, b);
+		problems++;
+		break;
+	    }
+	    seen[block] = TRUE;
+	    ReadBlock(block, &buf);
+	    if (buf.used < 0 || buf.used > EntriesSize) {
+		printf("fsck: directory %d: block %d: bad size\n",
+		       mySector, block);
+		problems++;
+		break;
+	    }
+	    for (i = 0; i < buf.used; i += size) {
+		entry = (DirectoryEntry *)&buf.entries[i];
+		size = EntrySize(entry->nameLength);
+		if (entry->nameLength < 1 || entry->nameLength > FileNameMaxLen
+			    || i + size > buf.used) {
+		    printf("fsck: directory %d: block %d: bad entry\n",
+			   mySector, block);
+		    problems++;
+		    break;
+		}
+		count++;
+		if (1 + Hash(entry->name, entry->nameLength)
+				    % header.numBuckets != b) {
+		    printf("fsck: directory %d: %.*s is in the wrong bucket\n",
+			   mySector, entry->nameLength, entry->name);
+		    problems++;
+		}
+		if (entry->sector < 0 || entry->sector >= NumSectors
+			    || inUse->Test(entry->sector)) {
+		    printf("fsck: directory %d: %.*s: header %d is bad, or "
+			   "used twice\n", mySector, entry->nameLength,
+			   entry->name, entry->sector);
+		    problems++;
+		    continue;
+		}
+		inUse->Mark(entry->sector);
+		n = hdr->Claim(entry->sector, inUse);
+		problems += n;
+		if (n == 0 && entry->isDir) {
+		    OpenFile *subFile = new OpenFile(entry->sector, TRUE);
+		    Directory *subDir = new Directory(subFile);
+
+		    problems += subDir->Check(entry->sector, mySector, inUse);
+		    delete subDir;
+		    delete subFile;
+		}
+	    }
+	}
+
+    for (block = header.freeBlock; block != 0; block = buf.next) {
+	if (block <= header.numBuckets || block >= numBlocks
+		    || seen[block]) {
+	    printf("fsck: directory %d: bad free list\n", mySector);
+	    problems++;
+	    break;
+	}
+	seen[block] = TRUE;
+	ReadBlock(block, &buf);
+    }
+    if (count != header.numEntries) {
+	printf("fsck: directory %d: %d names, not %d\n", mySector, count,
+	       header.numEntries);
+	problems++;
+    }
+    delete [] seen;
+    delete hdr;
+    return problems;
+}
+
+int nameCacheSize = DefaultNameCacheSize;
+
+//----------------------------------------------------------------------
+// NameCache::NameCache
+// 	Initialize an empty cache, with room for "numNames" names (if
+//	"numNames" is 0, the cache never knows anything).
+//----------------------------------------------------------------------
+
+NameCache::NameCache(int numNames)
+{
+    size = numNames;
+    entries = new NameCacheEntry[size];
+    buckets = new NameCacheEntry *[size];
+    for (int i = 0; i < size; i++) {
+	entries[i].dirSector = -1;
+	buckets[i] = NULL;
+	lru.Append(&entries[i]);
+    }
+}
+
+//----------------------------------------------------------------------
+// NameCache::~NameCache
+// 	De-allocate the cache.
+//----------------------------------------------------------------------
+
+NameCache::~NameCache()
+{
+    delete [] entries;
+    delete [] buckets;
+}
+
+//----------------------------------------------------------------------
+// NameCache::FindEntry
+// 	Return the link that points to the entry for "name" in the
+//	directory whose header is at "dirSector" -- the link is NULL if
+//	there is none.
+//----------------------------------------------------------------------
+
+NameCacheEntry **
+NameCache::FindEntry(int dirSector, char *name)
+{
+    unsigned int hash = Hash(name, strlen(name)) + dirSector * 31;
+    NameCacheEntry **ptr;
+
+    for (ptr = &buckets[hash % size]; *ptr != NULL; ptr = &(*ptr)->hashNext)
+	if ((*ptr)->dirSector == dirSector && !strcmp((*ptr)->name, name))
+	    break;
+    return ptr;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Lookup
+// 	If we know what "name", in the directory whose header is at
+//	"dirSector", is, set "*sector" (-1 if there is no such name) and
+//	"*isDir", and return TRUE.
+//----------------------------------------------------------------------
+
+bool
+NameCache::Lookup(int dirSector, char *name, int *sector, bool *isDir)
+{
+    NameCacheEntry *entry;
+
+    if (size == 0)
+	return FALSE;
+    entry = *FindEntry(dirSector, name);
+    if (entry == NULL) {
+	stats->numNameCacheMisses++;
+	return FALSE;
+    }
+    stats->numNameCacheHits++;
+    lru.RemoveItem(entry);
+    lru.Append(entry);
+    *sector = entry->sector;
+    *isDir = entry->isDir;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Enter
+// 	Remember that "name", in the directory whose header is at
+//	"dirSector", has its header at "sector" (-1 if there is no such
+//	name).  If it isn't in the cache, it replaces the least recently
+//	used name.
+//----------------------------------------------------------------------
+
+void
+NameCache::Enter(int dirSector, char *name, int sector, bool isDir)
+{
+    NameCacheEntry **ptr, *entry;
+
+    if (size == 0 || strlen(name) > FileNameMaxLen)
+	return;
+    ptr = FindEntry(dirSector, name);
+    if (*ptr != NULL) {
+	entry = *ptr;
+	lru.RemoveItem(entry);
+    } else {
+	entry = lru.Remove();
+	if (entry->dirSector != -1)
+	    *FindEntry(entry->dirSector, entry->name) = entry->hashNext;
+	ptr = FindEntry(dirSector, name);	// (may have just changed)
+	entry->dirSector = dirSector;
+	strcpy(entry->name, name);
+	entry->hashNext = NULL;
+	*ptr = entry;
+    }
+    entry->sector = sector;
+    entry->isDir = isDir;
+    lru.Append(entry);
+}
+
+//----------------------------------------------------------------------
+// NameCache::Purge
+// 	Forget every name in the directory whose header is at "dirSector",
+//	which has been removed (its sector may be reused for another).
+//----------------------------------------------------------------------
+
+void
+NameCache::Purge(int dirSector)
+{
+    for (int i = 0; i < size; i++)
+	if (entries[i].dirSector == dirSector) {
+	    *FindEntry(dirSector, entries[i].name) = entries[i].hashNext;
+	    entries[i].dirSector = -1;
+	    lru.RemoveItem(&entries[i]);
+	    lru.Prepend(&entries[i]);
+	}
+}
@@ -1,15 +1,20 @@
-// directory.h 
+// directory.h
 //	Data structures to manage a UNIX-like directory of file names.
-// 
+//
 //      A directory is a table of pairs: <file name, sector #>,
-//	giving the name of each file in the directory, and 
+//	giving the name of each file in the directory, and
 //	where to find its file header (the data structure describing
-//	where to find the file's data blocks) on disk.
+//	where to find the file's data blocks) on disk.  An entry can
+//	also name another directory, so that directories form a tree.
+//
+//	On disk, a directory is a hash table, so that finding a name
+//	only reads the one or two sectors it could be in, however many
+//	names the directory holds.
 //
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
-// All rights reserved.  See copyright.h for copyright notice and limitation 
+// All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
@@ -18,66 +23,166 @@
 #define DIRECTORY_H
 
 #include "openfile.h"
+#include "disk.h"
+#include "bitmap.h"
+#include "ilist.h"
 
-#define FileNameMaxLen 		9	// for simplicity, we assume 
-					// file names are <= 9 characters long
+#define FileNameMaxLen 		63	// longest name of a file or directory
+					// (a path may have any number of them)
+#define InitialBuckets		4	// hash buckets in a new directory
+#define MaxLoad			4	// average names per bucket before we
+					// double the number of buckets
 
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
 // the file's header is to be found on disk.
 //
+// Entries take up only as much room as their name needs: EntrySize
+// bytes, rounded up so that the next one is word aligned.  The name
+// is not '\0'-terminated.
+//
 // Internal data structures kept public so that Directory operations can
 // access them directly.
 
 class DirectoryEntry {
   public:
-    bool inUse;				// Is this directory entry in use?
-    int sector;				// Location on disk to find the 
-					//   FileHeader for this file 
-    char name[FileNameMaxLen + 1];	// Text name for file, with +1 for 
-					// the trailing '\0'
+    int sector;				// Location on disk to find the
+					//   FileHeader for this file
+    char isDir;				// Is it a directory?
+    char nameLength;			// How many characters "name" has
+    char name[FileNameMaxLen];		// Text name for file (really only
+					//   "nameLength" characters long)
+};
+
+#define EntrySize(nameLength) \
+		(divRoundUp(sizeof(int) + 2 + (nameLength), sizeof(int)) \
+		 * sizeof(int))
+
+// A directory file is made of sector-sized blocks.  Block 0 holds a
+// DirectoryHeader.  Blocks 1 through "numBuckets" are the first block
+// of each hash bucket; when one fills up, more are chained on from
+// after them.  Blocks that become empty go on a free list.
+
+class DirectoryHeader {
+  public:
+    int numBuckets;			// How many hash buckets there are
+    int numEntries;			// How many names, in all of them
+    int numBlocks;			// Blocks in use or on the free list
+    int freeBlock;			// First free block, 0 if none
+    int parent;				// Sector of the parent directory's
+					//   FileHeader (the root's own)
+};
+
+class DirectoryBlock {
+  public:
+    int next;				// Next block of this bucket, 0 if none
+    int used;				// Bytes of "entries" in use
+    char entries[SectorSize - 2 * sizeof(int)];
 };
 
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
-// The directory data structure can be stored in memory, or on disk.
-// When it is on disk, it is stored as a regular Nachos file.
-//
-// The constructor initializes a directory structure in memory; the
-// FetchFrom/WriteBack operations shuffle the directory information
-// from/to disk. 
+// The directory data structure is stored on disk as a regular Nachos
+// file.  Rather than reading it all in, we look up and change only the
+// blocks we need, straight in the file.  The file must stay open for as
+// long as the Directory is in use.
 
 class Directory {
   public:
-    Directory(int size); 		// Initialize an empty directory
-					// with space for "size" files
+    Directory(OpenFile *dirFile); 	// Use the directory in "dirFile"
     ~Directory();			// De-allocate the directory
 
-    void FetchFrom(OpenFile *file);  	// Init directory contents from disk
-    void WriteBack(OpenFile *file);	// Write modifications to 
-					// directory contents back to disk
+    void Format(int parentSector);	// Make "file" an empty directory;
+					// it must have room for InitialBuckets
 
-    int Find(char *name);		// Find the sector number of the 
-					// FileHeader for file: "name"
+    int Find(char *name, bool *isDir = NULL);
+					// Find the sector number of the
+					// FileHeader for file: "name", and
+					// whether it is a directory
 
-    bool Add(char *name, int newSector);  // Add a file name into the directory
+    bool Add(char *name, int newSector, bool isDir = FALSE);
+					// Add a file name into the directory
 
     bool Remove(char *name);		// Remove a file from the directory
 
+    int Parent() { return header.parent; }
+    bool IsEmpty() { return header.numEntries == 0; }
+
     void List();			// Print the names of all the files
 					//  in the directory
     void Print();			// Verbose print of the contents
 					//  of the directory -- all the file
 					//  names and their contents.
+    int Check(int mySector, int parentSector, BitMap *inUse);
+					// Check it, and every directory in
+					//  it; return the problems found
 
   private:
-    int tableSize;			// Number of directory entries
-    DirectoryEntry *table;		// Table of pairs: 
-					// <file name, file header location> 
+    OpenFile *file;			// Where the directory is stored
+    DirectoryHeader header;		// Copy of its block 0
+
+    int FindEntry(char *name, int *block, DirectoryBlock *buf);
+					// Find the block and offset of the
+					//  entry for "name"
+    bool Insert(int bucket, char *entry, int size);
+					// Put an entry on a bucket
+    void Rehash();			// Double the number of buckets
+    void ReadBlock(int block, DirectoryBlock *buf);
+    bool WriteBlock(int block, DirectoryBlock *buf);
+    void WriteHeader();
+};
+
+// The following class defines a cache of recent name lookups (in UNIX
+// terms, the "dentry cache"): for a name in a directory, the sector of
+// its FileHeader, and whether it is a directory -- or that there is no
+// such name.  Most lookups can then be answered without reading the
+// directory at all.
+//
+// The file system keeps it up to date as it adds and removes names.
+
+#define DefaultNameCacheSize 64	// names remembered, set with -nc
+					// (0 turns the cache off)
+
+extern int nameCacheSize;
 
-    int FindIndex(char *name);		// Find the index into the directory 
-					//  table corresponding to "name"
+class NameCacheEntry {
+  public:
+    int dirSector;			// Directory the name is in, -1 if
+					//   this entry is unused
+    char name[FileNameMaxLen + 1];
+    int sector;				// Its FileHeader, -1 if it doesn't
+					//   exist
+    bool isDir;
+    NameCacheEntry *hashNext;		// Next entry in the same bucket
+    ListLink<NameCacheEntry> link;	// For the LRU queue
+};
+
+class NameCache {
+  public:
+    NameCache(int numNames);		// Initialize an empty cache of
+					// "numNames" names
+    ~NameCache();
+
+    bool Lookup(int dirSector, char *name, int *sector, bool *isDir);
+					// Is "name" in the cache?  Return
+					// FALSE if we don't know
+    void Enter(int dirSector, char *name, int sector, bool isDir);
+					// Remember what "name" is (sector
+					// -1 if it doesn't exist)
+    void Purge(int dirSector);		// Forget every name in a directory
+					// that has been removed
+
+  private:
+    int size;
+    NameCacheEntry *entries;
+    NameCacheEntry **buckets;		// Hash chains, "size" of them
+    IntrusiveList<NameCacheEntry, &NameCacheEntry::link> lru;
+					// Least recently used first
+
+    NameCacheEntry **FindEntry(int dirSector, char *name);
+					// Where the entry for "name" is
+					//  linked from in its bucket
 };
 
 #endif // DIRECTORY_H
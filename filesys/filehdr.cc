@@ -3,12 +3,21 @@
 //	would be called the i-node).
 //
 //	The file header is used to locate where on disk the
-//	file's data is stored.  We implement this as a fixed size
-//	table of pointers -- each entry in the table points to the
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector,
+//	file's data is stored.  We implement this as a short table of
+//	extents -- runs of consecutive sectors -- followed, if the file
+//	doesn't fit in those, by a doubly indirect block.  The table size
+//	is chosen so that the file header will be just big enough to fit
+//	in one disk sector.
+//
+//	New data sectors are taken right after the file's last one when
+//	that is free, so that the file stays in one extent, and reading it
+//	sequentially goes from one sector to the next (which the disk's
+//	track buffer makes cheap).  Otherwise, they are taken in runs,
+//	preferably on the same track (see AllocPolicy).
+//
+//	Headers and indirect blocks are read and written through the
+//	journal (cf. journal.h), so that a crash can't leave a file
+//	header and the free map disagreeing about a sector.
 //
 //      Unlike in a real system, we do not keep track of file permissions,
 //	ownership, last modification date, etc., in the file header.
@@ -27,6 +36,45 @@
 #include "system.h"
 #include "filehdr.h"
 
+AllocPolicy allocPolicy = AllocRuns;
+
+//----------------------------------------------------------------------
+// FileHeader::FileHeader
+// 	Initialize the header of an empty file.  Allocate or FetchFrom
+//	then fill it in.
+//----------------------------------------------------------------------
+
+FileHeader::FileHeader()
+{
+    ASSERT((char *)&extents[NumExtents] - (char *)&numBytes <= SectorSize);
+    sectorMap = NULL;
+    mapSize = 0;
+    Reset();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::~FileHeader
+// 	De-allocate the in-memory copy of the file header.
+//----------------------------------------------------------------------
+
+FileHeader::~FileHeader()
+{
+    delete[] sectorMap;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Reset
+// 	Make this the header of a file with no data sectors.
+//----------------------------------------------------------------------
+
+void FileHeader::Reset()
+{
+    numBytes = numSectors = numExtents = 0;
+    doubleIndirect = -1;
+    extentSectors = 0;
+    dirty = FALSE;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
@@ -40,85 +88,100 @@
 
 bool FileHeader::Allocate(BitMap *freeMap, int fileSize)
 {
-    numBytes = fileSize;
-    numSectors = divRoundUp(fileSize, SectorSize);
-    if (freeMap->NumClear() < numSectors)
-        return FALSE;
-
-    if (numSectors < NumDirect)
-    {
-        for (int i = 0; i < numSectors; i++)
-            dataSectors[i] = freeMap->Find();
-        dataSectors[NumDirect - 1] = -1;
-    }
-    else
-    {
-        for (int i = 0; i < NumDirect; i++)
-            dataSectors[i] = freeMap->Find(); //最后一项是二级块的地址
-        int dataSectors2[NumIndirect];
-        for (int i = 0; i < numSectors - NumDirect + 1; i++)
-            dataSectors2[i] = freeMap->Find();
-        //将二级索引保存
-        synchDisk->WriteSector(dataSectors[NumDirect - 1], (char *)dataSectors2);
-    }
-    return TRUE;
+    Reset();
+    return SetLength(freeMap, fileSize);
 }
 
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
-// 	De-allocate all the space allocated for data blocks for this file.
+// 	De-allocate all the space allocated for data blocks for this file,
+//	and for the blocks that list them.  They are given back through
+//	the journal, which keeps them from being used again until the
+//	change that frees them is safely in its log.
 //
 //	"freeMap" is the bit map of free disk sectors
 //----------------------------------------------------------------------
 
 void FileHeader::Deallocate(BitMap *freeMap)
 {
-    if (numSectors < NumDirect)
-        for (int i = 0; i < numSectors; i++)
-        {
-            ASSERT(freeMap->Test((int)dataSectors[i])); // ought to be marked!
-            freeMap->Clear((int)dataSectors[i]);
-        }
-    else
-    {
-        int dataSectors2[NumIndirect];
-        synchDisk->ReadSector(dataSectors[NumDirect - 1], (char *)dataSectors2);
+    int i;
 
-        for (int i = 0; i < NumDirect; i++)
-        {
-            ASSERT(freeMap->Test((int)dataSectors[i])); // ought to be marked!
-            freeMap->Clear((int)dataSectors[i]);
-        }
-        for (int i = 0; i < numSectors - NumDirect + 1; i++)
+    for (i = 0; i < numSectors; i++)
+    {
+        ASSERT(freeMap->Test(sectorMap[i])); // ought to be marked!
+        journal->Free(freeMap, sectorMap[i]);
+    }
+    if (doubleIndirect != -1)
+    {
+        for (i = 0; i < divRoundUp(numSectors - extentSectors, NumIndirect); i++)
         {
-            ASSERT(freeMap->Test((int)dataSectors2[i])); // ought to be marked!
-            freeMap->Clear((int)dataSectors2[i]);
+            ASSERT(freeMap->Test(indirect[i]));
+            journal->Free(freeMap, indirect[i]);
         }
+        ASSERT(freeMap->Test(doubleIndirect));
+        journal->Free(freeMap, doubleIndirect);
     }
 }
 
 //----------------------------------------------------------------------
 // FileHeader::FetchFrom
-// 	Fetch contents of file header from disk.
+// 	Fetch contents of file header from disk, and work out where
+//	every data sector is.
 //
 //	"sector" is the disk sector containing the file header
 //----------------------------------------------------------------------
 
 void FileHeader::FetchFrom(int sector)
 {
-    synchDisk->ReadSector(sector, (char *)this);
+    int i, j, n = 0;
+    int block[NumIndirect];
+    char buf[SectorSize];
+
+    journal->ReadSector(sector, buf);
+    bcopy(buf, (char *)&numBytes,
+          (char *)&extents[NumExtents] - (char *)&numBytes);
+
+    if (mapSize < numSectors)
+    {
+        delete[] sectorMap;
+        mapSize = numSectors;
+        sectorMap = new int[mapSize];
+    }
+    for (i = 0; i < numExtents; i++)
+        for (j = 0; j < extents[i].length; j++)
+            sectorMap[n++] = extents[i].start + j;
+    extentSectors = n;
+    if (doubleIndirect != -1)
+    {
+        journal->ReadSector(doubleIndirect, (char *)indirect);
+        for (i = 0; n < numSectors; i++)
+        {
+            journal->ReadSector(indirect[i], (char *)block);
+            for (j = 0; j < (int)NumIndirect && n < numSectors; j++)
+                sectorMap[n++] = block[j];
+        }
+    }
+    ASSERT(n == numSectors);
+    dirty = FALSE;
 }
 
 //----------------------------------------------------------------------
 // FileHeader::WriteBack
 // 	Write the modified contents of the file header back to disk.
+//	(The indirect blocks are written whenever they change.)
 //
 //	"sector" is the disk sector to contain the file header
 //----------------------------------------------------------------------
 
 void FileHeader::WriteBack(int sector)
 {
-    synchDisk->WriteSector(sector, (char *)this);
+    char buf[SectorSize];
+
+    bzero(buf, SectorSize);
+    bcopy((char *)&numBytes, buf,
+          (char *)&extents[NumExtents] - (char *)&numBytes);
+    journal->WriteSector(sector, buf);
+    dirty = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -133,15 +196,8 @@ void FileHeader::WriteBack(int sector)
 
 int FileHeader::ByteToSector(int offset)
 {
-    int sec = offset / SectorSize;
-    if (sec < NumDirect - 1)
-        return (dataSectors[sec]);
-    else
-    {
-        int dataSectors2[NumIndirect];
-        synchDisk->ReadSector(dataSectors[NumDirect - 1], (char *)dataSectors2);
-        return (dataSectors2[sec - NumDirect + 1]);
-    }
+    ASSERT(offset >= 0 && offset / SectorSize < numSectors);
+    return sectorMap[offset / SectorSize];
 }
 
 //----------------------------------------------------------------------
@@ -156,75 +212,502 @@ int FileHeader::FileLength()
 
 //----------------------------------------------------------------------
 // FileHeader::Print
-// 	Print the contents of the file header, and the contents of all
-//	the data blocks pointed to by the file header.
+// 	Print the contents of the file header: where the data sectors
+//	are.
 //----------------------------------------------------------------------
 
 void FileHeader::Print()
 {
-    int i, j, k;
-    char *data = new char[SectorSize];
+    int i, runs = 0;
+
+    for (i = 0; i < numSectors; i++)
+        if (i == 0 || sectorMap[i] != sectorMap[i - 1] + 1)
+            runs++;
+    printf("文件大小: %d.  数据扇区 %d 个，分成 %d 段，连续区间:\n", numBytes,
+           numSectors, runs);
+    for (i = 0; i < numExtents; i++)
+        printf("%d-%d ", extents[i].start,
+               extents[i].start + extents[i].length - 1);
+    puts("");
+    if (doubleIndirect != -1)
+    {
+        printf("二级间接索引扇区: %d, 间接索引扇区:", doubleIndirect);
+        for (i = 0; i < divRoundUp(numSectors - extentSectors, NumIndirect); i++)
+            printf(" %d", indirect[i]);
+        printf("\n间接索引的数据扇区:\n");
+        for (i = extentSectors; i < numSectors; i++)
+            printf("%d ", sectorMap[i]);
+        puts("");
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Claim
+// 	Read in the file header at "sector", as FetchFrom does, but
+//	check that it makes sense first, and mark every sector it uses
+//	(data, indirect blocks, and the double indirect block) in "inUse".
+//	Return how many problems were found -- sectors out of range, or
+//	already used by something else.  For checking the file system;
+//	unless it returns 0, the header must not be used for anything.
+//----------------------------------------------------------------------
+
+int FileHeader::Claim(int sector, BitMap *inUse)
+{
+    int i, j, n = 0, problems = 0;
+    int block[NumIndirect];
+    char buf[SectorSize];
 
-    if (numSectors < NumDirect)
+    journal->ReadSector(sector, buf);
+    bcopy(buf, (char *)&numBytes,
+          (char *)&extents[NumExtents] - (char *)&numBytes);
+    if (numBytes < 0 || numBytes > MaxFileSize ||
+        numSectors != divRoundUp(numBytes, SectorSize) ||
+        numExtents < 0 || numExtents > (int)NumExtents)
     {
+        printf("fsck: header %d: bad size\n", sector);
+        return 1;
+    }
 
-        printf("文件大小: %d.  直接索引:\n", numBytes);
+    for (i = 0; i < numExtents && extents[i].length > 0 && n <= numSectors;
+         i++)
+        n += extents[i].length;
+    if (i < numExtents || n > numSectors ||
+        (n < numSectors) != (doubleIndirect != -1))
+    {
+        printf("fsck: header %d: extents don't add up\n", sector);
+        return 1;
+    }
+    for (i = 0; i < numExtents; i++)
+        for (j = 0; j < extents[i].length; j++)
+            problems += ClaimSector(sector, extents[i].start + j, inUse);
+    if (doubleIndirect != -1)
+    {
+        if (ClaimSector(sector, doubleIndirect, inUse) > 0)
+            return problems + 1;
+        journal->ReadSector(doubleIndirect, (char *)indirect);
+        for (i = 0; n < numSectors; i++)
+        {
+            if (ClaimSector(sector, indirect[i], inUse) > 0)
+                return problems + 1;
+            journal->ReadSector(indirect[i], (char *)block);
+            for (j = 0; j < (int)NumIndirect && n < numSectors; j++, n++)
+                problems += ClaimSector(sector, block[j], inUse);
+        }
+    }
+    return problems;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ClaimSector
+// 	Mark "sector", used by the file whose header is at "hdrSector",
+//	in "inUse".  Return 1 (and say why) if it can't be, 0 if it can.
+//----------------------------------------------------------------------
+
+int FileHeader::ClaimSector(int hdrSector, int sector, BitMap *inUse)
+{
+    if (sector < 0 || sector >= NumSectors)
+    {
+        printf("fsck: header %d: sector %d out of range\n", hdrSector,
+               sector);
+        return 1;
+    }
+    if (inUse->Test(sector))
+    {
+        printf("fsck: header %d: sector %d used twice\n", hdrSector,
+               sector);
+        return 1;
+    }
+    inUse->Mark(sector);
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::SetLength
+// 	Make the file "size" bytes long, allocating more data sectors if
+//	it needs them.  Return FALSE if there isn't room, or the file
+//	would be too big; the file is then left as it was.
+//
+//	"freeMap" may be NULL if the file is getting no longer than the
+//	sectors it already has
+//----------------------------------------------------------------------
+
+bool FileHeader::SetLength(BitMap *freeMap, int size)
+{
+    int count = divRoundUp(size, SectorSize);
+
+    if (size > MaxFileSize)
+        return FALSE; // 超出了文件头能表示的范围
+    if (count > numSectors && !Grow(freeMap, count - numSectors))
+        return FALSE;
+    if (size != numBytes)
+        dirty = TRUE;
+    numBytes = size;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Grow
+// 	Allocate "count" more data sectors for the file, and if they don't
+//	all fit in the extents, indirect blocks to list them in.  Return
+//	FALSE (having allocated nothing) if the disk is too full.
+//----------------------------------------------------------------------
+
+bool FileHeader::Grow(BitMap *freeMap, int count)
+{
+    int oldSectors = numSectors, oldExtents = numExtents;
+    int oldExtentSectors = extentSectors;
+    Extent oldLast = {0, 0};
+    int i, sector, length, newSize, oldBlocks, newBlocks, needed;
+
+    ASSERT(freeMap != NULL);
+    if (freeMap->NumClear() < count)
+        return FALSE;
+    if (numExtents > 0)
+        oldLast = extents[numExtents - 1];
+
+    if (mapSize < numSectors + count)
+    {
+        int *newMap;
+
+        newSize = max(2 * mapSize, numSectors + count);
+        newMap = new int[newSize];
         for (i = 0; i < numSectors; i++)
-            printf("%d ", dataSectors[i]);
-        puts("");
+            newMap[i] = sectorMap[i];
+        delete[] sectorMap;
+        sectorMap = newMap;
+        mapSize = newSize;
+    }
+
+    // the data sectors
+    if (allocPolicy == AllocFirstFit)
+    {
+        for (i = 0; i < count; i++)
+            AddSector(NextSector(freeMap));
     }
     else
     {
-        printf("二级索引：");
-        int dataSectors2[NumIndirect];
-        synchDisk->ReadSector(dataSectors[NumDirect - 1], (char *)dataSectors2);
-        printf("文件大小: %d.  文件直接索引:\n", numBytes);
-        for (i = 0; i < NumDirect - 1; i++)
-            printf("%d ", dataSectors[i]);
-        printf("\n文件二级索引扇区编号：%d\n", dataSectors[NumDirect - 1]);
-        for (i = 0; i < numSectors - NumDirect + 1; i++)
-            printf("%d ", dataSectors2[i]);
-        puts("");
+        for (i = 0; i < count; i += length)
+        {
+            sector = NextRun(freeMap, count - i, &length);
+            for (int j = 0; j < length; j++)
+                AddSector(sector + j);
+        }
+    }
+
+    // the blocks that list the ones that didn't fit in extents
+    oldBlocks = divRoundUp(oldSectors - oldExtentSectors, NumIndirect);
+    newBlocks = divRoundUp(numSectors - extentSectors, NumIndirect);
+    ASSERT(newBlocks <= (int)NumIndirect);
+    needed = newBlocks - oldBlocks;
+    if (newBlocks > 0 && doubleIndirect == -1)
+        needed++;
+    if (freeMap->NumClear() < needed)
+    { // put everything back the way it was
+        for (i = oldSectors; i < numSectors; i++)
+            freeMap->Clear(sectorMap[i]);
+        numSectors = oldSectors;
+        numExtents = oldExtents;
+        if (numExtents > 0)
+            extents[numExtents - 1] = oldLast;
+        extentSectors = oldExtentSectors;
+        return FALSE;
     }
-    delete[] data;
+    if (newBlocks > 0)
+    {
+        if (doubleIndirect == -1)
+            doubleIndirect = freeMap->Find();
+        for (i = oldBlocks; i < newBlocks; i++)
+            indirect[i] = freeMap->Find();
+        // the last old block may have had room for more
+        for (i = max(oldBlocks - 1, 0); i < newBlocks; i++)
+            WriteIndirect(i);
+        journal->WriteSector(doubleIndirect, (char *)indirect);
+    }
+    return TRUE;
 }
 
-bool FileHeader::SetLength(BitMap *freeMap, int size)
+//----------------------------------------------------------------------
+// FileHeader::NextSector
+// 	Allocate a data sector for the end of the file: the one after
+//	the file's last sector if it is free, so that the file stays
+//	contiguous, otherwise the first free one.
+//----------------------------------------------------------------------
+
+int FileHeader::NextSector(BitMap *freeMap)
 {
-    if (size > numSectors * SectorSize)
+    int next;
+
+    if (numSectors > 0)
     {
-        int oldNum = numSectors;
-        numSectors = divRoundUp(size, SectorSize);
-        if (freeMap->NumClear() < numSectors - oldNum)
+        next = sectorMap[numSectors - 1] + 1;
+        if (next < NumSectors && !freeMap->Test(next))
         {
-            numSectors = oldNum;
-            return false;
+            freeMap->Mark(next);
+            return next;
         }
-        for (int i = oldNum; i < NumDirect - 1 && i < numSectors; i++)
+    }
+    next = freeMap->Find();
+    ASSERT(next != -1);
+    return next;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::NextRun
+// 	Allocate up to "count" consecutive data sectors for the end of
+//	the file; set "*length" to how many, and return the first.  In
+//	order of preference:
+//	   right after the file's last sector, so that it doesn't need
+//	     another extent (even if there are only a few free there);
+//	   somewhere else on the same track, so that reading it won't need
+//	     a seek;
+//	   the first run anywhere that is long enough, and if there is
+//	     none, the longest.
+//	The caller has made sure there are enough free sectors.
+//----------------------------------------------------------------------
+
+int FileHeader::NextRun(BitMap *freeMap, int count, int *length)
+{
+    int start = -1, next, track, other, otherLength;
+    bool adjacent = FALSE;
+
+    *length = 0;
+    if (numSectors > 0)
+    {
+        next = sectorMap[numSectors - 1] + 1;
+        while (*length < count && next + *length < NumSectors &&
+               !freeMap->Test(next + *length))
+            (*length)++;
+        if (*length > 0)
         {
-            dataSectors[i] = freeMap->Find();
+            start = next;
+            adjacent = TRUE;
         }
-        if (numSectors >= NumDirect)
+        else
         {
-            if (oldNum < NumDirect)
-            {
-                dataSectors[NumDirect - 1] = freeMap->Find();
-                int dataSectors2[NumIndirect];
-                for (int i = 0; i < numSectors - NumDirect + 1; i++)
-                    dataSectors2[i] = freeMap->Find();
-                synchDisk->WriteSector(dataSectors[NumDirect - 1], (char *)dataSectors2);
-            }
-            else
-            {
-                int dataSectors2[NumIndirect];
-                synchDisk->ReadSector(dataSectors[NumDirect - 1], (char *)dataSectors2);
-                for (int i = oldNum - NumDirect + 1; i < numSectors - NumDirect + 1; i++)
-                    dataSectors2[i] = freeMap->Find();
-                synchDisk->WriteSector(dataSectors[NumDirect - 1], (char *)dataSectors2);
-            }
-            puts("二级索引扩展成功");
+            track = (next - 1) / SectorsPerTrack * SectorsPerTrack;
+            start = freeMap->FindRun(track, track + SectorsPerTrack,
+                                     count, length);
         }
     }
-    numBytes = size;
-    return true;
-}
\ No newline at end of file
+    if (*length < count && !adjacent)
+    { // a run that is long enough anywhere, or a longer one
+        other = freeMap->FindRun(0, NumSectors, count, &otherLength);
+        if (otherLength == count || otherLength > *length)
+        {
+            start = other;
+            *length = otherLength;
+        }
+    }
+    ASSERT(start != -1 && *length > 0);
+    freeMap->MarkRun(start, *length);
+    return start;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AddSector
+// 	Put a newly allocated data sector on the end of the file: in the
+//	last extent if it follows on from it, or a new extent, or once we
+//	are out of extents, in the indirect blocks.  There must be room
+//	in "sectorMap".
+//----------------------------------------------------------------------
+
+void FileHeader::AddSector(int sector)
+{
+    ASSERT(numSectors < mapSize);
+    sectorMap[numSectors] = sector;
+    if (extentSectors == numSectors)
+    {
+        if (numExtents > 0 && sector == extents[numExtents - 1].start +
+                                            extents[numExtents - 1].length)
+        {
+            extents[numExtents - 1].length++;
+            extentSectors++;
+        }
+        else if (numExtents < (int)NumExtents)
+        {
+            extents[numExtents].start = sector;
+            extents[numExtents].length = 1;
+            numExtents++;
+            extentSectors++;
+        }
+    }
+    numSectors++;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::WriteIndirect
+// 	Write out the "i"th indirect block, listing the data sectors that
+//	didn't fit in the extents.
+//----------------------------------------------------------------------
+
+void FileHeader::WriteIndirect(int i)
+{
+    int block[NumIndirect];
+    int n = extentSectors + i * NumIndirect;
+
+    for (int j = 0; j < (int)NumIndirect; j++, n++)
+        block[j] = (n < numSectors) ? sectorMap[n] : -1;
+    journal->WriteSector(indirect[i], (char *)block);
+}
+
+//----------------------------------------------------------------------
+// HeaderTable::HeaderTable
+// 	Initialize an empty table of open file headers.
+//----------------------------------------------------------------------
+
+HeaderTable::HeaderTable()
+{
+    for (int i = 0; i < NumSectors; i++)
+    {
+        headers[i] = NULL;
+        locks[i] = NULL;
+        users[i] = 0;
+        removed[i] = FALSE;
+        fetching[i] = FALSE;
+    }
+    tableLock = new Lock("header table");
+    fetched = new Condition("header fetched");
+}
+
+//----------------------------------------------------------------------
+// HeaderTable::~HeaderTable
+// 	De-allocate the headers that are still open.
+//----------------------------------------------------------------------
+
+HeaderTable::~HeaderTable()
+{
+    for (int i = 0; i < NumSectors; i++)
+    {
+        delete headers[i];
+        delete locks[i];
+    }
+    delete tableLock;
+    delete fetched;
+}
+
+//----------------------------------------------------------------------
+// HeaderTable::Open
+// 	Return the header of the file whose header is at "sector", for
+//	one more OpenFile.  Only the first one reads it from disk; anyone
+//	else who opens the file meanwhile waits for it to be read.
+//----------------------------------------------------------------------
+
+FileHeader *HeaderTable::Open(int sector)
+{
+    FileHeader *hdr;
+
+    ASSERT(sector >= 0 && sector < NumSectors);
+    tableLock->Acquire();
+    users[sector]++;
+    if (headers[sector] == NULL)
+    {
+        headers[sector] = new FileHeader;
+        locks[sector] = new RWLock("file");
+        fetching[sector] = TRUE;
+        tableLock->Release(); // don't hold up other files while we read
+
+        headers[sector]->FetchFrom(sector);
+
+        tableLock->Acquire();
+        fetching[sector] = FALSE;
+        fetched->Broadcast(tableLock);
+    }
+    while (fetching[sector])
+        fetched->Wait(tableLock);
+    hdr = headers[sector];
+    tableLock->Release();
+    return hdr;
+}
+
+//----------------------------------------------------------------------
+// HeaderTable::Close
+// 	An OpenFile is done with the header at "sector".  If it was the
+//	last, write the header back if it has changed (or, if the file
+//	has been removed, give back its sectors), and de-allocate it.
+//----------------------------------------------------------------------
+
+void HeaderTable::Close(int sector)
+{
+    journal->Begin(); // before any lock (cf. filesys.cc)
+    tableLock->Acquire();
+    ASSERT(headers[sector] != NULL && users[sector] > 0);
+    if (--users[sector] == 0)
+    {
+        if (removed[sector])
+            Free(sector);
+        else if (headers[sector]->Changed())
+            headers[sector]->WriteBack(sector);
+        delete headers[sector];
+        delete locks[sector];
+        headers[sector] = NULL;
+        locks[sector] = NULL;
+    }
+    tableLock->Release();
+    journal->End();
+}
+
+//----------------------------------------------------------------------
+// HeaderTable::Remove
+// 	The file whose header is at "sector" has been taken out of its
+//	directory.  Give back its header and data sectors, now if nobody
+//	has it open, or else when the last OpenFile closes it.
+//----------------------------------------------------------------------
+
+void HeaderTable::Remove(int sector)
+{
+    (void) Open(sector);
+    removed[sector] = TRUE;
+    Close(sector);
+}
+
+//----------------------------------------------------------------------
+// HeaderTable::Free
+// 	Give back the sectors of the removed file whose header is at
+//	"sector", to the file system's free map.
+//----------------------------------------------------------------------
+
+void HeaderTable::Free(int sector)
+{
+    BitMap *freeMap = fileSystem->AcquireFreeMap();
+
+    headers[sector]->Deallocate(freeMap); // remove data blocks
+    journal->Free(freeMap, sector);       // remove header block
+    fileSystem->ReleaseFreeMap(TRUE);
+    removed[sector] = FALSE;
+}
+
+//----------------------------------------------------------------------
+// HeaderTable::Flush
+// 	Write back every open header that has changed, so that the disk
+//	is up to date.  Each is kept open while we do, and written with
+//	its file locked, so that nobody is changing it meanwhile -- in an
+//	operation of its own, as there may be more of them than one batch
+//	of the journal can hold.
+//----------------------------------------------------------------------
+
+void HeaderTable::Flush()
+{
+    bool open[NumSectors];
+    int i;
+
+    tableLock->Acquire();
+    for (i = 0; i < NumSectors; i++)
+    {
+        open[i] = (headers[i] != NULL && !fetching[i]);
+        if (open[i])
+            users[i]++;
+    }
+    tableLock->Release();
+
+    for (i = 0; i < NumSectors; i++)
+        if (open[i])
+        {
+            journal->Begin();
+            locks[i]->AcquireWrite();
+            if (headers[i]->Changed())
+                headers[i]->WriteBack(i);
+            locks[i]->ReleaseWrite();
+            journal->End();
+            Close(i);
+        }
+}
@@ -16,29 +16,63 @@
 
 #include "disk.h"
 #include "bitmap.h"
+#include "synch.h"
 
-#define NumDirect ((SectorSize - 2 * sizeof(int)) / sizeof(int))
-#define NumIndirect (SectorSize / sizeof(int))
-#define MaxFileSize (NumDirect * SectorSize)
+#define NumExtents ((SectorSize - 4 * sizeof(int)) / (2 * sizeof(int)))
+#define NumIndirect (SectorSize / sizeof(int)) // sector numbers per
+                                               // indirect block
+#define MaxFileSize (NumSectors * SectorSize)  // the extents and the
+                                               // double indirect block
+                                               // can map the whole disk
+#define HeaderSectors(fileSize) \
+  (2 + divRoundUp(divRoundUp(fileSize, SectorSize), (int)NumIndirect))
+                                               // the most sectors -- the
+                                               // header, and its indirect
+                                               // blocks -- describing a
+                                               // file of "fileSize" bytes
+
+// How to choose sectors for a file that is growing:
+//   AllocFirstFit -- one at a time: the one after the file's last sector
+//		     if it is free, otherwise the first free sector
+//   AllocRuns     -- as few runs of free sectors as possible: right after
+//		     the file's last sector, or else on the same track,
+//		     or else wherever there is a run long enough
+enum AllocPolicy { AllocFirstFit, AllocRuns };
+
+extern AllocPolicy allocPolicy; // set with -fa
+
+// A run of consecutive data sectors: the file's next "length" sectors
+// are "start", "start" + 1, ...
+
+class Extent
+{
+public:
+  int start;
+  int length;
+};
 
 // The following class defines the Nachos "file header" (in UNIX terms,
 // the "i-node"), describing where on disk to find all of the data in the file.
-// The file header is organized as a simple table of pointers to
-// data blocks.
 //
-// The file header data structure can be stored in memory or on disk.
-// When it is on disk, it is stored in a single sector -- this means
-// that we assume the size of this data structure to be the same
-// as one disk sector.  Without indirect addressing, this
-// limits the maximum file length to just under 4K bytes.
+// On disk, it is stored in a single sector.  The first data sectors are
+// described by up to NumExtents extents; a file written sequentially on
+// a fairly empty disk needs only one.  If the file is too fragmented for
+// that, the rest of its sectors are listed in indirect blocks, whose
+// sector numbers are in turn listed in the "double indirect" block.
 //
-// There is no constructor; rather the file header can be initialized
-// by allocating blocks for the file (if it is a new file), or by
-// reading it from disk.
+// In memory, we also keep the number of every data sector of the file,
+// so that ByteToSector is just an array lookup, and the sector numbers
+// of the indirect blocks.
+//
+// The file header can be initialized by allocating blocks for the file
+// (if it is a new file), or by reading it from disk.
 
 class FileHeader
 {
 public:
+  FileHeader();  // Initialize an empty file header
+  ~FileHeader(); // De-allocate the in-memory block map
+
   bool Allocate(BitMap *bitMap, int fileSize); // Initialize a file header,
       //  including allocating space
       //  on disk for the file data
@@ -61,11 +95,82 @@ public:
   // 设置文件大小
   bool SetLength(BitMap *freeMap, int size);
 
+  bool Changed() { return dirty; } // Modified since it was read or
+                                   //  written back?
+
+  int Claim(int sectorNumber, BitMap *inUse); // Read in and check the
+      //  header, and mark the sectors
+      //  it uses; return the problems
+
 private:
-  int numBytes;               // Number of bytes in the file
-  int numSectors;             // Number of data sectors in the file
-  int dataSectors[NumDirect]; // Disk sector numbers for each data
-                              // block in the file
+  // what is on disk, in exactly this order
+  int numBytes;                // Number of bytes in the file
+  int numSectors;              // Number of data sectors in the file
+  int numExtents;              // Number of "extents" in use
+  int doubleIndirect;          // Sector listing the indirect blocks,
+                               // -1 if there are none
+  Extent extents[NumExtents];  // Where the first data sectors are
+
+  // only in memory
+  int extentSectors;           // How many data sectors the extents hold
+  int *sectorMap;              // Disk sector of each data sector
+  int mapSize;                 // How many entries "sectorMap" has room for
+  int indirect[NumIndirect];   // Disk sector of each indirect block
+  bool dirty;                  // Changed since FetchFrom/WriteBack
+
+  void Reset();                           // Describe an empty file
+  bool Grow(BitMap *freeMap, int count);  // Add data sectors
+  int NextSector(BitMap *freeMap);        // Allocate one, after the last
+                                          // if possible
+  int NextRun(BitMap *freeMap, int count, int *length);
+                                          // Allocate up to "count" in a row
+  void AddSector(int sector);             // Put one on the end of the file
+  void WriteIndirect(int i);              // Write out an indirect block
+  int ClaimSector(int hdrSector, int sector, BitMap *inUse);
+                                          // Mark one sector for Claim
+};
+
+// The following class defines the table of open file headers (in UNIX
+// terms, the "in-core i-node table").  However many times a file is
+// open, there is one FileHeader for it, so that when one OpenFile
+// makes the file grow, the others see it.  The header is written back
+// when the last of them closes the file, if it has changed.
+//
+// A file that is removed while it is open keeps its sectors until then.
+//
+// Each open file also has a lock (in UNIX terms, the inode lock), which
+// whoever reads or changes the file holds -- shared, to read it; for a
+// directory, it is the directory's lock.  The table itself has a lock
+// of its own.
+
+class HeaderTable
+{
+public:
+  HeaderTable();  // Initialize an empty table
+  ~HeaderTable(); // De-allocate it (Flush it first!)
+
+  FileHeader *Open(int sector); // Return the header at "sector", read in
+                                // if it isn't open already
+  void Close(int sector);       // One fewer user of it
+  void Remove(int sector);      // Free the file's sectors, once it
+                                // isn't open any more
+  void Flush();                 // Write back every changed header
+
+  RWLock *FileLock(int sector) { return locks[sector]; }
+                                // The lock of a file that is open
+  bool Removed(int sector) { return removed[sector]; }
+                                // Has it been removed?
+
+private:
+  FileHeader *headers[NumSectors]; // the header at each sector, if open
+  RWLock *locks[NumSectors];       // and its lock
+  int users[NumSectors];           // how many OpenFiles share it
+  bool removed[NumSectors];        // free it when they are done?
+  bool fetching[NumSectors];       // still being read from disk?
+  Lock *tableLock;                 // protects all of the above
+  Condition *fetched;              // signalled when one has been read
+
+  void Free(int sector);           // give its sectors back
 };
 
 #endif // FILEHDR_H
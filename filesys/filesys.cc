@@ -11,33 +11,63 @@
 //
 // 	The file system consists of several data structures:
 //	   A bitmap of free disk sectors (cf. bitmap.h)
-//	   A directory of file names and file headers
+//	   A tree of directories of file names and file headers, starting
+//	     from the root directory
 //
-//      Both the bitmap and the directory are represented as normal
-//	files.  Their file headers are located in specific sectors
-//	(sector 0 and sector 1), so that the file system can find them
-//	on bootup.
+//      Both the bitmap and the directories are represented as normal
+//	files.  The file headers of the bitmap and the root directory are
+//	located in specific sectors (sector 0 and sector 1), so that the
+//	file system can find them on bootup.
 //
-//	The file system assumes that the bitmap and directory files are
-//	kept "open" continuously while Nachos is running.
+//	The file system assumes that the bitmap and root directory files
+//	are kept "open" continuously while Nachos is running.  Other
+//	directories are opened when we need to read or change them.
+//
+//	To keep the metadata traffic down, the file system also keeps in
+//	memory:
+//	   the bitmap, which is read in only when the disk is mounted
+//	   a cache of recent name lookups (cf. NameCache), so that walking
+//	     a path seldom needs to read the directories on it
+//	   the table of open file headers (cf. HeaderTable), so that a
+//	     file that is open more than once is read in only once
+//	The directories themselves are read and written a block at a time,
+//	through the disk cache, which keeps the ones in use in memory.
 //
 //	For those operations (such as Create, Remove) that modify the
-//	directory and/or bitmap, if the operation succeeds, the changes
-//	are written immediately back to disk (the two files are kept
-//	open during all this time).  If the operation fails, and we have
-//	modified part of the directory and/or bitmap, we simply discard
-//	the changed version, without writing it back to disk.
+//	directory and/or bitmap, if the operation succeeds, the directory
+//	is changed straight away, and the new bitmap is written too.  If
+//	the operation fails, we undo what we have done to the bitmap.
+//
+//	Every operation's changes to headers, directories and the bitmap
+//	go through the journal (cf. journal.h) as one transaction, so if
+//	Nachos exits in the middle of one, it either happened or it
+//	didn't: the next time the disk is mounted, the journal redoes
+//	every change that was committed to its log.  The log has a place
+//	of its own in the middle of the disk, which the bitmap shows as
+//	in use.  Flush commits the changes made so far.
+//
+//	Any number of threads may use the file system at once.  Each
+//	directory has a lock (its file's lock, cf. HeaderTable), which is
+//	held while looking a name up in it (shared with other lookups) or
+//	changing it (alone); walking a path
+//	locks one directory at a time, opening the next before letting go
+//	of the one it is in, so that it can't be removed in between.  The
+//	bitmap has a lock of its own, and so does each file.  To avoid
+//	deadlock, the locks are always taken in this order:
+//	   journal->Begin (an operation in progress; never with any of
+//	     the rest held, since it may wait for a commit, which waits
+//	     for every operation to end)
+//	   directories, parents before their children
+//	   files
+//	   the table of open headers
+//	   the bitmap
+//	The name cache doesn't need a lock: nothing it does can block.
 //
 // 	Our implementation at this point has the following restrictions:
 //
-//	   there is no synchronization for concurrent accesses
-//	   files have a fixed size, set when the file is created
-//	   files cannot be bigger than about 3KB in size
-//	   there is no hierarchical directory structure, and only a limited
-//	     number of files can be added to the system
-//	   there is no attempt to make the system robust to failures
-//	    (if Nachos exits in the middle of an operation that modifies
-//	    the file system, it may corrupt the disk)
+//	   there is no current directory: every path starts from the root
+//	   the data in files is not journaled, so after a crash, a file
+//	    may have old (or another file's) data in it
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -50,6 +80,8 @@
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "system.h"
+#include "synch.h"
 
 // Sectors containing the file headers for the bitmap of free sectors,
 // and the directory of files.  These file headers are placed in well-known
@@ -57,12 +89,10 @@
 #define FreeMapSector 0
 #define DirectorySector 1
 
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number
-// of files that can be loaded onto the disk.
+// Initial file sizes for the bitmap and for a directory; a directory
+// grows as names are added to it.
 #define FreeMapFileSize (NumSectors / BitsInByte)
-#define NumDirEntries 10
-#define DirectoryFileSize (sizeof(DirectoryEntry) * NumDirEntries)
+#define DirectoryFileSize ((1 + InitialBuckets) * SectorSize)
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
@@ -80,19 +110,24 @@
 FileSystem::FileSystem(bool format)
 {
     DEBUG('f', "Initializing the file system.\n");
+    freeMap = new BitMap(NumSectors);
+    freeMapLock = new Lock("free map");
+    names = new NameCache(nameCacheSize);
     if (format)
     {
-        BitMap *freeMap = new BitMap(NumSectors);
-        Directory *directory = new Directory(NumDirEntries);
+        Directory *directory;
         FileHeader *mapHdr = new FileHeader;
         FileHeader *dirHdr = new FileHeader;
 
         DEBUG('f', "Formatting the file system.\n");
+        journal->Format();
+        journal->Begin();
 
-        // First, allocate space for FileHeaders for the directory and bitmap
-        // (make sure no one else grabs these!)
+        // First, allocate space for FileHeaders for the directory and bitmap,
+        // and the journal's log (make sure no one else grabs these!)
         freeMap->Mark(FreeMapSector);
         freeMap->Mark(DirectorySector);
+        freeMap->MarkRun(LogStart, LogSectors);
 
         // Second, allocate space for the data blocks containing the contents
         // of the directory and bitmap files.  There better be enough space!
@@ -113,8 +148,8 @@ FileSystem::FileSystem(bool format)
         // The file system operations assume these two files are left open
         // while Nachos is running.
 
-        freeMapFile = new OpenFile(FreeMapSector);
-        directoryFile = new OpenFile(DirectorySector);
+        freeMapFile = new OpenFile(FreeMapSector, TRUE);
+        directoryFile = new OpenFile(DirectorySector, TRUE);
 
         // Once we have the files "open", we can write the initial version
         // of each file back to disk.  The directory at this point is completely
@@ -124,99 +159,226 @@ FileSystem::FileSystem(bool format)
 
         DEBUG('f', "Writing bitmap and directory back to disk.\n");
         freeMap->WriteBack(freeMapFile); // flush changes to disk
-        directory->WriteBack(directoryFile);
+        directory = new Directory(directoryFile);
+        directory->Format(DirectorySector); // the root is its own parent
 
         if (DebugIsEnabled('f'))
         {
             freeMap->Print();
             directory->Print();
-
-            delete freeMap;
-            delete directory;
-            delete mapHdr;
-            delete dirHdr;
         }
+        delete directory;
+        delete mapHdr;
+        delete dirHdr;
+        journal->End();
+        journal->Sync();
     }
     else
     {
-        // if we are not formatting the disk, just open the files representing
-        // the bitmap and directory; these are left open while Nachos is running
-        freeMapFile = new OpenFile(FreeMapSector);
-        directoryFile = new OpenFile(DirectorySector);
+        // if we are not formatting the disk, finish whatever the journal
+        // says was committed, then just open the files representing the
+        // bitmap and directory; these are left open while Nachos is running
+        journal->Recover();
+        freeMapFile = new OpenFile(FreeMapSector, TRUE);
+        directoryFile = new OpenFile(DirectorySector, TRUE);
+        freeMap->FetchFrom(freeMapFile);
     }
 }
 
+//----------------------------------------------------------------------
+// FileSystem::~FileSystem
+// 	Close the bitmap and directory files, and de-allocate what we keep
+//	in memory.  Flush first, if the changes are to be kept!
+//----------------------------------------------------------------------
+
+FileSystem::~FileSystem()
+{
+    delete freeMapFile;
+    delete directoryFile;
+    delete freeMap;
+    delete freeMapLock;
+    delete names;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Flush
+// 	Write back the headers of files that are open, if they have
+//	changed, and commit everything changed so far to the journal's
+//	log, so that it will survive a crash.
+//----------------------------------------------------------------------
+
+void FileSystem::Flush()
+{
+    headerTable->Flush();
+    journal->Sync();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::AcquireFreeMap, FileSystem::ReleaseFreeMap
+// 	Lock the bitmap, for a file that is being allocated, or is growing,
+//	or is being removed, and return it; then unlock it again, writing
+//	it first if it has "changed".  Must be called in the middle of an
+//	operation, so that the new bitmap is part of it.
+//----------------------------------------------------------------------
+
+BitMap *
+FileSystem::AcquireFreeMap()
+{
+    ASSERT(currentThread->journalDepth > 0);
+    freeMapLock->Acquire();
+    return freeMap;
+}
+
+void FileSystem::ReleaseFreeMap(bool changed)
+{
+    if (changed)
+        FreeMapChanged();
+    freeMapLock->Release();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FreeMapChanged
+// 	Write the bitmap, after it has been changed.  Sectors the journal
+//	is holding on to are written as free: by the time this change is
+//	safe on disk, they will be.  (The journal clears them in the
+//	bitmap, when it lets them go, without the bitmap's lock: they are
+//	sectors nobody else may touch, and that can't block.)
+//----------------------------------------------------------------------
+
+void FileSystem::FreeMapChanged()
+{
+    BitMap *onDisk = new BitMap(NumSectors);
+
+    for (int i = 0; i < NumSectors; i++)
+        if (freeMap->Test(i) && !journal->Held(i))
+            onDisk->Mark(i);
+    onDisk->WriteBack(freeMapFile);
+    delete onDisk;
+}
+
 //----------------------------------------------------------------------
 // FileSystem::Create
 // 	Create a file in the Nachos file system (similar to UNIX create).
-//	Since we can't increase the size of files dynamically, we have
-//	to give Create the initial size of the file.
+//	Files can grow when they are written past their end, but we are
+//	given their initial size, to allocate space for in one go.
 //
 //	The steps to create a file are:
+//	  Find the directory it is to go in
 //	  Make sure the file doesn't already exist
 //        Allocate a sector for the file header
 // 	  Allocate space on disk for the data blocks for the file
-//	  Add the name to the directory
 //	  Store the new file header on disk
-//	  Flush the changes to the bitmap and the directory back to disk
+//	  Add the name to the directory (which writes it to disk)
+//	  Remember the name in the name cache
 //
 //	Return TRUE if everything goes ok, otherwise, return FALSE.
 //
 // 	Create fails if:
+//		a directory in the path does not exist
 //   		file is already in directory
 //	 	no free space for file header
-//	 	no free entry for file in directory
 //	 	no free space for data blocks for the file
+//	 	no free space for the directory to grow
 //
-// 	Note that this implementation assumes there is no concurrent access
-//	to the file system!
-//
-//	"name" -- name of file to be created
+//	"name" -- path name of file to be created
 //	"initialSize" -- size of file to be created
 //----------------------------------------------------------------------
 
 bool FileSystem::Create(char *name, int initialSize)
 {
-    Directory *directory;
-    BitMap *freeMap;
-    FileHeader *hdr;
-    int sector;
     bool success;
 
-    DEBUG('f', "Creating file %s, size %d\n", name, initialSize);
+    journal->Begin(OpSectors + HeaderSectors(min(initialSize, MaxFileSize)));
+    success = CreateEntry(name, initialSize, FALSE);
+    journal->End();
+    return success;
+}
 
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
+//----------------------------------------------------------------------
+// FileSystem::Mkdir
+// 	Create an empty directory (similar to UNIX mkdir).  This is like
+//	Create, except that the new file is formatted as a directory
+//	before it is added to its parent.
+//
+//	Return TRUE if everything goes ok, otherwise, return FALSE.
+//
+//	"name" -- path name of directory to be created
+//----------------------------------------------------------------------
 
-    if (directory->Find(name) != -1)
-        success = FALSE; // file is already in directory
-    else
+bool FileSystem::Mkdir(char *name)
+{
+    bool success;
+
+    journal->Begin(OpSectors + HeaderSectors(DirectoryFileSize));
+    success = CreateEntry(name, DirectoryFileSize, TRUE);
+    journal->End();
+    return success;
+}
+
+bool FileSystem::CreateEntry(char *path, int initialSize, bool isDir)
+{
+    char name[FileNameMaxLen + 1];
+    OpenFile *dirFile, *newFile;
+    Directory *directory, *newDirectory;
+    FileHeader *hdr;
+    BitMap *map;
+    int sector;
+    bool success, foundDir;
+
+    DEBUG('f', "Creating %s %s, size %d\n", isDir ? "directory" : "file",
+          path, initialSize);
+
+    dirFile = FindDirectory(path, name);
+    if (dirFile == NULL)
+        return FALSE; // a directory in the path is missing
+    dirFile->Acquire();
+    if (name[0] == '\0' || !strcmp(name, ".") || !strcmp(name, "..") ||
+        LookupName(dirFile, name, &foundDir) != -1 || dirFile->IsRemoved())
+    { // not a name we can add, or file is already in directory
+        dirFile->Release();
+        CloseDirectory(dirFile);
+        return FALSE;
+    }
+
+    map = AcquireFreeMap();
+    sector = map->Find(); // find a sector to hold the file header
+    hdr = new FileHeader;
+    if (sector == -1 || !hdr->Allocate(map, initialSize))
+    { // no free block for file header, or no space on disk for data
+        if (sector != -1)
+            map->Clear(sector);
+        ReleaseFreeMap(FALSE);
+        dirFile->Release();
+        CloseDirectory(dirFile);
+        delete hdr;
+        return FALSE;
+    }
+    ReleaseFreeMap(TRUE);
+    hdr->WriteBack(sector);
+    if (isDir)
     {
-        freeMap = new BitMap(NumSectors);
-        freeMap->FetchFrom(freeMapFile);
-        sector = freeMap->Find(); // find a sector to hold the file header
-        if (sector == -1)
-            success = FALSE; // no free block for file header
-        else if (!directory->Add(name, sector))
-            success = FALSE; // no space in directory
-        else
-        {
-            hdr = new FileHeader;
-            if (!hdr->Allocate(freeMap, initialSize))
-                success = FALSE; // no space on disk for data
-            else
-            {
-                success = TRUE;
-                // everthing worked, flush all changes back to disk
-                hdr->WriteBack(sector);
-                directory->WriteBack(directoryFile);
-                freeMap->WriteBack(freeMapFile);
-            }
-            delete hdr;
-        }
-        delete freeMap;
+        newFile = new OpenFile(sector, TRUE);
+        newDirectory = new Directory(newFile);
+        newDirectory->Format(dirFile->HeaderSector());
+        delete newDirectory;
+        delete newFile;
+    }
+
+    directory = new Directory(dirFile);
+    success = directory->Add(name, sector, isDir);
+    if (success)
+        names->Enter(dirFile->HeaderSector(), name, sector, isDir);
+    else
+    { // no space for the directory to grow: give it all back
+        map = AcquireFreeMap();
+        hdr->Deallocate(map);
+        journal->Free(map, sector);
+        ReleaseFreeMap(TRUE);
     }
     delete directory;
+    dirFile->Release();
+    CloseDirectory(dirFile);
+    delete hdr;
     return success;
 }
 
@@ -224,105 +386,309 @@ bool FileSystem::Create(char *name, int initialSize)
 // FileSystem::Open
 // 	Open a file for reading and writing.
 //	To open a file:
-//	  Find the location of the file's header, using the directory
-//	  Bring the header into memory
+//	  Find the location of the file's header, using the directories
+//	    on its path (or the name cache)
+//	  Bring the header into memory, unless it is open already
+//
+//	Directories can't be opened this way.
 //
-//	"name" -- the text name of the file to be opened
+//	"name" -- the path name of the file to be opened
 //----------------------------------------------------------------------
 
 OpenFile *
-FileSystem::Open(char *name)
+FileSystem::Open(char *path)
 {
-    Directory *directory = new Directory(NumDirEntries);
-    OpenFile *openFile = NULL;
+    char name[FileNameMaxLen + 1];
+    OpenFile *dirFile, *openFile = NULL;
     int sector;
-
-    DEBUG('f', "Opening file %s\n", name);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
-    if (sector >= 0)
-        openFile = new OpenFile(sector); // name was found in directory
-    delete directory;
-    return openFile; // return NULL if not found
+    bool isDir;
+
+    DEBUG('f', "Opening file %s\n", path);
+    dirFile = FindDirectory(path, name);
+    if (dirFile == NULL)
+        return NULL; // not found
+    dirFile->AcquireShared();
+    sector = LookupName(dirFile, name, &isDir);
+    if (sector != -1 && !isDir)
+        openFile = new OpenFile(sector); // before it can be removed
+    dirFile->ReleaseShared();
+    CloseDirectory(dirFile);
+    return openFile;
 }
 
 //----------------------------------------------------------------------
 // FileSystem::Remove
 // 	Delete a file from the file system.  This requires:
-//	    Remove it from the directory
+//	    Remove it from its directory
 //	    Delete the space for its header
 //	    Delete the space for its data blocks
-//	    Write changes to directory, bitmap back to disk
+//	The space is only given back once the file isn't open any more.
 //
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
-//	in the file system.
+//	in the file system (or is a directory).
 //
-//	"name" -- the text name of the file to be removed
+//	"name" -- the path name of the file to be removed
 //----------------------------------------------------------------------
 
 bool FileSystem::Remove(char *name)
 {
+    bool success;
+
+    journal->Begin();
+    success = RemoveEntry(name, FALSE);
+    journal->End();
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Rmdir
+// 	Delete a directory from the file system, as Remove does for a
+//	file.  The directory must be empty.
+//
+//	Return TRUE if the directory was deleted, FALSE if it wasn't in
+//	the file system, or isn't a directory, or isn't empty.
+//
+//	"name" -- the path name of the directory to be removed
+//----------------------------------------------------------------------
+
+bool FileSystem::Rmdir(char *name)
+{
+    bool success;
+
+    journal->Begin();
+    success = RemoveEntry(name, TRUE);
+    journal->End();
+    return success;
+}
+
+bool FileSystem::RemoveEntry(char *path, bool isDir)
+{
+    char name[FileNameMaxLen + 1];
+    OpenFile *dirFile, *subFile = NULL;
     Directory *directory;
-    BitMap *freeMap;
-    FileHeader *fileHdr;
     int sector;
-
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
-    if (sector == -1)
-    {
+    bool foundDir, empty;
+
+    dirFile = FindDirectory(path, name);
+    if (dirFile == NULL)
+        return FALSE; // a directory in the path is missing
+    dirFile->Acquire();
+    sector = -1;
+    if (name[0] != '\0' && strcmp(name, ".") && strcmp(name, ".."))
+        sector = LookupName(dirFile, name, &foundDir);
+    if (sector == -1 || foundDir != isDir)
+    { // not a name we can remove, or file not found
+        dirFile->Release();
+        CloseDirectory(dirFile);
+        return FALSE;
+    }
+    if (isDir)
+    { // only empty directories can go; keep it locked until it has
+        subFile = OpenDirectory(sector);
+        subFile->Acquire();
+        directory = new Directory(subFile);
+        empty = directory->IsEmpty();
         delete directory;
-        return FALSE; // file not found
+        if (!empty)
+        {
+            subFile->Release();
+            CloseDirectory(subFile);
+            dirFile->Release();
+            CloseDirectory(dirFile);
+            return FALSE;
+        }
+        names->Purge(sector);
     }
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
 
-    freeMap = new BitMap(NumSectors);
-    freeMap->FetchFrom(freeMapFile);
+    directory = new Directory(dirFile);
+    directory->Remove(name); // (written to disk as it goes)
+    delete directory;
+    names->Enter(dirFile->HeaderSector(), name, -1, FALSE);
+    headerTable->Remove(sector); // remove header and data blocks
+
+    if (subFile != NULL)
+    { // (it is freed when we close it, unless someone else has it open)
+        subFile->Release();
+        CloseDirectory(subFile);
+    }
+    dirFile->Release();
+    CloseDirectory(dirFile);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FindDirectory
+// 	Walk down "path" from the root directory, through every name in it
+//	but the last; return the directory that the last name should be
+//	in, open (the caller must close it, with CloseDirectory), and copy
+//	that name into "name" (it may be "" if the path is, or ends in,
+//	"/").
+//
+//	Each directory on the way is locked while we look the next name
+//	up in it, and until we have the next one open.
+//
+//	Return NULL if one of the directories on the way doesn't exist,
+//	or a name is longer than FileNameMaxLen.
+//----------------------------------------------------------------------
 
-    fileHdr->Deallocate(freeMap); // remove data blocks
-    freeMap->Clear(sector);       // remove header block
-    directory->Remove(name);
+OpenFile *
+FileSystem::FindDirectory(char *path, char *name)
+{
+    OpenFile *dirFile = OpenDirectory(DirectorySector), *next;
+    char *end;
+    int sector;
+    bool isDir;
 
-    freeMap->WriteBack(freeMapFile);     // flush to disk
-    directory->WriteBack(directoryFile); // flush to disk
-    delete fileHdr;
+    for (;;)
+    {
+        while (*path == '/')
+            path++;
+        for (end = path; *end != '\0' && *end != '/'; end++)
+            ;
+        if (end - path > FileNameMaxLen)
+            break;
+        strncpy(name, path, end - path);
+        name[end - path] = '\0';
+        for (path = end; *path == '/'; path++)
+            ;
+        if (*path == '\0')
+            return dirFile; // "name" is the last one
+        dirFile->AcquireShared();
+        sector = LookupName(dirFile, name, &isDir);
+        next = (sector != -1 && isDir) ? OpenDirectory(sector) : NULL;
+        dirFile->ReleaseShared();
+        CloseDirectory(dirFile);
+        if (next == NULL)
+            return NULL;
+        dirFile = next;
+    }
+    CloseDirectory(dirFile);
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LookupName
+// 	Return the sector of the header of "name", in the directory open
+//	in "dirFile", and set "*isDir" to whether it is a directory;
+//	return -1 if there is no such name.  "." is the same directory,
+//	and ".." its parent.  The directory must be locked.
+//
+//	The name cache is tried first; only if it doesn't know do we read
+//	the directory (and then tell the cache what we found).  Nothing is
+//	found in a directory that has been removed, and it is kept out of
+//	the cache, since its sector may soon be a new directory.
+//----------------------------------------------------------------------
+
+int FileSystem::LookupName(OpenFile *dirFile, char *name, bool *isDir)
+{
+    Directory *directory;
+    int sector, dirSector = dirFile->HeaderSector();
+
+    *isDir = TRUE;
+    if (dirFile->IsRemoved())
+        return -1;
+    if (name[0] == '\0' || !strcmp(name, "."))
+        return dirSector;
+    if (names->Lookup(dirSector, name, &sector, isDir))
+        return sector;
+
+    directory = new Directory(dirFile);
+    if (!strcmp(name, ".."))
+        sector = directory->Parent();
+    else
+        sector = directory->Find(name, isDir);
     delete directory;
-    delete freeMap;
-    return TRUE;
+    names->Enter(dirSector, name, sector, *isDir);
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::OpenDirectory, FileSystem::CloseDirectory
+// 	Open or close the directory file whose header is at "sector".  The
+//	root directory's file is always open, so we hand that one out
+//	instead.
+//----------------------------------------------------------------------
+
+OpenFile *
+FileSystem::OpenDirectory(int sector)
+{
+    if (sector == DirectorySector)
+        return directoryFile;
+    return new OpenFile(sector, TRUE);
+}
+
+void FileSystem::CloseDirectory(OpenFile *dirFile)
+{
+    if (dirFile != directoryFile)
+        delete dirFile;
 }
 
 //----------------------------------------------------------------------
 // FileSystem::List
-// 	List all the files in the file system directory.
+// 	List all the files in the root directory, or in the directory
+//	"name".  Return FALSE if there is no such directory.
 //----------------------------------------------------------------------
 
 void FileSystem::List()
 {
-    Directory *directory = new Directory(NumDirEntries);
+    Directory *directory;
+
+    directoryFile->AcquireShared();
+    directory = new Directory(directoryFile);
+    directory->List();
+    delete directory;
+    directoryFile->ReleaseShared();
+}
 
-    directory->FetchFrom(directoryFile);
+bool FileSystem::List(char *path)
+{
+    char name[FileNameMaxLen + 1];
+    OpenFile *dirFile = FindDirectory(path, name), *subFile = NULL;
+    Directory *directory;
+    int sector;
+    bool isDir;
+
+    if (dirFile == NULL)
+        return FALSE;
+    dirFile->AcquireShared();
+    sector = LookupName(dirFile, name, &isDir);
+    if (sector != -1 && isDir)
+        subFile = OpenDirectory(sector);
+    dirFile->ReleaseShared();
+    CloseDirectory(dirFile);
+    if (subFile == NULL)
+        return FALSE;
+
+    subFile->AcquireShared();
+    directory = new Directory(subFile);
     directory->List();
     delete directory;
+    subFile->ReleaseShared();
+    CloseDirectory(subFile);
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
 // FileSystem::Print
 // 	Print everything about the file system:
 //	  the contents of the bitmap
-//	  the contents of the directory
+//	  how fragmented the free space is
+//	  the contents of the root directory
 //	  for each file in the directory,
 //	      the contents of the file header
 //	      the data in the file
+//	      if it is a directory, all of this for its contents
+//	Nobody else should be changing the file system meanwhile.
 //----------------------------------------------------------------------
 
 void FileSystem::Print()
 {
     FileHeader *bitHdr = new FileHeader;
     FileHeader *dirHdr = new FileHeader;
-    BitMap *freeMap = new BitMap(NumSectors);
-    Directory *directory = new Directory(NumDirEntries);
+    Directory *directory = new Directory(directoryFile);
+    int numFree, numRuns, longest;
+
+    Flush(); // so that what we print from disk is up to date
 
     printf("Bit map file header:\n");
     bitHdr->FetchFrom(FreeMapSector);
@@ -332,14 +698,66 @@ void FileSystem::Print()
     dirHdr->FetchFrom(DirectorySector);
     dirHdr->Print();
 
-    freeMap->FetchFrom(freeMapFile);
     freeMap->Print();
+    numFree = freeMap->NumClear();
+    freeMap->FreeRuns(&numRuns, &longest);
+    printf("Free space: %d sectors in %d runs, longest %d, fragmentation "
+           "%.1f%%\n", numFree, numRuns, longest,
+           numFree == 0 ? 0.0 : 100.0 * (numFree - longest) / numFree);
 
-    directory->FetchFrom(directoryFile);
     directory->Print();
 
     delete bitHdr;
     delete dirHdr;
-    delete freeMap;
     delete directory;
 }
+
+//----------------------------------------------------------------------
+// FileSystem::Check
+// 	Check that the file system on disk makes sense (in UNIX terms,
+//	"fsck"): that every directory and file header is well formed, that
+//	no sector is used twice, and that the bitmap marks exactly the
+//	sectors that are used -- the headers and data of every file that
+//	can be reached from the root directory, the two well-known
+//	sectors, and the journal's log.  Print what is wrong, and return
+//	TRUE if nothing is.
+//----------------------------------------------------------------------
+
+bool FileSystem::Check()
+{
+    BitMap *inUse = new BitMap(NumSectors);
+    FileHeader *hdr = new FileHeader;
+    Directory *directory = new Directory(directoryFile);
+    int i, problems = 0, lost = 0;
+
+    inUse->Mark(FreeMapSector);
+    inUse->Mark(DirectorySector);
+    inUse->MarkRun(LogStart, LogSectors);
+    problems += hdr->Claim(FreeMapSector, inUse);
+    problems += hdr->Claim(DirectorySector, inUse);
+    problems += directory->Check(DirectorySector, DirectorySector, inUse);
+
+    for (i = 0; i < NumSectors; i++)
+        if (inUse->Test(i) && !freeMap->Test(i))
+        {
+            printf("fsck: sector %d is in use, but free in the bitmap\n", i);
+            problems++;
+        }
+        else if (!inUse->Test(i) && freeMap->Test(i))
+            lost++;
+    if (lost > 0)
+    {
+        printf("fsck: %d sectors are marked in the bitmap, but not used\n",
+               lost);
+        problems++;
+    }
+    if (problems == 0)
+        printf("fsck: ok\n");
+    else
+        printf("fsck: %d problems\n", problems);
+
+    delete inUse;
+    delete hdr;
+    delete directory;
+    return problems == 0;
+}
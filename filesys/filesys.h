@@ -20,9 +20,10 @@
 //	file system (in a file named "DISK"). 
 //
 //	In the "real" implementation, there are two key data structures used 
-//	in the file system.  There is a single "root" directory, listing
-//	all of the files in the file system; unlike UNIX, the baseline
-//	system does not provide a hierarchical directory structure.  
+//	in the file system.  There is a "root" directory, from which all
+//	of the files in the file system can be reached; as in UNIX, it can
+//	hold other directories, and files are named by paths such as
+//	"dir/sub/file" (always starting from the root).
 //	In addition, there is a bitmap for allocating
 //	disk sectors.  Both the root directory and the bitmap are themselves
 //	stored as files in the Nachos file system -- this causes an interesting
@@ -62,9 +63,16 @@ class FileSystem {
 
     bool Remove(char *name) { return (bool)(Unlink(name) == 0); }
 
+    void Flush() {}
+
 };
 
 #else // FILESYS
+#include "bitmap.h"
+
+class Lock;
+class NameCache;
+
 class FileSystem {
   public:
     FileSystem(bool format);		// Initialize the file system.
@@ -73,6 +81,7 @@ class FileSystem {
     					// If "format", there is nothing on
 					// the disk, so initialize the directory
     					// and the bitmap of free blocks.
+    ~FileSystem();			// Close it (Flush it first!)
 
     bool Create(char *name, int initialSize);  	
 					// Create a file (UNIX creat)
@@ -81,15 +90,52 @@ class FileSystem {
 
     bool Remove(char *name);  		// Delete a file (UNIX unlink)
 
-    void List();			// List all the files in the file system
+    bool Mkdir(char *name);		// Create a directory (UNIX mkdir)
+
+    bool Rmdir(char *name);		// Delete an empty directory
+					// (UNIX rmdir)
+
+    void List();			// List all the files in the root
+					// directory
+    bool List(char *name);		// List the files in a directory
+					// (UNIX ls)
 
     void Print();			// List all the files and their contents
 
+    void Flush();			// Write back the open file headers,
+					// if they have changed, and commit
+					// every change to the journal
+
+    bool Check();			// Check the file system on disk
+					// (UNIX fsck)
+
+    BitMap *AcquireFreeMap();		// Lock the bitmap, for files that
+    void ReleaseFreeMap(bool changed);	// grow or are removed while open;
+					// unlock it (and write it, if it
+					// has changed)
+
   private:
    OpenFile* freeMapFile;		// Bit map of free disk blocks,
 					// represented as a file
    OpenFile* directoryFile;		// "Root" directory -- list of 
 					// file names, represented as a file
+   BitMap* freeMap;			// The bitmap, kept in memory
+   Lock* freeMapLock;			// Protects it
+   NameCache* names;			// Recent name lookups
+
+   bool CreateEntry(char *name, int initialSize, bool isDir);
+   bool RemoveEntry(char *name, bool isDir);
+					// Create/Remove, and Mkdir/Rmdir
+   OpenFile* FindDirectory(char *path, char *name);
+					// The directory that holds the last
+					// name in "path", open
+   int LookupName(OpenFile *dirFile, char *name, bool *isDir);
+					// A name in a (locked) directory
+   void FreeMapChanged();		// Write the bitmap
+   OpenFile* OpenDirectory(int sector);
+   void CloseDirectory(OpenFile *dirFile);
+					// Open/close a directory file; the
+					// root's is always open
 };
 
 #endif // FILESYS
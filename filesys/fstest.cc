@@ -7,6 +7,16 @@
 //	   Perftest -- a stress test for the Nachos file system
 //		read and write a really large file in tiny chunks
 //		(won't work on baseline system!)
+//	   RandomReadBenchmark -- many threads reading random sectors at
+//		once, under each disk scheduling policy
+//	   CopyBenchmark -- copy a file onto a fragmented disk and read it
+//		back, under each sector allocation policy
+//	   MetadataBenchmark -- create, open and remove many small files,
+//		and count the sectors that took
+//	   CrashTest -- change the file system at random, and stop Nachos
+//		dead in the middle of it (cf. crashtest.sh)
+//	   StressTest -- many threads creating, writing and removing files
+//		at once, and checking that nothing got mixed up
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -20,6 +30,10 @@
 #include "thread.h"
 #include "disk.h"
 #include "stats.h"
+#include "synch.h"
+#include "synchdisk.h"
+#include "filehdr.h"
+#include "directory.h"
 
 #define TransferSize 10 // make it small, just to be difficult
 
@@ -140,11 +154,11 @@ FileWrite()
         if (numBytes < 10)
         {
             printf("Perf test: unable to write %s\n", FileName);
-            delete openFile;
-            return;
+            break;
         }
     }
-    delete openFile; // close file
+    openFile->WriteBack(); // the file has grown: save its header
+    delete openFile;       // close file
 }
 
 static void
@@ -271,7 +285,7 @@ void NAppend(char *from, char *to)
     //  start position for appending
     int start;
 
-    if (!strncmp(from, to, 9))
+    if (!strcmp(from, to))
     {
         //  "from" should be the same as "to"
         printf("NAppend: should be different files\n");
@@ -347,3 +361,463 @@ void PerformanceTest()
     }
     stats->Print();
 }
+
+//----------------------------------------------------------------------
+// RandomReadBenchmark
+// 	Fork "numThreads" threads that each read RandomReads random
+//	sectors, straight from the disk (the cache would hide what we
+//	want to measure), so that there are up to "numThreads" requests
+//	waiting for the disk at once.  Do it under each disk scheduling
+//	policy, with the same sectors each time, and report the latency
+//	of the requests and how long it all took.
+//----------------------------------------------------------------------
+
+#define RandomReads 20 // reads per thread
+
+static int *randomSectors;         // what each thread reads, in order
+static Semaphore *readersDone;
+static int readCount, readLatencyMax; // latency of the reads so far
+static double readLatencyTotal;
+
+static void
+RandomReader(_int which)
+{
+    char data[SectorSize];
+    int start, latency;
+
+    for (int i = 0; i < RandomReads; i++)
+    {
+        start = stats->totalTicks;
+        synchDisk->ReadFromDisk(randomSectors[which * RandomReads + i], data);
+        latency = stats->totalTicks - start;
+        readCount++;
+        readLatencyTotal += latency;
+        if (latency > readLatencyMax)
+            readLatencyMax = latency;
+    }
+    readersDone->V();
+}
+
+void RandomReadBenchmark(int numThreads)
+{
+    static char *policyNames[] = {"FCFS", "SSTF", "SCAN", "C-LOOK"};
+    int i, start;
+
+    randomSectors = new int[numThreads * RandomReads];
+    for (i = 0; i < numThreads * RandomReads; i++)
+        randomSectors[i] = Random() % NumSectors;
+    readersDone = new Semaphore("readers done", 0);
+
+    for (int policy = DiskFCFS; policy <= DiskCLOOK; policy++)
+    {
+        synchDisk->SetPolicy((DiskPolicy)policy);
+        readCount = readLatencyMax = 0;
+        readLatencyTotal = 0.0;
+        start = stats->totalTicks;
+        for (i = 0; i < numThreads; i++)
+        {
+            Thread *t = new Thread("random reader");
+            t->Fork(RandomReader, i);
+        }
+        for (i = 0; i < numThreads; i++)
+            readersDone->P();
+        printf("随机读测试（%-6s）：%d 个线程，各读 %d 个扇区，模拟时间 %d ticks，"
+               "平均延迟 %.1f ticks，最大延迟 %d ticks\n",
+               policyNames[policy], numThreads, RandomReads,
+               stats->totalTicks - start, readLatencyTotal / readCount,
+               readLatencyMax);
+    }
+    synchDisk->SetPolicy(DiskCLOOK);
+    delete readersDone;
+    delete[] randomSectors;
+}
+
+//----------------------------------------------------------------------
+// CopyBenchmark
+// 	Punch holes in the free space, a track or so apart, by creating
+//	a few files and removing every other one, then copy the UNIX file
+//	"from" into Nachos and read it back a sector at a time.  Do it under each
+//	sector allocation policy, starting from the same free map, and
+//	report how many times the disk had to seek, and how long it took.
+//----------------------------------------------------------------------
+
+#define NumFragFiles 9                              // every other one a hole
+#define HoleSize (2 * SectorSize)                   // the files we remove
+#define FragFileSize (SectorsPerTrack * SectorSize) // the ones we keep
+
+void CopyBenchmark(char *from)
+{
+    static char *policyNames[] = {"first fit", "runs"};
+    AllocPolicy saved = allocPolicy;
+    char name[FileNameMaxLen + 1], data[SectorSize];
+    int i, seeks, start;
+    OpenFile *openFile;
+
+    for (int policy = AllocFirstFit; policy <= AllocRuns; policy++)
+    {
+        allocPolicy = (AllocPolicy)policy;
+        for (i = 0; i < NumFragFiles; i++)
+        {
+            sprintf(name, "frag%d", i);
+            fileSystem->Create(name, (i % 2 == 0) ? HoleSize : FragFileSize);
+        }
+        for (i = 0; i < NumFragFiles; i += 2)
+        {
+            sprintf(name, "frag%d", i);
+            fileSystem->Remove(name);
+        }
+        fileSystem->Flush();
+
+        seeks = stats->numDiskSeeks;
+        start = stats->totalTicks;
+        Copy(from, "cbcopy");
+        fileSystem->Flush();
+        printf("复制测试（%-9s）：写入 seek %d 次，模拟时间 %d ticks\n",
+               policyNames[policy], stats->numDiskSeeks - seeks,
+               stats->totalTicks - start);
+
+        openFile = fileSystem->Open("cbcopy");
+        if (openFile != NULL)
+        {
+            seeks = stats->numDiskSeeks;
+            start = stats->totalTicks;
+            while (openFile->Read(data, SectorSize) > 0)
+                ;
+            printf("复制测试（%-9s）：读回 seek %d 次，模拟时间 %d ticks\n",
+                   policyNames[policy], stats->numDiskSeeks - seeks,
+                   stats->totalTicks - start);
+            delete openFile;
+        }
+
+        fileSystem->Remove("cbcopy");
+        for (i = 1; i < NumFragFiles; i += 2)
+        {
+            sprintf(name, "frag%d", i);
+            fileSystem->Remove(name);
+        }
+        fileSystem->Flush();
+    }
+    allocPolicy = saved;
+}
+
+//----------------------------------------------------------------------
+// MetadataBenchmark
+// 	Create "numFiles" empty files in a new directory, open each of them
+//	OpensPerFile times (all at once, so that they share a header), and
+//	remove them again.  Report how many sectors that read and wrote,
+//	through the disk cache and on the disk itself, and how many of
+//	the name lookups the name cache answered.  Compare with -nc 0.
+//----------------------------------------------------------------------
+
+#define OpensPerFile 4
+
+void MetadataBenchmark(int numFiles)
+{
+    char name[32];
+    OpenFile *openFiles[OpensPerFile];
+    int i, j, start, reads, writes, accesses, hits, misses;
+
+    if (!fileSystem->Mkdir("mb"))
+    {
+        printf("Metadata benchmark: can't create directory mb\n");
+        return;
+    }
+    synchDisk->Flush();
+    start = stats->totalTicks;
+    reads = stats->numDiskReads;
+    writes = stats->numDiskWrites;
+    accesses = stats->numCacheHits + stats->numCacheMisses;
+    hits = stats->numNameCacheHits;
+    misses = stats->numNameCacheMisses;
+
+    for (i = 0; i < numFiles; i++)
+    {
+        sprintf(name, "mb/file%d", i);
+        if (!fileSystem->Create(name, 0))
+        {
+            printf("Metadata benchmark: can't create %s\n", name);
+            break;
+        }
+    }
+    for (i = 0; i < numFiles; i++)
+    {
+        sprintf(name, "mb/file%d", i);
+        for (j = 0; j < OpensPerFile; j++)
+            openFiles[j] = fileSystem->Open(name);
+        for (j = 0; j < OpensPerFile; j++)
+            delete openFiles[j];
+    }
+    for (i = 0; i < numFiles; i++)
+    {
+        sprintf(name, "mb/file%d", i);
+        fileSystem->Remove(name);
+    }
+    fileSystem->Flush();
+    synchDisk->Flush();
+
+    printf("元数据测试：%d 个文件，各打开 %d 次，模拟时间 %d ticks\n",
+           numFiles, OpensPerFile, stats->totalTicks - start);
+    printf("元数据测试：经过磁盘缓存 %d 个扇区，磁盘读 %d 次，写 %d 次\n",
+           stats->numCacheHits + stats->numCacheMisses - accesses,
+           stats->numDiskReads - reads, stats->numDiskWrites - writes);
+    printf("元数据测试：名字缓存命中 %d 次，未命中 %d 次\n",
+           stats->numNameCacheHits - hits,
+           stats->numNameCacheMisses - misses);
+    fileSystem->Rmdir("mb");
+}
+
+//----------------------------------------------------------------------
+// CrashTest
+// 	Create and remove directories and files under "ct", and make the
+//	files longer, at random (but the same every time), flushing the
+//	file system now and then.  If "crashTick" isn't 0, Nachos stops
+//	dead that many ticks from now, as if the power had gone, without
+//	writing back anything it has in memory.  Then "nachos -fsck"
+//	should still find nothing wrong with the disk.
+//
+//	Files are always closed before they are removed: a file removed
+//	while it is open only gives its sectors back when it is closed,
+//	so a crash in between would lose them (as in UNIX, where fsck
+//	finds them again).
+//----------------------------------------------------------------------
+
+#define CrashSteps 300 // operations in the workload
+#define CrashDirs 4    // directories under "ct"
+#define CrashFiles 8   // files in each of them
+#define FlushEvery 25  // operations between flushes, on average
+
+static bool crashTestDone;
+
+static void
+Crash(_int arg)
+{
+    if (crashTestDone)
+        return;
+    printf("Crash test: crashed at tick %d\n", stats->totalTicks);
+    fflush(stdout);
+    Exit(0); // no Cleanup: whatever isn't on disk is lost
+}
+
+void CrashTest(int crashTick)
+{
+    char name[32], data[3 * SectorSize];
+    OpenFile *openFile;
+    int i, op, dir, file, length, start = stats->totalTicks;
+
+    crashTestDone = FALSE;
+    if (crashTick > 0)
+        interrupt->Schedule(Crash, 0, crashTick, TimerInt);
+    for (i = 0; i < (int)sizeof(data); i++)
+        data[i] = 'a' + i % 26;
+    if (!fileSystem->Mkdir("ct"))
+    {
+        printf("Crash test: can't create directory ct\n");
+        return;
+    }
+
+    for (i = 0; i < CrashSteps; i++)
+    {
+        op = Random() % 10;
+        dir = Random() % CrashDirs;
+        file = Random() % CrashFiles;
+        sprintf(name, "ct/d%d", dir);
+        if (op < 2)
+            fileSystem->Mkdir(name);
+        else if (op < 3)
+            fileSystem->Rmdir(name); // only if it is empty
+        else if (op < 5)
+        {
+            sprintf(name, "ct/d%d/f%d", dir, file);
+            fileSystem->Remove(name);
+        }
+        else
+        {
+            sprintf(name, "ct/d%d/f%d", dir, file);
+            openFile = fileSystem->Open(name);
+            if (openFile == NULL && fileSystem->Create(name, 0))
+                openFile = fileSystem->Open(name);
+            if (openFile != NULL)
+            {
+                length = (1 + Random() % 3) * SectorSize - Random() % 64;
+                openFile->WriteAt(data, length, openFile->Length());
+                delete openFile;
+            }
+        }
+        if (Random() % FlushEvery == 0)
+            fileSystem->Flush();
+    }
+    fileSystem->Flush();
+    synchDisk->Flush();
+    crashTestDone = TRUE;
+    printf("Crash test: workload done after %d ticks\n",
+           stats->totalTicks - start);
+}
+
+//----------------------------------------------------------------------
+// StressTest
+// 	Fork "numThreads" threads that all use the file system at once.
+//	Each creates, appends to and removes files of its own, in a
+//	directory they all share, and writes its own records into one file
+//	they all share; then we check that every file has exactly what
+//	was written to it, and that the file system is consistent on
+//	disk.  Run it with -rs, too, so that the threads are switched in
+//	the middle of things, not just while they wait for the disk.
+//----------------------------------------------------------------------
+
+#define StressSteps 40   // operations per thread
+#define StressFiles 4    // files each thread has at once, at most
+#define StressRecord 100 // bytes appended at a time (not a whole sector)
+
+static Semaphore *stressersDone;
+static int numStressers;
+static int *stressLengths; // how long each thread's files are, -1 if
+                           // they don't exist
+static int stressCreates, stressAppends, stressRemoves, stressErrors;
+
+static void
+StressRecordAt(int which, int position, char *record)
+{
+    for (int i = 0; i < StressRecord; i++)
+        record[i] = 'a' + (which * 7 + position + i) % 26;
+}
+
+static void
+StressWriter(_int which)
+{
+    char name[32], record[StressRecord];
+    int *lengths = &stressLengths[which * StressFiles];
+    OpenFile *openFile, *shared = fileSystem->Open("st/shared");
+    int i, f, position;
+
+    for (i = 0; i < StressSteps; i++)
+    {
+        f = Random() % StressFiles;
+        sprintf(name, "st/t%d_%d", (int)which, f);
+        if (lengths[f] == -1)
+        {
+            if (fileSystem->Create(name, 0))
+                lengths[f] = 0;
+            else
+                stressErrors++;
+            stressCreates++;
+        }
+        else if (Random() % 4 == 0)
+        {
+            if (!fileSystem->Remove(name))
+                stressErrors++;
+            lengths[f] = -1;
+            stressRemoves++;
+        }
+        else
+        {
+            openFile = fileSystem->Open(name);
+            StressRecordAt(which, lengths[f], record);
+            if (openFile == NULL ||
+                openFile->WriteAt(record, StressRecord, lengths[f]) !=
+                    StressRecord)
+                stressErrors++;
+            else
+                lengths[f] += StressRecord;
+            delete openFile;
+            stressAppends++;
+        }
+
+        // our record in the shared file, past where the others are
+        // writing theirs
+        position = (i * numStressers + which) * StressRecord;
+        StressRecordAt(which, position, record);
+        if (shared == NULL ||
+            shared->WriteAt(record, StressRecord, position) != StressRecord)
+            stressErrors++;
+    }
+    delete shared;
+    stressersDone->V();
+}
+
+//----------------------------------------------------------------------
+// StressCheck
+// 	Check that "length" bytes at "position" in "openFile" are the
+//	records thread "which" wrote there.  Return TRUE if they are.
+//----------------------------------------------------------------------
+
+static bool
+StressCheck(OpenFile *openFile, int which, int position, int length)
+{
+    char expected[StressRecord], record[StressRecord];
+
+    for (; length > 0; position += StressRecord, length -= StressRecord)
+    {
+        StressRecordAt(which, position, expected);
+        if (openFile->ReadAt(record, StressRecord, position) != StressRecord ||
+            bcmp(record, expected, StressRecord) != 0)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+void StressTest(int numThreads)
+{
+    char name[32];
+    OpenFile *openFile;
+    int i, f, start = stats->totalTicks, bad = 0;
+
+    if (!fileSystem->Mkdir("st") || !fileSystem->Create("st/shared", 0))
+    {
+        printf("Stress test: can't create st/shared\n");
+        return;
+    }
+    numStressers = numThreads;
+    stressLengths = new int[numThreads * StressFiles];
+    for (i = 0; i < numThreads * StressFiles; i++)
+        stressLengths[i] = -1;
+    stressCreates = stressAppends = stressRemoves = stressErrors = 0;
+    stressersDone = new Semaphore("stressers done", 0);
+
+    for (i = 0; i < numThreads; i++)
+    {
+        Thread *t = new Thread("stresser");
+        t->Fork(StressWriter, i);
+    }
+    for (i = 0; i < numThreads; i++)
+        stressersDone->P();
+
+    // every file should have just what its thread wrote to it
+    for (i = 0; i < numThreads; i++)
+        for (f = 0; f < StressFiles; f++)
+        {
+            sprintf(name, "st/t%d_%d", i, f);
+            openFile = fileSystem->Open(name);
+            if ((openFile == NULL) != (stressLengths[i * StressFiles + f] == -1) ||
+                (openFile != NULL &&
+                 (openFile->Length() != stressLengths[i * StressFiles + f] ||
+                  !StressCheck(openFile, i, 0, openFile->Length()))))
+                bad++;
+            delete openFile;
+        }
+    openFile = fileSystem->Open("st/shared");
+    for (f = 0; f < StressSteps; f++)
+        for (i = 0; i < numThreads; i++)
+            if (!StressCheck(openFile, i, (f * numThreads + i) * StressRecord,
+                             StressRecord))
+                bad++;
+    delete openFile;
+
+    printf("压力测试：%d 个线程，创建 %d 次，追加 %d 次，删除 %d 次，"
+           "模拟时间 %d ticks\n", numThreads, stressCreates, stressAppends,
+           stressRemoves, stats->totalTicks - start);
+    printf("压力测试：操作失败 %d 次，内容不对的文件或记录 %d 个\n",
+           stressErrors, bad);
+    fileSystem->Flush();
+    fileSystem->Check();
+
+    for (i = 0; i < numThreads; i++)
+        for (f = 0; f < StressFiles; f++)
+        {
+            sprintf(name, "st/t%d_%d", i, f);
+            fileSystem->Remove(name);
+        }
+    fileSystem->Remove("st/shared");
+    fileSystem->Rmdir("st");
+    delete stressersDone;
+    delete[] stressLengths;
+}
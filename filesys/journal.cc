@@ -0,0 +1,639 @@
+// journal.cc
+//	Routines to log changes to the file system's own data before
+//	they are made, so that a crash can't leave it half changed.
+//
+//	A file system operation changes several sectors -- creating a
+//	file changes the free map, the new file's header, and a block of
+//	its directory -- and any of those writes may be the last one to
+//	reach the disk before a crash.  So nothing reaches the disk until
+//	it is all in the log; then the changes are let through to the
+//	disk cache, which writes them to their places whenever it likes
+//	("checkpointing").  The log can only be started again once they
+//	all have been.
+//
+//	Changes are batched: the log is only written once enough sectors
+//	have changed, or somebody wants the changes to be safe (Sync).  A
+//	batch can't be written in pieces, so it must fit in the log: an
+//	operation doesn't start until there is room in the batch for all
+//	it may change (it says how much, when it begins), and for what
+//	the operations already under way may still change.  A
+//	sector that is changed many times in a batch -- the free map, or
+//	a directory that a lot of files are being created in -- is only
+//	logged once.  The records for a batch are written one after the
+//	other, but to every other sector of the log's tracks: once the
+//	disk has written a sector, the head is already over the next one,
+//	and waiting for that to come round again would cost a whole
+//	rotation.
+//
+//	Sectors that are freed (by removing a file) are not given back to
+//	the free map until the batch that frees them is committed: until
+//	then, a crash would bring the file back, and the sectors mustn't
+//	have been used for something else meanwhile.  They are "revoked"
+//	too, so that an old change to them that is still on its way to
+//	the disk can't land on top of the file data they are used for
+//	next.  After a crash, though, redoing a change from the log can
+//	still do that; as in UNIX file systems run without data
+//	journaling, only the file system's own data is sure to be right
+//	after a crash.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "journal.h"
+#include "synchdisk.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// LogSlots
+// 	Return how many sectors of the log it takes to commit a batch of
+//	"numSectors" changed sectors: the sectors, and the descriptors
+//	listing them.
+//----------------------------------------------------------------------
+
+static int
+LogSlots(int numSectors)
+{
+    return numSectors + divRoundUp(numSectors, (int)LogPerDescriptor);
+}
+
+//----------------------------------------------------------------------
+// LogSector
+// 	Return the disk sector of the "slot"th sector of the log.  On each
+//	track, the slots take the even sectors first, then the odd ones.
+//----------------------------------------------------------------------
+
+static int
+LogSector(int slot)
+{
+    int track = slot / SectorsPerTrack;
+    int i = 2 * (slot % SectorsPerTrack);
+
+    return LogStart + track * SectorsPerTrack
+		    + i % SectorsPerTrack + i / SectorsPerTrack;
+}
+
+//----------------------------------------------------------------------
+// Checksum
+// 	Add "numBytes" bytes at "data" into the running checksum "sum".
+//----------------------------------------------------------------------
+
+static unsigned int
+Checksum(char *data, int numBytes, unsigned int sum)
+{
+    for (int i = 0; i < numBytes; i++)
+	sum = ((sum << 1) | (sum >> 31)) + (unsigned char)data[i];
+    return sum;
+}
+
+//----------------------------------------------------------------------
+// Transaction::Transaction
+// 	Initialize an empty batch of changes.
+//----------------------------------------------------------------------
+
+Transaction::Transaction()
+{
+    numSectors = 0;
+    numFreed = 0;
+    for (int i = 0; i < NumSectors; i++) {
+	image[i] = NULL;
+	revoked[i] = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Transaction::~Transaction
+// 	De-allocate a batch of changes.
+//----------------------------------------------------------------------
+
+Transaction::~Transaction()
+{
+    Clear();
+}
+
+//----------------------------------------------------------------------
+// Transaction::Add
+// 	Add "sector" to the batch, and return where its new contents go.
+//	It must not be in the batch already.
+//----------------------------------------------------------------------
+
+char *
+Transaction::Add(int sector)
+{
+    ASSERT(sector >= 0 && sector < NumSectors && image[sector] == NULL);
+    image[sector] = new char[SectorSize];
+    revoked[sector] = FALSE;
+    sectors[numSectors++] = sector;
+    return image[sector];
+}
+
+//----------------------------------------------------------------------
+// Transaction::Drop
+// 	Take "sector" out of the batch, if it is there.
+//----------------------------------------------------------------------
+
+void
+Transaction::Drop(int sector)
+{
+    int i;
+
+    if (image[sector] == NULL)
+	return;
+    for (i = 0; sectors[i] != sector; i++)
+	;
+    for (numSectors--; i < numSectors; i++)
+	sectors[i] = sectors[i + 1];
+    delete [] image[sector];
+    image[sector] = NULL;
+}
+
+//----------------------------------------------------------------------
+// Transaction::Clear
+// 	Make the batch empty.
+//----------------------------------------------------------------------
+
+void
+Transaction::Clear()
+{
+    for (int i = 0; i < numSectors; i++) {
+	delete [] image[sectors[i]];
+	image[sectors[i]] = NULL;
+	revoked[sectors[i]] = FALSE;
+    }
+    numSectors = 0;
+    numFreed = 0;
+}
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Initialize the journal, with nothing changed.  Format or Recover
+//	must be called before anything else, to find out where the log
+//	is up to.
+//----------------------------------------------------------------------
+
+Journal::Journal()
+{
+    running = new Transaction;
+    spare = new Transaction;
+    committing = NULL;
+    updates = 0;
+    reserved = 0;
+    locked = FALSE;
+    nextSlot = 1;
+    nextSequence = 1;
+    for (int i = 0; i < NumSectors; i++)
+	held[i] = FALSE;
+    freeMap = NULL;
+    lock = new Lock("journal");
+    changed = new Condition("journal changed");
+    ASSERT(1 + LogSlots(MaxBatchSectors) <= LogSectors);
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.  Changes that haven't been committed are
+//	lost.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    delete running;
+    delete spare;
+    delete lock;
+    delete changed;
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Write an empty log, on a disk that is being formatted.  If there
+//	was a log on it already, its records mustn't look like the new
+//	log's, so we carry on from past any sequence number they could
+//	have.
+//----------------------------------------------------------------------
+
+void
+Journal::Format()
+{
+    char buf[SectorSize];
+    LogHeader *header = (LogHeader *)buf;
+
+    synchDisk->ReadFromDisk(LogSector(0), buf);
+    if (header->magic == LogMagic)
+	nextSequence = header->sequence + LogSectors;
+    else
+	nextSequence = 1;
+    Checkpoint();
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	Read the log, from the start, and redo every batch of changes
+//	whose records were all completely written; stop at the first
+//	record that wasn't.  Then write everything out, and start the
+//	log again.  Called when the disk is mounted, before the file
+//	system reads anything.
+//----------------------------------------------------------------------
+
+void
+Journal::Recover()
+{
+    char buf[SectorSize];
+    LogHeader *header = (LogHeader *)buf;
+    LogDescriptor desc;
+    unsigned int sum;
+    int i, slot = 1, redone = 0;
+    bool whole;
+
+    synchDisk->ReadFromDisk(LogSector(0), buf);
+    ASSERT(header->magic == LogMagic);	// not formatted with a log?
+    nextSequence = header->sequence;
+
+    while (slot < LogSectors) {
+	synchDisk->ReadFromDisk(LogSector(slot), (char *)&desc);
+	if (desc.magic != LogMagic || desc.sequence != nextSequence
+		|| desc.numSectors <= 0
+		|| desc.numSectors > (int)LogPerDescriptor
+		|| slot + 1 + desc.numSectors > LogSectors)
+	    break;			// the end of the log
+	sum = desc.checksum;
+	desc.checksum = 0;
+	desc.checksum = Checksum((char *)&desc, sizeof(LogDescriptor), 0);
+	whole = TRUE;
+	for (i = 0; i < desc.numSectors; i++) {
+	    if (desc.sectors[i] < 0 || desc.sectors[i] >= NumSectors) {
+		whole = FALSE;
+		break;
+	    }
+	    synchDisk->ReadFromDisk(LogSector(slot + 1 + i), buf);
+	    desc.checksum = Checksum(buf, SectorSize, desc.checksum);
+	    if (running->Find(desc.sectors[i]) == NULL)
+		running->Add(desc.sectors[i]);
+	    bcopy(buf, running->Find(desc.sectors[i]), SectorSize);
+	}
+	if (!whole || desc.checksum != sum)
+	    break;			// torn: the crash was while writing it
+	slot += 1 + desc.numSectors;
+	nextSequence++;
+	if (desc.last) {		// a whole batch: redo it
+	    Apply(running);
+	    running->Clear();
+	    redone++;
+	}
+    }
+    running->Clear();			// (the rest of a batch that wasn't)
+    DEBUG('f', "Journal: redid %d batches of changes\n", redone);
+    Checkpoint();
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start an operation that changes the file system, and at most
+//	"numSectors" sectors of it.  If the running batch is big enough,
+//	commit it first; and if it is about to be committed, or hasn't
+//	room for that many more, wait until it has been, so that the
+//	operation's changes are all in the same batch.
+//
+//	Operations may be nested (removing a file closes its header,
+//	writing a directory makes its file longer, ...); only the
+//	outermost one counts.
+//----------------------------------------------------------------------
+
+void
+Journal::Begin(int numSectors)
+{
+    if (currentThread->journalDepth++ > 0)
+	return;
+    ASSERT(numSectors <= MaxBatchSectors);
+    lock->Acquire();
+    if (running->numSectors >= CommitSectors)
+	Commit();
+    while (locked
+	    || running->numSectors + reserved + numSectors > MaxBatchSectors) {
+	if (!locked && updates == 0)
+	    Commit();
+	else
+	    changed->Wait(lock);
+    }
+    updates++;
+    reserved += numSectors;
+    currentThread->journalRoom = numSectors;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	End an operation started with Begin.
+//----------------------------------------------------------------------
+
+void
+Journal::End()
+{
+    ASSERT(currentThread->journalDepth > 0);
+    if (--currentThread->journalDepth > 0)
+	return;
+    lock->Acquire();
+    reserved -= currentThread->journalRoom;	// (what it didn't change)
+    currentThread->journalRoom = 0;
+    updates--;
+    changed->Broadcast(lock);		// (there may be room for more now)
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Reserve
+// 	Let the operation in progress change "numSectors" more sectors
+//	than it said it would, if the running batch has room for them.
+//	Doesn't wait: if there isn't room, return FALSE, and the
+//	operation must do without.
+//----------------------------------------------------------------------
+
+bool
+Journal::Reserve(int numSectors)
+{
+    bool room;
+
+    ASSERT(currentThread->journalDepth > 0);
+    lock->Acquire();
+    room = (running->numSectors + reserved + numSectors <= MaxBatchSectors);
+    if (room) {
+	reserved += numSectors;
+	currentThread->journalRoom += numSectors;
+    }
+    lock->Release();
+    return room;
+}
+
+//----------------------------------------------------------------------
+// Journal::ReadSector
+// 	Read the latest contents of a sector: as changed in the running
+//	batch, or in the one being committed, or if neither has changed
+//	it, through the disk cache.
+//----------------------------------------------------------------------
+
+void
+Journal::ReadSector(int sectorNumber, char* data)
+{
+    char *image;
+
+    lock->Acquire();
+    image = running->Find(sectorNumber);
+    if (image == NULL && committing != NULL
+		&& !committing->revoked[sectorNumber])
+	image = committing->Find(sectorNumber);
+    if (image != NULL) {
+	bcopy(image, data, SectorSize);
+	lock->Release();
+	return;
+    }
+    lock->Release();
+    synchDisk->ReadSector(sectorNumber, data);
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteSector
+// 	Change the whole of a sector, in the running batch.  Must be
+//	called between Begin and End.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteSector(int sectorNumber, char* data)
+{
+    ASSERT(currentThread->journalDepth > 0);
+    lock->Acquire();
+    if (running->Find(sectorNumber) == NULL)
+	Add(sectorNumber);
+    bcopy(data, running->Find(sectorNumber), SectorSize);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteBytes
+// 	Change "numBytes" bytes of a sector, starting "offset" bytes into
+//	it, in the running batch.  If the batch hasn't changed the sector
+//	yet, it starts from its latest contents -- or zeroes, if the
+//	sector is "fresh" (just allocated).  Must be called between Begin
+//	and End.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteBytes(int sectorNumber, char* from, int offset, int numBytes,
+		    bool fresh)
+{
+    char *image;
+
+    ASSERT(currentThread->journalDepth > 0);
+    ASSERT(offset >= 0 && numBytes >= 0 && offset + numBytes <= SectorSize);
+    lock->Acquire();
+    image = running->Find(sectorNumber);
+    if (image == NULL) {
+	image = Add(sectorNumber);
+	if (fresh)
+	    bzero(image, SectorSize);
+	else if (committing != NULL && committing->Find(sectorNumber) != NULL
+		    && !committing->revoked[sectorNumber])
+	    bcopy(committing->Find(sectorNumber), image, SectorSize);
+	else
+	    synchDisk->ReadSector(sectorNumber, image);
+    }
+    bcopy(from, &image[offset], numBytes);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Add
+// 	Add "sectorNumber" to the running batch, as one of the sectors
+//	the operation in progress said it may change, and return where
+//	its new contents go.  Called with the lock held.
+//----------------------------------------------------------------------
+
+char *
+Journal::Add(int sectorNumber)
+{
+    ASSERT(currentThread->journalRoom > 0);	// changing more than it
+						// said it would?
+    currentThread->journalRoom--;
+    reserved--;
+    return running->Add(sectorNumber);
+}
+
+//----------------------------------------------------------------------
+// Journal::Free
+// 	"sectorNumber" is no longer used: forget any change to it that
+//	hasn't reached the disk cache yet, and clear it in "map"
+//	once the running batch has been committed.  Until then it stays
+//	marked there, and is Held.  Must be called between Begin and End.
+//----------------------------------------------------------------------
+
+void
+Journal::Free(BitMap *map, int sectorNumber)
+{
+    ASSERT(currentThread->journalDepth > 0);
+    ASSERT(map->Test(sectorNumber) && !held[sectorNumber]);
+    lock->Acquire();
+    freeMap = map;
+    running->Drop(sectorNumber);
+    if (committing != NULL && committing->Find(sectorNumber) != NULL)
+	committing->revoked[sectorNumber] = TRUE;
+    running->freed[running->numFreed++] = sectorNumber;
+    held[sectorNumber] = TRUE;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Sync
+// 	Commit every change made so far, and return once they are all in
+//	the log.  Whoever else wants to Sync in the meantime waits for
+//	the same commit.  Must not be called in the middle of an
+//	operation.
+//----------------------------------------------------------------------
+
+void
+Journal::Sync()
+{
+    ASSERT(currentThread->journalDepth == 0);
+    lock->Acquire();
+    Commit();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Write the running batch to the log, and then let its changes
+//	through to the disk cache.  Called with the lock held.
+//
+//	Only one batch is committed at a time.  No operation may start
+//	until the ones in progress have ended; then the batch is taken
+//	out of the way, and operations carry on with a new one while it
+//	is written out.
+//----------------------------------------------------------------------
+
+void
+Journal::Commit()
+{
+    while (locked || committing != NULL)
+	changed->Wait(lock);
+    if (running->numSectors == 0)
+	return;
+    locked = TRUE;
+    while (updates > 0)
+	changed->Wait(lock);
+    committing = running;
+    running = spare;
+    spare = NULL;
+    locked = FALSE;
+    changed->Broadcast(lock);
+    lock->Release();
+
+    WriteRecords(committing);
+    Apply(committing);
+
+    lock->Acquire();
+    Release(committing);
+    committing->Clear();
+    spare = committing;
+    committing = NULL;
+    changed->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteRecords
+// 	Write a batch of changes to the log, as many records as it takes,
+//	starting the log again first if they don't fit after what is in
+//	it.  (Begin sees to it that a batch fits in an empty log.)
+//----------------------------------------------------------------------
+
+void
+Journal::WriteRecords(Transaction *trans)
+{
+    LogDescriptor desc;
+    int i, j, n = trans->numSectors;
+
+    ASSERT(n <= MaxBatchSectors);
+    if (nextSlot + LogSlots(n) > LogSectors)
+	Checkpoint();
+
+    for (i = 0; i < n; i += desc.numSectors) {
+	desc.magic = LogMagic;
+	desc.sequence = nextSequence++;
+	desc.numSectors = min(n - i, (int)LogPerDescriptor);
+	desc.last = (i + desc.numSectors == n);
+	desc.checksum = 0;
+	for (j = 0; j < (int)LogPerDescriptor; j++)
+	    desc.sectors[j] = (j < desc.numSectors) ? trans->sectors[i + j]
+						    : -1;
+	desc.checksum = Checksum((char *)&desc, sizeof(LogDescriptor), 0);
+	for (j = 0; j < desc.numSectors; j++)
+	    desc.checksum = Checksum(trans->image[trans->sectors[i + j]],
+				     SectorSize, desc.checksum);
+
+	synchDisk->WriteToDisk(LogSector(nextSlot), (char *)&desc);
+	for (j = 0; j < desc.numSectors; j++)
+	    synchDisk->WriteToDisk(LogSector(nextSlot + 1 + j),
+				   trans->image[trans->sectors[i + j]]);
+	nextSlot += 1 + desc.numSectors;
+    }
+    stats->numJournalCommits++;
+    stats->numJournalSectors += n;
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Make sure every change in the log is in its place on disk, and
+//	then make the log empty, by writing a new header: the records
+//	after it have old sequence numbers now.
+//----------------------------------------------------------------------
+
+void
+Journal::Checkpoint()
+{
+    char buf[SectorSize];
+    LogHeader *header = (LogHeader *)buf;
+
+    synchDisk->Flush();
+    bzero(buf, SectorSize);
+    header->magic = LogMagic;
+    header->sequence = nextSequence;
+    synchDisk->WriteToDisk(LogSector(0), buf);
+    nextSlot = 1;
+    stats->numCheckpoints++;
+}
+
+//----------------------------------------------------------------------
+// Journal::Apply
+// 	Let the changes in a committed batch through to the disk cache,
+//	except to sectors that have been revoked since.
+//----------------------------------------------------------------------
+
+void
+Journal::Apply(Transaction *trans)
+{
+    int sector;
+
+    for (int i = 0; i < trans->numSectors; i++) {
+	sector = trans->sectors[i];
+	lock->Acquire();
+	if (!trans->revoked[sector])
+	    synchDisk->WriteSector(sector, trans->image[sector]);
+	lock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// Journal::Release
+// 	Give the sectors freed by a committed batch back to the free map.
+//	Called with the lock held.
+//----------------------------------------------------------------------
+
+void
+Journal::Release(Transaction *trans)
+{
+    int sector;
+
+    for (int i = 0; i < trans->numFreed; i++) {
+	sector = trans->freed[i];
+	ASSERT(held[sector]);
+	freeMap->Clear(sector);
+	held[sector] = FALSE;
+    }
+}
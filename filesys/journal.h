@@ -0,0 +1,165 @@
+// journal.h
+//	Data structures for the file system's write-ahead metadata journal
+//	(in database terms, a redo log).
+//
+//	Every change to the file system's own data -- file headers and
+//	their indirect blocks, directories, the free map -- is made to a
+//	copy of the sector kept by the journal, not to the disk.  The
+//	changes made by a batch of file system operations are then
+//	written together, in one go, to a log on a reserved part of the
+//	disk; only once they are all safely there are they let through to
+//	the disk cache, to go to their real place on disk whenever it
+//	suits the cache.  If Nachos crashes, the changes in the log are
+//	written to their places again when the disk is next mounted, so
+//	that each operation either happened completely or not at all.
+//
+//	The data in ordinary files is not logged.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "disk.h"
+#include "bitmap.h"
+#include "synch.h"
+
+// The log takes up two whole tracks in the middle of the disk, so that
+// getting to it from anywhere is at most half a seek across the disk.
+// Sector LogStart holds a LogHeader; the rest of the log is filled
+// with records, from the start, until there isn't room for the next
+// one -- then everything in it is checkpointed (written to its place
+// on disk), and the log starts again from the beginning.
+
+#define LogSectors	(2 * SectorsPerTrack)
+#define LogStart	((NumTracks / 2 - 1) * SectorsPerTrack)
+#define CommitSectors	24	// commit once a batch has changed this
+				// many sectors
+#define MaxBatchSectors	60	// the most a batch may change: that
+				// many, and their descriptors, fill an
+				// empty log
+#define OpSectors	10	// the most an operation may change,
+				// unless it says otherwise
+
+// A record in the log is a LogDescriptor, followed by the sectors it
+// lists.  A batch of changes takes as many records as it needs; the
+// last one is marked, and is what commits the batch.  The checksum
+// tells a record that was completely written from one that wasn't.
+
+#define LogMagic	0x4a524e4c	// marks the log's sectors
+#define LogPerDescriptor ((SectorSize - 5 * sizeof(int)) / sizeof(int))
+
+class LogHeader {
+  public:
+    int magic;
+    int sequence;		// sequence number of the first record
+};
+
+class LogDescriptor {
+  public:
+    int magic;
+    int sequence;		// one more than the previous record's
+    int numSectors;		// how many sectors follow
+    int last;			// the last record of a batch?
+    unsigned int checksum;	// of all of the above, and the sectors
+    int sectors[LogPerDescriptor];	// where each sector belongs
+};
+
+// A batch of changes: the new contents of every sector it has changed.
+
+class Transaction {
+  public:
+    Transaction();
+    ~Transaction();
+
+    char *Find(int sector) { return image[sector]; }
+    char *Add(int sector);		// make room for a sector's contents
+    void Drop(int sector);		// forget a sector
+    void Clear();			// forget every sector
+
+    int numSectors;
+    int sectors[NumSectors];		// the sectors changed, in order
+    char *image[NumSectors];		// the new contents of each, or NULL
+    bool revoked[NumSectors];		// freed since it was committed, so
+					//  the contents are not to be used
+    int numFreed;
+    int freed[NumSectors];		// the sectors it frees
+};
+
+// The following class defines the journal.  Operations that change the
+// file system call Begin and End around the changes, and make them with
+// ReadSector, WriteSector and WriteBytes instead of the SynchDisk ones.
+// Any number of threads may be doing that at once; their changes all go
+// into the same batch, which is committed (written to the log) once it
+// is big enough, or when somebody calls Sync.  The batch is only
+// committed between operations, never in the middle of one -- so each
+// operation says, when it begins, how many sectors it may change, and
+// only starts once the batch has room for them, as well as for what
+// the operations in progress may still change.
+
+class Journal {
+  public:
+    Journal();				// Initialize the journal
+    ~Journal();				// De-allocate it (Sync it first!)
+
+    void Format();			// Make the log empty
+    void Recover();			// Redo everything committed to the log
+					// that may not have reached its place
+
+    void Begin(int numSectors = OpSectors);
+					// Start an operation, that changes at
+					// most "numSectors" sectors; they may
+					// nest
+    void End();				// End it
+    bool Reserve(int numSectors);	// Let the operation in progress
+					// change "numSectors" more, if the
+					// batch has room for them
+
+    void ReadSector(int sectorNumber, char* data);
+    void WriteSector(int sectorNumber, char* data);
+    void WriteBytes(int sectorNumber, char* from, int offset, int numBytes,
+		    bool fresh);	// Read/write part of the file system's
+					// own data, as SynchDisk does
+    void Free(BitMap *map, int sectorNumber);
+					// Give a sector back to "map",
+					// once the batch freeing it is
+					// committed
+    bool Held(int sectorNumber) { return held[sectorNumber]; }
+					// Freed, but not given back yet?
+
+    void Sync();			// Commit every change made so far, and
+					// wait until it is in the log
+
+  private:
+    Transaction *running;		// changes being made
+    Transaction *committing;		// changes being written to the log,
+					// NULL if none
+    Transaction *spare;			// the other one
+    int updates;			// operations in progress
+    int reserved;			// sectors they may still change
+    bool locked;			// no operation may start, until the
+					// running batch is committed
+    int nextSlot;			// where the next record goes in the log
+    int nextSequence;			// sequence number it gets
+    bool held[NumSectors];		// sectors being freed
+    BitMap *freeMap;			// what they go back to
+    Lock *lock;				// protects all of the above
+    Condition *changed;			// signalled when an operation ends,
+					// or a commit is over
+
+    char *Add(int sectorNumber);	// Add a sector to the running batch,
+					// out of the operation's reservation
+    void Commit();			// Write the running batch to the log
+    void WriteRecords(Transaction *trans);
+					// The records for a batch
+    void Checkpoint();			// Make the log empty again, once
+					// every change in it is in place
+    void Apply(Transaction *trans);	// Let committed changes go to disk
+    void Release(Transaction *trans);	// Give back what it freed
+};
+
+#endif // JOURNAL_H
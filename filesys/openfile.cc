@@ -5,7 +5,21 @@
 //	the OpenFile data structure).
 //
 //	Also as in UNIX, for convenience, we keep the file header in
-//	memory while the file is open.
+//	memory while the file is open.  If the file is open more than
+//	once, the OpenFiles share one header (cf. HeaderTable).
+//
+//	The files that hold the file system's own data -- the free map
+//	and the directories -- are read and written through the journal
+//	(cf. journal.h); other files go straight to the disk cache.
+//
+//	Any number of threads may read and write the same file at once,
+//	through ReadAt and WriteAt: each holds the file's lock (shared by
+//	all its OpenFiles) while it does -- for reading, along with any
+//	other readers; for writing, alone.  The file system's own files
+//	are locked by their callers instead -- a directory by whoever is
+//	looking in it or changing it, the free map by the file system.
+//	An OpenFile's seek position is its own, and Read and Write are
+//	not meant for threads that share an OpenFile.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -22,24 +36,72 @@
 //	into memory while the file is open.
 //
 //	"sector" -- the location on disk of the file header for this file
+//	"isJournaled" -- is it the free map or a directory?
 //----------------------------------------------------------------------
 
-OpenFile::OpenFile(int sector)
+OpenFile::OpenFile(int sector, bool isJournaled)
 {
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
+    hdr = headerTable->Open(sector);
     hdrSector = sector;
+    lock = headerTable->FileLock(sector);
+    journaled = isJournaled;
     seekPosition = 0;
+    lastReadSector = lastWriteSector = prefetchedTo = -1;
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	The header is written back if this was the last OpenFile for the
+//	file, and it has changed.
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
-    delete hdr;
+    headerTable->Close(hdrSector);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Acquire, OpenFile::Release
+// 	Lock or unlock the file, so that nobody else reads or changes it
+//	meanwhile.  ReadAt and WriteAt do this themselves, except for the
+//	file system's own files.
+//----------------------------------------------------------------------
+
+void OpenFile::Acquire()
+{
+    lock->AcquireWrite();
+}
+
+void OpenFile::Release()
+{
+    lock->ReleaseWrite();
+}
+
+//----------------------------------------------------------------------
+// OpenFile::AcquireShared, OpenFile::ReleaseShared
+// 	Lock or unlock the file so that nobody changes it meanwhile, but
+//	others may read it too.
+//----------------------------------------------------------------------
+
+void OpenFile::AcquireShared()
+{
+    lock->AcquireRead();
+}
+
+void OpenFile::ReleaseShared()
+{
+    lock->ReleaseRead();
+}
+
+//----------------------------------------------------------------------
+// OpenFile::IsRemoved
+// 	Has the file been removed (while we had it open)?
+//----------------------------------------------------------------------
+
+bool OpenFile::IsRemoved()
+{
+    return headerTable->Removed(hdrSector);
 }
 
 //----------------------------------------------------------------------
@@ -94,12 +156,19 @@ int OpenFile::Write(char *into, int numBytes)
 //
 //	For ReadAt:
 //	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	   request, but we only copy the part we are interested in.  If this
+//	   read starts where the last one ended, we ask for the next few
+//	   sectors to be read ahead.
 //	For WriteAt:
 //	   We must first read in any sectors that will be partially written,
 //	   so that we don't overwrite the unmodified portion.  We then copy
 //	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   or partial sectors that are part of the request.  Sectors past
+//	   the old end of the file have nothing in them worth reading.
+//	   Partial sectors are modified in place, in the disk cache.  If
+//	   this write starts past the sector the last one ended in, that
+//	   sector is done with, and is written out behind us.  If it
+//	   starts past the end of the file, the gap is filled with zeroes.
 //
 //	"into" -- the buffer to contain the data to be read from disk
 //	"from" -- the buffer containing the data to be written to disk
@@ -109,6 +178,39 @@ int OpenFile::Write(char *into, int numBytes)
 //----------------------------------------------------------------------
 
 int OpenFile::ReadAt(char *into, int numBytes, int position)
+{
+    int result;
+
+    if (journaled)
+        return ReadLocked(into, numBytes, position);
+    lock->AcquireRead();
+    result = ReadLocked(into, numBytes, position);
+    lock->ReleaseRead();
+    return result;
+}
+
+int OpenFile::WriteAt(char *from, int numBytes, int position)
+{
+    int result;
+
+    if (journaled)
+        return WriteLocked(from, numBytes, position);
+    // (in case the file grows: its header, its indirect blocks and the
+    // free map may change) before the lock
+    journal->Begin(1 + HeaderSectors(min(position + numBytes, MaxFileSize)));
+    lock->AcquireWrite();
+    result = WriteLocked(from, numBytes, position);
+    lock->ReleaseWrite();
+    journal->End();
+    return result;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadLocked, OpenFile::WriteLocked
+// 	ReadAt and WriteAt, with the file locked.
+//----------------------------------------------------------------------
+
+int OpenFile::ReadLocked(char *into, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
@@ -125,11 +227,24 @@ int OpenFile::ReadAt(char *into, int numBytes, int position)
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
 
+    // sequential?  then we will want the next few sectors soon
+    if (firstSector == lastReadSector || firstSector == lastReadSector + 1)
+    {
+        int last = divRoundDown(fileLength - 1, SectorSize);
+        if (lastSector + ReadAhead < last)
+            last = lastSector + ReadAhead;
+        for (i = max(lastSector, prefetchedTo) + 1; i <= last; i++)
+            synchDisk->Prefetch(hdr->ByteToSector(i * SectorSize));
+        if (last > prefetchedTo)
+            prefetchedTo = last;
+    }
+    lastReadSector = lastSector;
+
     // read in all the full and partial sectors that we need
     buf = new char[numSectors * SectorSize];
     for (i = firstSector; i <= lastSector; i++)
-        synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize),
-                              &buf[(i - firstSector) * SectorSize]);
+        ReadSector(hdr->ByteToSector(i * SectorSize),
+                   &buf[(i - firstSector) * SectorSize]);
 
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
@@ -137,58 +252,118 @@ int OpenFile::ReadAt(char *into, int numBytes, int position)
     return numBytes;
 }
 
-int OpenFile::WriteAt(char *from, int numBytes, int position)
+int OpenFile::WriteLocked(char *from, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
-    char *buf;
+    int oldLength = fileLength;
+    int i, firstSector, lastSector, first, last;
+    static char zeros[SectorSize];
 
-    if (numBytes < 0)
+    if (numBytes <= 0)
         return 0; // check request
 
-    if (seekPosition >= fileLength)
+    if (position + numBytes > fileLength)
     {
-        BitMap *freeMap = new BitMap(NumSectors);
-        OpenFile *freeMapFile = new OpenFile(NULL);
-        freeMap->FetchFrom(freeMapFile);
-        hdr->SetLength(freeMap, seekPosition + numBytes);
-        fileLength = hdr->FileLength();
-        freeMap->WriteBack(freeMapFile);
-        delete freeMap;
+        fileLength = Extend(position + numBytes);
+        if (fileLength < 0)
+            return 0; // 文件已达最大长度，或磁盘已满
     }
 
-    if (fileLength == 0)
-        return 0;
+    // writing past the end?  then zero the gap between the old end and
+    // "position", so that whatever was on those sectors doesn't show
+    for (i = divRoundDown(oldLength, SectorSize);
+         position > oldLength && i * SectorSize < position; i++)
+    {
+        first = max(oldLength, i * SectorSize);
+        last = min(position, (i + 1) * SectorSize);
+        WriteBytes(hdr->ByteToSector(first), zeros, first - i * SectorSize,
+                   last - first, i * SectorSize >= oldLength);
+    }
 
     DEBUG('f', "Writing %d bytes at %d, from file of length %d.\n",
           numBytes, position, fileLength);
 
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
 
-    buf = new char[numSectors * SectorSize];
+    // sequential?  then we are done with the sector we were writing
+    if (lastWriteSector != -1 && firstSector == lastWriteSector + 1)
+        synchDisk->WriteBehind(hdr->ByteToSector(lastWriteSector * SectorSize));
+    lastWriteSector = lastSector;
 
-    firstAligned = (bool)(position == (firstSector * SectorSize));
-    lastAligned = (bool)((position + numBytes) == ((lastSector + 1) * SectorSize));
+    // write each sector, or the part of it we are changing
+    for (i = firstSector; i <= lastSector; i++)
+    {
+        first = max(position, i * SectorSize);
+        last = min(position + numBytes, (i + 1) * SectorSize);
+        WriteBytes(hdr->ByteToSector(first), &from[first - position],
+                   first - i * SectorSize, last - first,
+                   i * SectorSize >= oldLength);
+    }
+    return numBytes;
+}
 
-    // read in first and last sector, if they are to be partially modified
-    if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);
-    if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize],
-               SectorSize, lastSector * SectorSize);
+//----------------------------------------------------------------------
+// OpenFile::ReadSector, OpenFile::WriteBytes
+// 	Read a whole sector of the file, or write part (or all) of one,
+//	through the journal if the file is journaled, otherwise through
+//	the disk cache.  "fresh" is as for SynchDisk::WriteBytes.
+//----------------------------------------------------------------------
 
-    // copy in the bytes we want to change
-    bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
+void OpenFile::ReadSector(int sector, char *data)
+{
+    if (journaled)
+        journal->ReadSector(sector, data);
+    else
+        synchDisk->ReadSector(sector, data);
+}
 
-    // write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)
-        synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize),
-                               &buf[(i - firstSector) * SectorSize]);
-    delete[] buf;
-    return numBytes;
+void OpenFile::WriteBytes(int sector, char *from, int offset, int numBytes,
+                          bool fresh)
+{
+    if (journaled)
+    {
+        journal->Begin();
+        if (numBytes == SectorSize)
+            journal->WriteSector(sector, from);
+        else
+            journal->WriteBytes(sector, from, offset, numBytes, fresh);
+        journal->End();
+    }
+    else if (numBytes == SectorSize)
+        synchDisk->WriteSector(sector, from);
+    else
+        synchDisk->WriteBytes(sector, from, offset, numBytes, fresh);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Extend
+// 	Make the file "length" bytes long.  The file system's free map is
+//	only needed if that needs more sectors than the file already has;
+//	then the header and the free map are changed in one operation, so
+//	that a crash leaves both changed or neither.  The file must be
+//	locked.
+//
+//	Return the new length, or -1 if there isn't room.
+//----------------------------------------------------------------------
+
+int OpenFile::Extend(int length)
+{
+    int allocated = divRoundUp(hdr->FileLength(), SectorSize) * SectorSize;
+    bool grown;
+
+    if (length <= allocated)
+    {
+        hdr->SetLength(NULL, length);
+        return length;
+    }
+    journal->Begin();
+    grown = hdr->SetLength(fileSystem->AcquireFreeMap(), length);
+    if (grown)
+        hdr->WriteBack(hdrSector);
+    fileSystem->ReleaseFreeMap(grown);
+    journal->End();
+    return grown ? length : -1;
 }
 
 //----------------------------------------------------------------------
@@ -203,7 +378,13 @@ int OpenFile::Length()
 
 void OpenFile::WriteBack()
 {
+    journal->Begin();
+    if (!journaled)
+        lock->AcquireWrite();
     hdr->WriteBack(hdrSector);
+    if (!journaled)
+        lock->ReleaseWrite();
+    journal->End();
 }
 
 void OpenFile::Print()
@@ -9,9 +9,13 @@
 //
 //	The other is the "real" implementation, that turns these
 //	operations into read and write disk sector requests.
-//	In this baseline implementation of the file system, we don't
-//	worry about concurrent accesses to the file system
-//	by different threads -- this is part of the assignment.
+//	Each OpenFile watches how it is used: reads that follow on from
+//	the previous one make the disk cache read the next few sectors
+//	ahead, and once writes have moved on past a sector, it is written
+//	out behind them.  Small writes go straight into the cached sector,
+//	rather than being read, modified and written back one at a time.
+//	(They are not buffered in the OpenFile itself, since a file can be
+//	open more than once -- the free map is, for one.)
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -73,11 +77,15 @@ private:
 
 #else // FILESYS
 class FileHeader;
+class RWLock;
+
+#define ReadAhead 4 // sectors to prefetch, once reads look sequential
 
 class OpenFile
 {
 public:
-	OpenFile(int sector); // Open a file whose header is located
+	OpenFile(int sector, bool isJournaled = FALSE);
+												// Open a file whose header is located
 												// at "sector" on the disk
 	~OpenFile();					// Close the file
 
@@ -95,6 +103,13 @@ public:
 	// bypassing the implicit position.
 	int WriteAt(char *from, int numBytes, int position);
 
+	void Acquire(); // Lock/unlock the file (the free map and
+	void Release(); // directories are only locked this way)
+	void AcquireShared(); // The same, but sharing it with
+	void ReleaseShared(); // others who are only reading it
+	bool IsRemoved(); // Removed since it was opened?
+	int HeaderSector() { return hdrSector; }
+
 	int Length(); // Return the number of bytes in the
 								// file (this interface is simpler
 								// than the UNIX idiom -- lseek to
@@ -108,6 +123,23 @@ private:
 	FileHeader *hdr;	// Header for this file
 	int seekPosition; // Current position within the file
 	int hdrSector;
+	RWLock *lock;		// The file's lock (cf. HeaderTable)
+	bool journaled; // Read and written through the journal?
+
+	int lastReadSector;	 // Last sector (of the file) of the last
+										 // ReadAt, -1 if none; the same for
+	int lastWriteSector; // WriteAt
+	int prefetchedTo;		 // Last sector we have asked to prefetch
+
+	void ReadSector(int sector, char *data);
+	void WriteBytes(int sector, char *from, int offset, int numBytes,
+									bool fresh); // Through the journal, or not
+
+	int ReadLocked(char *into, int numBytes, int position);
+	int WriteLocked(char *from, int numBytes, int position);
+									// ReadAt/WriteAt, with the file locked
+
+	int Extend(int length); // Make the file at least "length" bytes
 };
 
 #endif // FILESYS
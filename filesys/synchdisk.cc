@@ -7,8 +7,14 @@
 //
 //	Use a semaphore to synchronize the interrupt handlers with the
 //	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	handle one operation at a time, queue the requests that arrive
+//	while it is busy; when it finishes one, the interrupt handler
+//	starts the next, chosen by the scheduling policy.  The queue is
+//	shared with the interrupt handler, so it is protected by
+//	disabling interrupts rather than with a lock.
+//
+//	How long each request took, from when it was made to when it was
+//	done (waiting included), is recorded in the statistics.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -16,6 +22,7 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "system.h"
 
 //----------------------------------------------------------------------
 // DiskRequestDone
@@ -31,6 +38,20 @@ DiskRequestDone (_int arg)
     dsk->RequestDone();					// disk -> dsk
 }
 
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Initialize a request to read or write a sector, made now.
+//----------------------------------------------------------------------
+
+DiskRequest::DiskRequest(int sectorNumber, char* buffer, bool write)
+    : done("disk request", 0)
+{
+    sector = sectorNumber;
+    data = buffer;
+    writing = write;
+    arrived = stats->totalTicks;
+}
+
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
 // 	Initialize the synchronous interface to the physical disk, in turn
@@ -38,13 +59,23 @@ DiskRequestDone (_int arg)
 //
 //	"name" -- UNIX file name to be used as storage for the disk data
 //	   (usually, "DISK")
+//	"cacheSize" -- number of sectors to cache, 0 for none
+//	"cachePolicy" -- how to choose which cached sector to replace
+//	"diskPolicy" -- how to choose which waiting request to do next
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk(char* name)
+SynchDisk::SynchDisk(char* name, int cacheSize, CachePolicy cachePolicy,
+		     DiskPolicy diskPolicy)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
+    policy = diskPolicy;
+    active = NULL;
+    headSector = 0;
+    goingUp = TRUE;
     disk = new Disk(name, DiskRequestDone, (_int) this);
+    if (cacheSize > 0)
+	cache = new BufferCache(this, cacheSize, cachePolicy);
+    else
+	cache = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -55,9 +86,8 @@ SynchDisk::SynchDisk(char* name)
 
 SynchDisk::~SynchDisk()
 {
+    delete cache;
     delete disk;
-    delete lock;
-    delete semaphore;
 }
 
 //----------------------------------------------------------------------
@@ -72,16 +102,17 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    if (cache != NULL)
+	cache->ReadSector(sectorNumber, data);
+    else
+	ReadFromDisk(sectorNumber, data);
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::WriteSector
 // 	Write the contents of a buffer into a disk sector.  Return only
-//	after the data has been written.
+//	after the data has been written -- with a cache, only into the
+//	cache.
 //
 //	"sectorNumber" -- the disk sector to be written
 //	"data" -- the new contents of the disk sector
@@ -90,20 +121,219 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    if (cache != NULL)
+	cache->WriteSector(sectorNumber, data);
+    else
+	WriteToDisk(sectorNumber, data);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteBytes
+// 	Write "numBytes" bytes into a disk sector, starting "offset"
+//	bytes into it.  With a cache, the bytes go straight into the
+//	sector's buffer, so that a sector written a few bytes at a time
+//	is only written to disk once.
+//
+//	"fresh" -- the sector has just been allocated, so whatever was in
+//		it doesn't have to be read in; it is zeroed instead
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteBytes(int sectorNumber, char* from, int offset, int numBytes,
+		      bool fresh)
+{
+    char data[SectorSize];
+
+    ASSERT(offset >= 0 && numBytes >= 0 && offset + numBytes <= SectorSize);
+    if (cache != NULL) {
+	cache->WriteBytes(sectorNumber, from, offset, numBytes, fresh);
+	return;
+    }
+    if (fresh)
+	bzero(data, SectorSize);
+    else
+	ReadFromDisk(sectorNumber, data);
+    bcopy(from, &data[offset], numBytes);
+    WriteToDisk(sectorNumber, data);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush
+// 	Write every sector that has been written only into the cache out
+//	to disk.  This waits for the disk, so it must be called from a
+//	thread -- not from an interrupt handler, and not once the machine
+//	has gone idle.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Flush()
+{
+    if (cache != NULL)
+	cache->Flush();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Latency
+// 	Return how long it would take to read or write a sector, from
+//	where the disk head is now.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::Latency(int sectorNumber, bool writing)
+{
+    return disk->ComputeLatency(sectorNumber, writing);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Prefetch, SynchDisk::WriteBehind
+// 	Start reading a sector into the cache, or writing a dirty one
+//	out of it, in the background.  Without a cache, do nothing.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Prefetch(int sectorNumber)
+{
+    if (cache != NULL)
+	cache->Prefetch(sectorNumber);
+}
+
+void
+SynchDisk::WriteBehind(int sectorNumber)
+{
+    if (cache != NULL)
+	cache->WriteBehind(sectorNumber);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadFromDisk
+// 	Read the contents of a disk sector into a buffer, bypassing the
+//	cache.  Return only after the data has been read.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadFromDisk(int sectorNumber, char* data)
+{
+    DiskRequest request(sectorNumber, data, FALSE);
+
+    Submit(&request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteToDisk
+// 	Write the contents of a buffer into a disk sector, bypassing the
+//	cache.  Return only after the data has been written.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteToDisk(int sectorNumber, char* data)
+{
+    DiskRequest request(sectorNumber, data, TRUE);
+
+    Submit(&request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Submit
+// 	Send a request to the disk if it is idle, otherwise queue it, and
+//	wait until it is done.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Submit(DiskRequest *request)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    if (active == NULL)
+	Start(request);
+    else
+	waiting.Append(request);
+    (void) interrupt->SetLevel(oldLevel);
+    request->done.P();			// wait for interrupt
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Start
+// 	Send a request to the disk.  Interrupts must be off.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Start(DiskRequest *request)
+{
+    ASSERT(active == NULL);
+    active = request;
+    if (request->sector != headSector)
+	goingUp = (request->sector > headSector);
+    headSector = request->sector;
+    if (request->writing)
+	disk->WriteRequest(request->sector, request->data);
+    else
+	disk->ReadRequest(request->sector, request->data);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Choose
+// 	Take the request to do next off the queue, according to the
+//	policy.  Among requests that are as good as each other, the one
+//	that has waited longest wins.  Interrupts must be off.
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::Choose()
+{
+    DiskRequest *request, *best = NULL;
+    int distance, bestDistance = 0;
+    int headTrack = headSector / SectorsPerTrack;
+
+    if (policy == DiskFCFS)
+	return waiting.Remove();
+
+    for (int pass = 0; pass < 2 && best == NULL; pass++) {
+	for (request = waiting.Front(NULL); request != NULL;
+					request = request->link.next) {
+	    switch (policy) {
+	      case DiskSSTF:
+		distance = request->sector / SectorsPerTrack - headTrack;
+		if (distance < 0)
+		    distance = -distance;
+		break;
+	      case DiskSCAN:
+		distance = goingUp ? request->sector - headSector
+				   : headSector - request->sector;
+		break;
+	      default:		// DiskCLOOK: the second time round,
+				// start again from sector 0
+		distance = (pass == 0) ? request->sector - headSector
+				       : request->sector;
+		break;
+	    }
+	    if (distance >= 0 && (best == NULL || distance < bestDistance)) {
+		best = request;
+		bestDistance = distance;
+	    }
+	}
+	if (best == NULL && policy == DiskSCAN)
+	    goingUp = !goingUp;		// nothing left this way: turn around
+    }
+    ASSERT(best != NULL);
+    waiting.RemoveItem(best);
+    return best;
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::RequestDone
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler.  Record how long the request took, start
+//	the next one, and wake up the thread waiting for this one.
 //----------------------------------------------------------------------
 
 void
 SynchDisk::RequestDone()
 { 
-    semaphore->V();
+    DiskRequest *request = active;
+
+    ASSERT(request != NULL);
+    stats->RecordDiskLatency(stats->totalTicks - request->arrived);
+    active = NULL;
+    if (!waiting.IsEmpty())
+	Start(Choose());
+    request->done.V();
 }
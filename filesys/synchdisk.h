@@ -12,7 +12,34 @@
 #define SYNCHDISK_H
 
 #include "disk.h"
+#include "ilist.h"
 #include "synch.h"
+#include "bufcache.h"
+
+// Disk scheduling policies -- which waiting request goes to the disk next:
+//   DiskFCFS  -- the one that has waited longest
+//   DiskSSTF  -- "shortest seek time first": the one on the track nearest
+//		  the head.  Requests far away can starve.
+//   DiskSCAN  -- "elevator": the nearest one in the direction the head is
+//		  moving; when there are none that way, turn around
+//   DiskCLOOK -- "circular look": the nearest one at or past the head;
+//		  when there are none, go back to the lowest
+enum DiskPolicy { DiskFCFS, DiskSSTF, DiskSCAN, DiskCLOOK };
+
+// A request waiting for, or being served by, the disk.  It lives on the
+// stack of the thread that made it, which sleeps on "done".
+
+class DiskRequest {
+  public:
+    DiskRequest(int sectorNumber, char* buffer, bool write);
+
+    int sector;
+    char* data;
+    bool writing;
+    int arrived;			// when the request was made
+    Semaphore done;			// V'ed when the disk has finished it
+    ListLink<DiskRequest> link;		// for the queue of waiting requests
+};
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -23,31 +50,69 @@
 //
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
-// returning.
+// returning.  Requests made while the disk is busy are queued, and the
+// scheduling policy decides which to do next.
+//
+// Unless it is created with a cache size of 0, sectors are cached in
+// memory (see bufcache.h).  A write then only updates the cache, and
+// the sector is written to disk later; Flush forces it out.
 class SynchDisk {
   public:
-    SynchDisk(char* name);    		// Initialize a synchronous disk,
+    SynchDisk(char* name, int cacheSize = DefaultCacheSize,
+	      CachePolicy cachePolicy = CacheLRU,
+	      DiskPolicy diskPolicy = DiskCLOOK);
+    					// Initialize a synchronous disk,
 					// by initializing the raw Disk.
     ~SynchDisk();			// De-allocate the synch disk data
     
     void ReadSector(int sectorNumber, char* data);
     					// Read/write a disk sector, returning
     					// only once the data is actually read 
-					// or written.  These call
+					// or written (into the cache, if 
+					// there is one).
+    void WriteSector(int sectorNumber, char* data);
+    void WriteBytes(int sectorNumber, char* from, int offset, int numBytes,
+		    bool fresh);	// Write part of a sector; the rest is
+					// kept, or zeroed if "fresh" (newly
+					// allocated)
+    void Flush();			// Write everything that is only in
+					// the cache to disk.  Must be called
+					// from a thread, before halting.
+    int Latency(int sectorNumber, bool writing);
+					// How long a request would take now
+    void Prefetch(int sectorNumber);	// Hints, for the cache: a sector
+    void WriteBehind(int sectorNumber);	// is likely to be read soon, or
+					// not to be written again soon
+
+    void ReadFromDisk(int sectorNumber, char* data);
+    void WriteToDisk(int sectorNumber, char* data);
+					// Bypass the cache: these call
     					// Disk::ReadRequest/WriteRequest and
 					// then wait until the request is done.
-    void WriteSector(int sectorNumber, char* data);
     
     void RequestDone();			// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
 
+    void SetPolicy(DiskPolicy how) { policy = how; }
+    bool IsBusy() { return active != NULL; }
+					// Is a request being served?
+
   private:
     Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
+    DiskPolicy policy;			// How to choose the next request
+    DiskRequest *active;		// Being served by the disk, if any
+    IntrusiveList<DiskRequest, &DiskRequest::link> waiting;
+					// Requests that have to wait for it,
+					// oldest first
+    int headSector;			// Where the last request started
+    bool goingUp;			// SCAN: the way the head is sweeping
+    BufferCache *cache;			// NULL if not caching
+
+    void Submit(DiskRequest *request);	// Do a request, waiting for the
+					// disk if need be
+    void Start(DiskRequest *request);	// Send a request to the disk
+    DiskRequest *Choose();		// Take the next request off "waiting"
 };
 
 #endif // SYNCHDISK_H
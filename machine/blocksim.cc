@@ -0,0 +1,466 @@
+// blocksim.cc -- an alternate engine for running MIPS user code
+//
+//   The reference interpreter (mipssim.cc) fetches, decodes and
+//   dispatches through a big switch for every instruction, and calls
+//   Interrupt::OneTick after each one to advance time and look for
+//   interrupts.  This engine instead:
+//
+//	- splits the code in each physical page into basic blocks:
+//	  straight-line runs ending with a branch or jump (plus its
+//	  delay slot), a syscall, or the end of the page;
+//	- threads each block through a table of per-opcode handlers,
+//	  so executing an instruction is one indirect call with no
+//	  fetch, translation or decoding;
+//	- looks at the interrupt queue once per block and charges the
+//	  block's UserTicks in one go.
+//
+//   To stay instruction-for-instruction compatible with the reference
+//   engine, a block is cut short so that no interrupt can become due in
+//   the middle of it; when one is due on the very next tick we fall
+//   back to OneInstruction/OneTick.  Instructions that don't have a
+//   specialized handler here go through Machine::ExecuteInstruction,
+//   the reference switch itself.
+//
+//   Blocks live in the same per-page tables as the decoded instruction
+//   cache, so InvalidateDecoded (stores, paging, program loading)
+//   throws them away too.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#include "machine.h"
+#include "mipssim.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// Retire
+// 	Common tail of every handler, as at the end of ExecuteInstruction:
+//	do any delayed load, and advance the program counters.
+//----------------------------------------------------------------------
+
+static inline bool
+Retire(Machine *m, int nextLoadReg, int nextLoadValue, int pcAfter)
+{
+	int *r = m->registers;
+
+	m->DelayedLoad(nextLoadReg, nextLoadValue);
+	r[PrevPCReg] = r[PCReg];
+	r[PCReg] = r[NextPCReg];
+	r[NextPCReg] = pcAfter;
+	return TRUE;
+}
+
+#define REG(x) (m->registers[(int)instr->x])
+#define NEXTPC (m->registers[NextPCReg])
+
+// Instructions with no special handler (rare or trapping ones).
+static bool
+DoGeneric(Machine *m, Instruction *instr)
+{
+	return m->ExecuteInstruction(instr);
+}
+
+static bool
+DoADDIU(Machine *m, Instruction *instr)
+{
+	REG(rt) = REG(rs) + instr->extra;
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoADDU(Machine *m, Instruction *instr)
+{
+	REG(rd) = REG(rs) + REG(rt);
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoSUBU(Machine *m, Instruction *instr)
+{
+	REG(rd) = REG(rs) - REG(rt);
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoAND(Machine *m, Instruction *instr)
+{
+	REG(rd) = REG(rs) & REG(rt);
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoANDI(Machine *m, Instruction *instr)
+{
+	REG(rt) = REG(rs) & (instr->extra & 0xffff);
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoORI(Machine *m, Instruction *instr)
+{
+	REG(rt) = REG(rs) | (instr->extra & 0xffff);
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoXOR(Machine *m, Instruction *instr)
+{
+	REG(rd) = REG(rs) ^ REG(rt);
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoXORI(Machine *m, Instruction *instr)
+{
+	REG(rt) = REG(rs) ^ (instr->extra & 0xffff);
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoNOR(Machine *m, Instruction *instr)
+{
+	REG(rd) = ~(REG(rs) | REG(rt));
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoLUI(Machine *m, Instruction *instr)
+{
+	REG(rt) = instr->extra << 16;
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoSLL(Machine *m, Instruction *instr)
+{
+	REG(rd) = REG(rt) << instr->extra;
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoSRA(Machine *m, Instruction *instr)
+{
+	REG(rd) = REG(rt) >> instr->extra;
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoSLT(Machine *m, Instruction *instr)
+{
+	REG(rd) = (REG(rs) < REG(rt)) ? 1 : 0;
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoSLTI(Machine *m, Instruction *instr)
+{
+	REG(rt) = (REG(rs) < instr->extra) ? 1 : 0;
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoSLTU(Machine *m, Instruction *instr)
+{
+	REG(rd) = ((unsigned int)REG(rs) < (unsigned int)REG(rt)) ? 1 : 0;
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoSLTIU(Machine *m, Instruction *instr)
+{
+	REG(rt) = ((unsigned int)REG(rs) < (unsigned int)instr->extra) ? 1 : 0;
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoMFHI(Machine *m, Instruction *instr)
+{
+	REG(rd) = m->registers[HiReg];
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoMFLO(Machine *m, Instruction *instr)
+{
+	REG(rd) = m->registers[LoReg];
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoLW(Machine *m, Instruction *instr)
+{
+	int addr = REG(rs) + instr->extra;
+	int value;
+
+	if (addr & 0x3)
+	{
+		m->RaiseException(AddressErrorException, addr);
+		return FALSE;
+	}
+	if (!m->ReadMem(addr, 4, &value))
+		return FALSE;
+	return Retire(m, instr->rt, value, NEXTPC + 4);
+}
+
+static bool
+DoSW(Machine *m, Instruction *instr)
+{
+	if (!m->WriteMem((unsigned)(REG(rs) + instr->extra), 4, REG(rt)))
+		return FALSE;
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoBEQ(Machine *m, Instruction *instr)
+{
+	if (REG(rs) == REG(rt))
+		return Retire(m, 0, 0, NEXTPC + IndexToAddr(instr->extra));
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoBNE(Machine *m, Instruction *instr)
+{
+	if (REG(rs) != REG(rt))
+		return Retire(m, 0, 0, NEXTPC + IndexToAddr(instr->extra));
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoBGEZ(Machine *m, Instruction *instr)
+{
+	if (!(REG(rs) & SIGN_BIT))
+		return Retire(m, 0, 0, NEXTPC + IndexToAddr(instr->extra));
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoBGTZ(Machine *m, Instruction *instr)
+{
+	if (REG(rs) > 0)
+		return Retire(m, 0, 0, NEXTPC + IndexToAddr(instr->extra));
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoBLEZ(Machine *m, Instruction *instr)
+{
+	if (REG(rs) <= 0)
+		return Retire(m, 0, 0, NEXTPC + IndexToAddr(instr->extra));
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoBLTZ(Machine *m, Instruction *instr)
+{
+	if (REG(rs) & SIGN_BIT)
+		return Retire(m, 0, 0, NEXTPC + IndexToAddr(instr->extra));
+	return Retire(m, 0, 0, NEXTPC + 4);
+}
+
+static bool
+DoJ(Machine *m, Instruction *instr)
+{
+	return Retire(m, 0, 0, ((NEXTPC + 4) & 0xf0000000) |
+														 IndexToAddr(instr->extra));
+}
+
+static bool
+DoJAL(Machine *m, Instruction *instr)
+{
+	m->registers[R31] = NEXTPC + 4;
+	return DoJ(m, instr);
+}
+
+static bool
+DoJR(Machine *m, Instruction *instr)
+{
+	return Retire(m, 0, 0, REG(rs));
+}
+
+#undef REG
+#undef NEXTPC
+
+// Handler for each opcode; anything left NULL is run by DoGeneric.
+static BlockOp opHandlers[MaxOpcode + 1];
+
+static void
+InitHandlers()
+{
+	opHandlers[OP_ADDIU] = DoADDIU;
+	opHandlers[OP_ADDU] = DoADDU;
+	opHandlers[OP_SUBU] = DoSUBU;
+	opHandlers[OP_AND] = DoAND;
+	opHandlers[OP_ANDI] = DoANDI;
+	opHandlers[OP_ORI] = DoORI;
+	opHandlers[OP_XOR] = DoXOR;
+	opHandlers[OP_XORI] = DoXORI;
+	opHandlers[OP_NOR] = DoNOR;
+	opHandlers[OP_LUI] = DoLUI;
+	opHandlers[OP_SLL] = DoSLL;
+	opHandlers[OP_SRA] = DoSRA;
+	opHandlers[OP_SLT] = DoSLT;
+	opHandlers[OP_SLTI] = DoSLTI;
+	opHandlers[OP_SLTU] = DoSLTU;
+	opHandlers[OP_SLTIU] = DoSLTIU;
+	opHandlers[OP_MFHI] = DoMFHI;
+	opHandlers[OP_MFLO] = DoMFLO;
+	opHandlers[OP_LW] = DoLW;
+	opHandlers[OP_SW] = DoSW;
+	opHandlers[OP_BEQ] = DoBEQ;
+	opHandlers[OP_BNE] = DoBNE;
+	opHandlers[OP_BGEZ] = DoBGEZ;
+	opHandlers[OP_BGTZ] = DoBGTZ;
+	opHandlers[OP_BLEZ] = DoBLEZ;
+	opHandlers[OP_BLTZ] = DoBLTZ;
+	opHandlers[OP_J] = DoJ;
+	opHandlers[OP_JAL] = DoJAL;
+	opHandlers[OP_JR] = DoJR;
+	for (int i = 0; i <= MaxOpcode; i++)
+		if (opHandlers[i] == NULL)
+			opHandlers[i] = DoGeneric;
+}
+
+//----------------------------------------------------------------------
+// EndsBlock
+// 	Does this instruction change the flow of control (so the block
+//	ends after its delay slot), or trap into the kernel?
+//----------------------------------------------------------------------
+
+static bool
+EndsBlock(int opCode, bool *hasDelaySlot)
+{
+	switch (opCode)
+	{
+	case OP_BEQ:
+	case OP_BNE:
+	case OP_BGEZ:
+	case OP_BGEZAL:
+	case OP_BGTZ:
+	case OP_BLEZ:
+	case OP_BLTZ:
+	case OP_BLTZAL:
+	case OP_J:
+	case OP_JAL:
+	case OP_JALR:
+	case OP_JR:
+		*hasDelaySlot = TRUE;
+		return TRUE;
+	case OP_SYSCALL:
+	case OP_RES:
+	case OP_UNIMP:
+		*hasDelaySlot = FALSE;
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+//----------------------------------------------------------------------
+// Machine::BuildBlock
+// 	Decode the instructions from "word" in physical page "frame" up
+//	to the end of the basic block, attach a handler to each, and record
+//	the block's length.  Blocks never cross a page boundary.
+//----------------------------------------------------------------------
+
+void Machine::BuildBlock(int frame, int word)
+{
+	static bool initialized = FALSE;
+	bool hasDelaySlot = FALSE;
+	int len = 0;
+	int w;
+
+	if (!initialized)
+	{
+		InitHandlers();
+		initialized = TRUE;
+	}
+
+	for (w = word; w < InstrsPerPage; w++)
+	{
+		Instruction *instr = &decoded[frame][w];
+
+		if (!decodedValid[frame][w])
+		{
+			instr->value = WordToHost(*(unsigned int *)
+																&mainMemory[frame * PageSize + w * 4]);
+			instr->Decode();
+			decodedValid[frame][w] = TRUE;
+			frameDecoded[frame] = TRUE;
+		}
+		blockOps[frame][w] = opHandlers[(int)instr->opCode];
+		len++;
+		if (hasDelaySlot)
+			break; // that was the delay slot
+		if (EndsBlock(instr->opCode, &hasDelaySlot) && !hasDelaySlot)
+			break;
+	}
+	blockLen[frame][word] = len;
+}
+
+//----------------------------------------------------------------------
+// Machine::RunBlock
+// 	Run the basic block starting at the current PC.
+//
+//	We may run as many instructions as there are ticks before the next
+//	interrupt is due, less one -- the reference engine would notice it
+//	on the OneTick after the instruction that makes it due, so that
+//	instruction goes through OneInstruction/OneTick as usual.
+//
+//	If an instruction traps, RaiseException charges for the part of
+//	the block before it; the trapping instruction itself is charged by
+//	OneTick, as in Run.
+//----------------------------------------------------------------------
+
+void Machine::RunBlock()
+{
+	int due = interrupt->NextDueTime();
+	int budget, frame, word, n, pc;
+	Instruction *first;
+
+	if (due < 0)
+		budget = InstrsPerPage;
+	else
+		budget = (due - stats->totalTicks - 1) / UserTick;
+	if (budget <= 0)
+	{
+		OneInstruction();
+		interrupt->OneTick();
+		return;
+	}
+
+	first = FetchInstruction(registers[PCReg]);
+	if (first == NULL)
+	{ // exception occurred
+		interrupt->OneTick();
+		return;
+	}
+	frame = (first - &decoded[0][0]) / InstrsPerPage;
+	word = (first - &decoded[0][0]) % InstrsPerPage;
+	if (blockLen[frame][word] == 0)
+		BuildBlock(frame, word);
+	n = min((int)blockLen[frame][word], budget);
+
+	pc = registers[PCReg];
+	for (blockDone = 0; blockDone < n;)
+	{
+		if (!(*blockOps[frame][word + blockDone])(this,
+																							 &decoded[frame][word + blockDone]))
+		{ // trapped; RaiseException has already charged blockDone
+			blockDone = 0;
+			interrupt->OneTick();
+			return;
+		}
+		blockDone++;
+		pc += 4;
+		// stop if we jumped, or the block's own page was written to
+		if (registers[PCReg] != pc || !frameDecoded[frame])
+			break;
+	}
+	stats->totalTicks += blockDone * UserTick;
+	stats->userTicks += blockDone * UserTick;
+	blockDone = 0;
+}
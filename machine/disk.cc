@@ -264,8 +264,10 @@ Disk::UpdateLast(int newSector)
     int rotate;
     int seek = TimeToSeek(newSector, &rotate);
     
-    if (seek != 0)
+    if (seek != 0) {
 	bufferInit = stats->totalTicks + seek + rotate;
+	stats->numDiskSeeks++;
+    }
     lastSector = newSector;
     DEBUG('d', "Updating last sector = %d, %d\n", lastSector, bufferInit);
 }
@@ -14,6 +14,10 @@
 //		a user instruction is executed
 //		there is nothing in the ready queue
 //
+//	Pending interrupts are kept in a binary heap, and the time the
+//	earliest one is due is cached, so OneTick only has to compare two
+//	integers on the (common) ticks when nothing happens.
+//
 //  DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -48,8 +52,13 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, _int param, int time,
     arg = param;
     when = time;
     type = kind;
+    order = 0;
+    next = NULL;
 }
 
+// No interrupt is due before this; NextDueTime reports it as -1.
+#define NoneDue 0x7fffffff
+
 //----------------------------------------------------------------------
 // Interrupt::Interrupt
 // 	Initialize the simulation of hardware device interrupts.
@@ -60,10 +69,17 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, _int param, int time,
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new List();
+    maxPending = 16;
+    pending = new PendingInterrupt *[maxPending];
+    numPending = 0;
+    scheduled = 0;
+    nextDue = NoneDue;
+    freePool = NULL;
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
+    beforeHalt = NULL;
+    realTimeRate = 0;
 }
 
 //----------------------------------------------------------------------
@@ -73,9 +89,17 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-        delete pending->Remove();
-    delete pending;
+    PendingInterrupt *p;
+
+    for (int i = 0; i < numPending; i++)
+        delete pending[i];
+    delete[] pending;
+    while (freePool != NULL)
+    {
+        p = freePool;
+        freePool = p->next;
+        delete p;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -163,12 +187,15 @@ void Interrupt::OneTick()
     DEBUG('i', "\n== Tick %d ==\n", stats->totalTicks);
 
     // check any pending interrupts are now ready to fire
-    ChangeLevel(IntOn, IntOff); // first, turn off interrupts
-                                // (interrupt handlers run with
-                                // interrupts disabled)
-    while (CheckIfDue(FALSE))   // check for pending interrupts
-        ;
-    ChangeLevel(IntOff, IntOn); // re-enable interrupts
+    if (stats->totalTicks >= nextDue)
+    {
+        ChangeLevel(IntOn, IntOff); // first, turn off interrupts
+                                    // (interrupt handlers run with
+                                    // interrupts disabled)
+        while (CheckIfDue(FALSE))   // check for pending interrupts
+            ;
+        ChangeLevel(IntOff, IntOn); // re-enable interrupts
+    }
     if (yieldOnReturn)
     { // if the timer device handler asked
         // for a context switch, ok to do it now
@@ -227,6 +254,19 @@ void Interrupt::Idle()
     // operating, there are *always* pending interrupts, so this code
     // is not reached.  Instead, the halt must be invoked by the user program.
 
+    // but first, if asked to, run one more thread, to tidy up with
+    // (there's no thread left to wait for a device in, otherwise)
+    if (beforeHalt != NULL)
+    {
+        Thread *t = new Thread("before halt");
+
+        t->Fork(beforeHalt, beforeHaltArg);
+        beforeHalt = NULL;
+        yieldOnReturn = FALSE;
+        status = SystemMode;
+        return;
+    }
+
     DEBUG('i', "Machine idle.  No interrupts to do.\n");
     printf("No threads ready or runnable, and no pending interrupts.\n");
     printf("Assuming the program completed.\n");
@@ -249,7 +289,8 @@ void Interrupt::Halt()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: put it on the heap, reusing a PendingInterrupt
+//	from the free pool if there is one.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -263,13 +304,96 @@ void Interrupt::Halt()
 void Interrupt::Schedule(VoidFunctionPtr handler, _int arg, int fromNow, IntType type)
 {
     int when = stats->totalTicks + fromNow;
-    PendingInterrupt *toOccur = new PendingInterrupt(handler, arg, when, type);
+    PendingInterrupt *toOccur;
 
     DEBUG('i', "Scheduling interrupt handler the %s at time = %d\n",
           intTypeNames[type], when);
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    if (freePool != NULL)
+    {
+        toOccur = freePool;
+        freePool = toOccur->next;
+        toOccur->handler = handler;
+        toOccur->arg = arg;
+        toOccur->when = when;
+        toOccur->type = type;
+    }
+    else
+        toOccur = new PendingInterrupt(handler, arg, when, type);
+    toOccur->order = scheduled++;
+    InsertPending(toOccur);
+}
+
+//----------------------------------------------------------------------
+// Earlier
+// 	Heap order: by due time, and among interrupts due at the same
+//	time, by the order they were scheduled in (as the sorted list
+//	used to keep them).
+//----------------------------------------------------------------------
+
+static inline bool
+Earlier(PendingInterrupt *a, PendingInterrupt *b)
+{
+    return a->when < b->when || (a->when == b->when && a->order < b->order);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::InsertPending
+// 	Add an interrupt to the heap, growing it if it is full, and
+//	update the cached next due time.
+//----------------------------------------------------------------------
+
+void Interrupt::InsertPending(PendingInterrupt *toOccur)
+{
+    int i, parent;
+
+    if (numPending == maxPending)
+    {
+        PendingInterrupt **bigger = new PendingInterrupt *[maxPending * 2];
+
+        for (i = 0; i < numPending; i++)
+            bigger[i] = pending[i];
+        delete[] pending;
+        pending = bigger;
+        maxPending *= 2;
+    }
+    for (i = numPending++; i > 0; i = parent)
+    { // sift up
+        parent = (i - 1) / 2;
+        if (!Earlier(toOccur, pending[parent]))
+            break;
+        pending[i] = pending[parent];
+    }
+    pending[i] = toOccur;
+    nextDue = pending[0]->when;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::RemovePending
+// 	Remove and return the earliest interrupt on the heap (which must
+//	not be empty), and update the cached next due time.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+Interrupt::RemovePending()
+{
+    PendingInterrupt *first = pending[0];
+    PendingInterrupt *last = pending[--numPending];
+    int i, child;
+
+    for (i = 0; (child = 2 * i + 1) < numPending; i = child)
+    { // sift down
+        if (child + 1 < numPending && Earlier(pending[child + 1], pending[child]))
+            child++;
+        if (!Earlier(pending[child], last))
+            break;
+        pending[i] = pending[child];
+    }
+    if (numPending > 0)
+        pending[i] = last;
+    nextDue = (numPending > 0) ? pending[0]->when : NoneDue;
+    return first;
 }
 
 //----------------------------------------------------------------------
@@ -288,35 +412,32 @@ void Interrupt::Schedule(VoidFunctionPtr handler, _int arg, int fromNow, IntType
 bool Interrupt::CheckIfDue(bool advanceClock)
 {
     MachineStatus old = status;
+    PendingInterrupt *toOccur;
     int when;
 
     ASSERT(level == IntOff); // interrupts need to be disabled,
                              // to invoke an interrupt handler
     if (DebugIsEnabled('i'))
         DumpState();
-    PendingInterrupt *toOccur =
-        (PendingInterrupt *)pending->SortedRemove(&when);
-
-    if (toOccur == NULL) // no pending interrupts
+    if (numPending == 0) // no pending interrupts
         return FALSE;
 
+    when = nextDue;
     if (advanceClock && when > stats->totalTicks)
     { // advance the clock
+        if (realTimeRate > 0)
+            KeepUpWithHost(when);
         stats->idleTicks += (when - stats->totalTicks);
         stats->totalTicks = when;
     }
     else if (when > stats->totalTicks)
-    { // not time yet, put it back
-        pending->SortedInsert(toOccur, when);
-        return FALSE;
-    }
+        return FALSE; // not time yet
 
     // Check if there is nothing more to do, and if so, quit
-    if ((status == IdleMode) && (toOccur->type == TimerInt) && pending->IsEmpty())
-    {
-        pending->SortedInsert(toOccur, when);
+    if ((status == IdleMode) && (pending[0]->type == TimerInt) && numPending == 1)
         return FALSE;
-    }
+
+    toOccur = RemovePending();
 
     DEBUG('i', "Invoking interrupt handler for the %s at time %d\n",
           intTypeNames[toOccur->type], toOccur->when);
@@ -331,10 +452,80 @@ bool Interrupt::CheckIfDue(bool advanceClock)
     (*(toOccur->handler))(toOccur->arg); // call the interrupt handler
     status = old;                        // restore the machine status
     inHandler = FALSE;
-    delete toOccur;
+    toOccur->next = freePool;            // keep it for the next Schedule
+    freePool = toOccur;
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Interrupt::CallBeforeIdleHalt
+// 	When the machine is idle with nothing left to do, fork a thread to
+//	run "func(arg)", rather than halting straight away; halt the next
+//	time.  The file system uses this to write out what it has cached,
+//	which it can only do from a thread.
+//----------------------------------------------------------------------
+
+void Interrupt::CallBeforeIdleHalt(VoidFunctionPtr func, _int arg)
+{
+    beforeHalt = func;
+    beforeHaltArg = arg;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SetRealTime
+// 	From now on, when the machine is idle, don't advance simulated time
+//	to the next interrupt until as much time has passed on the host;
+//	each host millisecond is "ticksPerMillisecond" ticks.  Otherwise
+//	idle time takes no time at all, and copies of Nachos talking over
+//	the network each run their clocks ahead at whatever rate they
+//	happen to idle at, so times measured in ticks mean little.
+//	While the machine is busy, simulated time is still counted in
+//	ticks as usual.
+//----------------------------------------------------------------------
+
+void Interrupt::SetRealTime(int ticksPerMillisecond)
+{
+    realTimeRate = ticksPerMillisecond;
+    hostBase = HostMicroseconds();
+    tickBase = stats->totalTicks;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::KeepUpWithHost
+// 	The machine is idle until time "when": wait until the host's clock
+//	gets there.  If the host is already past where it should be --
+//	because the machine was busy, or the host was slow -- start from
+//	here, rather than racing to catch up.
+//----------------------------------------------------------------------
+
+void Interrupt::KeepUpWithHost(int when)
+{
+    int now = HostMicroseconds();
+    int due = hostBase +
+              (int)((stats->totalTicks - tickBase) * 1000.0 / realTimeRate);
+
+    if (now > due)
+    {
+        hostBase = now;
+        tickBase = stats->totalTicks;
+    }
+    DelayMicroseconds(hostBase +
+                      (int)((when - tickBase) * 1000.0 / realTimeRate) - now);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::NextDueTime
+// 	Return the simulated time at which the earliest pending interrupt
+//	is due, or -1 if none is pending.  Used by the basic-block engine
+//	to decide how many instructions it may run before it has to
+//	start calling OneTick again.
+//----------------------------------------------------------------------
+
+int Interrupt::NextDueTime()
+{
+    return (numPending > 0) ? nextDue : -1;
+}
+
 //----------------------------------------------------------------------
 // PrintPending
 // 	Print information about an interrupt that is scheduled to occur.
@@ -342,10 +533,8 @@ bool Interrupt::CheckIfDue(bool advanceClock)
 //----------------------------------------------------------------------
 
 static void
-PrintPending(_int arg)
+PrintPending(PendingInterrupt *pend)
 {
-    PendingInterrupt *pend = (PendingInterrupt *)arg;
-
     printf("Interrupt handler %s, scheduled at %d\n",
            intTypeNames[pend->type], pend->when);
 }
@@ -362,7 +551,8 @@ void Interrupt::DumpState()
            intLevelNames[level]);
     printf("Pending interrupts:\n");
     fflush(stdout);
-    pending->Mapcar(PrintPending);
+    for (int i = 0; i < numPending; i++) // in heap order; only the first
+        PrintPending(pending[i]);        // is sure to be the earliest
     printf("End of pending interrupts\n");
     fflush(stdout);
 }
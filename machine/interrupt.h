@@ -36,7 +36,7 @@
 #define INTERRUPT_H
 
 #include "copyright.h"
-#include "list.h"
+#include "utility.h"
 
 // Interrupts can be disabled (IntOff) or enabled (IntOn)
 enum IntStatus { IntOff, IntOn };
@@ -67,6 +67,9 @@ class PendingInterrupt {
     _int arg;           // The argument to the function.
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+    unsigned int order;		// breaks ties between interrupts due at
+				// the same time: first scheduled, first fired
+    PendingInterrupt *next;	// link on the free pool
 };
 
 // The following class defines the data structures for the simulation
@@ -91,6 +94,15 @@ class Interrupt {
 					// next interrupt
 
     void Halt(); 			// quit and print out stats
+
+    void CallBeforeIdleHalt(VoidFunctionPtr func, _int arg);
+					// When nothing is left to do, fork a
+					// thread to run "func(arg)" -- once --
+					// before halting
+    void SetRealTime(int ticksPerMillisecond);
+					// While idle, let simulated time pass
+					// no faster than the host's clock; 0
+					// (the default) to let it race ahead
     
     void YieldOnReturn();		// cause a context switch on return 
 					// from an interrupt handler
@@ -112,22 +124,43 @@ class Interrupt {
     
     void OneTick();       		// Advance simulated time
 
+    int NextDueTime();			// When the earliest pending interrupt
+					// is due, or -1 if there is none
+
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    List *pending;		// the list of interrupts scheduled
-				// to occur in the future
+    PendingInterrupt **pending;	// the interrupts scheduled to occur in
+				// the future, as a binary min-heap
+				// ordered by (when, order)
+    int numPending;		// number of interrupts in the heap
+    int maxPending;		// size of the heap array
+    unsigned int scheduled;	// how many interrupts have been scheduled
+    int nextDue;		// pending[0]->when, cached so that OneTick
+				// can tell in O(1) that nothing is due
+    PendingInterrupt *freePool;	// PendingInterrupts to reuse, so that
+				// Schedule doesn't call "new" each time
     bool inHandler;		// TRUE if we are running an interrupt handler
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
     MachineStatus status;	// idle, kernel mode, user mode
+    VoidFunctionPtr beforeHalt;	// for CallBeforeIdleHalt, or NULL
+    _int beforeHaltArg;
+    int realTimeRate;		// ticks per host millisecond, or 0
+    int hostBase, tickBase;	// host time (microseconds), and simulated
+				// time, when the two were last in step
 
     // these functions are internal to the interrupt simulation code
 
     bool CheckIfDue(bool advanceClock); // Check if an interrupt is supposed
 					// to occur now
+    void KeepUpWithHost(int when);	// Idle until time "when" on the
+					// host's clock, too
 
     void ChangeLevel(IntStatus old, 	// SetLevel, without advancing the
 	IntStatus now);  		// simulated time
+
+    void InsertPending(PendingInterrupt *toOccur); // heap operations
+    PendingInterrupt *RemovePending();
 };
 
 #endif // INTERRRUPT_H
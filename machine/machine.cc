@@ -50,9 +50,11 @@ void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"blocks" -- if TRUE, run user code with the basic-block engine
+//		(blocksim.cc) whenever we aren't single-stepping.
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, bool blocks)
 {
     int i;
 
@@ -61,6 +63,13 @@ Machine::Machine(bool debug)
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
       	mainMemory[i] = 0;
+    for (i = 0; i < NumPhysPages; i++) {
+        for (int j = 0; j < InstrsPerPage; j++) {
+            decodedValid[i][j] = FALSE;
+            blockLen[i][j] = 0;
+        }
+        frameDecoded[i] = FALSE;
+    }
 #ifdef USE_TLB
     tlb = new TranslationEntry[TLBSize];
     for (i = 0; i < TLBSize; i++)
@@ -72,6 +81,9 @@ Machine::Machine(bool debug)
 #endif
 
     singleStep = debug;
+    tlbLastHit = 0;
+    blockEngine = blocks;
+    blockDone = 0;
     CheckEndian();
 }
 
@@ -103,6 +115,12 @@ Machine::RaiseException(ExceptionType which, int badVAddr)
     DEBUG('m', "Exception: %s\n", exceptionNames[which]);
     
 //  ASSERT(interrupt->getStatus() == UserMode);
+    if (blockDone > 0) {		// charge for the part of the current
+					// block that ran before the trap
+        stats->totalTicks += blockDone * UserTick;
+        stats->userTicks += blockDone * UserTick;
+        blockDone = 0;
+    }
     registers[BadVAddrReg] = badVAddr;
     DelayedLoad(0, 0);			// finish anything in progress
     // 切换到系统态
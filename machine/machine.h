@@ -35,6 +35,7 @@
 #define NumPhysPages 32
 #define MemorySize (NumPhysPages * PageSize)
 #define TLBSize 4 // if there is a TLB, make it small
+#define InstrsPerPage (PageSize / 4) // instruction words per physical page
 
 enum ExceptionType
 {
@@ -96,6 +97,13 @@ public:
 									 // Immediates are sign-extended.
 };
 
+class Machine;
+
+// A specialized routine for executing one kind of instruction, used by
+// the basic-block engine (blocksim.cc) instead of the big switch in
+// ExecuteInstruction.  Returns FALSE if an exception was raised.
+typedef bool (*BlockOp)(Machine *m, Instruction *instr);
+
 // The following class defines the simulated host workstation hardware, as
 // seen by user programs -- the CPU registers, main memory, etc.
 // User programs shouldn't be able to tell that they are running on our
@@ -112,8 +120,10 @@ public:
 class Machine
 {
 public:
-	Machine(bool debug); // Initialize the simulation of the hardware
-			// for running user programs
+	Machine(bool debug, bool blocks = FALSE);
+	// Initialize the simulation of the hardware
+	// for running user programs; "blocks" selects
+	// the basic-block engine over the interpreter
 	~Machine(); // De-allocate the data structures
 
 	// Routines callable by the Nachos kernel
@@ -124,10 +134,33 @@ public:
 	void WriteRegister(int num, int value);
 	// store a value into a CPU register
 
+	void InvalidateDecoded(int frame);
+	// Forget any pre-decoded instructions for
+	// physical page "frame"; must be called
+	// whenever the kernel changes its contents
+	// behind the simulator's back (loading a
+	// program, paging in, etc.)
+
 	// Routines internal to the machine simulation -- DO NOT call these
 
-	void OneInstruction(Instruction *instr);
+	void OneInstruction();
 	// Run one instruction of a user program.
+	bool ExecuteInstruction(Instruction *instr);
+	// The part of OneInstruction after the
+	// fetch: execute a decoded instruction.
+	void RunBlock();
+	// Run the basic block at the current PC,
+	// or as much of it as can be done before
+	// the next interrupt is due.
+	void BuildBlock(int frame, int word);
+	// Find the extent of the block starting
+	// at "word" in physical page "frame", and
+	// pick a handler for each instruction.
+	Instruction *FetchInstruction(int addr);
+	// Translate "addr" and return the decoded
+	// instruction found there, decoding it only
+	// if the cached copy is stale.  Returns NULL
+	// if an exception occurred.
 	void DelayedLoad(int nextReg, int nextVal);
 	// Do a pending delayed load (modifying a reg)
 
@@ -190,6 +223,24 @@ private:
 			// simulated instruction
 	int runUntilTime; // drop back into the debugger when simulated
 										// time reaches this value
+	int tlbLastHit; // TLB slot that matched the last translation
+
+	// Pre-decoded copy of every instruction word in mainMemory, indexed
+	// by physical page and word within the page.  An entry is only used
+	// if its valid flag is set; stores into a page clear all of them.
+	Instruction decoded[NumPhysPages][InstrsPerPage];
+	bool decodedValid[NumPhysPages][InstrsPerPage];
+	bool frameDecoded[NumPhysPages]; // does the page have any valid entry?
+
+	// Basic-block engine state.  blockLen is the number of instructions
+	// in the block starting at each word (0 if not built yet); blockOps
+	// is the handler for each word; both are only meaningful while the
+	// word's decodedValid flag is set.
+	bool blockEngine; // run user code a block at a time?
+	unsigned char blockLen[NumPhysPages][InstrsPerPage];
+	BlockOp blockOps[NumPhysPages][InstrsPerPage];
+	int blockDone; // instructions of the current block already
+			// executed but not yet charged to stats
 };
 
 extern void ExceptionHandler(ExceptionType which);
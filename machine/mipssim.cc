@@ -25,11 +25,15 @@ static void Mult(int a, int b, bool signedArith, int *hiPtr, int *loPtr);
 //
 //	This routine is re-entrant, in that it can be called multiple
 //	times concurrently -- one for each thread executing user code.
+//
+//	With the basic-block engine selected, whole blocks are run at a
+//	time (see RunBlock), except while single-stepping or tracing
+//	instructions or ticks, where we need the instruction-at-a-time loop.
 //----------------------------------------------------------------------
 
 void Machine::Run()
 {
-	Instruction *instr = new Instruction; // storage for decoded instruction
+	bool tracing = DebugIsEnabled('m') || DebugIsEnabled('i');
 
 	if (DebugIsEnabled('m'))
 		printf("Starting thread \"%s\" at time %d\n",
@@ -37,7 +41,12 @@ void Machine::Run()
 	interrupt->setStatus(UserMode);
 	for (;;)
 	{
-		OneInstruction(instr);
+		if (blockEngine && !singleStep && !tracing)
+		{
+			RunBlock();
+			continue;
+		}
+		OneInstruction();
 		interrupt->OneTick();
 		if (singleStep && (runUntilTime <= stats->totalTicks))
 			Debugger();
@@ -88,20 +97,21 @@ TypeToReg(RegType reg, Instruction *instr)
 //	leaving.  This allows the Nachos kernel to control our behavior
 //	by controlling the contents of memory, the translation table,
 //	and the register set.
+//
+//	The one exception is the decoded form of each instruction, which
+//	is cached per physical page (see FetchInstruction); the cache is
+//	keyed by physical address and dropped whenever the page is written,
+//	so it never changes what the program sees.
 //----------------------------------------------------------------------
 
-void Machine::OneInstruction(Instruction *instr)
+void Machine::OneInstruction()
 {
-	int raw;
-	int nextLoadReg = 0;
-	int nextLoadValue = 0; // record delayed load operation, to apply
-			// in the future
+	Instruction *instr;
 
 	// Fetch instruction
-	if (!machine->ReadMem(registers[PCReg], 4, &raw))
+	instr = FetchInstruction(registers[PCReg]);
+	if (instr == NULL)
 		return; // exception occurred
-	instr->value = raw;
-	instr->Decode();
 
 	if (DebugIsEnabled('m'))
 	{
@@ -114,6 +124,26 @@ void Machine::OneInstruction(Instruction *instr)
 		printf("\n");
 	}
 
+	(void)ExecuteInstruction(instr);
+}
+
+//----------------------------------------------------------------------
+// Machine::ExecuteInstruction
+// 	Execute an already fetched and decoded instruction, as the
+//	second half of OneInstruction.  Shared with the basic-block
+//	engine (blocksim.cc), which uses it for every instruction it
+//	doesn't have a specialized handler for.
+//
+//	Returns FALSE if an exception was raised (in which case the
+//	kernel's exception handler has already run).
+//----------------------------------------------------------------------
+
+bool Machine::ExecuteInstruction(Instruction *instr)
+{
+	int nextLoadReg = 0;
+	int nextLoadValue = 0; // record delayed load operation, to apply
+			// in the future
+
 	// Compute next pc, but don't install in case there's an error or branch.
 	int pcAfter = registers[NextPCReg] + 4;
 	int sum, diff, tmp, value;
@@ -129,7 +159,7 @@ void Machine::OneInstruction(Instruction *instr)
 				((registers[instr->rs] ^ sum) & SIGN_BIT))
 		{
 			RaiseException(OverflowException, 0);
-			return;
+			return FALSE;
 		}
 		registers[instr->rd] = sum;
 		break;
@@ -140,7 +170,7 @@ void Machine::OneInstruction(Instruction *instr)
 				((instr->extra ^ sum) & SIGN_BIT))
 		{
 			RaiseException(OverflowException, 0);
-			return;
+			return FALSE;
 		}
 		registers[instr->rt] = sum;
 		break;
@@ -241,7 +271,7 @@ void Machine::OneInstruction(Instruction *instr)
 	case OP_LBU:
 		tmp = registers[instr->rs] + instr->extra;
 		if (!machine->ReadMem(tmp, 1, &value))
-			return;
+			return FALSE;
 
 		if ((value & 0x80) && (instr->opCode == OP_LB))
 			value |= 0xffffff00;
@@ -257,10 +287,10 @@ void Machine::OneInstruction(Instruction *instr)
 		if (tmp & 0x1)
 		{
 			RaiseException(AddressErrorException, tmp);
-			return;
+			return FALSE;
 		}
 		if (!machine->ReadMem(tmp, 2, &value))
-			return;
+			return FALSE;
 
 		if ((value & 0x8000) && (instr->opCode == OP_LH))
 			value |= 0xffff0000;
@@ -280,10 +310,10 @@ void Machine::OneInstruction(Instruction *instr)
 		if (tmp & 0x3)
 		{
 			RaiseException(AddressErrorException, tmp);
-			return;
+			return FALSE;
 		}
 		if (!machine->ReadMem(tmp, 4, &value))
-			return;
+			return FALSE;
 		nextLoadReg = instr->rt;
 		nextLoadValue = value;
 		break;
@@ -297,7 +327,7 @@ void Machine::OneInstruction(Instruction *instr)
 		ASSERT((tmp & 0x3) == 0);
 
 		if (!machine->ReadMem(tmp, 4, &value))
-			return;
+			return FALSE;
 		if (registers[LoadReg] == instr->rt)
 			nextLoadValue = registers[LoadValueReg];
 		else
@@ -329,7 +359,7 @@ void Machine::OneInstruction(Instruction *instr)
 		ASSERT((tmp & 0x3) == 0);
 
 		if (!machine->ReadMem(tmp, 4, &value))
-			return;
+			return FALSE;
 		if (registers[LoadReg] == instr->rt)
 			nextLoadValue = registers[LoadValueReg];
 		else
@@ -394,12 +424,12 @@ void Machine::OneInstruction(Instruction *instr)
 
 	case OP_SB:
 		if (!machine->WriteMem((unsigned)(registers[instr->rs] + instr->extra), 1, registers[instr->rt]))
-			return;
+			return FALSE;
 		break;
 
 	case OP_SH:
 		if (!machine->WriteMem((unsigned)(registers[instr->rs] + instr->extra), 2, registers[instr->rt]))
-			return;
+			return FALSE;
 		break;
 
 	case OP_SLL:
@@ -469,7 +499,7 @@ void Machine::OneInstruction(Instruction *instr)
 				((registers[instr->rs] ^ diff) & SIGN_BIT))
 		{
 			RaiseException(OverflowException, 0);
-			return;
+			return FALSE;
 		}
 		registers[instr->rd] = diff;
 		break;
@@ -480,7 +510,7 @@ void Machine::OneInstruction(Instruction *instr)
 
 	case OP_SW:
 		if (!machine->WriteMem((unsigned)(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
-			return;
+			return FALSE;
 		break;
 
 	case OP_SWL:
@@ -491,7 +521,7 @@ void Machine::OneInstruction(Instruction *instr)
 		ASSERT((tmp & 0x3) == 0);
 
 		if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-			return;
+			return FALSE;
 		switch (tmp & 0x3)
 		{
 		case 0:
@@ -511,7 +541,7 @@ void Machine::OneInstruction(Instruction *instr)
 			break;
 		}
 		if (!machine->WriteMem((tmp & ~0x3), 4, value))
-			return;
+			return FALSE;
 		break;
 
 	case OP_SWR:
@@ -522,7 +552,7 @@ void Machine::OneInstruction(Instruction *instr)
 		ASSERT((tmp & 0x3) == 0);
 
 		if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-			return;
+			return FALSE;
 		switch (tmp & 0x3)
 		{
 		case 0:
@@ -539,13 +569,13 @@ void Machine::OneInstruction(Instruction *instr)
 			break;
 		}
 		if (!machine->WriteMem((tmp & ~0x3), 4, value))
-			return;
+			return FALSE;
 		break;
 		//执行系统调用
 	case OP_SYSCALL:
 		// 自陷错误
 		RaiseException(SyscallException, 0);
-		return;
+		return FALSE;
 
 	case OP_XOR:
 		registers[instr->rd] = registers[instr->rs] ^ registers[instr->rt];
@@ -558,7 +588,7 @@ void Machine::OneInstruction(Instruction *instr)
 	case OP_RES:
 	case OP_UNIMP:
 		RaiseException(IllegalInstrException, 0);
-		return;
+		return FALSE;
 
 	default:
 		ASSERT(FALSE);
@@ -574,6 +604,7 @@ void Machine::OneInstruction(Instruction *instr)
 			// are jumping into lala-land
 	registers[PCReg] = registers[NextPCReg];
 	registers[NextPCReg] = pcAfter;
+	return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -24,6 +24,22 @@ static void NetworkReadPoll(_int arg)
 static void NetworkSendDone(_int arg)
 { Network *net = (Network *)arg; net->SendDone(); }
 
+// A packet held back by a slow link, until it is due to arrive
+class DelayedPacket {
+  public:
+    int sock;			// socket to send it from
+    char buffer[MaxWireSize];	// the packet, as on the wire
+    char toName[32];		// socket to send it to
+};
+
+static void NetworkDelayDone(_int arg)
+{
+    DelayedPacket *pkt = (DelayedPacket *)arg;
+
+    SendToSocket(pkt->sock, pkt->buffer, MaxWireSize, pkt->toName);
+    delete pkt;
+}
+
 // Initialize the network emulation
 //   addr is used to generate the socket name
 //   reliability says whether we drop packets to emulate unreliable links
@@ -45,8 +61,11 @@ Network::Network(NetworkAddress addr, double reliability, double orderability,
     readHandler = readAvail;
     handlerArg = callArg;
     sendBusy = FALSE;
+    burstSize = 0;
     inHdr.length = 0;
     delayBufFull = FALSE;
+    for (int i = 0; i < MaxNodes; i++)
+	SetLink(i, 1, 0, NetworkTime);
     
     sock = OpenSocket();
     sprintf(sockName, "SOCKET_%d", (int)addr);
@@ -95,35 +114,97 @@ Network::CheckPktAvail()
     (*readHandler)(handlerArg);	
 }
 
+// set up the link to machine "to": the chance that a packet sent over
+// it gets there, how long it takes to get there, and how long it
+// takes to put on the wire
+void
+Network::SetLink(NetworkAddress to, double reliability, int delay,
+		 int packetTime)
+{
+    ASSERT((to >= 0) && (to < MaxNodes) && (delay >= 0) && (packetTime > 0));
+    if (reliability < 0) linkChanceToWork[to] = 0;
+    else if (reliability > 1) linkChanceToWork[to] = 1;
+    else linkChanceToWork[to] = reliability;
+    linkDelay[to] = delay;
+    linkTime[to] = packetTime;
+}
+
 // notify user that another packet can be sent
 void
 Network::SendDone()
 {
     sendBusy = FALSE;
-    stats->numPacketsSent++;
+    stats->numPacketsSent += burstSize;
+    stats->numSendInterrupts++;
     (*writeHandler)(handlerArg);
 }
 
 // send a packet by concatenating hdr and data, and schedule
 // an interrupt to tell the user when the next packet can be sent 
+void
+Network::Send(PacketHeader hdr, char* data)
+{
+    SendBurst(&hdr, &data, 1);
+}
+
+// send a burst of "count" packets back to back, and schedule a single
+// interrupt for when the last of them is on the wire (each packet still
+// takes NetworkTime to go out; the interrupt is what's saved)
+void
+Network::SendBurst(PacketHeader *hdrs, char **data, int count)
+{
+    int ticks = 0;
+
+    ASSERT((sendBusy == FALSE) && (count > 0));
+
+    sendBusy = TRUE;
+    burstSize = count;
+    for (int i = 0; i < count; i++) {
+	if ((hdrs[i].to >= 0) && (hdrs[i].to < MaxNodes))
+	    ticks += linkTime[hdrs[i].to];
+	else
+	    ticks += NetworkTime;	// no link set up: the default
+    }
+    interrupt->Schedule(NetworkSendDone, (_int)this, ticks, NetworkSendInt);
+    for (int i = 0; i < count; i++)
+	Transmit(hdrs[i], data[i]);
+}
+
+// put one packet on the wire -- or lose it, or hold on to it for a while
 //
 // Note we always pad out a packet to MaxWireSize before putting it into
 // the socket, because it's simpler at the receive end.
 void
-Network::Send(PacketHeader hdr, char* data)
+Network::Transmit(PacketHeader hdr, char* data)
 {
     char toName[32];
+    double linkChance = 1;	// the default link, unless one is set up
+    int delay = 0;
 
-    ASSERT((sendBusy == FALSE) && (hdr.length > 0) 
+    ASSERT((hdr.length > 0) 
 		&& (hdr.length <= MaxPacketSize) && (hdr.from == ident));
     DEBUG('n', "Sending to addr %d, %d bytes... ", hdr.to, hdr.length);
 
-    interrupt->Schedule(NetworkSendDone, (_int)this, NetworkTime, NetworkSendInt);
-
-    if (Random() % 100 >= chanceToWork * 100) { // emulate a lost packet
+    if ((hdr.to >= 0) && (hdr.to < MaxNodes)) {
+	linkChance = linkChanceToWork[hdr.to];
+	delay = linkDelay[hdr.to];
+    }
+    if (Random() % 100 >= chanceToWork * 100 ||	// emulate a lost packet
+	(linkChance < 1 && Random() % 100 >= linkChance * 100)) {
 	DEBUG('n', "oops, lost it!\n");
 	return;
     }
+    if (delay > 0) { // emulate a slow link
+	DelayedPacket *pkt = new DelayedPacket;
+
+	pkt->sock = sock;
+	sprintf(pkt->toName, "SOCKET_%d", (int)hdr.to);
+	*(PacketHeader *)pkt->buffer = hdr;
+	bcopy(data, pkt->buffer + sizeof(PacketHeader), hdr.length);
+	interrupt->Schedule(NetworkDelayDone, (_int)pkt, delay,
+							NetworkSendInt);
+	return;
+    }
     if (Random() % 100 >= chanceToNotDelay * 100) { // emulate delay
       // to delay a packet, we simply save it in a buffer
       // it remains there until another packet is delayed, at which
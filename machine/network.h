@@ -49,6 +49,10 @@ class PacketHeader {
 #define MaxPacketSize 	(MaxWireSize - sizeof(struct PacketHeader))	
 				// data "payload" of the largest packet
 
+#define MaxNodes	16	// links can be set up to machines 0 to
+				// MaxNodes - 1; to any other, a packet
+				// goes over the default link
+
 
 // The following class defines a physical network device.  The network
 // is capable of delivering fixed sized packets
@@ -72,6 +76,12 @@ class PacketHeader {
 // without delay.  There is a 10% chance it will be lost, and a 9%
 // chance that it will be delayed.
 //
+// Each link -- from this machine to another -- can also be given its
+// own reliability, a fixed delay (in ticks) before a packet sent over
+// it arrives, and the time it takes to put a packet on it (so a slow
+// link takes longer than NetworkTime).  A packet is lost if either
+// the network as a whole or the link loses it.
+//
 // Note that you can change the seed for the random number 
 // generator, by changing the arguments to RandomInit() in Initialize().
 // The random number generator is used to choose which packets to drop
@@ -95,6 +105,11 @@ class Network {
 				// the PacketHeader is filled in automatically 
 				// by Send().
 
+    void SendBurst(PacketHeader *hdrs, char **data, int count);
+				// Send "count" packets back to back;
+				// "writeHandler" is invoked once, when
+				// the last of them has gone out.
+
     PacketHeader Receive(char* data);
     				// Poll the network for incoming messages.  
 				// If there is a packet waiting, copy the 
@@ -102,6 +117,10 @@ class Network {
 				// If no packet is waiting, return a header 
 				// with length 0.
 
+    void SetLink(NetworkAddress to, double reliability, int delay,
+		 int packetTime);
+				// Set up the link to machine "to"
+
     void SendDone();		// Interrupt handler, called when message is 
 				// sent
     void CheckPktAvail();	// Check if there is an incoming packet
@@ -119,6 +138,7 @@ class Network {
     _int handlerArg;		// Argument to be passed to interrupt handler
 				//   (pointer to post office)
     bool sendBusy;		// Packet is being sent.
+    int burstSize;		// How many packets are being sent.
     bool packetAvail;		// Packet has arrived, can be pulled off of
 				//   network
     PacketHeader inHdr;		// Information about arrived packet
@@ -126,6 +146,12 @@ class Network {
     char delayBuf[MaxWireSize];  // Place to save a delayed packet
     char delayToName[32];       // Place to send delayed packet, eventually
     bool delayBufFull;          // Is delayBuf in use?
+    double linkChanceToWork[MaxNodes];	// Per link: likelihood packet
+    int linkDelay[MaxNodes];		// will not be dropped, ticks
+    int linkTime[MaxNodes];		// before it arrives, and to send it
+
+    void Transmit(PacketHeader hdr, char* data);
+				// Put one packet on the wire
 };
 
 #endif // NETWORK_H
@@ -19,9 +19,45 @@
 Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
-    numDiskReads = numDiskWrites = 0;
+    numDiskReads = numDiskWrites = numDiskSeeks = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numTLBHits = numTLBMisses = 0;
+    numSendInterrupts = numPacketsQueued = sendQueueMax = sendLatencyMax = 0;
+    sendQueueTotal = sendLatencyTotal = 0.0;
+    mailPoolHighWater = numMailDropped = 0;
+    numPageOuts = numSwapReads = numSwapWrites = 0;
+    numThreads = numStacksAllocated = numStacksReused = 0;
+    threadPoolHighWater = 0;
+    numCacheHits = numCacheMisses = numCacheEvictions = 0;
+    numReadAheads = numWriteBehinds = 0;
+    numNameCacheHits = numNameCacheMisses = 0;
+    numJournalCommits = numJournalSectors = numCheckpoints = 0;
+    numDiskRequests = diskLatencyMax = 0;
+    diskLatencyTotal = 0.0;
+    for (int i = 0; i < DiskLatencyBuckets; i++)
+	diskLatency[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// Statistics::RecordDiskLatency
+// 	Count a disk request that took "ticks" from when it was made to
+//	when it was done.
+//----------------------------------------------------------------------
+
+void
+Statistics::RecordDiskLatency(int ticks)
+{
+    int i;
+
+    numDiskRequests++;
+    diskLatencyTotal += ticks;
+    if (ticks > diskLatencyMax)
+	diskLatencyMax = ticks;
+    for (i = 0; i < DiskLatencyBuckets - 1; i++)
+	if (ticks < (2 * RotationTime) << i)
+	    break;
+    diskLatency[i]++;
 }
 
 //----------------------------------------------------------------------
@@ -35,10 +71,76 @@ Statistics::Print()
 {
     printf("Ticks: total %d, idle %d, system %d, user %d\n", totalTicks, 
 	idleTicks, systemTicks, userTicks);
+    printf("Threads: %d, stacks allocated %d, reused %d, pool high water %d\n",
+	numThreads, numStacksAllocated, numStacksReused, threadPoolHighWater);
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
+#ifdef FILESYS
+    printf("Disk seeks: %d\n", numDiskSeeks);
+    printf("Disk cache: hits %d, misses %d, evictions %d, hit ratio %.2f%%\n",
+	numCacheHits, numCacheMisses, numCacheEvictions,
+	(numCacheHits + numCacheMisses) == 0 ? 0.0 :
+	100.0 * numCacheHits / (numCacheHits + numCacheMisses));
+    printf("Disk cache: read ahead %d, written behind %d\n", numReadAheads,
+	numWriteBehinds);
+    printf("Name cache: hits %d, misses %d\n", numNameCacheHits,
+	numNameCacheMisses);
+    printf("Journal: commits %d, sectors logged %d, checkpoints %d\n",
+	numJournalCommits, numJournalSectors, numCheckpoints);
+    if (numDiskRequests > 0) {
+	int i, count = 0, p50 = -1, p99 = -1;
+
+	// the percentiles are only as exact as the buckets: the bound of
+	// the bucket they fall in (or the maximum, for the last one)
+	for (i = 0; i < DiskLatencyBuckets; i++) {
+	    count += diskLatency[i];
+	    if (p50 == -1 && count * 2 >= numDiskRequests)
+		p50 = i;
+	    if (p99 == -1 && count * 100 >= numDiskRequests * 99)
+		p99 = i;
+	}
+	printf("Disk latency: requests %d, mean %.1f, p50 < %d, p99 < %d, "
+	    "max %d\n", numDiskRequests, diskLatencyTotal / numDiskRequests,
+	    p50 == DiskLatencyBuckets - 1 ? diskLatencyMax + 1
+					  : (2 * RotationTime) << p50,
+	    p99 == DiskLatencyBuckets - 1 ? diskLatencyMax + 1
+					  : (2 * RotationTime) << p99,
+	    diskLatencyMax);
+	for (i = 0; i < DiskLatencyBuckets; i++) {
+	    if (diskLatency[i] == 0)
+		continue;
+	    if (i == DiskLatencyBuckets - 1)
+		printf("  >= %7d ticks: %d\n", (2 * RotationTime) << (i - 1),
+		    diskLatency[i]);
+	    else
+		printf("  <  %7d ticks: %d\n", (2 * RotationTime) << i,
+		    diskLatency[i]);
+	}
+    }
+#endif
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
     printf("Paging: faults %d\n", numPageFaults);
+#ifdef VM
+    printf("VM: evictions %d, swap reads %d, swap writes %d\n", numPageOuts,
+	numSwapReads, numSwapWrites);
+#endif
+#ifdef USE_TLB
+    printf("TLB: hits %d, misses %d, hit ratio %.2f%%\n", numTLBHits,
+	numTLBMisses, (numTLBHits + numTLBMisses) == 0 ? 0.0 :
+	100.0 * numTLBHits / (numTLBHits + numTLBMisses));
+#endif
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
+#ifdef NETWORK
+    printf("Network send: interrupts %d, packets per interrupt %.2f\n",
+	numSendInterrupts, numSendInterrupts == 0 ? 0.0 :
+	(double) numPacketsSent / numSendInterrupts);
+    if (numPacketsQueued > 0)
+	printf("Network send queue: depth mean %.2f, max %d; "
+	    "latency mean %.1f, max %d\n", sendQueueTotal / numPacketsQueued,
+	    sendQueueMax, numPacketsSent == 0 ? 0.0 :
+	    sendLatencyTotal / numPacketsSent, sendLatencyMax);
+    printf("Mail buffers: high water %d; mail dropped, for want of one "
+	"or of room in its mailbox, %d\n", mailPoolHighWater, numMailDropped);
+#endif
 }
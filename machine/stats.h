@@ -19,6 +19,11 @@
 //
 // The fields in this class are public to make it easier to update.
 
+#define DiskLatencyBuckets 12	// disk latency histogram: bucket i counts
+				// requests that took less than
+				// (2 * RotationTime) << i ticks, and the
+				// last one the rest
+
 class Statistics {
   public:
     int totalTicks;      	// Total time running Nachos
@@ -30,14 +35,49 @@ class Statistics {
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int numDiskSeeks;		// number of them that had to move the head
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numPageOuts;		// number of pages evicted from memory
+    int numSwapReads;		// number of pages read back from swap
+    int numSwapWrites;		// number of dirty pages written to swap
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    int numSendInterrupts;	// number of send-done interrupts they took
+    int numPacketsQueued;	// number of packets queued to be sent, and
+    double sendQueueTotal;	// how many were in the queue (this one
+    int sendQueueMax;		// included) when each was: in total, at most
+    double sendLatencyTotal;	// ticks from being queued to being on the
+    int sendLatencyMax;		// wire: in total, at most
+    int mailPoolHighWater;	// most mail buffers in use at once
+    int numMailDropped;		// number of messages thrown away, as none
+				// was free, or their mailbox was full
+    int numTLBHits;		// number of translations found in the TLB
+    int numTLBMisses;		// number of translations not in the TLB
+    int numThreads;		// number of thread control blocks handed out
+    int numStacksAllocated;	// number of thread stacks taken from the host
+    int numStacksReused;	// number of thread stacks taken from the pool
+    int threadPoolHighWater;	// most stacks ever kept in the pool at once
+    int numCacheHits;		// number of sectors found in the disk cache
+    int numCacheMisses;		// number of sectors not in the disk cache
+    int numCacheEvictions;	// number of sectors pushed out of the cache
+    int numReadAheads;		// number of sectors read into it in advance
+    int numWriteBehinds;	// number of sectors written out in advance
+    int numNameCacheHits;	// number of file name lookups answered by
+    int numNameCacheMisses;	// the name cache, and not
+    int numJournalCommits;	// number of batches of changes committed
+    int numJournalSectors;	// number of sectors they wrote to the log
+    int numCheckpoints;		// number of times the log was emptied
+    int numDiskRequests;	// number of requests served by the synch
+				// disk, and how long they took, from being
+    double diskLatencyTotal;	// made to being done (waiting included):
+    int diskLatencyMax;		// in total, at most, and how many in each
+    int diskLatency[DiskLatencyBuckets]; // bucket of the histogram
 
     Statistics(); 		// initialize everything to zero
 
+    void RecordDiskLatency(int ticks);	// count a finished disk request
     void Print();		// print collected statistics
 };
 
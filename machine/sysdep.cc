@@ -381,7 +381,7 @@ ReadFromSocket(int sockID, char *buffer, int packetSize)
 //----------------------------------------------------------------------
 // SendToSocket
 // 	Transmit a fixed size packet to another Nachos' IPC port.
-//
+//	If there is no such port, the packet is thrown away.
 //----------------------------------------------------------------------
 void
 SendToSocket(int sockID, char *buffer, int packetSize, char *toName)
@@ -409,6 +409,9 @@ SendToSocket(int sockID, char *buffer, int packetSize, char *toName)
 #endif /* HOST_LINUX */
       if( !(retVal < 0) )
 	break;
+      else if( errno == ENOENT || errno == ECONNREFUSED )
+	break;		// no such machine (not started yet, or halted):
+			// the packet is lost, as on a real network
       else if( retVal < 0 && errno != ENOBUFS )
 	{
 	  perror("socket write failed:");
@@ -450,6 +453,59 @@ Delay(int seconds)
     (void) sleep((unsigned) seconds);
 }
 
+//----------------------------------------------------------------------
+// HostMilliseconds
+// 	Return the time of day on the host, in milliseconds, wrapped to
+//	fit an int.  Only the difference between two calls means anything;
+//	benchmarks use it to report real time next to simulated time.
+//----------------------------------------------------------------------
+
+int
+HostMilliseconds()
+{
+    struct timeval tv;
+
+    (void) gettimeofday(&tv, NULL);
+    return (int) ((tv.tv_sec % 1000000) * 1000 + tv.tv_usec / 1000);
+}
+
+//----------------------------------------------------------------------
+// HostMicroseconds
+// 	Return the time on the host, in microseconds since the first call;
+//	wraps after about half an hour.  Like HostMilliseconds, only the
+//	difference between two calls means anything.
+//----------------------------------------------------------------------
+
+int
+HostMicroseconds()
+{
+    static long startSeconds = -1;
+    struct timeval tv;
+
+    (void) gettimeofday(&tv, NULL);
+    if (startSeconds < 0)
+	startSeconds = tv.tv_sec;
+    return (int) ((tv.tv_sec - startSeconds) * 1000000 + tv.tv_usec);
+}
+
+//----------------------------------------------------------------------
+// DelayMicroseconds
+// 	Put the UNIX process running Nachos to sleep for (at least) x
+//	microseconds, to let simulated time keep up with the host's.
+//----------------------------------------------------------------------
+
+void
+DelayMicroseconds(int microseconds)
+{
+    struct timeval tv;
+
+    if (microseconds <= 0)
+	return;
+    tv.tv_sec = microseconds / 1000000;
+    tv.tv_usec = microseconds % 1000000;
+    (void) select(0, NULL, NULL, NULL, &tv);
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
@@ -43,6 +43,12 @@ extern void SendToSocket(int sockID, char *buffer, int packetSize,char *toName);
 extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
+extern void DelayMicroseconds(int microseconds);
+
+// Host (wall clock) time in milliseconds, for timing benchmarks; and in
+// microseconds, for keeping simulated time in step with it
+extern int HostMilliseconds();
+extern int HostMicroseconds();
 
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(VoidNoArgFunctionPtr cleanUp);
@@ -150,6 +150,8 @@ bool Machine::WriteMem(int addr, int size, int value)
 		machine->RaiseException(exception, addr);
 		return FALSE;
 	}
+	if (frameDecoded[physicalAddress / PageSize])
+		InvalidateDecoded(physicalAddress / PageSize);
 	switch (size)
 	{
 	case 1:
@@ -171,6 +173,81 @@ bool Machine::WriteMem(int addr, int size, int value)
 	return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::FetchInstruction
+//      Return the decoded instruction at virtual address "addr", as
+//	ReadMem followed by Instruction::Decode would, but re-using the
+//	decoding from the last time the same physical word was fetched.
+//
+//	With a linear page table and a resident page, the translation is
+//	done inline; anything unusual (TLB, faults, misalignment) goes
+//	through Translate so the exception behavior is unchanged.
+//
+//   	Returns NULL if the translation step failed.
+//
+//	"addr" -- the virtual address of the instruction
+//----------------------------------------------------------------------
+
+Instruction *
+Machine::FetchInstruction(int addr)
+{
+	ExceptionType exception;
+	int physicalAddress;
+	unsigned int vpn = (unsigned)addr / PageSize;
+	int frame, word;
+	Instruction *instr;
+
+	if (tlb == NULL && !(addr & 0x3) && vpn < pageTableSize &&
+			pageTable[vpn].valid &&
+			(unsigned)pageTable[vpn].physicalPage < NumPhysPages)
+	{
+		pageTable[vpn].use = TRUE;
+		physicalAddress = pageTable[vpn].physicalPage * PageSize +
+											(unsigned)addr % PageSize;
+	}
+	else
+	{
+		exception = Translate(addr, &physicalAddress, 4, FALSE);
+		if (exception != NoException)
+		{
+			RaiseException(exception, addr);
+			return NULL;
+		}
+	}
+
+	frame = physicalAddress / PageSize;
+	word = (physicalAddress % PageSize) / 4;
+	instr = &decoded[frame][word];
+	if (!decodedValid[frame][word])
+	{
+		instr->value = WordToHost(*(unsigned int *)&mainMemory[physicalAddress]);
+		instr->Decode();
+		decodedValid[frame][word] = TRUE;
+		frameDecoded[frame] = TRUE;
+	}
+	return instr;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateDecoded
+//      Throw away the cached decodings for physical page "frame".
+//	Stores through WriteMem do this automatically; kernel code that
+//	fills a frame directly (program loading, paging) must call it.
+//----------------------------------------------------------------------
+
+void Machine::InvalidateDecoded(int frame)
+{
+	ASSERT(frame >= 0 && frame < NumPhysPages);
+	if (!frameDecoded[frame])
+		return;
+	for (int i = 0; i < InstrsPerPage; i++)
+	{
+		decodedValid[frame][i] = FALSE;
+		blockLen[frame][i] = 0;
+	}
+	frameDecoded[frame] = FALSE;
+}
+
 //----------------------------------------------------------------------
 // Machine::Translate
 // 	Translate a virtual address into a physical address, using
@@ -230,19 +307,30 @@ Machine::Translate(int virtAddr, int *physAddr, int size, bool writing)
 	}
 	else
 	{
-		for (entry = NULL, i = 0; i < TLBSize; i++)
-			if (tlb[i].valid && ((unsigned int)tlb[i].virtualPage == vpn))
-			{
-				entry = &tlb[i]; // FOUND!
-				break;
-			}
+		// try the entry that matched last time first: successive
+		// references (instruction fetches especially) are usually
+		// to the same page
+		entry = NULL;
+		i = tlbLastHit;
+		if (tlb[i].valid && ((unsigned int)tlb[i].virtualPage == vpn))
+			entry = &tlb[i];
+		else
+			for (i = 0; i < TLBSize; i++)
+				if (tlb[i].valid && ((unsigned int)tlb[i].virtualPage == vpn))
+				{
+					entry = &tlb[i]; // FOUND!
+					tlbLastHit = i;
+					break;
+				}
 		if (entry == NULL)
 		{ // not found
 			DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
+			stats->numTLBMisses++;
 			return PageFaultException; // really, this is a TLB fault,
 																 // the page may be in memory,
 																 // but not in the TLB
 		}
+		stats->numTLBHits++;
 	}
 
 	if (entry->readOnly && writing)
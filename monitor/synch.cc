@@ -37,7 +37,6 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List;
 }
 
 //----------------------------------------------------------------------
@@ -48,7 +47,6 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 
 Semaphore::~Semaphore()
 {
-    delete queue;
 }
 
 //----------------------------------------------------------------------
@@ -67,7 +65,7 @@ Semaphore::P()
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
     
     while (value == 0) { 			// semaphore not available
-	queue->Append((void *)currentThread);	// so go to sleep
+	queue.Append(currentThread);		// so go to sleep
 	currentThread->Sleep();
     } 
     value--; 					// semaphore available, 
@@ -90,7 +88,7 @@ Semaphore::V()
     Thread *thread;
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
-    thread = (Thread *)queue->Remove();
+    thread = queue.Remove();
     if (thread != NULL)	   // make thread ready, consuming the V immediately
 	scheduler->ReadyToRun(thread);
     value++;
@@ -98,6 +96,8 @@ Semaphore::V()
 }
 
 
+bool priorityDonation = TRUE;
+
 //----------------------------------------------------------------------
 // Lock::Lock
 // 	Initialize a lock, so that it can be used for synchronization.
@@ -110,7 +110,7 @@ Lock::Lock(char* debugName)
 {
     name = debugName;
     owner = NULL;
-    lock = new Semaphore(name,1);
+    nextHeld = NULL;
 }
 
 
@@ -121,40 +121,119 @@ Lock::Lock(char* debugName)
 //----------------------------------------------------------------------
 Lock::~Lock() 
 {
-    delete lock;
 }
 
 //----------------------------------------------------------------------
 // Lock::Acquire
-//      Use a binary semaphore to implement the lock.  Record which 
+//      Wait until the lock is free, then take it.  Record which 
 //      thread acquired the lock in order to assure that only the
 //      same thread releases it.
+//
+//	While waiting, donate our priority to the owner.  Once we have
+//	the lock, threads still waiting on it donate theirs to us.
 //----------------------------------------------------------------------
 void Lock::Acquire() 
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);  // disable interrupts
 
-    lock->P();                            // procure the semaphore
+    ASSERT(owner != currentThread);
+    while (owner != NULL) {		  // lock is busy, so go to sleep
+	currentThread->waitingFor = this;
+	waiters.SortedInsert(currentThread, currentThread->GetPriority());
+	if (priorityDonation)
+	    Donate();
+	currentThread->Sleep();
+    }
+    currentThread->waitingFor = NULL;
     owner = currentThread;                // record the new owner of the lock
+    nextHeld = currentThread->heldLocks;
+    currentThread->heldLocks = this;
+    if (priorityDonation)
+	currentThread->RecomputePriority();
     (void) interrupt->SetLevel(oldLevel); // re-enable interrupts
 }
 
 //----------------------------------------------------------------------
 // Lock::Release
-//      Set the lock to be free (i.e. vanquish the semaphore).  Check
-//      that the currentThread is allowed to release this lock.
+//      Set the lock to be free, and wake up the highest priority
+//      waiter, if any.  Check that the currentThread is allowed to
+//      release this lock.  Give up any priority donated through it.
 //----------------------------------------------------------------------
 void Lock::Release() 
 {
+    Lock **ptr;
+    Thread *thread;
     IntStatus oldLevel = interrupt->SetLevel(IntOff);  // disable interrupts
 
     // Ensure: a) lock is BUSY  b) this thread is the same one that acquired it.
     ASSERT(currentThread == owner);        
     owner = NULL;                          // clear the owner
-    lock->V();                             // vanquish the semaphore
+    for (ptr = &currentThread->heldLocks; *ptr != this; ptr = &(*ptr)->nextHeld)
+	ASSERT(*ptr != NULL);
+    *ptr = nextHeld;
+    nextHeld = NULL;
+
+    thread = waiters.SortedRemove(NULL);
+    if (thread != NULL)			   // it retries in Acquire
+	scheduler->ReadyToRun(thread);
+    if (priorityDonation)
+	currentThread->RecomputePriority();
     (void) interrupt->SetLevel(oldLevel);
 }
 
+//----------------------------------------------------------------------
+// Lock::Donate
+//      The current thread has just started waiting on this lock.  Raise
+//      the owner's priority to ours, if that is higher; if the owner is
+//      waiting on another lock, raise that lock's owner's priority, and
+//      so on along the chain.  Stop as soon as some owner's priority
+//      doesn't change, since the rest of the chain has it already.
+//----------------------------------------------------------------------
+void Lock::Donate()
+{
+    Lock *lock = this;
+    Thread *holder;
+    unsigned int before;
+
+    while (lock != NULL && lock->owner != NULL) {
+	holder = lock->owner;
+	before = holder->GetPriority();
+	scheduler->Reprioritize(holder);  // moves it if it is ready to run
+	if (holder->GetPriority() == before)
+	    break;
+	DEBUG('t', "Thread \"%s\" inherits priority %d through lock \"%s\"\n",
+	      holder->getName(), holder->GetPriority(), lock->name);
+	lock = holder->waitingFor;
+	if (lock != NULL)
+	    lock->Requeue(holder);
+    }
+}
+
+//----------------------------------------------------------------------
+// Lock::Requeue
+//      "waiter"'s priority has changed; keep the list of waiters sorted.
+//      (It may have been woken up already, and not be on the list.)
+//----------------------------------------------------------------------
+void Lock::Requeue(Thread *waiter)
+{
+    if (waiters.RemoveItem(waiter))
+	waiters.SortedInsert(waiter, waiter->GetPriority());
+}
+
+//----------------------------------------------------------------------
+// Lock::TopWaiterPriority
+//      Return the priority of the highest priority thread waiting on
+//      the lock, or NumPriorities if there is none.
+//----------------------------------------------------------------------
+unsigned int Lock::TopWaiterPriority()
+{
+    int priority;
+
+    if (waiters.Front(&priority) == NULL)
+	return NumPriorities;
+    return priority;
+}
+
 
 //----------------------------------------------------------------------
 // Lock::isHeldByCurrentThread
@@ -179,7 +258,6 @@ bool Lock::isHeldByCurrentThread()
 Condition::Condition(char* debugName) 
 { 
     name = debugName;
-    queue = new List;
     lock = NULL;
 }
 
@@ -191,7 +269,6 @@ Condition::Condition(char* debugName)
 
 Condition::~Condition() 
 { 
-    delete queue;
 }
 
 //----------------------------------------------------------------------
@@ -208,11 +285,11 @@ void Condition::Wait(Lock* conditionLock)
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
     ASSERT(conditionLock->isHeldByCurrentThread());  // check pre-condition
-    if(queue->IsEmpty()) {
+    if(queue.IsEmpty()) {
 	lock = conditionLock;  // helps to enforce pre-condition
     } 
     ASSERT(lock == conditionLock); // another pre-condition
-    queue->Append(currentThread);  // add this thread to the waiting list
+    queue.Append(currentThread);  // add this thread to the waiting list
     conditionLock->Release();      // release the lock
     currentThread->Sleep();        // goto sleep
     conditionLock->Acquire();      // awaken: re-acquire the lock
@@ -232,9 +309,9 @@ void Condition::Signal(Lock* conditionLock)
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
     ASSERT(conditionLock->isHeldByCurrentThread());
-    if(!queue->IsEmpty()) {
+    if(!queue.IsEmpty()) {
 	ASSERT(lock == conditionLock);
-	nextThread = (Thread *)queue->Remove();
+	nextThread = queue.Remove();
 	scheduler->ReadyToRun(nextThread);      // wake up the thread
     } 
     (void) interrupt->SetLevel(oldLevel);
@@ -253,15 +330,253 @@ void Condition::Broadcast(Lock* conditionLock)
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
     ASSERT(conditionLock->isHeldByCurrentThread());
-    if(!queue->IsEmpty()) {
+    if(!queue.IsEmpty()) {
 	ASSERT(lock == conditionLock);
-	while(nextThread = (Thread *)queue->Remove()) {
+	while(nextThread = queue.Remove()) {
 	    scheduler->ReadyToRun(nextThread);  // wake up the thread
 	}
     } 
     (void) interrupt->SetLevel(oldLevel);
 }
 
+//----------------------------------------------------------------------
+// RWLock::RWLock
+// 	Initialize a reader/writer lock, so that nobody holds it.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//	"pref" is who goes first, when readers and writers are both
+//	waiting.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(char* debugName, RWPreference pref)
+{
+    name = debugName;
+    preference = pref;
+    lock = new Lock(debugName);
+    readOK = new Condition(debugName);
+    writeOK = new Condition(debugName);
+    upgradeOK = new Condition(debugName);
+    readers = waitingReaders = waitingWriters = 0;
+    writer = NULL;
+    upgrading = FALSE;
+    readHolds = writeHolds = readWaits = writeWaits = 0;
+    readWaitTicks = writeWaitTicks = maxWaitTicks = 0;
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+// 	De-allocate the lock.  Assume nobody holds it, or waits for it.
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    ASSERT(readers == 0 && writer == NULL);
+    delete lock;
+    delete readOK;
+    delete writeOK;
+    delete upgradeOK;
+}
+
+//----------------------------------------------------------------------
+// RWLock::CanRead
+// 	May a new reader take the lock now?  Not if a writer has it, or a
+//	reader is upgrading; nor, if writers go first, while one waits.
+//	Called with "lock" held.
+//----------------------------------------------------------------------
+
+bool
+RWLock::CanRead()
+{
+    return writer == NULL && !upgrading &&
+	(preference == PreferReaders || waitingWriters == 0);
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireRead, RWLock::ReleaseRead
+// 	Share the lock with any other readers.  The last reader out lets
+//	a waiting writer (or upgrading reader) in.
+//----------------------------------------------------------------------
+
+void
+RWLock::AcquireRead()
+{
+    int start = stats->totalTicks;
+    bool waited = FALSE;
+
+    lock->Acquire();
+    ASSERT(writer != currentThread);
+    waitingReaders++;
+    while (!CanRead()) {
+	waited = TRUE;
+	readOK->Wait(lock);
+    }
+    waitingReaders--;
+    readers++;
+    readHolds++;
+    if (waited)
+	Waited(FALSE, start);
+    lock->Release();
+}
+
+void
+RWLock::ReleaseRead()
+{
+    lock->Acquire();
+    ASSERT(readers > 0 && writer == NULL);
+    readers--;
+    if (upgrading && readers == 1)	// only the upgrader is left
+	upgradeOK->Signal(lock);
+    else if (readers == 0 && waitingWriters > 0)
+	writeOK->Signal(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireWrite, RWLock::ReleaseWrite
+// 	Hold the lock alone.  On the way out, hand it on to whoever the
+//	preference says should go first, if both are waiting.
+//----------------------------------------------------------------------
+
+void
+RWLock::AcquireWrite()
+{
+    int start = stats->totalTicks;
+    bool waited = FALSE;
+
+    lock->Acquire();
+    ASSERT(writer != currentThread);
+    waitingWriters++;
+    while (writer != NULL || readers > 0 ||
+	   (preference == PreferReaders && waitingReaders > 0)) {
+	waited = TRUE;
+	writeOK->Wait(lock);
+    }
+    waitingWriters--;
+    writer = currentThread;
+    writeHolds++;
+    if (waited)
+	Waited(TRUE, start);
+    lock->Release();
+}
+
+void
+RWLock::ReleaseWrite()
+{
+    lock->Acquire();
+    ASSERT(writer == currentThread);
+    writer = NULL;
+    if (waitingReaders > 0 && CanRead())
+	readOK->Broadcast(lock);
+    else if (waitingWriters > 0)
+	writeOK->Signal(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::Upgrade
+// 	Turn the current thread's read hold into a write hold, once the
+//	other readers are gone.  If another reader is upgrading already,
+//	get out of its way and wait for the write lock from scratch, and
+//	return FALSE: whatever was read under the read hold may have
+//	changed since.  Otherwise return TRUE.
+//----------------------------------------------------------------------
+
+bool
+RWLock::Upgrade()
+{
+    int start = stats->totalTicks;
+    bool waited = FALSE;
+
+    lock->Acquire();
+    ASSERT(readers > 0 && writer == NULL);
+    if (upgrading) {
+	readers--;
+	if (readers == 1)
+	    upgradeOK->Signal(lock);
+	lock->Release();
+	AcquireWrite();
+	return FALSE;
+    }
+    upgrading = TRUE;
+    while (readers > 1) {
+	waited = TRUE;
+	upgradeOK->Wait(lock);
+    }
+    upgrading = FALSE;
+    readers = 0;
+    writer = currentThread;
+    writeHolds++;
+    if (waited)
+	Waited(TRUE, start);
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// RWLock::Downgrade
+// 	Turn the current thread's write hold into a read hold, and let in
+//	any readers that are allowed to come in with it.
+//----------------------------------------------------------------------
+
+void
+RWLock::Downgrade()
+{
+    lock->Acquire();
+    ASSERT(writer == currentThread);
+    writer = NULL;
+    readers = 1;
+    if (waitingReaders > 0 && CanRead())
+	readOK->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::isWriteHeldByCurrentThread
+//----------------------------------------------------------------------
+
+bool
+RWLock::isWriteHeldByCurrentThread()
+{
+    return writer == currentThread;
+}
+
+//----------------------------------------------------------------------
+// RWLock::Waited
+// 	Count a wait for a read ("forWrite" FALSE) or write hold that
+//	started at "start".
+//----------------------------------------------------------------------
+
+void
+RWLock::Waited(bool forWrite, int start)
+{
+    int ticks = stats->totalTicks - start;
+
+    if (forWrite) {
+	writeWaits++;
+	writeWaitTicks += ticks;
+    } else {
+	readWaits++;
+	readWaitTicks += ticks;
+    }
+    if (ticks > maxWaitTicks)
+	maxWaitTicks = ticks;
+}
+
+//----------------------------------------------------------------------
+// RWLock::PrintStats
+// 	Print how often the lock was taken, and how much of that was spent
+//	waiting.
+//----------------------------------------------------------------------
+
+void
+RWLock::PrintStats()
+{
+    printf("RWLock %s: reads %d (waited %d, %d ticks), "
+	   "writes %d (waited %d, %d ticks), longest wait %d ticks\n",
+	   name, readHolds, readWaits, readWaitTicks,
+	   writeHolds, writeWaits, writeWaitTicks, maxWaitTicks);
+}
+
 // condition variables in Hoare's style
 Condition_H::Condition_H(char* debugName) 
 { 
@@ -0,0 +1,21 @@
+#!/bin/sh
+# goodput.sh
+#	Run the reliable transport benchmark between two copies of Nachos
+#	(machines 0 and 1) on this host, once for each network reliability
+#	given, and print the goodput each time.  Run from the directory
+#	nachos was built in:  sh goodput.sh [bytes] [reliability ...]
+
+bytes=${1:-20000}
+shift
+rates=${*:-1 0.95 0.9 0.8 0.7 0.5}
+
+for n in $rates; do
+	rm -f SOCKET_0 SOCKET_1
+	./nachos -m 1 -n $n -tr 0 $bytes > receiver.log 2>&1 &
+	./nachos -m 0 -n $n -ts 1 $bytes > sender.log 2>&1
+	wait
+	echo "reliability $n:"
+	grep -e "可靠传输测试" -e "Channel" sender.log
+	grep -e "可靠传输测试" receiver.log
+done
+rm -f SOCKET_0 SOCKET_1 sender.log receiver.log
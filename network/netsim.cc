@@ -0,0 +1,424 @@
+// netsim.cc
+//	One node of a simulated network: the workloads that netsim.sh
+//	runs, on several copies of Nachos at once, over a topology
+//	described in a file, to measure what the network does.
+//
+//	Every node reads the same topology file.  Each line is one of
+//		nodes <number of nodes>
+//		timeout <ticks to wait for an answer>
+//		link <node> <node> [loss <fraction>] [delay <ticks>]
+//			[bandwidth <packets per 1000 ticks>]
+//	where a node may be "*", for every node; later lines override
+//	earlier ones, and "#" starts a comment.  Links go both ways.  A
+//	link that isn't mentioned loses nothing, adds no delay, and takes
+//	NetworkTime to send a packet on.
+//
+//	While a node is idle, its simulated clock keeps to the host's, a
+//	tick a microsecond, so that every node's clock runs at the same
+//	rate, and delays and timeouts in ticks mean the same on all of
+//	them.  (Otherwise an idle node's clock races ahead, by however
+//	much it happens to idle.)
+//
+//	The workloads:
+//		pingpong	each even node pings the node after it
+//		alltoall	every node pings every other, all at once
+//		ring		node 0 sends a token round all the nodes
+//	in each case "rounds" times.  A ping that isn't answered within
+//	the timeout is counted as lost.  Each node that sends reports how
+//	many of its pings were answered, the percentiles of the round
+//	trip times, and the throughput; every node then keeps answering
+//	the others until netsim.sh stops it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#include "system.h"
+#include "network.h"
+#include "post.h"
+#include "interrupt.h"
+
+#define EchoBox		4	// pings are answered from here
+#define ReplyBox	5	// ... to here
+#define RingBox		6	// the token goes round these
+
+#define TicksPerMillisecond	1000	// while idle, simulated time keeps
+					// to the host's: a tick a microsecond
+#define DefaultTimeout	(1000 * NetworkTime)	// 100ms; pings on lan4 take
+						// at most a few ms
+
+// What a ping (or the token) carries, so that its answer can be matched
+// up with it, and timed.
+
+class Probe {
+  public:
+    int seq;			// which ping it is
+    int sentAt;			// when it was sent
+};
+
+// A ping waiting for its answer; there is one for each node, so each
+// node pings any other node once at a time (or, for the ring, itself).
+
+class PingWait {
+  public:
+    int seq;			// the ping being waited for
+    bool done;			// answered, or timed out?
+    int rtt;			// round trip time; -1 if timed out
+    Semaphore *answered;	// V'ed when it is done
+};
+
+class PingTimer {		// argument to the timeout handler
+  public:
+    int node, seq;
+};
+
+static int numNodes, myAddr, timeout;
+static PingWait waits[MaxNodes];
+
+static Lock *sampleLock;	// protects the following
+static int *samples;		// round trip times of the pings answered
+static int numSamples, numLost;
+
+//----------------------------------------------------------------------
+// ParseNode
+//	Parse a node in the topology file: a machine ID, or -1 for "*".
+//----------------------------------------------------------------------
+
+static int
+ParseNode(char *word)
+{
+    if (word == NULL)
+	return MaxNodes;		// (no good)
+    if (!strcmp(word, "*"))
+	return -1;
+    return atoi(word);
+}
+
+//----------------------------------------------------------------------
+// ReadTopology
+//	Read the topology file, and set up the links from this machine
+//	to the others accordingly.
+//----------------------------------------------------------------------
+
+static void
+ReadTopology(char *name)
+{
+    FILE *file = fopen(name, "r");
+    char line[200], *word;
+    int lineNumber = 0;
+
+    if (file == NULL) {
+	printf("netsim: can't open %s\n", name);
+	fflush(stdout);
+	ASSERT(FALSE);
+    }
+    numNodes = 0;
+    timeout = DefaultTimeout;
+    while (fgets(line, sizeof(line), file) != NULL) {
+	lineNumber++;
+	if ((word = strchr(line, '#')) != NULL)
+	    *word = '\0';
+	if ((word = strtok(line, " \t\n")) == NULL)
+	    continue;
+	if (!strcmp(word, "nodes") || !strcmp(word, "timeout")) {
+	    char *value = strtok(NULL, " \t\n");
+
+	    if (value == NULL)
+		goto bad;
+	    if (!strcmp(word, "nodes"))
+		numNodes = atoi(value);
+	    else
+		timeout = atoi(value);
+	} else if (!strcmp(word, "link")) {
+	    int a = ParseNode(strtok(NULL, " \t\n"));
+	    int b = ParseNode(strtok(NULL, " \t\n"));
+	    double loss = 0;
+	    int delay = 0, packetTime = NetworkTime;
+
+	    if (a >= MaxNodes || b >= MaxNodes)
+		goto bad;
+	    while ((word = strtok(NULL, " \t\n")) != NULL) {
+		char *value = strtok(NULL, " \t\n");
+
+		if (value == NULL)
+		    goto bad;
+		if (!strcmp(word, "loss"))
+		    loss = atof(value);
+		else if (!strcmp(word, "delay"))
+		    delay = atoi(value);
+		else if (!strcmp(word, "bandwidth") && atof(value) > 0)
+		    packetTime = max((int) (1000 / atof(value)), 1);
+		else
+		    goto bad;
+	    }
+	    for (int other = 0; other < MaxNodes; other++)
+		if (other != myAddr &&
+		    (((a == myAddr || a == -1) && (b == other || b == -1)) ||
+		     ((a == other || a == -1) && (b == myAddr || b == -1))))
+		    postOffice->SetLink(other, 1 - loss, delay, packetTime);
+	} else
+	    goto bad;
+    }
+    fclose(file);
+    if (numNodes < 2 || numNodes > MaxNodes || myAddr >= numNodes) {
+	printf("netsim: %s needs \"nodes\", from 2 to %d, including %d\n",
+	       name, MaxNodes, myAddr);
+	fflush(stdout);
+	ASSERT(FALSE);
+    }
+    return;
+
+  bad:
+    printf("netsim: bad line %d in %s\n", lineNumber, name);
+    fflush(stdout);
+    ASSERT(FALSE);
+}
+
+//----------------------------------------------------------------------
+// Answered
+//	The answer to the ping waited for in slot "node" has come -- or,
+//	if "probe" is NULL, the time to wait for it is up.  Stale answers,
+//	to pings already given up on, are ignored.
+//----------------------------------------------------------------------
+
+static void
+Answered(int node, int seq, Probe *probe)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    PingWait *w = &waits[node];
+
+    if (w->seq == seq && !w->done) {
+	w->done = TRUE;
+	w->rtt = (probe == NULL) ? -1 : stats->totalTicks - probe->sentAt;
+	w->answered->V();
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+static void
+PingTimedOut(_int arg)
+{
+    PingTimer *pingTimer = (PingTimer *) arg;
+
+    Answered(pingTimer->node, pingTimer->seq, NULL);
+    delete pingTimer;
+}
+
+//----------------------------------------------------------------------
+// Ping
+//	Send a ping to mailbox "box" on machine "to", and wait until it is
+//	answered -- in slot "node" of "waits" -- or the timeout is up.
+//	Record the round trip time, or that it was lost.
+//----------------------------------------------------------------------
+
+static void
+Ping(int to, int box, int node)
+{
+    PingWait *w = &waits[node];
+    PingTimer *pingTimer = new PingTimer;
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+    Probe probe;
+    IntStatus oldLevel;
+
+    oldLevel = interrupt->SetLevel(IntOff);
+    probe.seq = ++w->seq;
+    probe.sentAt = stats->totalTicks;
+    w->done = FALSE;
+    (void) interrupt->SetLevel(oldLevel);
+
+    pktHdr.to = to;
+    mailHdr.to = box;
+    mailHdr.from = ReplyBox;
+    mailHdr.length = sizeof(Probe);
+    postOffice->Send(pktHdr, mailHdr, (char *) &probe);
+
+    pingTimer->node = node;
+    pingTimer->seq = probe.seq;
+    interrupt->Schedule(PingTimedOut, (_int) pingTimer, timeout, TimerInt);
+    w->answered->P();
+
+    sampleLock->Acquire();
+    if (w->rtt < 0)
+	numLost++;
+    else
+	samples[numSamples++] = w->rtt;
+    sampleLock->Release();
+}
+
+//----------------------------------------------------------------------
+// EchoServer, Collector, RingForwarder
+//	The threads every node runs: answer pings; match answers up with
+//	the pings they answer; pass the token on to the next node (or, at
+//	node 0, take it as the answer to the ping it sent round).  Mail
+//	from machines that aren't in the topology is ignored.
+//----------------------------------------------------------------------
+
+static void
+EchoServer(_int arg)
+{
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+
+    for (;;) {
+	Mail *mail = postOffice->Receive(EchoBox);
+
+	pktHdr.to = mail->pktHdr.from;
+	mailHdr.to = mail->mailHdr.from;
+	mailHdr.from = EchoBox;
+	mailHdr.length = mail->mailHdr.length;
+	postOffice->Send(pktHdr, mailHdr, mail->data);
+	mail->Release();
+    }
+}
+
+static void
+Collector(_int arg)
+{
+    Probe probe;
+
+    for (;;) {
+	Mail *mail = postOffice->Receive(ReplyBox);
+
+	if (mail->pktHdr.from >= 0 && mail->pktHdr.from < numNodes) {
+	    bcopy(mail->data, (char *) &probe, sizeof(Probe));
+	    Answered(mail->pktHdr.from, probe.seq, &probe);
+	}
+	mail->Release();
+    }
+}
+
+static void
+RingForwarder(_int arg)
+{
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+    Probe probe;
+
+    for (;;) {
+	Mail *mail = postOffice->Receive(RingBox);
+
+	if (mail->pktHdr.from < 0 || mail->pktHdr.from >= numNodes)
+	    ;				// not one of ours
+	else if (myAddr == 0) {		// it's been all the way round
+	    bcopy(mail->data, (char *) &probe, sizeof(Probe));
+	    Answered(myAddr, probe.seq, &probe);
+	} else {
+	    pktHdr.to = (myAddr + 1) % numNodes;
+	    mailHdr.to = RingBox;
+	    mailHdr.from = RingBox;
+	    mailHdr.length = mail->mailHdr.length;
+	    postOffice->Send(pktHdr, mailHdr, mail->data);
+	}
+	mail->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// Pinger
+//	A thread that pings one other node "rounds" times, one after
+//	the other.  (For alltoall.)
+//----------------------------------------------------------------------
+
+static int pingRounds;
+static Semaphore *pingersDone;
+
+static void
+Pinger(_int to)
+{
+    for (int i = 0; i < pingRounds; i++)
+	Ping(to, EchoBox, to);
+    pingersDone->V();
+}
+
+//----------------------------------------------------------------------
+// Percentile
+//	The "p"th percentile of the (sorted) round trip times.
+//----------------------------------------------------------------------
+
+static int
+Percentile(int p)
+{
+    return samples[min((numSamples * p + 99) / 100, numSamples) - 1];
+}
+
+//----------------------------------------------------------------------
+// NetSim
+//	Be node "postOffice->Address()" of the network described in
+//	"topology", and run "workload" on it for "rounds" rounds.
+//----------------------------------------------------------------------
+
+void
+NetSim(char *topology, char *workload, int rounds)
+{
+    int start, startHost, ticks, ms, sent, i, j, v;
+
+    myAddr = postOffice->Address();
+    ReadTopology(topology);
+    interrupt->SetRealTime(TicksPerMillisecond);
+    for (i = 0; i < numNodes; i++) {
+	waits[i].seq = 0;
+	waits[i].answered = new Semaphore("ping answered", 0);
+    }
+    sampleLock = new Lock("netsim samples");
+    samples = new int[rounds * numNodes];
+    numSamples = numLost = 0;
+    pingRounds = rounds;
+    pingersDone = new Semaphore("pingers done", 0);
+
+    (new Thread("echo server"))->Fork(EchoServer, 0);
+    (new Thread("collector"))->Fork(Collector, 0);
+    (new Thread("ring forwarder"))->Fork(RingForwarder, 0);
+
+    start = stats->totalTicks;
+    startHost = HostMilliseconds();
+    if (!strcmp(workload, "pingpong")) {
+	if (myAddr % 2 == 0 && myAddr + 1 < numNodes)
+	    for (i = 0; i < rounds; i++)
+		Ping(myAddr + 1, EchoBox, myAddr + 1);
+    } else if (!strcmp(workload, "alltoall")) {
+	for (i = 0; i < numNodes; i++)
+	    if (i != myAddr)
+		(new Thread("pinger"))->Fork(Pinger, i);
+	for (i = 0; i < numNodes - 1; i++)
+	    pingersDone->P();
+    } else if (!strcmp(workload, "ring")) {
+	if (myAddr == 0)
+	    for (i = 0; i < rounds; i++)
+		Ping(1, RingBox, myAddr);
+    } else {
+	printf("netsim: unknown workload %s\n", workload);
+	fflush(stdout);
+	ASSERT(FALSE);
+    }
+    ticks = stats->totalTicks - start;
+    ms = HostMilliseconds() - startHost;
+
+    // sort the round trip times, to find the percentiles
+    for (i = 1; i < numSamples; i++) {
+	v = samples[i];
+	for (j = i; j > 0 && samples[j - 1] > v; j--)
+	    samples[j] = samples[j - 1];
+	samples[j] = v;
+    }
+
+    sent = numSamples + numLost;
+    if (sent > 0) {
+	printf("网络模拟：节点 %d，负载 %s，共 %d 个节点，发出 %d 次，"
+	       "得到回应 %d 次，丢失 %d 次\n", myAddr, workload, numNodes,
+	       sent, numSamples, numLost);
+	if (numSamples > 0)
+	    printf("网络模拟：节点 %d，往返时间 p50 %d，p90 %d，p99 %d，"
+		   "最大 %d ticks\n", myAddr, Percentile(50), Percentile(90),
+		   Percentile(99), samples[numSamples - 1]);
+	printf("网络模拟：节点 %d，吞吐 %.3f 次/千 tick，%.1f 次/秒\n",
+	       myAddr, numSamples * 1000.0 / max(ticks, 1),
+	       numSamples * 1000.0 / max(ms, 1));
+    }
+    printf("网络模拟：节点 %d 完成\n", myAddr);
+    fflush(stdout);
+
+    // keep answering the other nodes, until netsim.sh stops us
+}
@@ -0,0 +1,65 @@
+#!/bin/sh
+# netsim.sh
+#	Run a workload over a simulated network: start one copy of Nachos
+#	for each node in the topology file, on this host, wait until every
+#	one has done its part, then stop them all and print what they
+#	measured (cf. netsim.cc).  Run from the directory nachos was built
+#	in:  sh netsim.sh <topology file> <pingpong|alltoall|ring> [rounds]
+#
+#	Exits with status 1 if a node dies, or they aren't all done within
+#	NETSIM_TIMEOUT seconds (default 120).
+
+topo=$1
+workload=$2
+rounds=${3:-100}
+limit=${NETSIM_TIMEOUT:-120}
+
+if [ ! -f "$topo" ] || [ -z "$workload" ]; then
+	echo "usage: sh netsim.sh <topology file> <pingpong|alltoall|ring> [rounds]"
+	exit 2
+fi
+nodes=`awk '$1 == "nodes" { print $2 }' $topo`
+
+rm -f SOCKET_*
+pids=""
+i=0
+while [ $i -lt $nodes ]; do
+	./nachos -m $i -ns $topo $workload $rounds > netsim.$i.log 2>&1 &
+	pids="$pids $!"
+	i=`expr $i + 1`
+done
+
+# wait until every node has said it's done, or one has died
+status=0
+waited=0
+while :; do
+	done=`cat netsim.*.log | grep -c "完成"`
+	[ $done -eq $nodes ] && break
+	for pid in $pids; do
+		case `ps -o stat= -p $pid` in
+		""|Z*)
+			status=1;;
+		esac
+	done
+	if [ $status -ne 0 ]; then
+		echo "netsim: a node stopped before it was done"
+		break
+	fi
+	if [ $waited -ge $limit ]; then
+		echo "netsim: timed out after $limit seconds"
+		status=1
+		break
+	fi
+	sleep 1
+	waited=`expr $waited + 1`
+done
+kill $pids 2>/dev/null
+wait 2>/dev/null
+
+i=0
+while [ $i -lt $nodes ]; do
+	grep -v "完成" netsim.$i.log | grep -e "网络模拟" -e "netsim" -e "Assert"
+	i=`expr $i + 1`
+done
+rm -f SOCKET_* netsim.*.log
+exit $status
@@ -7,6 +7,17 @@
 //		./nachos -m 0 -o 1 &
 //		./nachos -m 1 -o 0 &
 //
+//	The same goes for the reliable transport benchmark (cf. goodput.sh):
+//		./nachos -m 1 -tr 0 100000 &
+//		./nachos -m 0 -ts 1 100000
+//
+//	The Post Office send benchmark needs only the one:
+//		./nachos -m 0 -pb 8
+//
+//	The RPC benchmark needs a server and a client (cf. rpcbench.sh):
+//		./nachos -m 1 -rpcs 4 &
+//		./nachos -m 0 -rpcc 1 8 200
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -16,6 +27,8 @@
 #include "system.h"
 #include "network.h"
 #include "post.h"
+#include "transport.h"
+#include "rpc.h"
 #include "interrupt.h"
 
 // Test out message delivery, by doing the following:
@@ -62,6 +75,302 @@ MailTest(int farAddr)
     printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
     fflush(stdout);
 
-    // Then we're done!
+    // Then we're done!  (Once our acknowledgement has actually gone out.)
+    postOffice->Flush();
+    interrupt->Halt();
+}
+
+//----------------------------------------------------------------------
+// Reliable transport benchmark
+//	One machine sends "numBytes" bytes to the other over a Channel, in
+//	messages of TransportMessage bytes (several segments each); the
+//	other checks every byte, and sends back how many were right.  The
+//	sender reports the goodput -- bytes delivered, not counting
+//	anything sent more than once -- in simulated and in real time.
+//	Run it with different -n, to see what losing packets costs.
+//----------------------------------------------------------------------
+
+#define TransportBox	2	// both ends use this mailbox
+#define TransportMessage 100	// bytes in each message
+#define LingerTime	(10 * MaxRTO)	// cf. TransportSender
+
+static char
+TransportByte(int position)
+{
+    return (char) (position % 251);
+}
+
+static void
+LingerDone(_int sem)
+{
+    ((Semaphore *) sem)->V();
+}
+
+void
+TransportSender(int farAddr, int numBytes)
+{
+    Channel *channel = new Channel(farAddr, TransportBox, TransportBox);
+    Semaphore *linger = new Semaphore("linger", 0);
+    char buffer[TransportMessage];
+    int sent, n, i, good = 0;
+    int start = stats->totalTicks, startHost = HostMilliseconds();
+    int ticks, ms;
+
+    for (sent = 0; sent < numBytes; sent += n) {
+	n = min(numBytes - sent, TransportMessage);
+	for (i = 0; i < n; i++)
+	    buffer[i] = TransportByte(sent + i);
+	channel->Send(buffer, n);
+    }
+    channel->Receive((char *) &good, sizeof(int));
+    ticks = stats->totalTicks - start;
+    ms = HostMilliseconds() - startHost;
+
+    printf("可靠传输测试：发送 %d 字节，对方正确收到 %d 字节，"
+	   "模拟时间 %d ticks，实际用时 %d ms\n", numBytes, good, ticks, ms);
+    printf("可靠传输测试：有效吞吐 %.2f 字节/千 tick，%.1f KB/s\n",
+	   numBytes * 1000.0 / ticks, ms > 0 ? numBytes / 1.024 / ms : 0.0);
+    channel->PrintStats();
+    fflush(stdout);
+
+    // Our acknowledgement of the reply may be lost; stay around for a
+    // while to acknowledge it again, if the other end sends it again.
+    // (Sending to a machine that is gone is fatal, so the other end
+    // stays around longer still.)
+    interrupt->Schedule(LingerDone, (_int) linger, LingerTime, TimerInt);
+    linger->P();
+    interrupt->Halt();
+}
+
+void
+TransportReceiver(int farAddr, int numBytes)
+{
+    Channel *channel = new Channel(farAddr, TransportBox, TransportBox);
+    char buffer[TransportMessage];
+    int received = 0, good = 0, n, i;
+
+    while (received < numBytes) {
+	n = channel->Receive(buffer, TransportMessage);
+	ASSERT(n <= TransportMessage);
+	for (i = 0; i < n; i++)
+	    if (buffer[i] == TransportByte(received + i))
+		good++;
+	received += n;
+    }
+    channel->Send((char *) &good, sizeof(int));
+    channel->Flush();			// (once the sender has it, it's done)
+
+    printf("可靠传输测试：收到 %d 字节，正确 %d 字节\n", received, good);
+    channel->PrintStats();
+    fflush(stdout);
+    Delay(2);				// until the sender has stopped
+    interrupt->Halt();
+}
+
+//----------------------------------------------------------------------
+// Post Office send benchmark
+//	"numThreads" threads each send PostBenchMails pieces of mail, as
+//	fast as they can, to a mailbox on this same machine; the main
+//	thread takes them all in.  Reports how long the senders took to
+//	get their mail off their hands, and how long until it had all
+//	arrived.  The transmit queue's depth and latency are in the
+//	statistics printed at the end.  Needs a reliable network (-n 1).
+//----------------------------------------------------------------------
+
+#define PostBenchBox	3
+#define PostBenchMails	200
+
+static Semaphore *postBenchDone;
+static int postBenchSent;		// when the last sender was done
+
+static void
+PostBenchSender(_int which)
+{
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+    char data[MaxMailSize];
+
+    pktHdr.to = postOffice->Address();
+    mailHdr.to = PostBenchBox;
+    mailHdr.from = PostBenchBox;
+    mailHdr.length = MaxMailSize;
+    for (int i = 0; i < PostBenchMails; i++) {
+	data[0] = (char) which;
+	postOffice->Send(pktHdr, mailHdr, data);
+    }
+    postBenchSent = max(postBenchSent, stats->totalTicks);
+    postBenchDone->V();
+}
+
+void
+PostBenchmark(int numThreads)
+{
+    int total = numThreads * PostBenchMails;
+    int start = stats->totalTicks, sendTicks, ticks, i;
+
+    postBenchDone = new Semaphore("post benchmark done", 0);
+    postBenchSent = start;
+    for (i = 0; i < numThreads; i++) {
+	Thread *t = new Thread("post benchmark sender");
+
+	t->Fork(PostBenchSender, (_int) i);
+    }
+    for (i = 0; i < total; i++)		// (no need to copy it out)
+	postOffice->Receive(PostBenchBox)->Release();
+    ticks = stats->totalTicks - start;
+    for (i = 0; i < numThreads; i++)
+	postBenchDone->P();
+    sendTicks = postBenchSent - start;
+
+    printf("投递测试：%d 个线程，每个发送 %d 封信\n", numThreads,
+	   PostBenchMails);
+    printf("投递测试：发送方用时 %d ticks，全部收到用时 %d ticks，"
+	   "%.2f 封/千 tick\n", sendTicks, ticks, total * 1000.0 / ticks);
+    fflush(stdout);
+    delete postBenchDone;
+    interrupt->Halt();
+}
+
+//----------------------------------------------------------------------
+// RPC benchmark
+//	The server answers calls to RpcAdd, with a pool of "numWorkers"
+//	threads.  The client calls it from "numThreads" threads at once,
+//	"numCalls" times each, checks every result, and reports calls per
+//	1000 ticks (and per second), and the percentiles of the time the
+//	calls took.  Then it tells the server to stop.
+//----------------------------------------------------------------------
+
+#define RpcBenchBox	7	// the server's mailbox
+#define RpcBenchReplyBox 8	// the client's
+#define RpcAdd		1	// procedures
+#define RpcStop		2
+#define RpcStopTries	8	// times to tell the server to stop
+
+static Semaphore *rpcStopped;
+
+static int
+RpcAddHandler(char *args, int argLength, char *result)
+{
+    RpcMarshal in(args, argLength), out(result, RpcMaxData);
+    int a = in.GetInt(), b = in.GetInt();
+
+    if (in.Bad())
+	return 0;			// (the caller will notice)
+    out.PutInt(a + b);
+    return out.Length();
+}
+
+static int
+RpcStopHandler(char *args, int argLength, char *result)
+{
+    rpcStopped->V();
+    return 0;
+}
+
+void
+RpcServerBenchmark(int numWorkers)
+{
+    RpcServer *server = new RpcServer(RpcBenchBox);
+
+    rpcStopped = new Semaphore("rpc server stopped", 0);
+    server->Register(RpcAdd, RpcAddHandler);
+    server->Register(RpcStop, RpcStopHandler);
+    server->Start(numWorkers);
+    rpcStopped->P();
+
+    currentThread->Yield();		// let the reply to RpcStop be sent
+    postOffice->Flush();
+    server->PrintStats();
+    fflush(stdout);
+    interrupt->Halt();
+}
+
+static RpcClient *rpcClient;
+static int rpcServer, rpcCalls, rpcErrors;
+static int *rpcSamples, rpcNumSamples;
+static Lock *rpcLock;			// protects the above
+static Semaphore *rpcCallersDone;
+
+static void
+RpcCaller(_int which)
+{
+    char args[RpcMaxData], result[RpcMaxData];
+
+    for (int i = 0; i < rpcCalls; i++) {
+	RpcMarshal in(args, RpcMaxData), out(result, RpcMaxData);
+	int start = stats->totalTicks, n, sum;
+
+	in.PutInt(which);
+	in.PutInt(i);
+	n = rpcClient->Call(rpcServer, RpcBenchBox, RpcAdd, args,
+			    in.Length(), result);
+	sum = (n >= 0) ? out.GetInt() : 0;
+
+	rpcLock->Acquire();
+	if (n < 0 || out.Bad() || sum != which + i)
+	    rpcErrors++;
+	else
+	    rpcSamples[rpcNumSamples++] = stats->totalTicks - start;
+	rpcLock->Release();
+    }
+    rpcCallersDone->V();
+}
+
+static int
+RpcPercentile(int p)
+{
+    return rpcSamples[min((rpcNumSamples * p + 99) / 100, rpcNumSamples) - 1];
+}
+
+void
+RpcClientBenchmark(int server, int numThreads, int numCalls)
+{
+    char result[RpcMaxData];
+    int start, startHost, ticks, ms, i, j, v;
+
+    rpcClient = new RpcClient(RpcBenchReplyBox);
+    rpcServer = server;
+    rpcCalls = numCalls;
+    rpcErrors = rpcNumSamples = 0;
+    rpcSamples = new int[numThreads * numCalls];
+    rpcLock = new Lock("rpc benchmark");
+    rpcCallersDone = new Semaphore("rpc callers done", 0);
+
+    start = stats->totalTicks;
+    startHost = HostMilliseconds();
+    for (i = 0; i < numThreads; i++)
+	(new Thread("rpc caller"))->Fork(RpcCaller, i);
+    for (i = 0; i < numThreads; i++)
+	rpcCallersDone->P();
+    ticks = stats->totalTicks - start;
+    ms = HostMilliseconds() - startHost;
+
+    // sort the times the calls took, to find the percentiles
+    for (i = 1; i < rpcNumSamples; i++) {
+	v = rpcSamples[i];
+	for (j = i; j > 0 && rpcSamples[j - 1] > v; j--)
+	    rpcSamples[j] = rpcSamples[j - 1];
+	rpcSamples[j] = v;
+    }
+
+    printf("RPC 测试：%d 个线程，每个调用 %d 次，成功 %d 次，失败 %d 次\n",
+	   numThreads, numCalls, rpcNumSamples, rpcErrors);
+    printf("RPC 测试：%.3f 次/千 tick，%.1f 次/秒\n",
+	   rpcNumSamples * 1000.0 / max(ticks, 1),
+	   rpcNumSamples * 1000.0 / max(ms, 1));
+    if (rpcNumSamples > 0)
+	printf("RPC 测试：调用时间 p50 %d，p90 %d，p99 %d，最大 %d ticks\n",
+	       RpcPercentile(50), RpcPercentile(90), RpcPercentile(99),
+	       rpcSamples[rpcNumSamples - 1]);
+
+    // tell the server to stop, until it answers; but if the answer is
+    // lost, it has stopped, and nothing will answer the next time
+    for (i = 0; i < RpcStopTries; i++)
+	if (rpcClient->Call(server, RpcBenchBox, RpcStop, NULL, 0,
+			    result) >= 0)
+	    break;
+    rpcClient->PrintStats();
+    fflush(stdout);
+    postOffice->Flush();
     interrupt->Halt();
 }
@@ -18,24 +18,117 @@
 
 #include "copyright.h"
 #include "post.h"
+#include "system.h"
 
 //----------------------------------------------------------------------
 // Mail::Mail
-//      Initialize a single mail message, by concatenating the headers to
-//	the data.
-//
-//	"pktH" -- source, destination machine ID's
-//	"mailH" -- source, destination mailbox ID's
-//	"data" -- payload data
+//      Initialize a mail buffer, free to start with.  The payload goes
+//	right after the MailHeader, in the packet as it arrived.
+//----------------------------------------------------------------------
+
+Mail::Mail()
+{
+    data = contents + sizeof(MailHeader);
+    refCount = 0;
+    pool = NULL;
+}
+
+//----------------------------------------------------------------------
+// Mail::Hold, Mail::Release
+//      Take another reference to the mail, or drop one.
 //----------------------------------------------------------------------
 
-Mail::Mail(PacketHeader pktH, MailHeader mailH, char *msgData)
+void
+Mail::Hold()
 {
-    ASSERT(mailH.length <= MaxMailSize);
+    pool->Hold(this);
+}
 
-    pktHdr = pktH;
-    mailHdr = mailH;
-    bcopy(msgData, data, mailHdr.length);
+void
+Mail::Release()
+{
+    pool->Release(this);
+}
+
+//----------------------------------------------------------------------
+// MailPool::MailPool
+//      Initialize a pool of "size" mail buffers, all free.
+//----------------------------------------------------------------------
+
+MailPool::MailPool(int size)
+{
+    mails = new Mail[size];
+    for (int i = 0; i < size; i++) {
+	mails[i].pool = this;
+	freeList.Append(&mails[i]);
+    }
+    inUse = 0;
+}
+
+//----------------------------------------------------------------------
+// MailPool::~MailPool
+//      De-allocate the pool, and every buffer in it.
+//----------------------------------------------------------------------
+
+MailPool::~MailPool()
+{
+    delete [] mails;
+}
+
+//----------------------------------------------------------------------
+// MailPool::Get
+//      Take a free buffer out of the pool, with one reference to it
+//	(the caller's).  Return NULL if none is free.
+//----------------------------------------------------------------------
+
+Mail *
+MailPool::Get()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Mail *mail = freeList.Remove();
+
+    if (mail != NULL) {
+	mail->refCount = 1;
+	inUse++;
+	if (inUse > stats->mailPoolHighWater)
+	    stats->mailPoolHighWater = inUse;
+    }
+    (void) interrupt->SetLevel(oldLevel);
+    return mail;
+}
+
+//----------------------------------------------------------------------
+// MailPool::Hold
+//      Take another reference to "mail", which must be in use.
+//----------------------------------------------------------------------
+
+void
+MailPool::Hold(Mail *mail)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(mail->refCount > 0);
+    mail->refCount++;
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// MailPool::Release
+//      Drop a reference to "mail"; once there are none left, put it
+//	back in the pool.
+//----------------------------------------------------------------------
+
+void
+MailPool::Release(Mail *mail)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(mail->refCount > 0);
+    if (--mail->refCount == 0) {
+	freeList.Append(mail);
+	inUse--;
+    }
+    (void) interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
@@ -49,7 +142,8 @@ Mail::Mail(PacketHeader pktH, MailHeader mailH, char *msgData)
 
 MailBox::MailBox()
 { 
-    messages = new SynchList(); 
+    arrived = new Semaphore("mail arrived", 0);
+    numMessages = 0;
 }
 
 //----------------------------------------------------------------------
@@ -62,7 +156,7 @@ MailBox::MailBox()
 
 MailBox::~MailBox()
 { 
-    delete messages; 
+    delete arrived; 
 }
 
 //----------------------------------------------------------------------
@@ -86,54 +180,52 @@ PrintHeader(PacketHeader pktHdr, MailHeader mailHdr)
 // 	Add a message to the mailbox.  If anyone is waiting for message
 //	arrival, wake them up!
 //
-//	We need to reconstruct the Mail message (by concatenating the headers
-//	to the data), to simplify queueing the message on the SynchList.
+//	The mailbox takes over the caller's reference to the mail --
+//	unless it already has MailBoxLimit messages, when it returns FALSE.
 //
-//	"pktHdr" -- source, destination machine ID's
-//	"mailHdr" -- source, destination mailbox ID's
-//	"data" -- payload message data
+//	"mail" -- the message, headers and all
 //----------------------------------------------------------------------
 
-void 
-MailBox::Put(PacketHeader pktHdr, MailHeader mailHdr, char *data)
+bool 
+MailBox::Put(Mail *mail)
 { 
-    Mail *mail = new Mail(pktHdr, mailHdr, data); 
-
-    messages->Append((void *)mail);	// put on the end of the list of 
-					// arrived messages, and wake up 
-					// any waiters
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    bool room = (numMessages < MailBoxLimit);
+
+    if (room) {
+	numMessages++;
+	messages.Append(mail);		// put on the end of the list of 
+	arrived->V();			// arrived messages, and wake up 
+    }					// any waiters
+    (void) interrupt->SetLevel(oldLevel);
+    return room;
 }
 
 //----------------------------------------------------------------------
 // MailBox::Get
-// 	Get a message from a mailbox, parsing it into the packet header,
-//	mailbox header, and data. 
+// 	Get a message from a mailbox.  The calling thread gets the
+//	mailbox's reference to it, and must Release it when done.
 //
 //	The calling thread waits if there are no messages in the mailbox.
-//
-//	"pktHdr" -- address to put: source, destination machine ID's
-//	"mailHdr" -- address to put: source, destination mailbox ID's
-//	"data" -- address to put: payload message data
 //----------------------------------------------------------------------
 
-void 
-MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data) 
+Mail *
+MailBox::Get() 
 { 
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Mail *mail;
+
     DEBUG('n', "Waiting for mail in mailbox\n");
-    Mail *mail = (Mail *) messages->Remove();	// remove message from list;
-						// will wait if list is empty
+    arrived->P();				// wait if list is empty;
+    mail = messages.Remove();			// remove message from list
+    numMessages--;
+    (void) interrupt->SetLevel(oldLevel);
 
-    *pktHdr = mail->pktHdr;
-    *mailHdr = mail->mailHdr;
     if (DebugIsEnabled('n')) {
 	printf("Got mail from mailbox: ");
-	PrintHeader(*pktHdr, *mailHdr);
+	PrintHeader(mail->pktHdr, mail->mailHdr);
     }
-    bcopy(mail->data, data, mail->mailHdr.length);
-					// copy the message data into
-					// the caller's buffer
-    delete mail;			// we've copied out the stuff we
-					// need, we can now discard the message
+    return mail;
 }
 
 //----------------------------------------------------------------------
@@ -179,13 +271,15 @@ PostOffice::PostOffice(NetworkAddress addr, double reliability,
 {
 // First, initialize the synchronization with the interrupt handlers
     messageAvailable = new Semaphore("message available", 0);
-    messageSent = new Semaphore("message sent", 0);
-    sendLock = new Lock("message send lock");
+    slotFree = new Semaphore("send queue slot free", SendQueueSize);
+    queueEmpty = new Semaphore("send queue empty", 0);
+    queueHead = queueLength = inFlight = flushWaiters = 0;
 
 // Second, initialize the mailboxes
     netAddr = addr; 
     numBoxes = nBoxes;
     boxes = new MailBox[nBoxes];
+    pool = new MailPool(MailPoolSize);
 
 // Third, initialize the network; tell it which interrupt handlers to call
     network = new Network(addr, reliability, orderability,
@@ -208,9 +302,10 @@ PostOffice::~PostOffice()
 {
     delete network;
     delete [] boxes;
+    delete pool;
     delete messageAvailable;
-    delete messageSent;
-    delete sendLock;
+    delete slotFree;
+    delete queueEmpty;
 }
 
 //----------------------------------------------------------------------
@@ -219,43 +314,67 @@ PostOffice::~PostOffice()
 //
 //      Incoming messages have had the PacketHeader stripped off,
 //	but the MailHeader is still tacked on the front of the data.
+//
+//	If every mail buffer is in use, or the mailbox is full, the
+//	message is thrown away, rather than waiting for room: otherwise
+//	mail that nobody reads, in one mailbox, would stop delivery to
+//	all the others.
 //----------------------------------------------------------------------
 
 void
 PostOffice::PostalDelivery()
 {
-    PacketHeader pktHdr;
-    MailHeader mailHdr;
-    char *buffer = new char[MaxPacketSize];
+    char dropped[MaxPacketSize];
+    Mail *mail;
 
     for (;;) {
-        // first, wait for a message
+        // first, wait for a message, and get a buffer to put it in (in
+	// one go, so as to turn interrupts back on only once)
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
         messageAvailable->P();	
-        pktHdr = network->Receive(buffer);
-
-        mailHdr = *(MailHeader *)buffer;
+	mail = pool->Get();
+	(void) interrupt->SetLevel(oldLevel);
+
+	if (mail == NULL) {		// no room for it
+	    (void) network->Receive(dropped);
+	    stats->numMailDropped++;
+	    continue;
+	}
+
+	// then copy it, once, straight into the buffer it will be
+	// delivered in
+        mail->pktHdr = network->Receive(mail->contents);
+        mail->mailHdr = *(MailHeader *)mail->contents;
         if (DebugIsEnabled('n')) {
 	    printf("Putting mail into mailbox: ");
-	    PrintHeader(pktHdr, mailHdr);
+	    PrintHeader(mail->pktHdr, mail->mailHdr);
         }
 
 	// check that arriving message is legal!
-	ASSERT(0 <= mailHdr.to && mailHdr.to < numBoxes);
-	ASSERT(mailHdr.length <= MaxMailSize);
+	ASSERT(0 <= mail->mailHdr.to && mail->mailHdr.to < numBoxes);
+	ASSERT(mail->mailHdr.length <= MaxMailSize);
 
 	// put into mailbox
-        boxes[mailHdr.to].Put(pktHdr, mailHdr, buffer + sizeof(MailHeader));
+        if (!boxes[mail->mailHdr.to].Put(mail)) {
+	    mail->Release();
+	    stats->numMailDropped++;
+	}
     }
 }
 
 //----------------------------------------------------------------------
 // PostOffice::Send
-// 	Concatenate the MailHeader to the front of the data, and pass 
-//	the result to the Network for delivery to the destination machine.
+// 	Concatenate the MailHeader to the front of the data, and put the
+//	result in the transmit queue, to be passed to the Network for
+//	delivery to the destination machine.
 //
 //	Note that the MailHeader + data looks just like normal payload
 //	data to the Network.
 //
+//	If the Network is idle, the packet goes straight out; otherwise
+//	it waits its turn in the queue, and the caller goes on without
+//	it.  The caller only waits if the queue is full.
+//
 //	"pktHdr" -- source, destination machine ID's
 //	"mailHdr" -- source, destination mailbox ID's
 //	"data" -- payload message data
@@ -264,8 +383,8 @@ PostOffice::PostalDelivery()
 void
 PostOffice::Send(PacketHeader pktHdr, MailHeader mailHdr, char* data)
 {
-    char* buffer = new char[MaxPacketSize];	// space to hold concatenated
-						// mailHdr + data
+    OutgoingPacket *packet;
+    IntStatus oldLevel;
 
     if (DebugIsEnabled('n')) {
 	printf("Post send: ");
@@ -278,27 +397,81 @@ PostOffice::Send(PacketHeader pktHdr, MailHeader mailHdr, char* data)
     pktHdr.from = netAddr;
     pktHdr.length = mailHdr.length + sizeof(MailHeader);
 
+    slotFree->P();			// wait for room in the queue
+
+    // the queue is shared with the interrupt handler
+    oldLevel = interrupt->SetLevel(IntOff);
+    packet = &sendQueue[(queueHead + queueLength) % SendQueueSize];
+    queueLength++;
+
     // concatenate MailHeader and data
+    packet->pktHdr = pktHdr;
 #ifdef HOST_ALPHA
-    bcopy((const char *)&mailHdr, buffer, sizeof(MailHeader));
+    bcopy((const char *)&mailHdr, packet->data, sizeof(MailHeader));
 #else
-    bcopy(&mailHdr, buffer, sizeof(MailHeader));
+    bcopy(&mailHdr, packet->data, sizeof(MailHeader));
 #endif
-    bcopy(data, buffer + sizeof(MailHeader), mailHdr.length);
+    bcopy(data, packet->data + sizeof(MailHeader), mailHdr.length);
+    packet->queuedAt = stats->totalTicks;
 
-    sendLock->Acquire();   		// only one message can be sent
-					// to the network at any one time
-    network->Send(pktHdr, buffer);
-    messageSent->P();			// wait for interrupt to tell us
-					// ok to send the next message
-    sendLock->Release();
+    stats->numPacketsQueued++;
+    stats->sendQueueTotal += queueLength;
+    if (queueLength > stats->sendQueueMax)
+	stats->sendQueueMax = queueLength;
 
-    delete [] buffer;			// we've sent the message, so
-					// we can delete our buffer
+    if (inFlight == 0)			// the Network is idle
+	StartSending();
+    (void) interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
-// PostOffice::Send
+// PostOffice::StartSending
+// 	Hand the Network as many of the packets at the front of the
+//	transmit queue as it will take in one go.  A packet queued while
+//	the Network is idle goes out alone, straight away; those queued
+//	while it's busy go out together when it's done, with a single
+//	interrupt for the lot.
+//
+//	Called with interrupts off, when the Network is idle.
+//----------------------------------------------------------------------
+
+void
+PostOffice::StartSending()
+{
+    PacketHeader hdrs[SendBatchSize];
+    char *data[SendBatchSize];
+
+    ASSERT(inFlight == 0 && queueLength > 0);
+    inFlight = min(queueLength, SendBatchSize);
+    for (int i = 0; i < inFlight; i++) {
+	OutgoingPacket *packet = &sendQueue[(queueHead + i) % SendQueueSize];
+
+	hdrs[i] = packet->pktHdr;
+	data[i] = packet->data;
+    }
+    network->SendBurst(hdrs, data, inFlight);
+}
+
+//----------------------------------------------------------------------
+// PostOffice::Flush
+// 	Wait until every message queued so far has been sent.  Needed
+//	before halting, or whatever is left in the queue is lost.
+//----------------------------------------------------------------------
+
+void
+PostOffice::Flush()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    while (queueLength > 0) {
+	flushWaiters++;
+	queueEmpty->P();
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// PostOffice::Receive
 // 	Retrieve a message from a specific box if one is available, 
 //	otherwise wait for a message to arrive in the box.
 //
@@ -315,11 +488,36 @@ PostOffice::Send(PacketHeader pktHdr, MailHeader mailHdr, char* data)
 void
 PostOffice::Receive(int box, PacketHeader *pktHdr, 
 				MailHeader *mailHdr, char* data)
+{
+    Mail *mail = Receive(box);
+
+    *pktHdr = mail->pktHdr;
+    *mailHdr = mail->mailHdr;
+    bcopy(mail->data, data, mail->mailHdr.length);
+					// copy the message data into
+					// the caller's buffer
+    mail->Release();			// we've copied out the stuff we
+					// need, the buffer can be reused
+}
+
+//----------------------------------------------------------------------
+// PostOffice::Receive
+// 	Retrieve a message from a specific box, as above, but hand over
+//	the mail buffer itself instead of copying out of it.  The caller
+//	reads the headers and data in place, and must call Release on
+//	the mail once done with it (or Hold, to pass it on).
+//
+//	"box" -- mailbox ID in which to look for message
+//----------------------------------------------------------------------
+
+Mail *
+PostOffice::Receive(int box)
 {
     ASSERT((box >= 0) && (box < numBoxes));
 
-    boxes[box].Get(pktHdr, mailHdr, data);
-    ASSERT(mailHdr->length <= MaxMailSize);
+    Mail *mail = boxes[box].Get();
+    ASSERT(mail->mailHdr.length <= MaxMailSize);
+    return mail;
 }
 
 //----------------------------------------------------------------------
@@ -340,6 +538,9 @@ PostOffice::IncomingPacket()
 // 	Interrupt handler, called when the next packet can be put onto the 
 //	network.
 //
+//	Take the packets the Network has sent out of the queue, making
+//	room for waiting senders, and hand it the next batch.
+//
 //	The name of this routine is a misnomer; if "reliability < 1",
 //	the packet could have been dropped by the network, so it won't get
 //	through.
@@ -348,6 +549,20 @@ PostOffice::IncomingPacket()
 void 
 PostOffice::PacketSent()
 { 
-    messageSent->V();
+    for (; inFlight > 0; inFlight--) {
+	int latency = stats->totalTicks - sendQueue[queueHead].queuedAt;
+
+	stats->sendLatencyTotal += latency;
+	if (latency > stats->sendLatencyMax)
+	    stats->sendLatencyMax = latency;
+	queueHead = (queueHead + 1) % SendQueueSize;
+	queueLength--;
+	slotFree->V();
+    }
+    if (queueLength > 0)
+	StartSending();
+    else
+	for (; flushWaiters > 0; flushWaiters--)
+	    queueEmpty->V();
 }
 
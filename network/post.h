@@ -29,7 +29,8 @@
 #define POST_H
 
 #include "network.h"
-#include "synchlist.h"
+#include "ilist.h"
+#include "synch.h"
 
 // Mailbox address -- uniquely identifies a mailbox on a given machine.
 // A mailbox is just a place for temporary storage for messages.
@@ -53,41 +54,106 @@ class MailHeader {
 #define MaxMailSize 	(MaxPacketSize - sizeof(MailHeader))
 
 
-// The following class defines the format of an incoming/outgoing 
+// The following class defines the format of an incoming 
 // "Mail" message.  The message format is layered: 
 //	network header (PacketHeader) 
 //	post office header (MailHeader) 
 //	data
+//
+// Mail lives in buffers that belong to the Post Office's MailPool.  The
+// packet is copied into one straight off the Network, and the same
+// buffer goes into the mailbox and is handed to whoever receives it,
+// who may read it in place.  It goes back to the pool when the last
+// reference to it is dropped.
+
+class MailPool;
 
 class Mail {
   public:
-     Mail(PacketHeader pktH, MailHeader mailH, char *msgData);
-				// Initialize a mail message by
-				// concatenating the headers to the data
+     Mail();			// Initialize an empty mail buffer
+
+     void Hold();		// Take another reference to the mail
+     void Release();		// Drop a reference; the buffer goes back
+				// to the pool when there are none left
 
      PacketHeader pktHdr;	// Header appended by Network
      MailHeader mailHdr;	// Header appended by PostOffice
-     char data[MaxMailSize];	// Payload -- message data
+     char *data;		// Payload -- message data, in "contents"
+     char contents[MaxPacketSize];	// The packet as it arrived:
+				// MailHeader, then data
+
+     int refCount;		// References to the mail; 0 if free
+     MailPool *pool;		// Where it goes back to
+     ListLink<Mail> link;	// for queueing it in a MailBox, or in
+				// the pool
+};
+
+// The following class defines a fixed-size pool of mail buffers.  When
+// they are all in use, arriving mail is thrown away, as if the network
+// had lost it, rather than held up until one is free.  (And no mailbox
+// may hold more than MailBoxLimit of them -- so mail piling up in one
+// mailbox that nobody reads can't stop delivery to the others.)
+
+#define MailPoolSize	64
+
+class MailPool {
+  public:
+    MailPool(int size);		// Allocate "size" buffers
+    ~MailPool();
+
+    Mail *Get();		// Take a free buffer, with one reference;
+				// NULL if there are none
+    void Hold(Mail *mail);	// Take, drop a reference to "mail"
+    void Release(Mail *mail);
+
+  private:
+    Mail *mails;		// The buffers
+    IntrusiveList<Mail, &Mail::link> freeList;	// The free ones
+    int inUse;			// How many are not free
+				// (the list and the reference counts
+				// are protected by turning interrupts
+				// off; it's only a few instructions)
 };
 
+// The following class defines a packet waiting in the Post Office's
+// transmit queue, to be sent to the Network -- or on its way out.
+
+class OutgoingPacket {
+  public:
+    PacketHeader pktHdr;	// Header for the Network
+    char data[MaxPacketSize];	// MailHeader + message data
+    int queuedAt;		// When it was queued, for measuring
+				// send latency
+};
+
+#define SendQueueSize	16	// most packets queued to be sent at once
+#define SendBatchSize	4	// most handed to the Network at once
+
 // The following class defines a single mailbox, or temporary storage
 // for messages.   Incoming messages are put by the PostOffice into the 
 // appropriate mailbox, and these messages can then be retrieved by
 // threads on this machine.
 
+#define MailBoxLimit	(MailPoolSize / 2)	// most messages waiting in
+						// one mailbox
+
 class MailBox {
   public: 
     MailBox();			// Allocate and initialize mail box
     ~MailBox();			// De-allocate mail box
 
-    void Put(PacketHeader pktHdr, MailHeader mailHdr, char *data);
-   				// Atomically put a message into the mailbox
-    void Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data); 
-   				// Atomically get a message out of the 
+    bool Put(Mail *mail);	// Atomically put a message into the mailbox
+				// (FALSE, and don't, if it's full)
+    Mail *Get();		// Atomically get a message out of the 
 				// mailbox (and wait if there is no message 
 				// to get!)
   private:
-    SynchList *messages;	// A mailbox is just a list of arrived messages
+    IntrusiveList<Mail, &Mail::link> messages; // A mailbox is just a list
+				// of arrived messages
+    Semaphore *arrived;		// Counts them
+    int numMessages;		// ... as does this, for Put
+				// (the list is protected by turning
+				// interrupts off, as in MailPool)
 };
 
 // The following class defines a "Post Office", or a collection of 
@@ -111,12 +177,27 @@ class PostOffice {
     void Send(PacketHeader pktHdr, MailHeader mailHdr, char *data);
     				// Send a message to a mailbox on a remote 
 				// machine.  The fromBox in the MailHeader is 
-				// the return box for ack's.
+				// the return box for ack's.  Returns once
+				// the message is queued to be sent; waits
+				// only if the queue is full.
+    void Flush();		// Wait until every message queued has
+				// been sent
+
+    NetworkAddress Address() { return netAddr; }
+				// This machine's network address
+    void SetLink(NetworkAddress to, double reliability, int delay,
+		 int packetTime)
+	{ network->SetLink(to, reliability, delay, packetTime); }
+				// Set up the link to machine "to" (cf.
+				// Network::SetLink)
     
     void Receive(int box, PacketHeader *pktHdr, 
 		MailHeader *mailHdr, char *data);
     				// Retrieve a message from "box".  Wait if
 				// there is no message in the box.
+    Mail *Receive(int box);	// Same, but hand over the mail itself,
+				// without copying it; the caller must
+				// Release it when done with it
 
     void PostalDelivery();	// Wait for incoming messages, 
 				// and then put them in the correct mailbox
@@ -134,9 +215,22 @@ class PostOffice {
     NetworkAddress netAddr;	// Network address of this machine
     MailBox *boxes;		// Table of mail boxes to hold incoming mail
     int numBoxes;		// Number of mail boxes
+    MailPool *pool;		// Buffers for incoming mail
     Semaphore *messageAvailable;// V'ed when message has arrived from network
-    Semaphore *messageSent;	// V'ed when next message can be sent to network
-    Lock *sendLock;		// Only one outgoing message at a time
+
+    OutgoingPacket sendQueue[SendQueueSize];
+				// Transmit queue: a ring of packets waiting
+				// to be sent, or being sent
+    int queueHead;		// Oldest packet in the queue
+    int queueLength;		// Packets in the queue
+    int inFlight;		// How many of them, from "queueHead", the
+				// Network is sending
+    Semaphore *slotFree;	// Counts free places in the queue
+    Semaphore *queueEmpty;	// V'ed when the queue empties, once for
+    int flushWaiters;		// each thread waiting in Flush
+
+    void StartSending();	// Hand the Network the next batch of
+				// packets in the queue
 };
 
 #endif
@@ -0,0 +1,448 @@
+// rpc.cc
+//	Routines for remote procedure calls over the Post Office: the
+//	server's workers, the client's calls and the thread that hands
+//	them their replies, and marshaling.
+//
+//	Calls and replies are read in place, in the Post Office's mail
+//	buffers (cf. PostOffice::Receive), so a reply is only copied once,
+//	into the caller's "result".
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "rpc.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// ServeHelper, DemultiplexHelper, TimeoutHelper
+// 	Dummy functions because C++ can't indirectly invoke member functions
+//	The first two are forked as the server's workers, and the client's
+//	thread; the last is called by the timer, when a call times out.
+//----------------------------------------------------------------------
+
+static void ServeHelper(_int arg)
+{ RpcServer *server = (RpcServer *) arg; server->Serve(); }
+static void DemultiplexHelper(_int arg)
+{ RpcClient *client = (RpcClient *) arg; client->Demultiplex(); }
+
+class CallTimer {		// argument to the timeout handler
+  public:
+    RpcClient *client;
+    int id;
+};
+
+static void TimeoutHelper(_int arg)
+{
+    CallTimer *callTimer = (CallTimer *) arg;
+
+    callTimer->client->TimedOut(callTimer->id);
+    delete callTimer;
+}
+
+//----------------------------------------------------------------------
+// RpcServer::RpcServer
+// 	Set up a server for calls sent to mailbox "box".  It answers none
+//	until Start is called, so its procedures can all be registered
+//	(and whatever they use set up) first.
+//----------------------------------------------------------------------
+
+RpcServer::RpcServer(MailBoxAddress serverBox)
+{
+    box = serverBox;
+    for (int i = 0; i < RpcMaxProcs; i++)
+	handlers[i] = NULL;
+    statsLock = new Lock("rpc server stats");
+    callsServed = badCalls = 0;
+}
+
+//----------------------------------------------------------------------
+// RpcServer::~RpcServer
+// 	De-allocate the server.  Its workers last until Nachos halts, so
+//	this must only be done then.
+//----------------------------------------------------------------------
+
+RpcServer::~RpcServer()
+{
+    delete statsLock;
+}
+
+//----------------------------------------------------------------------
+// RpcServer::Register
+// 	Answer calls to procedure number "proc" with "handler".
+//----------------------------------------------------------------------
+
+void
+RpcServer::Register(int proc, RpcHandler handler)
+{
+    ASSERT(proc >= 0 && proc < RpcMaxProcs);
+    handlers[proc] = handler;
+}
+
+//----------------------------------------------------------------------
+// RpcServer::Start
+// 	Start answering calls, with a pool of "numWorkers" threads; a call
+//	to a procedure that isn't registered fails.
+//----------------------------------------------------------------------
+
+void
+RpcServer::Start(int numWorkers)
+{
+    for (int i = 0; i < numWorkers; i++) {
+	Thread *t = new Thread("rpc worker");
+
+	t->Fork(ServeHelper, (_int) this);
+    }
+}
+
+//----------------------------------------------------------------------
+// RpcServer::Serve
+// 	What each worker does: take the next call out of the mailbox, run
+//	the procedure it asks for on its arguments, and send the result
+//	back to the mailbox the call came from, with the call's ID.
+//
+//	The arguments are read where they are, in the call's mail buffer.
+//----------------------------------------------------------------------
+
+void
+RpcServer::Serve()
+{
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+    char buffer[MaxMailSize];
+    RpcHeader *reply = (RpcHeader *) buffer;
+
+    for (;;) {
+	Mail *mail = postOffice->Receive(box);
+	RpcHeader *call = (RpcHeader *) mail->data;
+	int resultLength = 0;
+	RpcHandler handler;
+	bool bad;
+
+	if (mail->mailHdr.length < sizeof(RpcHeader)) {
+	    mail->Release();		// not a call at all
+	    continue;
+	}
+	reply->id = call->id;
+	reply->proc = call->proc;
+	handler = (call->proc < RpcMaxProcs) ? handlers[call->proc] : NULL;
+	bad = (handler == NULL);
+	if (bad)
+	    reply->status = RpcNoProcedure;
+	else {
+	    reply->status = RpcOK;
+	    resultLength = (*handler)
+		(mail->data + sizeof(RpcHeader),
+		 mail->mailHdr.length - sizeof(RpcHeader),
+		 buffer + sizeof(RpcHeader));
+	    ASSERT(resultLength >= 0 && resultLength <= (int) RpcMaxData);
+	}
+
+	pktHdr.to = mail->pktHdr.from;
+	mailHdr.to = mail->mailHdr.from;
+	mailHdr.from = box;
+	mailHdr.length = sizeof(RpcHeader) + resultLength;
+	mail->Release();
+	postOffice->Send(pktHdr, mailHdr, buffer);
+
+	statsLock->Acquire();
+	if (bad)
+	    badCalls++;
+	else
+	    callsServed++;
+	statsLock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// RpcServer::PrintStats
+// 	Print how many calls the server has answered.
+//----------------------------------------------------------------------
+
+void
+RpcServer::PrintStats()
+{
+    printf("RPC server at box %d: calls served %d, to no such procedure %d\n",
+	   box, callsServed, badCalls);
+}
+
+//----------------------------------------------------------------------
+// RpcClient::RpcClient
+// 	Start a client, taking its replies in mailbox "replyBox".  Nothing
+//	else may use that mailbox.
+//----------------------------------------------------------------------
+
+RpcClient::RpcClient(MailBoxAddress box)
+{
+    Thread *t = new Thread("rpc client");
+
+    replyBox = box;
+    nextId = 1;
+    calls = timeouts = lateReplies = 0;
+    t->Fork(DemultiplexHelper, (_int) this);
+}
+
+//----------------------------------------------------------------------
+// RpcClient::~RpcClient
+// 	De-allocate the client.  Its thread lasts until Nachos halts, so
+//	this must only be done then.
+//----------------------------------------------------------------------
+
+RpcClient::~RpcClient()
+{
+}
+
+//----------------------------------------------------------------------
+// RpcClient::Call
+// 	Call procedure "proc" of the server at mailbox "box" on machine
+//	"to", with "argLength" bytes of arguments, "args", and wait for
+//	the result.  Copy it to "result" (which must have room for
+//	RpcMaxData bytes), and return its length; or if there's no reply
+//	within "timeout" ticks, or the server has no such procedure, say
+//	so.
+//----------------------------------------------------------------------
+
+int
+RpcClient::Call(NetworkAddress to, MailBoxAddress box, int proc,
+		char *args, int argLength, char *result, int timeout)
+{
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+    char buffer[MaxMailSize];
+    RpcHeader *call = (RpcHeader *) buffer;
+    Semaphore finished("rpc call finished", 0);
+    CallTimer *callTimer = new CallTimer;
+    PendingCall waiting;
+    IntStatus oldLevel;
+    int length;
+
+    ASSERT(argLength >= 0 && argLength <= (int) RpcMaxData);
+    ASSERT(proc >= 0 && proc < RpcMaxProcs);
+
+    // put the call on the list, before its reply can possibly come
+    oldLevel = interrupt->SetLevel(IntOff);
+    waiting.id = nextId++;
+    waiting.reply = NULL;
+    waiting.finished = &finished;
+    pending.Append(&waiting);
+    calls++;
+    (void) interrupt->SetLevel(oldLevel);
+
+    call->id = waiting.id;
+    call->proc = proc;
+    call->status = RpcOK;
+    bcopy(args, buffer + sizeof(RpcHeader), argLength);
+    pktHdr.to = to;
+    mailHdr.to = box;
+    mailHdr.from = replyBox;
+    mailHdr.length = sizeof(RpcHeader) + argLength;
+    postOffice->Send(pktHdr, mailHdr, buffer);
+
+    callTimer->client = this;
+    callTimer->id = waiting.id;
+    interrupt->Schedule(TimeoutHelper, (_int) callTimer, timeout, TimerInt);
+    finished.P();			// (the list no longer has it)
+
+    if (waiting.reply == NULL)
+	return RpcTimedOut;
+    call = (RpcHeader *) waiting.reply->data;
+    if (call->status != RpcOK)
+	length = call->status;
+    else {
+	length = waiting.reply->mailHdr.length - sizeof(RpcHeader);
+	bcopy(waiting.reply->data + sizeof(RpcHeader), result, length);
+    }
+    waiting.reply->Release();
+    return length;
+}
+
+//----------------------------------------------------------------------
+// RpcClient::Finish
+// 	Take call "id" off the list of those waiting, if it's still on
+//	it, and wake up its caller, with "reply" (NULL if it timed out).
+//	Return the call, or NULL if it had already finished.
+//
+//	Called with interrupts off.
+//----------------------------------------------------------------------
+
+PendingCall *
+RpcClient::Finish(int id, Mail *reply)
+{
+    PendingCall *call;
+    int key;
+
+    for (call = pending.Front(&key); call != NULL;
+	 call = call->link.next)
+	if (call->id == id)
+	    break;
+    if (call == NULL)
+	return NULL;
+    pending.RemoveItem(call);
+    call->reply = reply;
+    call->finished->V();
+    return call;
+}
+
+//----------------------------------------------------------------------
+// RpcClient::Demultiplex
+// 	The client's thread: take each reply out of the reply mailbox,
+//	and hand it to the call it answers -- unless that has timed out.
+//----------------------------------------------------------------------
+
+void
+RpcClient::Demultiplex()
+{
+    for (;;) {
+	Mail *mail = postOffice->Receive(replyBox);
+	IntStatus oldLevel;
+	PendingCall *call = NULL;
+
+	if (mail->mailHdr.length >= sizeof(RpcHeader)) {
+	    oldLevel = interrupt->SetLevel(IntOff);
+	    call = Finish(((RpcHeader *) mail->data)->id, mail);
+	    if (call == NULL)
+		lateReplies++;
+	    (void) interrupt->SetLevel(oldLevel);
+	}
+	if (call == NULL)
+	    mail->Release();		// nobody wants it
+    }
+}
+
+//----------------------------------------------------------------------
+// RpcClient::TimedOut
+// 	Interrupt handler: call "id" has had as long as it's going to
+//	get.  If it's still waiting, it fails.
+//----------------------------------------------------------------------
+
+void
+RpcClient::TimedOut(int id)
+{
+    if (Finish(id, NULL) != NULL)
+	timeouts++;
+}
+
+//----------------------------------------------------------------------
+// RpcClient::PrintStats
+// 	Print how many calls the client has made, and how they went.
+//----------------------------------------------------------------------
+
+void
+RpcClient::PrintStats()
+{
+    printf("RPC client at box %d: calls %d, timed out %d, late replies %d\n",
+	   replyBox, calls, timeouts, lateReplies);
+}
+
+//----------------------------------------------------------------------
+// RpcMarshal::RpcMarshal
+// 	Pack into, or unpack from, the first "size" bytes of "buffer".
+//----------------------------------------------------------------------
+
+RpcMarshal::RpcMarshal(char *buf, int bufSize)
+{
+    buffer = buf;
+    size = bufSize;
+    position = 0;
+    bad = FALSE;
+}
+
+//----------------------------------------------------------------------
+// RpcMarshal::PutInt, PutShort, PutBytes, PutString
+// 	Pack a value in after the ones packed so far.
+//----------------------------------------------------------------------
+
+void
+RpcMarshal::PutInt(int value)
+{
+    ASSERT(position + 4 <= size);
+    for (int i = 3; i >= 0; i--)
+	buffer[position++] = (char) (value >> (8 * i));
+}
+
+void
+RpcMarshal::PutShort(short value)
+{
+    ASSERT(position + 2 <= size);
+    buffer[position++] = (char) (value >> 8);
+    buffer[position++] = (char) value;
+}
+
+void
+RpcMarshal::PutBytes(char *from, int numBytes)
+{
+    ASSERT(numBytes >= 0 && position + numBytes <= size);
+    bcopy(from, buffer + position, numBytes);
+    position += numBytes;
+}
+
+void
+RpcMarshal::PutString(char *string)
+{
+    int length = strlen(string);
+
+    PutShort((short) length);
+    PutBytes(string, length);
+}
+
+//----------------------------------------------------------------------
+// RpcMarshal::GetInt, GetShort, GetBytes, GetString
+// 	Unpack the value after the ones unpacked so far.  If it isn't
+//	all there, return zeros (or an empty string), and remember that
+//	the buffer is bad.
+//----------------------------------------------------------------------
+
+int
+RpcMarshal::GetInt()
+{
+    unsigned int value = 0;
+
+    if (position + 4 > size) {
+	bad = TRUE;
+	return 0;
+    }
+    for (int i = 0; i < 4; i++)
+	value = (value << 8) | (unsigned char) buffer[position++];
+    return (int) value;
+}
+
+short
+RpcMarshal::GetShort()
+{
+    unsigned short value;
+
+    if (position + 2 > size) {
+	bad = TRUE;
+	return 0;
+    }
+    value = (unsigned char) buffer[position++] << 8;
+    value |= (unsigned char) buffer[position++];
+    return (short) value;
+}
+
+void
+RpcMarshal::GetBytes(char *into, int numBytes)
+{
+    if (numBytes < 0 || position + numBytes > size) {
+	bad = TRUE;
+	bzero(into, max(numBytes, 0));
+	return;
+    }
+    bcopy(buffer + position, into, numBytes);
+    position += numBytes;
+}
+
+void
+RpcMarshal::GetString(char *into, int maxLength)
+{
+    int length = GetShort();
+
+    if (bad || length < 0 || length >= maxLength) {
+	bad = TRUE;
+	into[0] = '\0';
+	return;
+    }
+    GetBytes(into, length);
+    into[bad ? 0 : length] = '\0';
+}
@@ -0,0 +1,166 @@
+// rpc.h
+//	Data structures for remote procedure calls between machines, on
+//	top of the Post Office.
+//
+//	A server answers calls sent to one of its machine's mailboxes.
+//	It has a table of procedures, by number, and a pool of worker
+//	threads that take the calls out of the mailbox, run the
+//	procedure asked for, and send the result back.
+//
+//	A client sends calls, and waits for their results, all on one
+//	reply mailbox: each call gets an ID, which its reply carries, so
+//	any number of threads can have calls outstanding at once.  A call
+//	that isn't answered within its timeout fails; a reply that comes
+//	after that is thrown away.  Calls are not retried -- each is sent
+//	once, so a procedure runs at most once per call.
+//
+//	A call's arguments, and its result, must fit in one piece of mail
+//	(RpcMaxData bytes); RpcMarshal packs small structures into them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef RPC_H
+#define RPC_H
+
+#include "post.h"
+#include "ilist.h"
+#include "stats.h"
+
+// The following class defines the RPC header.  This is prepended to
+// the arguments of a call, and to its result.
+
+class RpcHeader {
+  public:
+    int id;			// which call it is, or answers
+    unsigned short proc;	// the procedure called
+    short status;		// (in a reply) RpcOK, or why not
+};
+
+#define RpcMaxData	(MaxMailSize - sizeof(RpcHeader))
+				// arguments, or result, of a call
+#define RpcMaxProcs	16	// procedures a server may have
+
+// The status of a reply; if it's not RpcOK, it's also what Call returns.
+#define RpcOK		0
+#define RpcTimedOut	-1	// no reply in time
+#define RpcNoProcedure	-2	// the server has no such procedure
+
+#define RpcDefaultTimeout	(20000 * NetworkTime)
+
+// A procedure: called with the arguments of a call, it puts the result
+// in "result" (up to RpcMaxData bytes), and returns its length.
+
+typedef int (*RpcHandler)(char *args, int argLength, char *result);
+
+// The following class defines the server end of RPC.
+
+class RpcServer {
+  public:
+    RpcServer(MailBoxAddress box);
+				// Answer calls sent to mailbox "box"
+    ~RpcServer();
+
+    void Register(int proc, RpcHandler handler);
+				// Answer calls to procedure "proc" with
+				// "handler".  (Register every procedure
+				// before calling Start.)
+    void Start(int numWorkers);	// Start answering calls, with
+				// "numWorkers" threads
+    void PrintStats();		// Print what the server has done
+
+    void Serve();		// The workers: answer calls, for ever
+
+  private:
+    MailBoxAddress box;		// where calls come in
+    RpcHandler handlers[RpcMaxProcs];	// the procedures
+    Lock *statsLock;		// protects the following
+    int callsServed, badCalls;
+};
+
+// A call waiting for its reply.
+
+class PendingCall {
+  public:
+    int id;			// the call's ID
+    Mail *reply;		// its reply, or NULL if it timed out
+    Semaphore *finished;	// V'ed when it is answered, or times out
+    ListLink<PendingCall> link;	// for the client's list of them
+};
+
+// The following class defines the client end of RPC.  Any number of
+// threads may make calls with the same client at once.
+
+class RpcClient {
+  public:
+    RpcClient(MailBoxAddress replyBox);
+				// Make calls, and take their replies in
+				// mailbox "replyBox"
+    ~RpcClient();
+
+    int Call(NetworkAddress to, MailBoxAddress box, int proc,
+	     char *args, int argLength, char *result,
+	     int timeout = RpcDefaultTimeout);
+				// Call procedure "proc" of the server at
+				// mailbox "box" on machine "to".  Returns
+				// the length of the result, put in
+				// "result", or RpcTimedOut/RpcNoProcedure
+    void PrintStats();		// Print what the client has done
+
+    void Demultiplex();		// The client's own thread: hand each
+				// reply to the call it answers
+    void TimedOut(int id);	// Interrupt handler: the time for call
+				// "id" is up
+
+  private:
+    MailBoxAddress replyBox;
+    int nextId;			// ID for the next call
+    IntrusiveList<PendingCall, &PendingCall::link> pending;
+				// calls waiting for replies
+				// (these are protected by turning
+				// interrupts off, as the timeout handler
+				// uses them too)
+    int calls, timeouts, lateReplies;
+
+    PendingCall *Finish(int id, Mail *reply);
+				// Take call "id" off the list, and wake
+				// it up with "reply"
+};
+
+// The following class packs integers, strings and bytes into a buffer,
+// for the arguments or result of a call, and unpacks them -- in the
+// same order.  Integers go in most significant byte first, whatever
+// the host.  Packing past the end of the buffer is an error;
+// unpacking past it returns zeros, and marks the buffer as bad, so a
+// procedure can tell a malformed call.
+
+class RpcMarshal {
+  public:
+    RpcMarshal(char *buffer, int size);	// Pack into, or unpack from,
+					// the first "size" bytes of "buffer"
+
+    void PutInt(int value);
+    void PutShort(short value);
+    void PutBytes(char *from, int numBytes);
+    void PutString(char *string);	// length, then the characters
+
+    int GetInt();
+    short GetShort();
+    void GetBytes(char *into, int numBytes);
+    void GetString(char *into, int maxLength);
+					// (including the '\0')
+
+    int Length() { return position; }	// bytes packed, or unpacked
+    bool Bad() { return bad; }		// unpacked past the end?
+
+  private:
+    char *buffer;
+    int size;
+    int position;
+    bool bad;
+};
+
+#endif // RPC_H
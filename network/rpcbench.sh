@@ -0,0 +1,41 @@
+#!/bin/sh
+# rpcbench.sh
+#	Run the RPC benchmark between two copies of Nachos on this host:
+#	a server (machine 1) with a pool of workers, and a client (machine
+#	0), once for each number of client threads given, and print the
+#	calls per second and the tail latency each time.  Run from the
+#	directory nachos was built in:
+#		sh rpcbench.sh [calls per thread] [workers] [threads ...]
+
+calls=${1:-200}
+workers=${2:-4}
+shift 2
+threads=${*:-1 2 4 8}
+
+for t in $threads; do
+	rm -f SOCKET_0 SOCKET_1
+	./nachos -m 1 -rpcs $workers > server.log 2>&1 &
+	server=$!
+	./nachos -m 0 -rpcc 1 $t $calls > client.log 2>&1
+
+	# the server stops when the client tells it to; if it never
+	# hears, don't wait for it for ever
+	waited=0
+	while :; do
+		case `ps -o stat= -p $server` in
+		""|Z*)
+			break;;
+		esac
+		if [ $waited -ge 10 ]; then
+			echo "rpcbench: the server didn't stop; killed it"
+			kill $server
+			break
+		fi
+		sleep 1
+		waited=`expr $waited + 1`
+	done
+	wait
+	echo "$t threads, $workers workers:"
+	grep -e "RPC" client.log server.log | sed 's/^[a-z]*\.log://'
+done
+rm -f SOCKET_0 SOCKET_1 server.log client.log
@@ -0,0 +1,466 @@
+// transport.cc
+//	Routines for reliable, ordered delivery of messages between two
+//	mailboxes, with a sliding window, cumulative acknowledgements and
+//	retransmission (cf. transport.h).
+//
+//	Everything a channel knows is protected by its lock, but the lock
+//	is never held while mail is being sent: the Post Office takes a
+//	whole NetworkTime to send each piece, and meanwhile the other
+//	threads using the channel should be able to get on.  The
+//	retransmission timer is an interrupt, so it can't take the lock;
+//	it just wakes up the thread that does the retransmitting.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "transport.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// Message::Message, Message::~Message
+//      A whole message, put back together: a copy of "msgData", which
+//	is "msgLength" bytes long.
+//----------------------------------------------------------------------
+
+Message::Message(char *msgData, int msgLength)
+{
+    length = msgLength;
+    data = new char[length > 0 ? length : 1];
+    bcopy(msgData, data, length);
+}
+
+Message::~Message()
+{
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+// DeliverHelper, RetransmitHelper, ChannelTimer
+// 	Dummy functions because C++ can't indirectly invoke member functions.
+//	The first two are forked as the channel's threads; the last is
+//	the retransmission timer's interrupt handler.
+//
+//	"arg" -- pointer to the Channel
+//----------------------------------------------------------------------
+
+static void DeliverHelper(_int arg)
+{ Channel *channel = (Channel *) arg; channel->Deliver(); }
+static void RetransmitHelper(_int arg)
+{ Channel *channel = (Channel *) arg; channel->Retransmit(); }
+static void ChannelTimer(_int arg)
+{ Channel *channel = (Channel *) arg; channel->TimerExpired(); }
+
+//----------------------------------------------------------------------
+// Channel::Channel
+// 	Initialize a channel between mailbox "localBox" on this machine
+//	and mailbox "farBox" on machine "farAddr", and start the threads
+//	that look after it.  The other end must be set up the same way,
+//	with the mailboxes the other way round.
+//
+//	"window" is how many segments may be sent before the first of
+//	them is acknowledged.
+//----------------------------------------------------------------------
+
+Channel::Channel(NetworkAddress far, MailBoxAddress local,
+		 MailBoxAddress farMailBox, int windowSize)
+{
+    ASSERT(windowSize > 0 && windowSize <= MaxWindow);
+    farAddr = far;
+    localBox = local;
+    farBox = farMailBox;
+    window = windowSize;
+    lock = new Lock("channel");
+    sendLock = new Lock("channel send");
+
+    base = nextSeq = dupAcks = 0;
+    windowOpen = new Condition("channel window");
+    srtt = -1;
+    rttvar = 0;
+    rto = InitialRTO;
+    deadline = -1;
+    timerSet = FALSE;
+    timeout = new Semaphore("channel timeout", 0);
+
+    expected = 0;
+    for (int i = 0; i < MaxWindow; i++)
+	recvBuf[i].present = FALSE;
+    partialSize = MaxSegmentSize;
+    partial = new char[partialSize];
+    partialLength = 0;
+    messageReady = new Condition("channel message");
+
+    segmentsSent = retransmits = timeouts = fastRetransmits = 0;
+    acksSent = duplicates = outOfOrder = 0;
+    messagesSent = messagesReceived = 0;
+
+    (new Thread("channel delivery"))->Fork(DeliverHelper, (_int) this);
+    (new Thread("channel retransmit"))->Fork(RetransmitHelper, (_int) this);
+}
+
+//----------------------------------------------------------------------
+// Channel::Send
+// 	Cut a message into segments, and send them, waiting whenever the
+//	window is full for the other end to acknowledge some of them.
+//	Only one message is sent at a time, so that their segments don't
+//	get mixed up.
+//
+//	"data" -- the message
+//	"length" -- how many bytes it is (it may be 0)
+//----------------------------------------------------------------------
+
+void
+Channel::Send(char *data, int length)
+{
+    char buffer[MaxMailSize];
+    int offset = 0, n, mailLength;
+    SegmentSlot *seg;
+
+    sendLock->Acquire();
+    lock->Acquire();
+    do {
+	n = min(length - offset, (int) MaxSegmentSize);
+	while (nextSeq - base >= window)
+	    windowOpen->Wait(lock);
+	seg = &sendBuf[nextSeq % MaxWindow];
+	seg->hdr.seq = nextSeq;
+	seg->hdr.length = n;
+	seg->hdr.flags = SegData | ((offset + n == length) ? SegLast : 0);
+	bcopy(data + offset, seg->data, n);
+	seg->sentAt = stats->totalTicks;
+	if (base == nextSeq)		// the oldest outstanding segment
+	    StartTimer();
+	nextSeq++;
+	segmentsSent++;
+	mailLength = Pack(seg, buffer);
+
+	lock->Release();		// not while the mail goes out
+	SendMail(buffer, mailLength);
+	lock->Acquire();
+	offset += n;
+    } while (offset < length);
+    messagesSent++;
+    lock->Release();
+    sendLock->Release();
+}
+
+//----------------------------------------------------------------------
+// Channel::Receive
+// 	Wait for a whole message to arrive, and copy as much of it as
+//	will fit into "data".  Return the length of the whole message.
+//
+//	"data" -- where to put the message
+//	"maxLength" -- how much room there is there
+//----------------------------------------------------------------------
+
+int
+Channel::Receive(char *data, int maxLength)
+{
+    Message *message;
+    int length;
+
+    lock->Acquire();
+    while (messages.IsEmpty())
+	messageReady->Wait(lock);
+    message = messages.Remove();
+    lock->Release();
+
+    length = message->length;
+    bcopy(message->data, data, min(length, maxLength));
+    delete message;
+    return length;
+}
+
+//----------------------------------------------------------------------
+// Channel::Flush
+// 	Wait until the other end has acknowledged every segment sent.
+//----------------------------------------------------------------------
+
+void
+Channel::Flush()
+{
+    lock->Acquire();
+    while (base != nextSeq)
+	windowOpen->Wait(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Channel::Deliver
+// 	The channel's delivery thread: wait for mail from the other end,
+//	and deal with the acknowledgement it carries and the data in it,
+//	if any.  Data is always acknowledged at once (even if we had it
+//	already -- the acknowledgement may have been lost).
+//----------------------------------------------------------------------
+
+void
+Channel::Deliver()
+{
+    Mail *mail;
+    SegmentHeader *hdr;
+    char resend[MaxMailSize], ack[MaxMailSize];
+    int resendLength, ackLength;
+
+    for (;;) {
+	mail = postOffice->Receive(localBox);	// (read it in place)
+	hdr = (SegmentHeader *) mail->data;
+	if (mail->pktHdr.from != farAddr || mail->mailHdr.from != farBox ||
+	    mail->mailHdr.length < sizeof(SegmentHeader) ||
+	    hdr->length > MaxSegmentSize) {
+	    mail->Release();
+	    continue;			// not for this channel
+	}
+
+	lock->Acquire();
+	resendLength = ackLength = 0;
+	if (hdr->ack > base && hdr->ack <= nextSeq)
+	    Acknowledged(hdr->ack);
+	else if (hdr->ack == base && base != nextSeq &&
+		 !(hdr->flags & SegData) && ++dupAcks == 3) {
+	    // the other end keeps getting segments, but not the one after
+	    // "base": it must have been lost
+	    sendBuf[base % MaxWindow].sentAt = -1;
+	    resendLength = Pack(&sendBuf[base % MaxWindow], resend);
+	    fastRetransmits++;
+	    retransmits++;
+	}
+	if (hdr->flags & SegData) {
+	    Arrived(hdr, mail->data + sizeof(SegmentHeader));
+	    ackLength = Pack(NULL, ack);
+	    acksSent++;
+	}
+	lock->Release();
+	mail->Release();
+
+	if (resendLength > 0)
+	    SendMail(resend, resendLength);
+	if (ackLength > 0)
+	    SendMail(ack, ackLength);
+    }
+}
+
+//----------------------------------------------------------------------
+// Channel::Acknowledged
+// 	The other end has received every segment before "ack".  Take the
+//	round trip time of the last of them, unless it had to be sent
+//	again (then we can't tell which time it was received), slide the
+//	window on, and restart the timer for what is still outstanding.
+//----------------------------------------------------------------------
+
+void
+Channel::Acknowledged(int ack)
+{
+    SegmentSlot *last = &sendBuf[(ack - 1) % MaxWindow];
+    int sample, diff;
+
+    if (last->sentAt != -1) {
+	sample = stats->totalTicks - last->sentAt;
+	if (srtt == -1) {
+	    srtt = sample;
+	    rttvar = sample / 2;
+	} else {
+	    diff = (srtt > sample) ? srtt - sample : sample - srtt;
+	    rttvar = (3 * rttvar + diff) / 4;
+	    srtt = (7 * srtt + sample) / 8;
+	}
+	rto = max(MinRTO, min(srtt + 4 * rttvar, MaxRTO));
+    }
+    base = ack;
+    dupAcks = 0;
+    if (base == nextSeq)
+	StopTimer();
+    else
+	StartTimer();
+    windowOpen->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// Channel::Arrived
+// 	A segment of data has arrived.  Keep it, unless we have it
+//	already, then hand on every segment we now have in order: the
+//	last segment of a message makes the message whole.
+//----------------------------------------------------------------------
+
+void
+Channel::Arrived(SegmentHeader *hdr, char *data)
+{
+    SegmentSlot *seg;
+    char *bigger;
+
+    if (hdr->seq < expected || hdr->seq >= expected + MaxWindow ||
+	recvBuf[hdr->seq % MaxWindow].present) {
+	duplicates++;
+	return;
+    }
+    if (hdr->seq != expected)
+	outOfOrder++;
+    seg = &recvBuf[hdr->seq % MaxWindow];
+    seg->hdr = *hdr;
+    bcopy(data, seg->data, hdr->length);
+    seg->present = TRUE;
+
+    for (seg = &recvBuf[expected % MaxWindow]; seg->present;
+	 seg = &recvBuf[expected % MaxWindow]) {
+	if (partialLength + seg->hdr.length > partialSize) {
+	    partialSize *= 2;
+	    bigger = new char[partialSize];
+	    bcopy(partial, bigger, partialLength);
+	    delete [] partial;
+	    partial = bigger;
+	}
+	bcopy(seg->data, partial + partialLength, seg->hdr.length);
+	partialLength += seg->hdr.length;
+	if (seg->hdr.flags & SegLast) {
+	    messages.Append(new Message(partial, partialLength));
+	    messageReady->Signal(lock);
+	    messagesReceived++;
+	    partialLength = 0;
+	}
+	seg->present = FALSE;
+	expected++;
+    }
+}
+
+//----------------------------------------------------------------------
+// Channel::Retransmit
+// 	The channel's retransmission thread: whenever the timer goes off,
+//	send the oldest outstanding segment again, and double the timeout
+//	(the network is slower than we thought, or too busy).  The rest
+//	may well have arrived; the acknowledgement for this one will say.
+//----------------------------------------------------------------------
+
+void
+Channel::Retransmit()
+{
+    char buffer[MaxMailSize];
+    int length;
+
+    for (;;) {
+	timeout->P();
+	lock->Acquire();
+	length = 0;
+	if (base != nextSeq) {
+	    timeouts++;
+	    retransmits++;
+	    rto = min(2 * rto, MaxRTO);
+	    sendBuf[base % MaxWindow].sentAt = -1;
+	    length = Pack(&sendBuf[base % MaxWindow], buffer);
+	    StartTimer();
+	}
+	lock->Release();
+
+	if (length > 0)
+	    SendMail(buffer, length);
+    }
+}
+
+//----------------------------------------------------------------------
+// Channel::StartTimer, Channel::StopTimer, Channel::TimerExpired
+// 	The retransmission timer.  Interrupts can't be cancelled, so at
+//	most one is scheduled at a time; when it goes off, it checks
+//	whether the timer has been stopped or restarted meanwhile, and
+//	if it has been restarted, it is scheduled again for the rest.
+//
+//	Since TimerExpired is an interrupt handler, interrupts are off
+//	while the others change what it looks at.
+//----------------------------------------------------------------------
+
+void
+Channel::StartTimer()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    deadline = stats->totalTicks + rto;
+    if (!timerSet) {
+	timerSet = TRUE;
+	interrupt->Schedule(ChannelTimer, (_int) this, rto, TimerInt);
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+void
+Channel::StopTimer()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    deadline = -1;
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+void
+Channel::TimerExpired()
+{
+    if (deadline == -1)			// stopped
+	timerSet = FALSE;
+    else if (stats->totalTicks < deadline)	// restarted
+	interrupt->Schedule(ChannelTimer, (_int) this,
+			    deadline - stats->totalTicks, TimerInt);
+    else {
+	timerSet = FALSE;
+	deadline = -1;
+	timeout->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// Channel::Pack
+// 	Put segment "seg" into "buffer", as the contents of a piece of
+//	mail, with an acknowledgement of everything received so far.  If
+//	"seg" is NULL, the mail is just the acknowledgement.  Return the
+//	length of the mail.
+//----------------------------------------------------------------------
+
+int
+Channel::Pack(SegmentSlot *seg, char *buffer)
+{
+    SegmentHeader *hdr = (SegmentHeader *) buffer;
+
+    if (seg == NULL) {
+	hdr->seq = 0;
+	hdr->length = 0;
+	hdr->flags = 0;
+    } else {
+	*hdr = seg->hdr;
+	bcopy(seg->data, buffer + sizeof(SegmentHeader), seg->hdr.length);
+    }
+    hdr->ack = expected;
+    return sizeof(SegmentHeader) + hdr->length;
+}
+
+//----------------------------------------------------------------------
+// Channel::SendMail
+// 	Send "length" bytes of "buffer" to the other end's mailbox.
+//----------------------------------------------------------------------
+
+void
+Channel::SendMail(char *buffer, int length)
+{
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+
+    pktHdr.to = farAddr;
+    mailHdr.to = farBox;
+    mailHdr.from = localBox;
+    mailHdr.length = length;
+    postOffice->Send(pktHdr, mailHdr, buffer);
+}
+
+//----------------------------------------------------------------------
+// Channel::PrintStats
+// 	Print how much the channel has sent and received, and how much of
+//	it was sent again, or received more than once.
+//----------------------------------------------------------------------
+
+void
+Channel::PrintStats()
+{
+    printf("Channel to %d, box %d: messages sent %d, received %d\n",
+	   farAddr, farBox, messagesSent, messagesReceived);
+    printf("Channel segments: sent %d, sent again %d (timeouts %d, "
+	   "fast %d), acks sent %d\n", segmentsSent, retransmits, timeouts,
+	   fastRetransmits, acksSent);
+    printf("Channel segments: received twice %d, out of order %d, "
+	   "round trip %d ticks, timeout %d ticks\n", duplicates, outOfOrder,
+	   srtt, rto);
+}
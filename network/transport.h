@@ -0,0 +1,163 @@
+// transport.h
+//	Data structures for reliable, ordered delivery of messages of any
+//	size between two mailboxes on different machines, on top of the
+//	Post Office's unreliable, unordered, fixed-size delivery.
+//
+//	A Channel joins a mailbox on this machine to one on another.
+//	Each message sent on it is cut into segments small enough to
+//	go in one piece of mail; every segment has a sequence number,
+//	and every piece of mail carries back a cumulative acknowledgement
+//	-- the sequence number of the first segment not yet received in
+//	order.  Up to a window's worth of segments may be sent before the
+//	first of them is acknowledged.  If the oldest is not acknowledged
+//	within the retransmission timeout (adjusted to the round trip
+//	time measured so far), it is sent again, and the timeout doubles.
+//	Three acknowledgements in a row for the same segment mean the one
+//	after it was lost, and it is sent again straight away.  The
+//	receiving end keeps segments that arrive out of order, up to a
+//	window's worth ahead, and puts the messages back together, in order.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "post.h"
+#include "ilist.h"
+
+// The following class defines the segment header.  This is prepended
+// to the data by the Channel, before it goes to the Post Office.
+
+#define SegData		1	// the segment carries data
+#define SegLast		2	// ... the last of a message
+
+class SegmentHeader {
+  public:
+    int seq;			// sequence number, if it carries data
+    int ack;			// first segment not yet received in order
+    unsigned short length;	// bytes of data after the header
+    unsigned short flags;	// SegData, SegLast
+};
+
+#define MaxSegmentSize	(MaxMailSize - sizeof(SegmentHeader))
+				// data in a segment
+
+#define MaxWindow	32	// most segments that may be outstanding
+#define DefaultWindow	8
+
+#define InitialRTO	(20 * NetworkTime)	// retransmission timeouts
+#define MinRTO		(5 * NetworkTime)
+#define MaxRTO		(10000 * NetworkTime)
+
+// A segment that has been sent but not acknowledged yet, or has arrived
+// before the ones before it.
+
+class SegmentSlot {
+  public:
+    SegmentHeader hdr;
+    char data[MaxSegmentSize];
+    int sentAt;			// when it was sent, for measuring the
+				// round trip time; -1 if sent again
+    bool present;		// (receiving end) arrived?
+};
+
+// A message that has been put back together, waiting for Receive.
+
+class Message {
+  public:
+    Message(char *msgData, int msgLength);
+    ~Message();
+
+    char *data;
+    int length;
+    ListLink<Message> link;	// for queueing it in the Channel
+};
+
+// The following class defines a channel.  Both ends create one, naming
+// each other's mailbox.  Any number of threads may send and receive on
+// a channel; each message goes out in one piece, and is received whole
+// by one of the receivers.
+//
+// Each channel has two threads of its own: one takes in whatever
+// arrives in its mailbox, the other sends segments again when the
+// retransmission timer goes off.  A channel lasts until Nachos halts.
+
+class Channel {
+  public:
+    Channel(NetworkAddress farAddr, MailBoxAddress localBox,
+	    MailBoxAddress farBox, int window = DefaultWindow);
+				// Join mailbox "localBox" on this machine
+				// to "farBox" on machine "farAddr"
+
+    void Send(char *data, int length);
+				// Send a message.  Returns once it is all
+				// sent, though it may not have arrived yet.
+    int Receive(char *data, int maxLength);
+				// Wait for a message, and copy up to
+				// "maxLength" bytes of it into "data".
+				// Returns the message's length.
+    void Flush();		// Wait until everything sent has been
+				// acknowledged
+
+    void PrintStats();		// Print what the channel has done
+
+    void Deliver();		// The channel's own threads: take in
+    void Retransmit();		// what arrives, and send again what
+				// is not acknowledged in time
+    void TimerExpired();	// Interrupt handler, for the
+				// retransmission timer
+
+  private:
+    NetworkAddress farAddr;	// the other end
+    MailBoxAddress localBox, farBox;
+    int window;			// segments that may be outstanding
+    Lock *lock;			// protects everything below
+    Lock *sendLock;		// one message goes out at a time
+
+    // sending end
+    SegmentSlot sendBuf[MaxWindow];	// outstanding segments, by seq
+    int base;			// oldest segment not acknowledged
+    int nextSeq;		// sequence number of the next segment
+    int dupAcks;		// acknowledgements in a row for "base"
+    Condition *windowOpen;	// signalled when segments are
+				// acknowledged
+    int srtt, rttvar;		// smoothed round trip time, and its
+				// variation
+    int rto;			// retransmission timeout
+    int deadline;		// when the timer is to go off, -1 if
+				// it's stopped
+    bool timerSet;		// is an interrupt scheduled for it?
+    Semaphore *timeout;		// V'ed when the timer goes off
+
+    // receiving end
+    SegmentSlot recvBuf[MaxWindow];	// segments that came early, by seq
+    int expected;		// next segment to be received in order
+    char *partial;		// the message being put back together
+    int partialLength, partialSize;
+    IntrusiveList<Message, &Message::link> messages;
+				// messages waiting for Receive
+    Condition *messageReady;	// signalled when one is added
+
+    // statistics
+    int segmentsSent, retransmits, timeouts, fastRetransmits;
+    int acksSent, duplicates, outOfOrder;
+    int messagesSent, messagesReceived;
+
+    int Pack(SegmentSlot *seg, char *buffer);
+				// Put "seg" in mail, acknowledging what
+				// we have received so far
+    void SendMail(char *buffer, int length);
+				// Send mail to the other end
+    void StartTimer();		// (Re)start the retransmission timer
+    void StopTimer();
+    void Acknowledged(int ack);	// The other end has everything up to
+				// "ack"
+    void Arrived(SegmentHeader *hdr, char *data);
+				// A segment of data has arrived
+};
+
+#endif // TRANSPORT_H
@@ -0,0 +1,233 @@
+// ilist.h
+//	Data structures to manage intrusive lists: lists whose link
+//	fields are embedded in the items themselves.
+//
+//	A List allocates a ListElement for every item put on it, and
+//	frees it when the item is taken off.  The kernel's own queues --
+//	ready lists, semaphore and condition variable queues, mailboxes --
+//	are on the path of every context switch, so they use these lists
+//	instead: putting an item on or taking it off never allocates.
+//
+//	The price is that an item can be on at most one list per link
+//	field it has.  For instance, a Thread has one ("queueLink"), which
+//	is enough because a thread is only ever waiting in one place: on
+//	a ready list, or on a semaphore, lock or condition.
+//
+//	The operations are the same as List's, but type safe: an
+//	IntrusiveList<Thread, &Thread::queueLink> only holds Threads.
+//
+//     	NOTE: Mutual exclusion must be provided by the caller.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef ILIST_H
+#define ILIST_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class defines the link field to embed in an item that
+// is to be put on an intrusive list: the equivalent of a ListElement,
+// without the pointer to the item.
+
+template <class T>
+class ListLink {
+  public:
+    ListLink() { next = NULL; key = 0; }
+
+    T *next;			// next item on the list,
+				// NULL if this is the last
+    int key;			// priority, for a sorted list
+};
+
+// The following class defines an intrusive list of T's, linked through
+// their "link" field.  As with List, by using the "Sorted" functions,
+// the list can be kept sorted in increasing order by key.
+
+template <class T, ListLink<T> T::*link>
+class IntrusiveList {
+  public:
+    IntrusiveList() { first = last = NULL; } // initialize the list
+
+    void Prepend(T *item);	// Put item at the beginning of the list
+    void Append(T *item);	// Put item at the end of the list
+    T *Remove() { return SortedRemove(NULL); }
+				// Take item off the front of the list
+    bool RemoveItem(T *item);	// Take "item" off the list, wherever
+				// it is; FALSE if it wasn't there
+    T *Front(int *keyPtr);	// Return the first item (and its key),
+				// without removing it
+
+    void Mapcar(VoidFunctionPtr func);	// Apply "func" to every element
+					// on the list
+    bool IsEmpty() { return first == NULL; } // is the list empty?
+
+    // Routines to put/get items on/off list in order (sorted by key)
+    void SortedInsert(T *item, int sortKey);	// Put item into list
+    T *SortedRemove(int *keyPtr); 	  	// Remove first item from list
+
+  private:
+    T *first;			// Head of the list, NULL if list is empty
+    T *last;			// Last item on the list
+
+    static ListLink<T> *Link(T *item) { return &(item->*link); }
+};
+
+//----------------------------------------------------------------------
+// IntrusiveList::Append
+//      Append an "item" to the end of the list.  It must not be on
+//	another list through the same link field.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+void
+IntrusiveList<T, link>::Append(T *item)
+{
+    ASSERT(Link(item)->next == NULL && item != last);
+    Link(item)->key = 0;
+    if (IsEmpty())
+	first = item;
+    else
+	Link(last)->next = item;
+    last = item;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::Prepend
+//      Put an "item" on the front of the list.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+void
+IntrusiveList<T, link>::Prepend(T *item)
+{
+    ASSERT(Link(item)->next == NULL && item != last);
+    Link(item)->key = 0;
+    Link(item)->next = first;
+    first = item;
+    if (last == NULL)
+	last = item;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::SortedInsert
+//      Insert an "item" into a list, so that the items are sorted in
+//	increasing order by "sortKey", after any with the same key.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+void
+IntrusiveList<T, link>::SortedInsert(T *item, int sortKey)
+{
+    T *ptr;
+
+    ASSERT(Link(item)->next == NULL && item != last);
+    Link(item)->key = sortKey;
+    if (IsEmpty()) {
+	first = last = item;
+    } else if (sortKey < Link(first)->key) {	// goes on front of list
+	Link(item)->next = first;
+	first = item;
+    } else {		// look for first item on the list bigger than it
+	for (ptr = first; Link(ptr)->next != NULL; ptr = Link(ptr)->next) {
+	    if (sortKey < Link(Link(ptr)->next)->key) {
+		Link(item)->next = Link(ptr)->next;
+		Link(ptr)->next = item;
+		return;
+	    }
+	}
+	Link(last)->next = item;		// goes at end of list
+	last = item;
+    }
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::SortedRemove
+//      Remove the first item from the front of a sorted list.
+//
+// Returns:
+//	Pointer to removed item, NULL if nothing on the list.
+//	Sets *keyPtr (if not NULL) to its key.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+T *
+IntrusiveList<T, link>::SortedRemove(int *keyPtr)
+{
+    T *item = first;
+
+    if (IsEmpty())
+	return NULL;
+    first = Link(item)->next;
+    if (first == NULL)
+	last = NULL;
+    Link(item)->next = NULL;
+    if (keyPtr != NULL)
+	*keyPtr = Link(item)->key;
+    return item;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::RemoveItem
+//      Remove "item" from the list, wherever it is.  Takes time
+//	proportional to its distance from the front.
+//
+// Returns:
+//	TRUE if "item" was on the list.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+bool
+IntrusiveList<T, link>::RemoveItem(T *item)
+{
+    T *ptr, *prev = NULL;
+
+    for (ptr = first; ptr != NULL; prev = ptr, ptr = Link(ptr)->next) {
+	if (ptr != item)
+	    continue;
+	if (prev == NULL)
+	    first = Link(item)->next;
+	else
+	    Link(prev)->next = Link(item)->next;
+	if (last == item)
+	    last = prev;
+	Link(item)->next = NULL;
+	return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::Front
+//      Look at the first item on the list, without removing it.
+//	Sets *keyPtr (if not NULL) to its key.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+T *
+IntrusiveList<T, link>::Front(int *keyPtr)
+{
+    if (IsEmpty())
+	return NULL;
+    if (keyPtr != NULL)
+	*keyPtr = Link(first)->key;
+    return first;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::Mapcar
+//	Apply a function to each item on the list.  "func" must not
+//	take the item off the list.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+void
+IntrusiveList<T, link>::Mapcar(VoidFunctionPtr func)
+{
+    for (T *ptr = first; ptr != NULL; ptr = Link(ptr)->next)
+	(*func)((_int)ptr);
+}
+
+#endif // ILIST_H
@@ -8,38 +8,91 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
-//		-f -cp <unix file> <nachos file>
-//		-p <nachos file> -r <nachos file> -l -D -t
+// Usage: nachos -d <debugflags> -rs <random seed #> -mlfq -tp <pool size>
+//		-sb <# threads> -fb <# forks> -pi -rwb <# threads>
+//		-s -bb -x <nachos file> -c <consoleIn> <consoleOut>
+//		-tlb <fifo|clock|random> -vm <fifo|clock|eclock|lru>
+//		-f -dc <# sectors> -dcp <lru|2q> -ds <fcfs|sstf|scan|clook>
+//		-nc <# names> -fa <first|runs> -cp <unix file> <nachos file>
+//		-p <nachos file> -r <nachos file> -l -ls <nachos directory>
+//		-mkdir <nachos directory> -rmdir <nachos directory> -D -t
+//		-rb <# threads> -cb <unix file> -mb <# files>
+//		-ct <ticks> -fsck -fst <# threads>
 //              -n <network reliability> -e <network orderability>
 //              -m <machine id>
 //              -o <other machine id>
+//              -ts <other machine id> <# bytes> -tr <other machine id> <# bytes>
+//              -pb <# threads>
+//              -ns <topology file> <pingpong|alltoall|ring> <# rounds>
+//              -rpcs <# workers> -rpcc <server machine id> <# threads> <# calls>
 //              -z
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -mlfq schedules threads with a multi-level feedback queue, time
+//	sliced by the timer
+//    -tp sets how many finished threads' stacks are kept for reuse
 //    -z prints the copyright message
 //
+//  THREADS
+//    -sb runs the scheduler benchmark with the given number of threads
+//    -fb runs the fork/finish benchmark with the given number of forks
+//    -pi runs the priority inversion test
+//    -rwb runs the reader/writer lock benchmark with the given number
+//	of threads
+//
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
+//    -bb runs user programs with the basic-block engine instead of
+//	the instruction-at-a-time interpreter
 //    -x runs a user program
 //    -c tests the console
 //
+//  VM
+//    -tlb selects the TLB replacement policy (with USE_TLB)
+//    -vm selects the page replacement policy for demand paging
+//
 //  FILESYS
 //    -f causes the physical disk to be formatted
+//    -dc sets how many disk sectors to cache in memory (0 for none)
+//    -dcp selects the disk cache replacement policy
+//    -ds selects the disk scheduling policy (fcfs, sstf, scan, clook)
+//    -nc sets how many file name lookups to cache (0 for none)
+//    -fa selects how sectors are allocated to files (first, runs)
 //    -cp copies a file from UNIX to Nachos
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
-//    -l lists the contents of the Nachos directory
+//    -l lists the contents of the Nachos root directory
+//    -ls lists the contents of a Nachos directory
+//    -mkdir creates a Nachos directory
+//    -rmdir removes an empty Nachos directory
 //    -D prints the contents of the entire file system
 //    -t tests the performance of the Nachos file system
+//    -rb runs the random-read disk benchmark with the given number
+//	of threads, under each disk scheduling policy
+//    -cb runs the copy benchmark on the given UNIX file, under each
+//	sector allocation policy
+//    -mb runs the metadata benchmark with the given number of files
+//    -ct runs the crash test workload, crashing after the given number
+//	of ticks (0 for never)
+//    -fsck checks the file system on disk
+//    -fst runs the file system stress test with the given number of
+//	threads
 //
 //  NETWORK
 //    -n sets the network reliability
 //    -e sets the network orderability
 //    -m sets this machine's host id (needed for the network)
 //    -o runs a simple test of the Nachos network software
+//    -ts, -tr run the reliable transport benchmark, sending the given
+//	number of bytes to, or receiving them from, the other machine
+//    -pb runs the Post Office send benchmark, with the given number of
+//	threads sending mail to this machine
+//    -ns runs this machine's part in a network simulation, over the
+//	given topology (cf. network/netsim.cc, netsim.sh)
+//    -rpcs, -rpcc run the RPC benchmark's server, with the given number
+//	of workers, and client, calling it from the given number of
+//	threads the given number of times each
 //
 //  NOTE -- flags are ignored until the relevant assignment.
 //  Some of the flags are interpreted here; some in system.cc.
@@ -58,12 +111,25 @@
 // External functions used by this file
 
 extern void ThreadTest(void), Copy(char *unixFile, char *nachosFile);
+extern void SchedulerBenchmark(int numThreads), ForkBenchmark(int numForks);
 extern void Print(char *file), PerformanceTest(void);
 extern void StartProcess(char *file), ConsoleTest(char *in, char *out);
 extern void MailTest(int networkID);
-extern void SynchTest(void);
+extern void TransportSender(int farAddr, int numBytes);
+extern void TransportReceiver(int farAddr, int numBytes);
+extern void PostBenchmark(int numThreads);
+extern void NetSim(char *topology, char *workload, int rounds);
+extern void RpcServerBenchmark(int numWorkers);
+extern void RpcClientBenchmark(int server, int numThreads, int numCalls);
+extern void SynchTest(void), InversionTest(void);
+extern void RWBenchmark(int numThreads);
 extern void Append(char *from, char *to, int half);
 extern void NAppend(char *from, char *to);
+extern void RandomReadBenchmark(int numThreads);
+extern void CopyBenchmark(char *unixFile);
+extern void MetadataBenchmark(int numFiles);
+extern void CrashTest(int crashTick);
+extern void StressTest(int numThreads);
 
 //----------------------------------------------------------------------
 // main
@@ -99,6 +165,28 @@ int main(int argc, char **argv)
 		argCount = 1;
 		if (!strcmp(*argv, "-z")) // print copyright
 			printf(copyright);
+#ifdef THREADS
+		if (!strcmp(*argv, "-sb"))
+		{ // scheduler benchmark
+			ASSERT(argc > 1);
+			SchedulerBenchmark(atoi(*(argv + 1)));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-fb"))
+		{ // fork/finish benchmark
+			ASSERT(argc > 1);
+			ForkBenchmark(atoi(*(argv + 1)));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-pi")) // priority inversion test
+			InversionTest();
+		else if (!strcmp(*argv, "-rwb"))
+		{ // reader/writer lock benchmark
+			ASSERT(argc > 1);
+			RWBenchmark(atoi(*(argv + 1)));
+			argCount = 2;
+		}
+#endif // THREADS
 #ifdef USER_PROGRAM
 		if (!strcmp(*argv, "-x"))
 		{ // run a user program
@@ -144,6 +232,27 @@ int main(int argc, char **argv)
 		{ // list Nachos directory
 			fileSystem->List();
 		}
+		else if (!strcmp(*argv, "-ls"))
+		{ // list a Nachos directory
+			ASSERT(argc > 1);
+			if (!fileSystem->List(*(argv + 1)))
+				printf("ls: no directory %s\n", *(argv + 1));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-mkdir"))
+		{ // create a Nachos directory
+			ASSERT(argc > 1);
+			if (!fileSystem->Mkdir(*(argv + 1)))
+				printf("mkdir: couldn't create directory %s\n", *(argv + 1));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-rmdir"))
+		{ // remove an empty Nachos directory
+			ASSERT(argc > 1);
+			if (!fileSystem->Rmdir(*(argv + 1)))
+				printf("rmdir: couldn't remove directory %s\n", *(argv + 1));
+			argCount = 2;
+		}
 		else if (!strcmp(*argv, "-D"))
 		{ // print entire filesystem
 			fileSystem->Print();
@@ -152,6 +261,40 @@ int main(int argc, char **argv)
 		{ // performance test
 			PerformanceTest();
 		}
+		else if (!strcmp(*argv, "-rb"))
+		{ // disk scheduling benchmark
+			ASSERT(argc > 1);
+			RandomReadBenchmark(atoi(*(argv + 1)));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-cb"))
+		{ // allocation benchmark
+			ASSERT(argc > 1);
+			CopyBenchmark(*(argv + 1));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-mb"))
+		{ // name cache and header table benchmark
+			ASSERT(argc > 1);
+			MetadataBenchmark(atoi(*(argv + 1)));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-ct"))
+		{ // journal crash test
+			ASSERT(argc > 1);
+			CrashTest(atoi(*(argv + 1)));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-fsck"))
+		{ // check the file system
+			fileSystem->Check();
+		}
+		else if (!strcmp(*argv, "-fst"))
+		{ // concurrent file system stress test
+			ASSERT(argc > 1);
+			StressTest(atoi(*(argv + 1)));
+			argCount = 2;
+		}
 		else if (!strcmp(*argv, "-ap"))
 		{
 			ASSERT(argc > 2);
@@ -175,9 +318,53 @@ int main(int argc, char **argv)
 			MailTest(atoi(*(argv + 1)));
 			argCount = 2;
 		}
+		else if (!strcmp(*argv, "-ts"))
+		{ // reliable transport benchmark, sending end
+			ASSERT(argc > 2);
+			Delay(2); // give the receiving end time to start
+			TransportSender(atoi(*(argv + 1)), atoi(*(argv + 2)));
+			argCount = 3;
+		}
+		else if (!strcmp(*argv, "-tr"))
+		{ // reliable transport benchmark, receiving end
+			ASSERT(argc > 2);
+			TransportReceiver(atoi(*(argv + 1)), atoi(*(argv + 2)));
+			argCount = 3;
+		}
+		else if (!strcmp(*argv, "-pb"))
+		{ // Post Office send benchmark
+			ASSERT(argc > 1);
+			PostBenchmark(atoi(*(argv + 1)));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-ns"))
+		{ // network simulation
+			ASSERT(argc > 3);
+			Delay(2); // give the other nodes time to start
+			NetSim(*(argv + 1), *(argv + 2), atoi(*(argv + 3)));
+			argCount = 4;
+		}
+		else if (!strcmp(*argv, "-rpcs"))
+		{ // RPC benchmark, server
+			ASSERT(argc > 1);
+			RpcServerBenchmark(atoi(*(argv + 1)));
+			argCount = 2;
+		}
+		else if (!strcmp(*argv, "-rpcc"))
+		{ // RPC benchmark, client
+			ASSERT(argc > 3);
+			Delay(2); // give the server time to start
+			RpcClientBenchmark(atoi(*(argv + 1)), atoi(*(argv + 2)),
+					   atoi(*(argv + 3)));
+			argCount = 4;
+		}
 #endif // NETWORK
 	}
 
+#ifdef FILESYS
+	fileSystem->Flush(); // write back the free map and open file headers,
+	synchDisk->Flush();	 // and what the commands left in the cache
+#endif
 	currentThread->Finish(); // NOTE: if the procedure "main"
 			// returns, then the program "nachos"
 			// will exit (as any other normal program
@@ -11,8 +11,13 @@
 //	end up calling FindNextToRun(), and that would put us in an
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+// 	Strict priorities, FIFO within a priority.  There is a ready
+//	queue per priority and a bitmap of the non-empty ones, so that
+//	both putting a thread on the ready list and finding the highest
+//	priority ready thread take constant time.
+//
+//	With the MLFQ policy, the priorities change as threads run: see
+//	ShouldPreempt and Age.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -22,46 +27,63 @@
 #include "scheduler.h"
 #include "system.h"
 
+#include <strings.h> // for ffs
+
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
-// 	Initialize the list of ready but not running threads to empty.
+// 	Initialize the lists of ready but not running threads to empty.
+//
+//	"how" is the scheduling policy
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler()
+Scheduler::Scheduler(SchedPolicy how)
 {
-    readyList = new List;
+    readyLevels = 0;
+    policy = how;
+    dispatchedAt = 0;
+    lastAged = 0;
 }
 
 //----------------------------------------------------------------------
 // Scheduler::~Scheduler
-// 	De-allocate the list of ready threads.
+// 	De-allocate the lists of ready threads.
 //----------------------------------------------------------------------
 
 Scheduler::~Scheduler()
 {
-    delete readyList;
 }
 
 //----------------------------------------------------------------------
 // Scheduler::ReadyToRun
 // 	Mark a thread as ready, but not running.
-//	Put it on the ready list, for later scheduling onto the CPU.
+//	Put it at the end of the ready list for its priority, for later
+//	scheduling onto the CPU.
 //
 //	"thread" is the thread to be put on the ready list.
 //----------------------------------------------------------------------
 
 void Scheduler::ReadyToRun(Thread *thread)
 {
+    unsigned int priority;
+
     DEBUG('t', "Putting thread %s on ready list.\n", thread->getName());
+    if (policy == SchedMLFQ && thread->GetBasePriority() >= NumMLFQLevels)
+        thread->SetPriority(NumMLFQLevels - 1); // start on the lowest level
+    priority = thread->GetPriority();
+    ASSERT(priority < NumPriorities);
 
     thread->setStatus(READY);
-    readyList->SortedInsert((void *)thread, thread->GetPriority());
+    thread->readySince = stats->totalTicks;
+    readyList[priority].Append(thread);
+    readyLevels |= 1u << priority;
 }
 
 //----------------------------------------------------------------------
 // Scheduler::FindNextToRun
 // 	Return the next thread to be scheduled onto the CPU.
-//	If there are no ready threads, return NULL.
+//	That is the first thread on the highest priority non-empty
+//	ready list; the lowest set bit of readyLevels says which list
+//	that is.  If there are no ready threads, return NULL.
 // Side effect:
 //	Thread is removed from the ready list.
 //----------------------------------------------------------------------
@@ -69,7 +91,16 @@ void Scheduler::ReadyToRun(Thread *thread)
 Thread *
 Scheduler::FindNextToRun()
 {
-    return (Thread *)readyList->SortedRemove(NULL);
+    Thread *thread;
+    int priority;
+
+    if (readyLevels == 0)
+        return NULL;
+    priority = ffs(readyLevels) - 1;
+    thread = readyList[priority].Remove();
+    if (readyList[priority].IsEmpty())
+        readyLevels &= ~(1u << priority);
+    return thread;
 }
 
 //----------------------------------------------------------------------
@@ -100,6 +131,7 @@ void Scheduler::Run(Thread *nextThread)
 
     oldThread->CheckOverflow(); // check if the old thread
                                 // had an undetected stack overflow
+    Charge(oldThread);
 
     currentThread = nextThread;        // switch to the next thread
     currentThread->setStatus(RUNNING); // nextThread is now running
@@ -143,5 +175,128 @@ void Scheduler::Run(Thread *nextThread)
 void Scheduler::Print()
 {
     printf("Ready list contents:\n");
-    readyList->Mapcar((VoidFunctionPtr)ThreadPrint);
+    for (int i = 0; i < NumPriorities; i++)
+        readyList[i].Mapcar((VoidFunctionPtr)ThreadPrint);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Charge
+// 	Add the CPU time the running thread has used since it was last
+//	charged to its account.  Time the machine spent idle isn't
+//	anybody's.
+//
+//	"thread" is the running thread
+//----------------------------------------------------------------------
+
+void Scheduler::Charge(Thread *thread)
+{
+    int now = stats->totalTicks - stats->idleTicks;
+
+    thread->cpuTicks += now - dispatchedAt;
+    thread->sliceTicks += now - dispatchedAt;
+    dispatchedAt = now;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ShouldPreempt
+// 	Called from the timer interrupt handler, to decide whether the
+//	running thread should give up the CPU when the handler returns.
+//
+//	With static priorities, it always does (this is what -rs has
+//	always done).  With MLFQ, a thread that has used up its time slice
+//	moves down a level, and then yields only if there is another
+//	thread ready at the same or a higher level; a thread still within
+//	its slice yields only to a higher level.  The levels are the
+//	threads' own priorities; a donated priority (see Lock) is used for
+//	choosing whom to run, but not for the time slice.  Slices are not
+//	reset by blocking, so a thread can't stay on a high level by
+//	sleeping just before its slice runs out.
+//----------------------------------------------------------------------
+
+bool Scheduler::ShouldPreempt()
+{
+    Thread *thread = currentThread;
+    unsigned int level = thread->GetBasePriority();
+    unsigned int best;
+
+    if (policy == SchedPriority)
+        return TRUE;
+
+    Charge(thread);
+    if (stats->totalTicks - lastAged >= AgingTicks)
+        Age();
+    best = (readyLevels == 0) ? NumPriorities : ffs(readyLevels) - 1;
+
+    if (thread->sliceTicks < MLFQSlice(level))
+        return best < thread->GetPriority();
+
+    DEBUG('t', "Thread \"%s\" used up its time slice at level %d\n",
+          thread->getName(), level);
+    thread->sliceTicks = 0;
+    if (level < NumMLFQLevels - 1)
+        thread->SetPriority(level + 1);
+    return best <= thread->GetPriority(); // (donations still count)
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Age
+// 	Move every thread that has been on a ready list for AgingTicks
+//	or longer up one level, so that CPU-bound threads on the lower
+//	levels don't starve.  This walks every ready list, so it is only
+//	done once every AgingTicks.
+//----------------------------------------------------------------------
+
+void Scheduler::Age()
+{
+    ThreadList waiting;
+    Thread *thread;
+    unsigned int now;
+
+    lastAged = stats->totalTicks;
+    for (int level = 1; level < NumMLFQLevels; level++)
+    {
+        while ((thread = readyList[level].Remove()) != NULL)
+            waiting.Append(thread);
+        while ((thread = waiting.Remove()) != NULL)
+        {
+            if (stats->totalTicks - thread->readySince >= AgingTicks &&
+                thread->GetBasePriority() > 0)
+            {
+                thread->SetPriority(thread->GetBasePriority() - 1);
+                thread->sliceTicks = 0;
+                DEBUG('t', "Aging thread \"%s\" to level %d\n",
+                      thread->getName(), thread->GetBasePriority());
+            }
+            now = thread->GetPriority();
+            readyList[now].Append(thread);
+            readyLevels |= 1u << now;
+        }
+        if (readyList[level].IsEmpty())
+            readyLevels &= ~(1u << level);
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Reprioritize
+// 	A thread's effective priority may have changed, because of a
+//	priority donation (see Lock::Donate).  Recompute it, and if the
+//	thread is on a ready list, move it to the right one.
+//
+//	"thread" is the thread whose priority may have changed
+//----------------------------------------------------------------------
+
+void Scheduler::Reprioritize(Thread *thread)
+{
+    unsigned int old = thread->GetPriority();
+    unsigned int now;
+
+    thread->RecomputePriority();
+    now = thread->GetPriority();
+    if (now == old || thread->getStatus() != READY)
+        return;
+    readyList[old].RemoveItem(thread);
+    if (readyList[old].IsEmpty())
+        readyLevels &= ~(1u << old);
+    readyList[now].Append(thread);
+    readyLevels |= 1u << now;
 }
@@ -10,27 +10,56 @@
 #define SCHEDULER_H
 
 #include "copyright.h"
-#include "list.h"
 #include "thread.h"
 
+// Scheduling policies:
+//   SchedPriority -- static priorities, set when the thread is created;
+//		      the timer (if any) forces a Yield on every interrupt
+//   SchedMLFQ     -- multi-level feedback queue: priorities 0 to
+//		      NumMLFQLevels - 1 are levels.  A thread that uses up
+//		      its level's time slice moves down a level; one that
+//		      has waited AgingTicks on the ready list moves up.
+enum SchedPolicy { SchedPriority, SchedMLFQ };
+
+#define NumMLFQLevels	4
+#define MLFQSlice(level) (TimerTicks << (level)) // time slice at "level"
+#define AgingTicks	(50 * TimerTicks)
+
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
 // thread is running, and which threads are ready but not running.
 
 class Scheduler {
   public:
-    Scheduler();			// Initialize list of ready threads 
-    ~Scheduler();			// De-allocate ready list
+    Scheduler(SchedPolicy how = SchedPriority); // Initialize list of
+					// ready threads
+    ~Scheduler();			// De-allocate ready lists
 
     void ReadyToRun(Thread* thread);	// Thread can be dispatched.
     Thread* FindNextToRun();		// Dequeue first thread on the ready 
 					// list, if any, and return thread.
     void Run(Thread* nextThread);	// Cause nextThread to start running
     void Print();			// Print contents of ready list
+
+    void Charge(Thread* thread);	// Account the running thread for the
+					// CPU time used since it was dispatched
+    bool ShouldPreempt();		// Called on each timer interrupt: 
+					// should the running thread yield?
+    void Reprioritize(Thread* thread);	// Thread's priority may have changed
     
   private:
-    List *readyList;  		// queue of threads that are ready to run,
-				// but not running
+    SchedPolicy policy;
+    int dispatchedAt;		// non-idle ticks when the running thread
+				// was last charged
+    int lastAged;		// when the ready lists were last aged
+
+    void Age();			// move up threads that waited too long
+
+    ThreadList readyList[NumPriorities]; // queues of threads that are ready
+				// to run, but not running -- one FIFO
+				// queue per priority
+    unsigned int readyLevels;	// bit i is set iff readyList[i] is
+				// not empty
 };
 
 #endif // SCHEDULER_H
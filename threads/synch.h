@@ -49,7 +49,7 @@ class Semaphore {
   private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List *queue;       // threads waiting in P() for the value to be > 0
+    ThreadList queue;  // threads waiting in P() for the value to be > 0
 };
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
@@ -63,6 +63,14 @@ class Semaphore {
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).  
+//
+// To avoid priority inversion, a thread waiting in Acquire donates its
+// priority to the lock's owner (and, if the owner is itself waiting for
+// another lock, to that lock's owner, and so on); Release wakes up the
+// highest priority waiter.
+
+extern bool priorityDonation;		// FALSE to turn donation off, to
+					// demonstrate priority inversion
 
 class Lock {
   public:
@@ -78,10 +86,19 @@ class Lock {
 					// checking in Release, and in
 					// Condition variable ops below.
 
+    unsigned int TopWaiterPriority();	// priority of the highest priority
+					// waiter, NumPriorities if none
+    Lock *nextHeld;			// next lock held by the same thread
+
   private:
     char* name;				// for debugging
     Thread *owner;                      // remember who acquired the lock
-    Semaphore *lock;                    // use semaphore for the actual lock
+    ThreadList waiters;			// threads waiting in Acquire,
+					// sorted by priority
+
+    void Donate();			// pass the current thread's priority
+					// along the chain of lock owners
+    void Requeue(Thread *waiter);	// a waiter's priority has changed
 };
 
 // The following class defines a "condition variable".  A condition
@@ -133,8 +150,82 @@ class Condition {
 
   private:
     char* name;
-    List* queue;  // threads waiting on the condition
+    ThreadList queue;  // threads waiting on the condition
     Lock* lock;   // debugging aid:  used to check correctness of
                   // arguments to Wait, Signal and Broacast
 };
+
+// The following class defines a "reader/writer lock", for data that is
+// read much more often than it is changed.  Any number of threads may
+// hold it for reading at once, but a thread holding it for writing
+// holds it alone:
+//
+//	AcquireRead, ReleaseRead -- share the lock with other readers
+//
+//	AcquireWrite, ReleaseWrite -- hold it exclusively
+//
+//	Upgrade -- turn a read hold into a write hold.  Two readers can't
+//		both be turned into writers while they wait for each other,
+//		so if another reader is upgrading already, we give up our
+//		read hold and wait for the write lock like anybody else;
+//		Upgrade returns FALSE then, to tell the caller that others
+//		may have changed the data in between.  Either way, the
+//		caller holds the lock for writing when it returns.
+//
+//	Downgrade -- turn a write hold into a read hold, letting other
+//		readers in without letting any writer in first.
+//
+// When both readers and writers are waiting, "preference" decides who
+// goes first: with PreferReaders, new readers join the ones holding the
+// lock even if a writer is waiting (so writers may starve); with
+// PreferWriters, a waiting writer keeps new readers out (so readers may
+// starve, if writers keep coming).  A reader waiting in Upgrade keeps
+// new readers out either way.
+//
+// The lock is built out of a Lock and condition variables, so a thread
+// waiting on it does not donate its priority to the threads holding it.
+//
+// To see whether it is worth it, the lock counts how often each kind of
+// hold had to wait, and for how long.
+
+enum RWPreference { PreferReaders, PreferWriters };
+
+class RWLock {
+  public:
+    RWLock(char* debugName, RWPreference pref = PreferWriters);
+    ~RWLock();				// assume no one is using it
+    char* getName() { return name; }
+
+    void AcquireRead();
+    void ReleaseRead();
+    void AcquireWrite();
+    void ReleaseWrite();
+    bool Upgrade();			// read hold to write hold
+    void Downgrade();			// write hold to read hold
+
+    bool isWriteHeldByCurrentThread();	// true if the current thread
+					// holds this lock for writing
+    void PrintStats();			// how much waiting there was
+
+    int readHolds, writeHolds;		// times the lock was taken
+    int readWaits, writeWaits;		// ... and had to be waited for
+    int readWaitTicks, writeWaitTicks;	// total time spent waiting
+    int maxWaitTicks;			// longest single wait
+
+  private:
+    char* name;				// for debugging
+    RWPreference preference;		// who goes first
+    Lock *lock;				// protects the fields below
+    Condition *readOK;			// readers wait here
+    Condition *writeOK;			// writers wait here
+    Condition *upgradeOK;		// an upgrading reader waits here
+    int readers;			// threads holding it for reading
+    Thread *writer;			// thread holding it for writing
+    int waitingReaders, waitingWriters;
+    bool upgrading;			// a reader is waiting in Upgrade
+
+    bool CanRead();			// may a new reader come in now?
+    void Waited(bool forWrite, int start);  // count a wait
+};
+
 #endif // SYNCH_H
@@ -1,18 +1,26 @@
-// synchlist.h 
+// synchlist.h
 //	Data structures for synchronized access to a list.
 //
-//	Implemented by surrounding the List abstraction
+//	Implemented by surrounding the IntrusiveList abstraction
 //	with synchronization routines.
 //
+// 	Implemented in "monitor"-style -- surround each procedure with a
+// 	lock acquire and release pair, using condition signal and wait for
+// 	synchronization.
+//
+//	This is a template over the type of item, and the link field
+//	in it that the list uses (see ilist.h), so it is all here
+//	rather than in a .cc file.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
-// All rights reserved.  See copyright.h for copyright notice and limitation 
+// All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
 
 #ifndef SYNCHLIST_H
 #define SYNCHLIST_H
 
 #include "copyright.h"
-#include "list.h"
+#include "ilist.h"
 #include "synch.h"
 
 // The following class defines a "synchronized list" -- a list for which:
@@ -21,22 +29,107 @@
 //	wait until the list has an element on it.
 //	2. One thread at a time can access list data structures
 
+template <class T, ListLink<T> T::*link>
 class SynchList {
   public:
     SynchList();		// initialize a synchronized list
     ~SynchList();		// de-allocate a synchronized list
 
-    void Append(void *item);	// append item to the end of the list,
+    void Append(T *item);	// append item to the end of the list,
 				// and wake up any thread waiting in remove
-    void *Remove();		// remove the first item from the front of
+    T *Remove();		// remove the first item from the front of
 				// the list, waiting if the list is empty
 				// apply function to every item in the list
     void Mapcar(VoidFunctionPtr func);
 
   private:
-    List *list;			// the unsynchronized list
+    IntrusiveList<T, link> list; // the unsynchronized list
     Lock *lock;			// enforce mutual exclusive access to the list
     Condition *listEmpty;	// wait in Remove if the list is empty
 };
 
+//----------------------------------------------------------------------
+// SynchList::SynchList
+//	Allocate and initialize the data structures needed for a
+//	synchronized list, empty to start with.
+//	Elements can now be added to the list.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+SynchList<T, link>::SynchList()
+{
+    lock = new Lock("list lock");
+    listEmpty = new Condition("list empty cond");
+}
+
+//----------------------------------------------------------------------
+// SynchList::~SynchList
+//	De-allocate the data structures created for synchronizing a list.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+SynchList<T, link>::~SynchList()
+{
+    delete lock;
+    delete listEmpty;
+}
+
+//----------------------------------------------------------------------
+// SynchList::Append
+//      Append an "item" to the end of the list.  Wake up anyone
+//	waiting for an element to be appended.
+//
+//	"item" is the thing to put on the list.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+void
+SynchList<T, link>::Append(T *item)
+{
+    lock->Acquire();		// enforce mutual exclusive access to the list
+    list.Append(item);
+    listEmpty->Signal(lock);	// wake up a waiter, if any
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchList::Remove
+//      Remove an "item" from the beginning of the list.  Wait if
+//	the list is empty.
+// Returns:
+//	The removed item.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+T *
+SynchList<T, link>::Remove()
+{
+    T *item;
+
+    lock->Acquire();			// enforce mutual exclusion
+    while (list.IsEmpty())
+	listEmpty->Wait(lock);		// wait until list isn't empty
+    item = list.Remove();
+    ASSERT(item != NULL);
+    lock->Release();
+    return item;
+}
+
+//----------------------------------------------------------------------
+// SynchList::Mapcar
+//      Apply function to every item on the list.  Obey mutual exclusion
+//	constraints.
+//
+//	"func" is the procedure to be applied.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*link>
+void
+SynchList<T, link>::Mapcar(VoidFunctionPtr func)
+{
+    lock->Acquire();
+    list.Mapcar(func);
+    lock->Release();
+}
+
 #endif // SYNCHLIST_H
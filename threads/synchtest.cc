@@ -143,3 +143,268 @@ SynchTest()
 	ts[i]->Fork(SynchThread, i);
     }
 }
+
+//----------------------------------------------------------------------
+// Priority inversion test
+//      A low priority thread holds lock "a"; a middle priority thread
+//      holds lock "b" and waits for "a"; a high priority thread waits
+//      for "b".  Meanwhile two medium priority threads (higher than
+//      the low and middle ones, lower than the high one) keep the CPU
+//      busy.  Without priority donation, the high priority thread
+//      waits until the medium threads are done; with donation passed
+//      along the chain, the low priority thread gets to finish with
+//      "a" at once, and the high priority thread waits only for that.
+//----------------------------------------------------------------------
+
+#define InvPrioHigh	1
+#define InvPrioMedium	3
+#define InvPrioMiddle	4
+#define InvPrioLow	6
+#define InvMediumLoops	20
+#define InvLowLoops	3
+
+static Lock *invA, *invB;
+static Semaphore *invReady, *invDone;
+static int invMediumRuns;	// loops the medium threads have done
+
+static void
+InvLow(_int dummy)
+{
+    invA->Acquire();
+    invReady->V();			// let the others start
+    for (int i = 0; i < InvLowLoops; i++)	// work while holding "a"
+	currentThread->Yield();
+    invA->Release();
+    invDone->V();
+}
+
+static void
+InvMiddle(_int dummy)
+{
+    invB->Acquire();
+    invReady->V();
+    invA->Acquire();			// blocks behind the low thread
+    invA->Release();
+    invB->Release();
+    invDone->V();
+}
+
+static void
+InvMedium(_int dummy)
+{
+    for (int i = 0; i < InvMediumLoops; i++) {
+	invMediumRuns++;
+	currentThread->Yield();
+    }
+    invDone->V();
+}
+
+static void
+InvHigh(_int dummy)
+{
+    int before = invMediumRuns;
+    int start = stats->totalTicks;
+
+    invB->Acquire();			// blocks behind the middle thread
+    printf("优先级反转测试（%s优先级捐赠）：高优先级线程等待了 %d ticks，"
+	   "期间中优先级线程运行了 %d 次\n",
+	   priorityDonation ? "有" : "无", stats->totalTicks - start,
+	   invMediumRuns - before);
+    invB->Release();
+    invDone->V();
+}
+
+//----------------------------------------------------------------------
+// InversionTest
+//      Run the scenario above once without and once with priority
+//      donation.  Called from the main thread, which has the highest
+//      priority, so the threads are started one by one.
+//----------------------------------------------------------------------
+void
+InversionTest()
+{
+    bool saved = priorityDonation;
+
+    invA = new Lock("inversion a");
+    invB = new Lock("inversion b");
+    invReady = new Semaphore("inversion ready", 0);
+    invDone = new Semaphore("inversion done", 0);
+
+    for (int donate = 0; donate <= 1; donate++) {
+	priorityDonation = donate;
+	invMediumRuns = 0;
+	(new Thread("low", InvPrioLow))->Fork(InvLow, 0);
+	invReady->P();			// low holds "a"
+	(new Thread("middle", InvPrioMiddle))->Fork(InvMiddle, 0);
+	invReady->P();			// middle holds "b"
+	(new Thread("medium 1", InvPrioMedium))->Fork(InvMedium, 1);
+	(new Thread("medium 2", InvPrioMedium))->Fork(InvMedium, 2);
+	(new Thread("high", InvPrioHigh))->Fork(InvHigh, 0);
+	for (int i = 0; i < 5; i++)
+	    invDone->P();
+	ASSERT(invMediumRuns == 2 * InvMediumLoops);
+    }
+    priorityDonation = saved;
+
+    delete invA;
+    delete invB;
+    delete invReady;
+    delete invDone;
+}
+
+//----------------------------------------------------------------------
+// Reader/writer lock benchmark
+//      A table that is read much more often than it is changed, and
+//      that takes a while to look things up in (say, because it has to
+//      wait for the disk), guarded by a Lock, then by an RWLock that
+//      prefers readers, then by one that prefers writers.  Readers check
+//      that the table is never seen half changed.  Writers read first,
+//      and upgrade to change the table, then downgrade to check it.
+//
+//      The waiting is done on an interrupt, as if for the disk, not on
+//      the CPU, so while one reader waits another may be looking things
+//      up too -- if the lock lets it.  (Not a timer interrupt: if that
+//      were all that was pending, the machine would think it was done.)
+//----------------------------------------------------------------------
+
+#define RWTableSize	8
+#define RWOps		20	// operations per thread
+#define RWWriteEvery	10	// one operation in this many is a write
+#define RWLookupTicks	1000	// how long a lookup takes
+#define RWThinkTicks	100	// time between operations
+
+static int rwTable[RWTableSize];
+static int rwMode;		// 0 for Lock, else the RWLock below
+static Lock *rwExclusive;
+static RWLock *rwShared;
+static Semaphore *rwDone;
+static int rwReads, rwWrites, rwTorn;
+static int rwReadWaitTicks, rwWriteWaitTicks;
+
+static void
+RWWake(_int sem)
+{
+    ((Semaphore *) sem)->V();
+}
+
+static void
+RWDelay(int ticks)
+{
+    Semaphore *sem = new Semaphore("rw delay", 0);
+
+    interrupt->Schedule(RWWake, (_int) sem, ticks, DiskInt);
+    sem->P();
+    delete sem;
+}
+
+// look something up in the table: it should all be the same
+static void
+RWLookup()
+{
+    int value = rwTable[0];
+
+    RWDelay(RWLookupTicks);
+    for (int i = 1; i < RWTableSize; i++)
+	if (rwTable[i] != value)
+	    rwTorn++;
+}
+
+static void
+RWUpdate()
+{
+    for (int i = 0; i < RWTableSize; i++) {
+	rwTable[i]++;
+	if (i == RWTableSize / 2)	// let the others see it half done
+	    currentThread->Yield();
+    }
+}
+
+static void
+RWThread(_int which)
+{
+    int start;
+
+    for (int i = 0; i < RWOps; i++) {
+	RWDelay(RWThinkTicks);
+	start = stats->totalTicks;
+	if ((i + which) % RWWriteEvery != 0) {		// a read
+	    if (rwMode == 0)
+		rwExclusive->Acquire();
+	    else
+		rwShared->AcquireRead();
+	    rwReadWaitTicks += stats->totalTicks - start;
+	    RWLookup();
+	    if (rwMode == 0)
+		rwExclusive->Release();
+	    else
+		rwShared->ReleaseRead();
+	    rwReads++;
+	} else if (rwMode == 0) {			// a write
+	    rwExclusive->Acquire();
+	    rwWriteWaitTicks += stats->totalTicks - start;
+	    RWLookup();
+	    RWUpdate();
+	    RWLookup();
+	    rwExclusive->Release();
+	    rwWrites++;
+	} else {
+	    rwShared->AcquireRead();
+	    RWLookup();
+	    rwShared->Upgrade();
+	    rwWriteWaitTicks += stats->totalTicks - start - RWLookupTicks;
+	    RWUpdate();
+	    rwShared->Downgrade();
+	    RWLookup();
+	    rwShared->ReleaseRead();
+	    rwWrites++;
+	}
+    }
+    rwDone->V();
+}
+
+//----------------------------------------------------------------------
+// RWBenchmark
+//      Run the benchmark above with "numThreads" threads, once with
+//      each kind of lock, and report how long each took.
+//----------------------------------------------------------------------
+
+void
+RWBenchmark(int numThreads)
+{
+    static char *modeNames[] = { "Lock", "RWLock，读者优先",
+				 "RWLock，写者优先" };
+    int i, start, ticks;
+
+    rwExclusive = new Lock("rw exclusive");
+    rwDone = new Semaphore("rw done", 0);
+    for (rwMode = 0; rwMode < 3; rwMode++) {
+	rwShared = new RWLock("rw shared",
+			      rwMode == 1 ? PreferReaders : PreferWriters);
+	for (i = 0; i < RWTableSize; i++)
+	    rwTable[i] = 0;
+	rwReads = rwWrites = rwTorn = 0;
+	rwReadWaitTicks = rwWriteWaitTicks = 0;
+	start = stats->totalTicks;
+
+	for (i = 0; i < numThreads; i++)
+	    (new Thread("rw bench"))->Fork(RWThread, i);
+	for (i = 0; i < numThreads; i++)
+	    rwDone->P();
+
+	ticks = stats->totalTicks - start;
+	printf("读写锁测试（%s）：%d 个线程，读 %d 次，写 %d 次，"
+	       "模拟时间 %d ticks，每千 tick 完成 %.2f 次\n",
+	       modeNames[rwMode], numThreads, rwReads, rwWrites, ticks,
+	       (rwReads + rwWrites) * 1000.0 / ticks);
+	printf("读写锁测试（%s）：读平均等待 %d ticks，写平均等待 %d ticks，"
+	       "读到改了一半的表 %d 次\n", modeNames[rwMode],
+	       rwReads ? rwReadWaitTicks / rwReads : 0,
+	       rwWrites ? rwWriteWaitTicks / rwWrites : 0, rwTorn);
+	if (rwMode != 0)
+	    rwShared->PrintStats();
+	ASSERT(rwTable[0] == rwWrites);
+	delete rwShared;
+    }
+    delete rwExclusive;
+    delete rwDone;
+}
@@ -7,6 +7,10 @@
 
 #include "copyright.h"
 #include "system.h"
+#ifdef FILESYS
+#include "filehdr.h"
+#include "directory.h"
+#endif
 
 // This defines *all* of the global data structures used by Nachos.
 // These are all initialized and de-allocated by this file.
@@ -25,6 +29,8 @@ FileSystem *fileSystem;
 
 #ifdef FILESYS
 SynchDisk *synchDisk;
+HeaderTable *headerTable;
+Journal *journal;
 #endif
 
 #ifdef USER_PROGRAM // requires either FILESYS or FILESYS_STUB
@@ -33,6 +39,14 @@ BitMap *freeMap;
 bool procs[NumPhysPages];
 #endif
 
+#ifdef USE_TLB
+TLBManager *tlbManager;
+#endif
+
+#ifdef VM
+CoreMap *coreMap;
+#endif
+
 #ifdef NETWORK
 PostOffice *postOffice;
 #endif
@@ -40,6 +54,21 @@ PostOffice *postOffice;
 // External definition, to allow us to take a pointer to this function
 extern void Cleanup();
 
+#ifdef FILESYS
+//----------------------------------------------------------------------
+// FlushBeforeHalt
+// 	Nachos is about to halt because every thread has finished: write
+//	out whatever the journal, and the disk cache, still hold.  (Cleanup
+//	can't, by then; there's no thread left to wait for the disk.)
+//----------------------------------------------------------------------
+static void
+FlushBeforeHalt(_int dummy)
+{
+    fileSystem->Flush();
+    synchDisk->Flush();
+}
+#endif
+
 //----------------------------------------------------------------------
 // TimerInterruptHandler
 // 	Interrupt handler for the timer device.  The timer device is
@@ -60,7 +89,7 @@ extern void Cleanup();
 static void
 TimerInterruptHandler(_int dummy)
 {
-    if (interrupt->getStatus() != IdleMode)
+    if (interrupt->getStatus() != IdleMode && scheduler->ShouldPreempt())
         interrupt->YieldOnReturn();
 }
 
@@ -79,13 +108,26 @@ void Initialize(int argc, char **argv)
     int argCount;
     char *debugArgs = "";
     bool randomYield = FALSE;
+    SchedPolicy schedPolicy = SchedPriority;
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE; // single step user program
+    bool blockEngine = FALSE;   // run user code a basic block at a time
+#endif
+#ifdef USE_TLB
+    TLBPolicy tlbPolicy = TLBFifo; // TLB replacement policy
+#endif
+#ifdef VM
+    ReplacePolicy pagePolicy = ReplaceClock; // page replacement policy
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE; // format disk
 #endif
+#ifdef FILESYS
+    int cacheSize = DefaultCacheSize;  // sectors cached in memory
+    CachePolicy cachePolicy = CacheLRU; // disk cache replacement policy
+    DiskPolicy diskPolicy = DiskCLOOK;  // disk scheduling policy
+#endif
 #ifdef NETWORK
     double rely = 1;  // network reliability
     double order = 1; // network orderability
@@ -113,14 +155,112 @@ void Initialize(int argc, char **argv)
             randomYield = TRUE;
             argCount = 2;
         }
+        else if (!strcmp(*argv, "-mlfq"))
+            schedPolicy = SchedMLFQ;
+        else if (!strcmp(*argv, "-tp"))
+        {
+            ASSERT(argc > 1);
+            threadPoolSize = atoi(*(argv + 1));
+            argCount = 2;
+        }
 #ifdef USER_PROGRAM
         if (!strcmp(*argv, "-s"))
             debugUserProg = TRUE;
+        else if (!strcmp(*argv, "-bb"))
+            blockEngine = TRUE;
+#endif
+#ifdef USE_TLB
+        if (!strcmp(*argv, "-tlb"))
+        {
+            ASSERT(argc > 1);
+            if (!strcmp(*(argv + 1), "clock"))
+                tlbPolicy = TLBClock;
+            else if (!strcmp(*(argv + 1), "random"))
+                tlbPolicy = TLBRandom;
+            else
+            {
+                ASSERT(!strcmp(*(argv + 1), "fifo"));
+                tlbPolicy = TLBFifo;
+            }
+            argCount = 2;
+        }
+#endif
+#ifdef VM
+        if (!strcmp(*argv, "-vm"))
+        {
+            ASSERT(argc > 1);
+            if (!strcmp(*(argv + 1), "fifo"))
+                pagePolicy = ReplaceFifo;
+            else if (!strcmp(*(argv + 1), "eclock"))
+                pagePolicy = ReplaceEnhancedClock;
+            else if (!strcmp(*(argv + 1), "lru"))
+                pagePolicy = ReplaceLRU;
+            else
+            {
+                ASSERT(!strcmp(*(argv + 1), "clock"));
+                pagePolicy = ReplaceClock;
+            }
+            argCount = 2;
+        }
 #endif
 #ifdef FILESYS_NEEDED
         if (!strcmp(*argv, "-f"))
             format = TRUE;
 #endif
+#ifdef FILESYS
+        if (!strcmp(*argv, "-dc"))
+        {
+            ASSERT(argc > 1);
+            cacheSize = atoi(*(argv + 1)); // 0 turns the cache off
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-dcp"))
+        {
+            ASSERT(argc > 1);
+            if (!strcmp(*(argv + 1), "2q"))
+                cachePolicy = Cache2Q;
+            else
+            {
+                ASSERT(!strcmp(*(argv + 1), "lru"));
+                cachePolicy = CacheLRU;
+            }
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-nc"))
+        {
+            ASSERT(argc > 1);
+            nameCacheSize = atoi(*(argv + 1)); // 0 turns the cache off
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-fa"))
+        {
+            ASSERT(argc > 1);
+            if (!strcmp(*(argv + 1), "first"))
+                allocPolicy = AllocFirstFit;
+            else
+            {
+                ASSERT(!strcmp(*(argv + 1), "runs"));
+                allocPolicy = AllocRuns;
+            }
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-ds"))
+        {
+            ASSERT(argc > 1);
+            if (!strcmp(*(argv + 1), "fcfs"))
+                diskPolicy = DiskFCFS;
+            else if (!strcmp(*(argv + 1), "sstf"))
+                diskPolicy = DiskSSTF;
+            else if (!strcmp(*(argv + 1), "scan"))
+                diskPolicy = DiskSCAN;
+            else
+            {
+                ASSERT(!strcmp(*(argv + 1), "clook"));
+                diskPolicy = DiskCLOOK;
+            }
+            argCount = 2;
+        }
+#endif
 #ifdef NETWORK
         if (!strcmp(*argv, "-n"))
         {
@@ -146,8 +286,8 @@ void Initialize(int argc, char **argv)
     DebugInit(debugArgs);        // initialize DEBUG messages
     stats = new Statistics();    // collect statistics
     interrupt = new Interrupt;   // start up interrupt handling
-    scheduler = new Scheduler(); // initialize the ready queue
-    if (randomYield)             // start the timer (if needed)
+    scheduler = new Scheduler(schedPolicy); // initialize the ready queue
+    if (randomYield || schedPolicy == SchedMLFQ) // start the timer (if needed)
         timer = new Timer(TimerInterruptHandler, 0, randomYield);
 
     threadToBeDestroyed = NULL;
@@ -162,19 +302,33 @@ void Initialize(int argc, char **argv)
     CallOnUserAbort(Cleanup); // if user hits ctl-C
 
 #ifdef USER_PROGRAM
-    machine = new Machine(debugUserProg); // this must come first
+    machine = new Machine(debugUserProg, blockEngine); // this must come first
     freeMap = new BitMap(NumPhysPages);
     bzero(procs, NumPhysPages);
 #endif
 
+#ifdef USE_TLB
+    tlbManager = new TLBManager(tlbPolicy);
+#endif
+
+#ifdef VM
+    coreMap = new CoreMap(pagePolicy);
+#endif
+
 #ifdef FILESYS
-    synchDisk = new SynchDisk("DISK");
+    synchDisk = new SynchDisk("DISK", cacheSize, cachePolicy, diskPolicy);
+    headerTable = new HeaderTable;
+    journal = new Journal;
 #endif
 
 #ifdef FILESYS_NEEDED
     fileSystem = new FileSystem(format);
 #endif
 
+#ifdef FILESYS
+    interrupt->CallBeforeIdleHalt(FlushBeforeHalt, 0);
+#endif
+
 #ifdef NETWORK
     postOffice = new PostOffice(netname, rely, order, 10);
 #endif
@@ -191,15 +345,34 @@ void Cleanup()
     delete postOffice;
 #endif
 
+#ifdef VM
+    delete coreMap;
+#endif
+
+#ifdef USE_TLB
+    delete tlbManager;
+#endif
+
 #ifdef USER_PROGRAM
     delete machine;
 #endif
 
+#ifdef FILESYS
+    // (if we're idle, FlushBeforeHalt has done this, and the disk
+    // below, already -- and there is no thread left to do it in now)
+    if (interrupt->getStatus() != IdleMode)
+        fileSystem->Flush();
+#endif
+
 #ifdef FILESYS_NEEDED
     delete fileSystem;
 #endif
 
 #ifdef FILESYS
+    if (interrupt->getStatus() != IdleMode)
+        synchDisk->Flush();
+    delete journal;
+    delete headerTable;
     delete synchDisk;
 #endif
 
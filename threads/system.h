@@ -37,6 +37,16 @@ extern BitMap *freeMap;
 extern bool procs[NumPhysPages];
 #endif
 
+#ifdef USE_TLB
+#include "tlbmanager.h"
+extern TLBManager *tlbManager; // refills the TLB on a miss
+#endif
+
+#ifdef VM
+#include "coremap.h"
+extern CoreMap *coreMap; // physical frames, for demand paging
+#endif
+
 #ifdef FILESYS_NEEDED // FILESYS or FILESYS_STUB
 #include "filesys.h"
 extern FileSystem *fileSystem;
@@ -44,7 +54,11 @@ extern FileSystem *fileSystem;
 
 #ifdef FILESYS
 #include "synchdisk.h"
+#include "filehdr.h"
+#include "journal.h"
 extern SynchDisk *synchDisk;
+extern HeaderTable *headerTable; // file headers of the open files
+extern Journal *journal;         // changes to the file system's own data
 #endif
 
 #ifdef NETWORK
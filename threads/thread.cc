@@ -24,21 +24,113 @@
                                    // execution stack, for detecting \
                                    // stack overflows
 
+int threadPoolSize = DefaultThreadPool;
+
+// The pools are linked through the first word of each free control block
+// or stack (which is overwritten when it is handed out again).
+static void *freeThreads = NULL; // control blocks ready for reuse
+static int numFreeThreads = 0;
+static int *freeStacks = NULL;   // stacks, guard pages still in place
+static int numFreeStacks = 0;
+
+//----------------------------------------------------------------------
+// Thread::operator new, Thread::operator delete
+// 	Allocate and free thread control blocks, reusing the ones of
+//	threads that have finished.
+//----------------------------------------------------------------------
+
+void *
+Thread::operator new(size_t size)
+{
+    void *p;
+
+    ASSERT(size == sizeof(Thread));
+    if (stats != NULL)
+        stats->numThreads++;
+    if (freeThreads == NULL)
+        return ::operator new(size);
+    p = freeThreads;
+    freeThreads = *(void **)p;
+    numFreeThreads--;
+    return p;
+}
+
+void Thread::operator delete(void *p)
+{
+    if (numFreeThreads >= threadPoolSize)
+    {
+        ::operator delete(p);
+        return;
+    }
+    *(void **)p = freeThreads;
+    freeThreads = p;
+    numFreeThreads++;
+}
+
+//----------------------------------------------------------------------
+// AllocStack, FreeStack
+// 	Get an execution stack, with guard pages on both sides, from the
+//	pool if possible; give one back to the pool when its thread is
+//	destroyed, or to the host if the pool is full.
+//----------------------------------------------------------------------
+
+static int *
+AllocStack()
+{
+    int *stack = freeStacks;
+
+    if (stack == NULL)
+    {
+        stats->numStacksAllocated++;
+        return (int *)AllocBoundedArray(StackSize * sizeof(_int));
+    }
+    stats->numStacksReused++;
+    freeStacks = *(int **)stack;
+    numFreeStacks--;
+    return stack;
+}
+
+static void
+FreeStack(int *stack)
+{
+    if (numFreeStacks >= threadPoolSize)
+    {
+        DeallocBoundedArray((char *)stack, StackSize * sizeof(_int));
+        return;
+    }
+    *(int **)stack = freeStacks;
+    freeStacks = stack;
+    if (++numFreeStacks > stats->threadPoolHighWater)
+        stats->threadPoolHighWater = numFreeStacks;
+}
+
 //----------------------------------------------------------------------
 // Thread::Thread
 // 	Initialize a thread control block, so that we can then call
 //	Thread::Fork.
 //
 //	"threadName" is an arbitrary string, useful for debugging.
+//	"p" is the thread's priority, 0 (highest) to NumPriorities - 1
 //----------------------------------------------------------------------
 
 Thread::Thread(char *threadName, int p)
 {
+    ASSERT(p >= 0 && p < NumPriorities);
     name = threadName;
     stackTop = NULL;
     stack = NULL;
     status = JUST_CREATED;
     priority = p;
+    basePriority = p;
+    heldLocks = NULL;
+    waitingFor = NULL;
+    cpuTicks = 0;
+    sliceTicks = 0;
+    readySince = 0;
+#ifdef FILESYS
+    journalDepth = 0;
+    journalRoom = 0;
+#endif
 #ifdef USER_PROGRAM
     space = NULL;
 #endif
@@ -62,7 +154,7 @@ Thread::~Thread()
 
     ASSERT(this != currentThread);
     if (stack != NULL)
-        DeallocBoundedArray((char *)stack, StackSize * sizeof(_int));
+        FreeStack(stack);
 }
 
 //----------------------------------------------------------------------
@@ -149,7 +241,9 @@ void Thread::Finish()
     (void)interrupt->SetLevel(IntOff);
     ASSERT(this == currentThread);
 
-    DEBUG('t', "Finishing thread \"%s\"\n", getName());
+    scheduler->Charge(this);
+    DEBUG('t', "Finishing thread \"%s\", after %d ticks of CPU time\n",
+          getName(), cpuTicks);
 
     threadToBeDestroyed = currentThread;
     Sleep(); // invokes SWITCH
@@ -257,7 +351,7 @@ void ThreadPrint(_int arg)
 
 void Thread::StackAllocate(VoidFunctionPtr func, _int arg)
 {
-    stack = (int *)AllocBoundedArray(StackSize * sizeof(_int));
+    stack = AllocStack();
 
 #ifdef HOST_SNAKE
     // HP stack works from low addresses to high addresses
@@ -395,4 +489,40 @@ void Thread::RestoreUserState()
 unsigned int Thread::GetPriority()
 {
     return priority;
-}
\ No newline at end of file
+}
+//----------------------------------------------------------------------
+// Thread::SetPriority
+// 	Change the thread's own priority.  Donations it is receiving
+//	still apply.  The caller is responsible for moving the thread if
+//	it is on a ready list.
+//
+//	"p" is the new priority
+//----------------------------------------------------------------------
+
+void Thread::SetPriority(unsigned int p)
+{
+    basePriority = p;
+    RecomputePriority();
+}
+
+//----------------------------------------------------------------------
+// Thread::RecomputePriority
+// 	The effective priority is the higher of the thread's own priority
+//	and that of the highest priority thread waiting on any lock it
+//	holds.  (The waiters' priorities are effective priorities too, so
+//	donations pass along chains of locks.)
+//----------------------------------------------------------------------
+
+void Thread::RecomputePriority()
+{
+    unsigned int p = basePriority;
+    unsigned int donated;
+
+    for (Lock *lock = heldLocks; lock != NULL; lock = lock->nextHeld)
+    {
+        donated = lock->TopWaiterPriority();
+        if (donated < p)
+            p = donated;
+    }
+    priority = p;
+}
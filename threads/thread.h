@@ -39,6 +39,7 @@
 
 #include "copyright.h"
 #include "utility.h"
+#include "ilist.h"
 
 #ifdef USER_PROGRAM
 #include "machine.h"
@@ -54,6 +55,16 @@
 // WATCH OUT IF THIS ISN'T BIG ENOUGH!!!!!
 #define StackSize (sizeof(_int) * 1024) // in words
 
+// Finished threads' control blocks and stacks are kept for reuse, up to
+// threadPoolSize of each (set with -tp), rather than given back to the
+// host; allocating a stack costs two mprotect calls, freeing it two more.
+#define DefaultThreadPool 64
+extern int threadPoolSize;
+
+// Thread priorities run from 0 (the highest, and the default) to
+// NumPriorities - 1.  The scheduler keeps one ready queue per priority.
+#define NumPriorities 32
+
 // Thread state
 enum ThreadStatus
 {
@@ -63,6 +74,8 @@ enum ThreadStatus
   BLOCKED
 };
 
+class Lock;
+
 // external function, dummy routine whose sole job is to call Thread::Print
 extern void ThreadPrint(_int arg);
 
@@ -93,6 +106,9 @@ public:
                                              // must not be running when delete
                                              // is called
 
+  void *operator new(size_t size); // take a control block from the pool
+  void operator delete(void *p);   // put it back
+
   // basic thread operations
 
   void Fork(VoidFunctionPtr func, _int arg); // Make thread run (*func)(arg)
@@ -108,8 +124,36 @@ public:
   char *getName() { return (name); }
   void Print() { printf("%s, ", name); }
 
-  // 获取该线程的优先级
+  ThreadStatus getStatus() { return status; }
+
+  // 获取该线程的有效优先级：在它持有的锁上等待的线程优先级更高时，
+  // 继承（捐赠）其优先级
   unsigned int GetPriority();
+  // 线程自身的（基础）优先级
+  unsigned int GetBasePriority() { return basePriority; }
+  // 修改基础优先级，只能在线程不在就绪队列中时调用（MLFQ 调度使用）
+  void SetPriority(unsigned int p);
+  // 根据持有的锁上的等待者重新计算有效优先级
+  void RecomputePriority();
+
+  // Priority donation, maintained by Lock (see synch.cc)
+  Lock *heldLocks;  // locks this thread holds, linked by Lock::nextHeld
+  Lock *waitingFor; // the lock this thread is blocked in Acquire on
+
+  // CPU time accounting, kept up to date by the Scheduler
+  int cpuTicks;   // simulated ticks this thread has run for
+  int sliceTicks; // ticks used of its current MLFQ time slice
+  int readySince; // when it was last put on the ready list
+
+  // A thread waits in at most one place at a time -- on a ready list,
+  // or on a semaphore, lock or condition -- so one link will do
+  ListLink<Thread> queueLink;
+
+#ifdef FILESYS
+  int journalDepth; // file system operations it is in the middle of,
+                    // maintained by Journal (see journal.cc)
+  int journalRoom;  // sectors the outermost one may still change
+#endif
 
 private:
   // some of the private data for this class is listed above
@@ -120,7 +164,8 @@ private:
   ThreadStatus status; // ready, running or blocked
   char *name;
 
-  unsigned int priority;
+  unsigned int priority;     // effective priority
+  unsigned int basePriority; // priority before donation
 
   void StackAllocate(VoidFunctionPtr func, _int arg);
   // Allocate a stack for thread.
@@ -141,6 +186,9 @@ public:
 #endif
 };
 
+// A queue of threads, linked through Thread::queueLink
+typedef IntrusiveList<Thread, &Thread::queueLink> ThreadList;
+
 // Magical machine-dependent routines, defined in switch.s
 
 extern "C"
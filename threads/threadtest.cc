@@ -11,6 +11,7 @@
 
 #include "copyright.h"
 #include "system.h"
+#include "synch.h"
 
 //----------------------------------------------------------------------
 // SimpleThread
@@ -49,3 +50,80 @@ void ThreadTest()
     t2->Fork(SimpleThread, 2);
     t3->Fork(SimpleThread, 3);
 }
+
+//----------------------------------------------------------------------
+// SchedulerBenchmark
+// 	Scheduler micro-benchmark: fork "numThreads" threads with random
+//	priorities, each of which yields a few times before finishing,
+//	and report how much simulated and host time that took.  Almost
+//	all of the work is putting threads on and taking them off the
+//	ready list.
+//----------------------------------------------------------------------
+
+#define BenchYields 5
+
+static Semaphore *benchDone;
+
+static void
+BenchThread(_int which)
+{
+    for (int i = 0; i < BenchYields; i++)
+        currentThread->Yield();
+    benchDone->V();
+}
+
+void SchedulerBenchmark(int numThreads)
+{
+    int startTicks = stats->totalTicks;
+    int startHost = HostMilliseconds();
+
+    benchDone = new Semaphore("bench done", 0);
+    for (int i = 0; i < numThreads; i++)
+    {
+        Thread *t = new Thread("bench", Random() % NumPriorities);
+        t->Fork(BenchThread, i);
+    }
+    for (int i = 0; i < numThreads; i++)
+        benchDone->P();
+    delete benchDone;
+
+    printf("调度器测试：%d 个线程，各让出 CPU %d 次，模拟时间 %d ticks，实际用时 %d ms\n",
+           numThreads, BenchYields, stats->totalTicks - startTicks,
+           HostMilliseconds() - startHost);
+}
+
+//----------------------------------------------------------------------
+// ForkBenchmark
+// 	Fork/finish benchmark: fork "numForks" threads that do nothing,
+//	one at a time, letting each one finish before forking the next,
+//	and report the host time per fork.  Run once with the thread pool
+//	turned off, then with it on.
+//----------------------------------------------------------------------
+
+static void
+NullThread(_int dummy)
+{
+}
+
+void ForkBenchmark(int numForks)
+{
+    int saved = threadPoolSize;
+    int start, elapsed;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        threadPoolSize = (pass == 0) ? 0 : saved;
+        start = HostMilliseconds();
+        for (int i = 0; i < numForks; i++)
+        {
+            Thread *t = new Thread("fork bench", currentThread->GetPriority());
+            t->Fork(NullThread, i);
+            currentThread->Yield(); // it runs and finishes
+        }
+        elapsed = HostMilliseconds() - start;
+        printf("创建/结束线程测试（线程池大小 %d）：%d 次，实际用时 %d ms，"
+               "平均 %.2f us\n", threadPoolSize, numForks, elapsed,
+               elapsed * 1000.0 / numForks);
+    }
+    threadPoolSize = saved;
+}
@@ -18,7 +18,6 @@
 #include "copyright.h"
 #include "system.h"
 #include "addrspace.h"
-#include "noff.h"
 
 //----------------------------------------------------------------------
 // SwapHeader
@@ -90,6 +89,30 @@ AddrSpace::AddrSpace(OpenFile *executable)
     numPages = divRoundUp(size, PageSize);
     size = numPages * PageSize;
 
+#ifdef VM
+    // 按需调页：不预先分配物理帧，每个页面在第一次访问时才装入
+    // （代码和数据从可执行文件读入，其余清零），换出时写入本进程的交换文件
+    header = noffH;
+    frames = 0;
+    pageTable = new TranslationEntry[numPages];
+    inSwap = new bool[numPages];
+    for (i = 0; i < numPages; i++)
+    {
+        pageTable[i].virtualPage = i;
+        pageTable[i].physicalPage = -1;
+        pageTable[i].valid = FALSE;
+        pageTable[i].use = FALSE;
+        pageTable[i].dirty = FALSE;
+        pageTable[i].readOnly = FALSE;
+        inSwap[i] = FALSE;
+    }
+    sprintf(swapName, "SWAP.%d", spaceID);
+    bool created = fileSystem->Create(swapName, size);
+    ASSERT(created);
+    swapFile = fileSystem->Open(swapName);
+    ASSERT(swapFile != NULL);
+    DEBUG('v', "地址空间 %d 共 %d 页，交换文件 %s\n", spaceID, numPages, swapName);
+#else
     // 初始大小需要：代码大小 + 需要初始化的数据大小
     frames = divRoundUp(noffH.code.size + noffH.initData.size, PageSize);
 
@@ -110,6 +133,8 @@ AddrSpace::AddrSpace(OpenFile *executable)
     {
         pageTable[i].virtualPage = i;
         pageTable[i].physicalPage = freeMap->Find();
+        // 帧中可能残留上一个程序的指令译码缓存
+        machine->InvalidateDecoded(pageTable[i].physicalPage);
         pageTable[i].valid = TRUE;
         pageTable[i].use = FALSE;
         pageTable[i].dirty = FALSE;
@@ -154,6 +179,7 @@ AddrSpace::AddrSpace(OpenFile *executable)
         executable->ReadAt(&(machine->mainMemory[dataPhyAddr]),
                            noffH.initData.size, noffH.initData.inFileAddr);
     }
+#endif // VM
     Print();
 }
 
@@ -164,6 +190,34 @@ AddrSpace::AddrSpace(OpenFile *executable)
 
 AddrSpace::~AddrSpace()
 {
+#ifdef USE_TLB
+    // TLB 中可能还有本地址空间的页表项
+    tlbManager->Forget(this);
+#endif
+#ifdef VM
+    // 释放所有物理帧并删除交换文件；加锁以免其他线程正在换出本空间的页面
+    coreMap->Acquire();
+    for (unsigned int i = 0; i < numPages; i++)
+    {
+        if (pageTable[i].valid)
+        {
+            coreMap->Free(pageTable[i].physicalPage);
+        }
+    }
+    coreMap->Release();
+    delete swapFile;
+    fileSystem->Remove(swapName);
+    delete[] inSwap;
+#else
+    for (unsigned int i = 0; i < numPages; i++)
+    {
+        if (pageTable[i].valid)
+        {
+            freeMap->Clear(pageTable[i].physicalPage);
+        }
+    }
+#endif
+    procs[spaceID] = 0;
     delete[] pageTable;
     delete executable;
 }
@@ -217,12 +271,19 @@ void AddrSpace::SaveState()
 //	this address space can run.
 //
 //      For now, tell the machine where to find the page table.
+//	With a TLB there is no page table register: the TLB is flushed
+//	instead (unless it already holds our translations), and refilled
+//	from our page table on each miss.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState()
 {
+#ifdef USE_TLB
+    tlbManager->SwitchTo(this);
+#else
     machine->pageTable = pageTable;
     machine->pageTableSize = numPages;
+#endif
 }
 
 unsigned int AddrSpace::GetSpaceID()
@@ -258,9 +319,16 @@ unsigned int AddrSpace::FindPageToReplace()
 
 void AddrSpace::ReplacePage(int badVAddr)
 {
+#ifdef VM
+    PageIn((unsigned)badVAddr / PageSize);
+#else
     int newPage = badVAddr / PageSize;
     int oldPage = FindPageToReplace();
     printf("新页面：%d, 旧页面： %d\n", newPage, oldPage);
+#ifdef USE_TLB
+    // 旧页面的修改位可能只记录在 TLB 中，先写回页表再使其失效
+    tlbManager->InvalidatePage(this, oldPage);
+#endif
     WriteBack(oldPage);
     pageTable[oldPage].valid = FALSE;
     pageTable[newPage].physicalPage = pageTable[oldPage].physicalPage;
@@ -268,9 +336,12 @@ void AddrSpace::ReplacePage(int badVAddr)
     pageTable[newPage].dirty = FALSE;
     pageTable[newPage].readOnly = FALSE;
 
-    executable->ReadAt(&(machine->mainMemory[pageTable[newPage].physicalPage]), PageSize, newPage * PageSize);
+    // 帧内容被替换，丢弃该帧的指令译码缓存
+    machine->InvalidateDecoded(pageTable[newPage].physicalPage);
+    executable->ReadAt(&(machine->mainMemory[pageTable[newPage].physicalPage * PageSize]), PageSize, newPage * PageSize);
 
     Print();
+#endif // VM
 }
 
 void AddrSpace::WriteBack(int page)
@@ -280,6 +351,100 @@ void AddrSpace::WriteBack(int page)
     {
         DEBUG('v', "页面 %d 被修改，写回磁盘\n", page);
 
-        executable->WriteAt(&(machine->mainMemory[pageTable[page].physicalPage]), PageSize, page * PageSize);
+        executable->WriteAt(&(machine->mainMemory[pageTable[page].physicalPage * PageSize]), PageSize, page * PageSize);
+    }
+}
+
+TranslationEntry *AddrSpace::PageTableEntry(unsigned int vpn)
+{
+    if (vpn >= numPages)
+    {
+        return NULL;
+    }
+    return &pageTable[vpn];
+}
+
+#ifdef VM
+//----------------------------------------------------------------------
+// LoadSegment
+// 	Copy the part of segment "seg" that falls inside the page starting
+//	at virtual address "pageStart" from the executable into "dest".
+//----------------------------------------------------------------------
+
+static void
+LoadSegment(OpenFile *executable, Segment *seg, int pageStart, char *dest)
+{
+    int from = max(pageStart, seg->virtualAddr);
+    int to = min(pageStart + PageSize, seg->virtualAddr + seg->size);
+
+    if (from < to)
+        executable->ReadAt(dest + (from - pageStart), to - from,
+                           seg->inFileAddr + (from - seg->virtualAddr));
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+// 	Demand paging: bring page "vpn" into memory, evicting some other
+//	page if memory is full.  A page that has been written to swap
+//	comes back from there; otherwise it is built from the code and
+//	initialized data in the executable, and zero everywhere else.
+//----------------------------------------------------------------------
+
+void AddrSpace::PageIn(unsigned int vpn)
+{
+    ASSERT(vpn < numPages);
+    coreMap->Acquire();
+    if (!pageTable[vpn].valid) // 等锁期间可能已被装入
+    {
+        int frame = coreMap->Allocate(this, vpn);
+        char *dest = &(machine->mainMemory[frame * PageSize]);
+
+        DEBUG('v', "地址空间 %d 缺页：%d -> 帧 %d\n", spaceID, vpn, frame);
+        stats->numPageFaults++;
+        machine->InvalidateDecoded(frame);
+        if (inSwap[vpn])
+        {
+            swapFile->ReadAt(dest, PageSize, vpn * PageSize);
+            stats->numSwapReads++;
+        }
+        else
+        {
+            bzero(dest, PageSize);
+            LoadSegment(executable, &header.code, vpn * PageSize, dest);
+            LoadSegment(executable, &header.initData, vpn * PageSize, dest);
+        }
+        pageTable[vpn].physicalPage = frame;
+        pageTable[vpn].use = TRUE; // 马上就要访问，别让时钟算法立刻换出
+        pageTable[vpn].dirty = FALSE;
+        pageTable[vpn].valid = TRUE;
     }
-}
\ No newline at end of file
+    coreMap->Release();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageOut
+// 	Called by the core map, with the paging lock held, to evict page
+//	"vpn".  Only a dirty page needs writing: a clean one is still the
+//	same as its copy in swap or in the executable.
+//----------------------------------------------------------------------
+
+void AddrSpace::PageOut(unsigned int vpn)
+{
+    TranslationEntry *entry = &pageTable[vpn];
+
+    ASSERT(entry->valid);
+#ifdef USE_TLB
+    tlbManager->InvalidatePage(this, vpn); // 修改位可能还在 TLB 中
+#endif
+    entry->valid = FALSE;
+    if (entry->dirty)
+    {
+        swapFile->WriteAt(&(machine->mainMemory[entry->physicalPage * PageSize]),
+                          PageSize, vpn * PageSize);
+        inSwap[vpn] = TRUE;
+        stats->numSwapWrites++;
+    }
+    entry->physicalPage = -1;
+    entry->dirty = FALSE;
+}
+#endif // VM
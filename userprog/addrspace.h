@@ -15,6 +15,7 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "noff.h"
 
 #define UserStackSize 1024 // increase this as necessary!
 #define MaxNumPhysPages 5
@@ -41,6 +42,16 @@ public:
   void ReplacePage(int badVAddr);
   
   void WriteBack(int page);
+
+  // 获取逻辑页号对应的页表项，越界时返回 NULL
+  TranslationEntry *PageTableEntry(unsigned int vpn);
+
+#ifdef VM
+  // 按需调页：装入页面
+  void PageIn(unsigned int vpn);
+  // 按需调页：换出页面（由 CoreMap 调用）
+  void PageOut(unsigned int vpn);
+#endif
 private:
   // 页表数组地址
   TranslationEntry *pageTable;
@@ -52,6 +63,15 @@ private:
   unsigned int frames;
   // 可执行程序
   OpenFile *executable;
+#ifdef VM
+  // 可执行文件头部，用于按需装入代码段和数据段
+  NoffHeader header;
+  // 每个页面是否已写入交换文件
+  bool *inSwap;
+  // 交换文件
+  OpenFile *swapFile;
+  char swapName[20];
+#endif
 };
 
 #endif // ADDRSPACE_H
@@ -9,6 +9,23 @@
 #include "copyright.h"
 #include "bitmap.h"
 
+#include <strings.h>
+
+//----------------------------------------------------------------------
+// CountBits
+// 	Return how many bits of "word" are set, adding them up in
+//	parallel rather than one at a time.
+//----------------------------------------------------------------------
+
+static int
+CountBits(unsigned int word)
+{
+    word = word - ((word >> 1) & 0x55555555);
+    word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+    word = (word + (word >> 4)) & 0x0f0f0f0f;
+    return (word * 0x01010101) >> 24;
+}
+
 //----------------------------------------------------------------------
 // BitMap::BitMap
 // 	Initialize a bitmap with "nitems" bits, so that every bit is clear.
@@ -94,12 +111,12 @@ BitMap::Test(int which)
 int 
 BitMap::Find() 
 {
-    for (int i = 0; i < numBits; i++)
-	if (!Test(i)) {
-	    Mark(i);
-	    return i;
-	}
-    return -1;
+    int i = NextClear(0, numBits);
+
+    if (i == numBits)
+	return -1;
+    Mark(i);
+    return i;
 }
 
 //----------------------------------------------------------------------
@@ -111,13 +128,122 @@ BitMap::Find()
 int 
 BitMap::NumClear() 
 {
-    int count = 0;
+    int count = numBits;
 
-    for (int i = 0; i < numBits; i++)
-	if (!Test(i)) count++;
+    for (int w = 0; w < numWords; w++)
+	count -= CountBits(map[w]);
     return count;
 }
 
+//----------------------------------------------------------------------
+// BitMap::NextClear, BitMap::NextSet
+// 	Return the number of the first clear (set) bit in [from, to), or
+//	"to" if there is none.  Words with nothing of interest in them
+//	are passed over whole.
+//----------------------------------------------------------------------
+
+int
+BitMap::NextClear(int from, int to)
+{
+    int w = from / BitsInWord;
+    unsigned int bits;
+
+    if (from >= to)
+	return to;
+    // the clear bits, ignoring those before "from"
+    bits = ~map[w] & (~0u << (from % BitsInWord));
+    while (bits == 0) {
+	if (++w * BitsInWord >= to)
+	    return to;
+	bits = ~map[w];
+    }
+    return min(w * BitsInWord + ffs(bits) - 1, to);
+}
+
+int
+BitMap::NextSet(int from, int to)
+{
+    int w = from / BitsInWord;
+    unsigned int bits;
+
+    if (from >= to)
+	return to;
+    bits = map[w] & (~0u << (from % BitsInWord));
+    while (bits == 0) {
+	if (++w * BitsInWord >= to)
+	    return to;
+	bits = map[w];
+    }
+    return min(w * BitsInWord + ffs(bits) - 1, to);
+}
+
+//----------------------------------------------------------------------
+// BitMap::FindRun
+// 	Look for "count" consecutive clear bits between "from" and "to".
+//	Return where the first such run starts, or if there is none,
+//	where the longest run there starts.  Set "*length" to how many
+//	bits of it are clear (at most "count").  Return -1 if there are
+//	no clear bits at all in the range.
+//
+//	The bits are not marked; MarkRun does that.
+//----------------------------------------------------------------------
+
+int
+BitMap::FindRun(int from, int to, int count, int *length)
+{
+    int start, end, best = -1, bestLength = 0;
+
+    ASSERT(from >= 0 && to <= numBits && count > 0);
+    for (start = NextClear(from, to); start < to;
+				start = NextClear(end, to)) {
+	end = NextSet(start, to);
+	if (end - start >= count) {
+	    *length = count;
+	    return start;
+	}
+	if (end - start > bestLength) {
+	    best = start;
+	    bestLength = end - start;
+	}
+    }
+    *length = bestLength;
+    return best;
+}
+
+//----------------------------------------------------------------------
+// BitMap::MarkRun
+// 	Set "length" bits, starting at "start".
+//----------------------------------------------------------------------
+
+void
+BitMap::MarkRun(int start, int length)
+{
+    for (int i = start; i < start + length; i++) {
+	ASSERT(!Test(i));
+	Mark(i);
+    }
+}
+
+//----------------------------------------------------------------------
+// BitMap::FreeRuns
+// 	Return how many separate runs of clear bits there are, and how
+//	long the longest is.
+//----------------------------------------------------------------------
+
+void
+BitMap::FreeRuns(int *numRuns, int *longest)
+{
+    int start, end;
+
+    *numRuns = *longest = 0;
+    for (start = NextClear(0, numBits); start < numBits;
+				start = NextClear(end, numBits)) {
+	end = NextSet(start, numBits);
+	(*numRuns)++;
+	*longest = max(*longest, end - start);
+    }
+}
+
 //----------------------------------------------------------------------
 // BitMap::Print
 // 	Print the contents of the bitmap, for debugging.
@@ -8,6 +8,11 @@
 //	The bitmap can be parameterized with with the number of bits being 
 //	managed.
 //
+//	Searches go a word at a time: a word with every bit set is skipped
+//	with one comparison, and in the others ffs finds the first bit of
+//	interest.  Runs of clear bits can be found and marked in one go,
+//	which the file system uses to keep files contiguous on disk.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -45,6 +50,15 @@ class BitMap {
 				// If no bits are clear, return -1.
     int NumClear();		// Return the number of clear bits
 
+    int FindRun(int from, int to, int count, int *length);
+				// Return the first run of "count" clear
+				// bits in [from, to), or if there is none,
+				// the longest; -1 if all of them are set.
+				// Doesn't mark it.
+    void MarkRun(int start, int length);  // Set "length" bits from "start"
+    void FreeRuns(int *numRuns, int *longest);
+				// How fragmented are the clear bits?
+
     void Print();		// Print contents of bitmap
     
     // These aren't needed until FILESYS, when we will need to read and 
@@ -59,6 +73,9 @@ class BitMap {
 					//  multiple of the number of bits in
 					//  a word)
     unsigned int *map;			// bit storage
+
+    int NextClear(int from, int to);	// First clear bit in [from, to),
+    int NextSet(int from, int to);	// or first set one; "to" if none
 };
 
 #endif // BITMAP_H
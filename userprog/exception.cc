@@ -93,13 +93,27 @@ void SysCallExit()
 {
     int addr = machine->ReadRegister(4);
     printf("【用户程序】退出：%d\n", addr);
+    // 释放地址空间（物理帧、交换文件），线程本身由调度器回收
+    AddrSpace *space = currentThread->space;
+    currentThread->space = NULL;
+    delete space;
     currentThread->Finish();
 }
 
 // 处理缺页错误
 void HandlePageFault()
 {
+#ifdef USE_TLB
+    // 使用 TLB 时，缺页异常表示 TLB 未命中：从页表中重新装入
+    int badVAddr = machine->ReadRegister(BadVAddrReg);
+    if (!tlbManager->HandleMiss(badVAddr))
+    {
+        printf("访问越界，地址：0x%x\n", badVAddr);
+        ASSERT(FALSE);
+    }
+#else
     currentThread->space->ReplacePage(machine->ReadRegister(BadVAddrReg));
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -145,6 +159,9 @@ void ExceptionHandler(ExceptionType which)
         {
         case SC_Halt:
             DEBUG('s', "执行系统调用：ShutDown.\n");
+#ifdef FILESYS
+            synchDisk->Flush(); // 关机前把磁盘缓存中修改过的扇区写回
+#endif
             interrupt->Halt();
             break;
         case SC_Exec:
@@ -0,0 +1,207 @@
+// coremap.cc
+//	Routines to manage physical page frames for demand paging.
+//
+//	Frames are handed out from the global "freeMap" while there are
+//	free ones; after that, Allocate picks a victim according to the
+//	replacement policy and has its owner page it out.
+//
+//	The policies look at the use and dirty bits in the owners' page
+//	tables.  With a TLB, the hardware only sets those bits in the TLB
+//	entry, so they are folded into the page tables first.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "system.h"
+#include "coremap.h"
+#include "addrspace.h"
+
+//----------------------------------------------------------------------
+// CoreMap::CoreMap
+// 	Initialize the core map; every frame starts out free.
+//
+//	"how" is the page replacement policy
+//----------------------------------------------------------------------
+
+CoreMap::CoreMap(ReplacePolicy how)
+{
+    policy = how;
+    hand = 0;
+    loads = 0;
+    lock = new Lock("paging");
+    for (int i = 0; i < NumPhysPages; i++) {
+	frames[i].space = NULL;
+	frames[i].virtualPage = -1;
+	frames[i].loadedAt = 0;
+	frames[i].age = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// CoreMap::~CoreMap
+//----------------------------------------------------------------------
+
+CoreMap::~CoreMap()
+{
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Acquire, CoreMap::Release
+// 	Paging in or out may block on I/O; only one thread at a time
+//	may be changing the core map or any page table's mappings.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Acquire()
+{
+    lock->Acquire();
+}
+
+void
+CoreMap::Release()
+{
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// CoreMap::EntryFor
+// 	Return the page table entry that maps an in-use frame.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+CoreMap::EntryFor(int frame)
+{
+    FrameInfo *info = &frames[frame];
+    TranslationEntry *entry;
+
+    ASSERT(info->space != NULL);
+    entry = info->space->PageTableEntry(info->virtualPage);
+    ASSERT(entry != NULL && entry->valid && entry->physicalPage == frame);
+    return entry;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Allocate
+// 	Find a frame to hold page "vpn" of "space".  If there are no free
+//	frames, evict one; the victim's owner writes it to its swap file
+//	if it is dirty.  The caller fills in the frame and its own page
+//	table entry.
+//
+//	"space", "vpn" -- the page that is being paged in
+//----------------------------------------------------------------------
+
+int
+CoreMap::Allocate(AddrSpace *space, int vpn)
+{
+    int frame;
+
+    ASSERT(lock->isHeldByCurrentThread());
+#ifdef USE_TLB
+    tlbManager->SyncAll();		// bring use/dirty bits up to date
+#endif
+    if (policy == ReplaceLRU) {		// age every resident page
+	for (int i = 0; i < NumPhysPages; i++) {
+	    if (frames[i].space == NULL)
+		continue;
+	    TranslationEntry *entry = EntryFor(i);
+	    frames[i].age = (frames[i].age >> 1) | (entry->use ? 0x80 : 0);
+	    entry->use = FALSE;
+	}
+    }
+
+    frame = freeMap->Find();
+    if (frame == -1) {
+	FrameInfo *victim;
+
+	frame = FindVictim();
+	victim = &frames[frame];
+	DEBUG('v', "Evicting page %d of space %d from frame %d\n",
+	      victim->virtualPage, victim->space->GetSpaceID(), frame);
+	stats->numPageOuts++;
+	victim->space->PageOut(victim->virtualPage);
+    }
+    frames[frame].space = space;
+    frames[frame].virtualPage = vpn;
+    frames[frame].loadedAt = loads++;
+    frames[frame].age = 0x80;		// it is about to be referenced
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Free
+// 	A frame is no longer in use (its address space is going away).
+//----------------------------------------------------------------------
+
+void
+CoreMap::Free(int frame)
+{
+    ASSERT(frames[frame].space != NULL);
+    frames[frame].space = NULL;
+    frames[frame].virtualPage = -1;
+    freeMap->Clear(frame);
+}
+
+//----------------------------------------------------------------------
+// CoreMap::FindVictim
+// 	Choose a frame to evict.  Only called when every frame is in use.
+//----------------------------------------------------------------------
+
+int
+CoreMap::FindVictim()
+{
+    TranslationEntry *entry;
+    int i, victim = 0;
+
+    switch (policy) {
+      case ReplaceFifo:
+	for (i = 1; i < NumPhysPages; i++)
+	    if (frames[i].loadedAt < frames[victim].loadedAt)
+		victim = i;
+	return victim;
+
+      case ReplaceClock:
+	for (;;) {
+	    entry = EntryFor(hand);
+	    victim = hand;
+	    hand = (hand + 1) % NumPhysPages;
+	    if (!entry->use)
+		return victim;
+	    entry->use = FALSE;		// second chance
+	}
+
+      case ReplaceEnhancedClock:
+	// Look for (unused, clean) without changing anything; failing
+	// that, for (unused, dirty), clearing use bits as we go.  At
+	// worst the second round finds one.
+	for (;;) {
+	    for (i = 0; i < NumPhysPages; i++) {
+		entry = EntryFor(hand);
+		victim = hand;
+		hand = (hand + 1) % NumPhysPages;
+		if (!entry->use && !entry->dirty)
+		    return victim;
+	    }
+	    for (i = 0; i < NumPhysPages; i++) {
+		entry = EntryFor(hand);
+		victim = hand;
+		hand = (hand + 1) % NumPhysPages;
+		if (!entry->use && entry->dirty)
+		    return victim;
+		entry->use = FALSE;
+	    }
+	}
+
+      case ReplaceLRU:
+	for (i = 1; i < NumPhysPages; i++)
+	    if (frames[i].age < frames[victim].age ||
+		(frames[i].age == frames[victim].age &&
+		 frames[i].loadedAt < frames[victim].loadedAt))
+		victim = i;
+	return victim;
+    }
+    ASSERT(FALSE);
+    return -1;
+}
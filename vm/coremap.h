@@ -0,0 +1,74 @@
+// coremap.h
+//	Data structures for demand paging: the core map.
+//
+//	The core map records, for every physical page frame, which
+//	address space and virtual page currently live there.  When a
+//	page fault needs a frame and none is free, it picks a victim
+//	frame with one of several replacement policies, and asks the
+//	owning address space to page the victim out (to its swap file,
+//	if it has been modified).
+//
+//	All of paging is serialized by one lock, since paging in or out
+//	may block on the disk.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef COREMAP_H
+#define COREMAP_H
+
+#include "copyright.h"
+#include "machine.h"
+#include "synch.h"
+
+class AddrSpace;
+
+// How to choose the page to evict when physical memory is full.
+enum ReplacePolicy {
+    ReplaceFifo,		// oldest page loaded
+    ReplaceClock,		// second chance, on the use bit
+    ReplaceEnhancedClock,	// second chance, on the (use, dirty) pair,
+				// preferring clean pages
+    ReplaceLRU			// least recently used, approximated by
+				// aging the use bit at each page fault
+};
+
+// What the core map knows about one physical page frame.
+class FrameInfo {
+  public:
+    AddrSpace *space;		// owner, or NULL if the frame is free
+    int virtualPage;		// which of the owner's pages is here
+    int loadedAt;		// when it was paged in (for FIFO)
+    unsigned char age;		// use bit history (for LRU), most
+				// recent reference in the high bit
+};
+
+class CoreMap {
+  public:
+    CoreMap(ReplacePolicy how);		// all frames start out free
+    ~CoreMap();
+
+    void Acquire();			// serialize paging
+    void Release();
+
+    int Allocate(AddrSpace *space, int vpn);
+					// Find a frame for page "vpn" of
+					// "space", evicting another page if
+					// memory is full.  Caller must hold
+					// the paging lock.
+    void Free(int frame);		// Frame is no longer in use
+
+  private:
+    int FindVictim();			// choose a frame to evict
+    TranslationEntry *EntryFor(int frame); // page table entry mapping
+					// "frame"
+
+    ReplacePolicy policy;
+    FrameInfo frames[NumPhysPages];
+    int hand;				// clock hand
+    int loads;				// number of pages paged in so far
+    Lock *lock;				// held while paging
+};
+
+#endif // COREMAP_H
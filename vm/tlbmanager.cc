@@ -0,0 +1,232 @@
+// tlbmanager.cc
+//	Routines to manage the software-loaded TLB: refilling it on a
+//	miss, choosing which entry to replace, and keeping the page
+//	table's use and dirty bits up to date.
+//
+//	Replacement policies:
+//	    TLBFifo   -- replace entries in the order they were loaded
+//	    TLBClock  -- second chance, using the use bit the hardware sets
+//			 in the TLB entry on every reference
+//	    TLBRandom -- any entry, chosen with Random()
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "system.h"
+#include "tlbmanager.h"
+#include "addrspace.h"
+
+//----------------------------------------------------------------------
+// TLBManager::TLBManager
+// 	Initialize TLB management.  The TLB is empty at startup (see
+//	Machine::Machine).
+//
+//	"how" is the replacement policy to use once the TLB is full
+//----------------------------------------------------------------------
+
+TLBManager::TLBManager(TLBPolicy how)
+{
+    policy = how;
+    hand = 0;
+    owner = NULL;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::HandleMiss
+// 	Called from the exception handler when a user reference misses
+//	in the TLB.  Find the translation in the current address space's
+//	page table -- paging the page in if it isn't resident -- and load
+//	it into the TLB.  On return, the faulting instruction is simply
+//	re-executed.
+//
+//	Returns FALSE if "badVAddr" isn't part of the address space at all.
+//
+//	"badVAddr" is the virtual address that missed
+//----------------------------------------------------------------------
+
+bool
+TLBManager::HandleMiss(int badVAddr)
+{
+    AddrSpace *space = currentThread->space;
+    unsigned int vpn = (unsigned) badVAddr / PageSize;
+    TranslationEntry *pte, *entry;
+    int slot;
+
+    ASSERT(space != NULL);
+    if (owner != space)
+	SwitchTo(space);
+    pte = space->PageTableEntry(vpn);
+    if (pte == NULL)
+	return FALSE;
+    // A real page fault.  Releasing the paging lock may let another
+    // thread run and evict the page again before we get here, so retry.
+    while (!pte->valid)
+	space->ReplacePage(badVAddr);
+
+    slot = FindVictim();
+    Evict(slot);
+    entry = &machine->tlb[slot];
+    entry->virtualPage = vpn;
+    entry->physicalPage = pte->physicalPage;
+    entry->readOnly = pte->readOnly;
+    entry->use = FALSE;			// gathered here, and folded into
+    entry->dirty = FALSE;		// the page table by SyncBits
+    entry->valid = TRUE;
+    DEBUG('a', "TLB miss on page %d, loaded into slot %d\n", vpn, slot);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::FindVictim
+// 	Pick the TLB slot to load a new translation into: an empty one if
+//	there is one, otherwise according to the replacement policy.
+//----------------------------------------------------------------------
+
+int
+TLBManager::FindVictim()
+{
+    TranslationEntry *tlb = machine->tlb;
+    int i;
+
+    for (i = 0; i < TLBSize; i++)
+	if (!tlb[i].valid)
+	    return i;
+
+    switch (policy) {
+      case TLBFifo:
+	i = hand;
+	hand = (hand + 1) % TLBSize;
+	return i;
+
+      case TLBClock:
+	// give each recently used entry a second chance; SyncBits
+	// folds the use bit into the page table and clears it
+	while (tlb[hand].use) {
+	    SyncBits(hand);
+	    hand = (hand + 1) % TLBSize;
+	}
+	i = hand;
+	hand = (hand + 1) % TLBSize;
+	return i;
+
+      case TLBRandom:
+	return Random() % TLBSize;
+    }
+    ASSERT(FALSE);
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::SyncBits
+// 	Fold the use and dirty bits that the hardware set in a TLB entry
+//	into the owner's page table entry.  The entry's bits are then
+//	cleared, so that they only record references made since, and
+//	the kernel is free to clear the page table's use bit.
+//----------------------------------------------------------------------
+
+void
+TLBManager::SyncBits(int slot)
+{
+    TranslationEntry *entry = &machine->tlb[slot];
+    TranslationEntry *pte;
+
+    if (!entry->valid || owner == NULL)
+	return;
+    pte = owner->PageTableEntry(entry->virtualPage);
+    ASSERT(pte != NULL);
+    pte->use = pte->use || entry->use;
+    pte->dirty = pte->dirty || entry->dirty;
+    entry->use = FALSE;
+    entry->dirty = FALSE;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::SyncAll
+// 	Bring the current address space's use and dirty bits up to date,
+//	before the page replacement code looks at them.
+//----------------------------------------------------------------------
+
+void
+TLBManager::SyncAll()
+{
+    for (int i = 0; i < TLBSize; i++)
+	SyncBits(i);
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Evict
+// 	Write back and invalidate one TLB entry.
+//----------------------------------------------------------------------
+
+void
+TLBManager::Evict(int slot)
+{
+    SyncBits(slot);
+    machine->tlb[slot].valid = FALSE;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Flush
+// 	Empty the TLB, writing back every entry.
+//----------------------------------------------------------------------
+
+void
+TLBManager::Flush()
+{
+    for (int i = 0; i < TLBSize; i++)
+	Evict(i);
+    hand = 0;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::SwitchTo
+// 	Called on a context switch into a thread running in "space".
+//	Switching between threads of the same address space (or back to
+//	the space that last used the TLB, with only kernel threads in
+//	between) keeps the TLB contents.
+//----------------------------------------------------------------------
+
+void
+TLBManager::SwitchTo(AddrSpace *space)
+{
+    if (space == owner)
+	return;
+    Flush();
+    owner = space;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::InvalidatePage
+// 	Page "vpn" of "space" is being paged out: if the TLB holds its
+//	translation, fold its dirty bit into the page table (so it gets
+//	written back) and drop it.
+//----------------------------------------------------------------------
+
+void
+TLBManager::InvalidatePage(AddrSpace *space, int vpn)
+{
+    if (space != owner)
+	return;
+    for (int i = 0; i < TLBSize; i++)
+	if (machine->tlb[i].valid && machine->tlb[i].virtualPage == vpn)
+	    Evict(i);
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Forget
+// 	"space" is being deallocated; if the TLB holds its translations,
+//	drop them without writing anything back.
+//----------------------------------------------------------------------
+
+void
+TLBManager::Forget(AddrSpace *space)
+{
+    if (space != owner)
+	return;
+    for (int i = 0; i < TLBSize; i++)
+	machine->tlb[i].valid = FALSE;
+    owner = NULL;
+    hand = 0;
+}
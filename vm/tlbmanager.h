@@ -0,0 +1,61 @@
+// tlbmanager.h
+//	Data structures for managing the software-loaded TLB.
+//
+//	When USE_TLB is defined the simulated MIPS has no page table
+//	register; a reference to a page that isn't in the TLB raises
+//	PageFaultException, and it is up to the kernel to find the
+//	translation in the current address space's page table and load
+//	it into one of the TLBSize slots, evicting another translation
+//	if need be.
+//
+//	The TLB holds translations for one address space at a time; on a
+//	context switch to a different address space it is flushed, with
+//	the use and dirty bits of each entry copied back to the page table
+//	(the hardware only sets them in the TLB).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TLBMANAGER_H
+#define TLBMANAGER_H
+
+#include "copyright.h"
+#include "translate.h"
+
+class AddrSpace;
+
+// How to choose which TLB entry to replace on a miss, once all
+// the entries are in use.
+enum TLBPolicy { TLBFifo, TLBClock, TLBRandom };
+
+class TLBManager {
+  public:
+    TLBManager(TLBPolicy how);		// TLB starts out empty
+
+    bool HandleMiss(int badVAddr);	// Load the translation for "badVAddr"
+					// into the TLB, paging it in first if
+					// need be.  FALSE if the address is
+					// outside the address space.
+
+    void SwitchTo(AddrSpace *space);	// Context switch to "space": flush
+					// the TLB unless it is already ours
+    void Flush();			// Write back and empty every entry
+    void SyncAll();			// Fold every entry's use/dirty bits
+					// into the page table
+    void InvalidatePage(AddrSpace *space, int vpn);
+					// Page "vpn" of "space" is being
+					// paged out
+    void Forget(AddrSpace *space);	// "space" is being deallocated
+
+  private:
+    int FindVictim();			// pick a slot to (re)load
+    void Evict(int slot);		// write back and invalidate a slot
+    void SyncBits(int slot);		// copy use/dirty bits to page table
+
+    TLBPolicy policy;
+    int hand;				// next FIFO victim, or clock hand
+    AddrSpace *owner;			// whose translations are in the TLB
+};
+
+#endif // TLBMANAGER_H